@@ -97,7 +97,7 @@ MEMORY
 PAGE 0 :   /* Program Memory */
            /* Memory (RAM/FLASH/OTP) blocks can be moved to PAGE1 for data allocation */
    RAML0       : origin = 0x008000, length = 0x000800     /* on-chip RAM block L0 */
-   RAML1       : origin = 0x008800, length = 0x000400     /* on-chip RAM block L1 */
+   RAML4       : origin = 0x00A000, length = 0x002000     /* on-chip RAM block L4, code run from RAM */
    OTP         : origin = 0x3D7800, length = 0x000400     /* on-chip OTP */
 
    FLASHH      : origin = 0x3D8000, length = 0x004000     /* on-chip FLASH */
@@ -127,8 +127,8 @@ PAGE 1 :   /* Data Memory */
    BOOT_RSVD   : origin = 0x000000, length = 0x000050     /* Part of M0, BOOT rom will use this for stack */
    RAMM0       : origin = 0x000050, length = 0x0003B0     /* on-chip RAM block M0 */
    RAMM1       : origin = 0x000400, length = 0x000400     /* on-chip RAM block M1 */
+   RAML1       : origin = 0x008800, length = 0x000400     /* on-chip RAM block L1, warm start */
    RAML2_3     : origin = 0x008C00, length = 0x001400     /* on-chip RAM block L2 */
-   RAML4       : origin = 0x00A000, length = 0x002000     /* on-chip RAM block L4 */
    RAML5       : origin = 0x00C000, length = 0x002000     /* on-chip RAM block L5 */
    RAML6       : origin = 0x00E000, length = 0x002000     /* on-chip RAM block L6 */
    RAML7       : origin = 0x010000, length = 0x002000     /* on-chip RAM block L7 */
@@ -152,12 +152,55 @@ SECTIONS
    .pinit              : > FLASHA_B,   PAGE = 0
    .text               : > FLASHA_B,   PAGE = 0
    codestart           : > BEGIN,      PAGE = 0
+#if defined(HOT_PATH_IN_RAM)
+   /* Hot path: functions run often per second, chosen by reading the
+      code (refresh loop, packet builders, parser), run from zero wait
+      state RAM too. Not measured yet: check the list with the task
+      profile (Lenz 0x02 0xFA) on the target before relying on it.
+      Needs compiler option --gen_func_subsections=on and
+      linker option --define=HOT_PATH_IN_RAM; main copies the section. */
+   ramfuncs            : {
+                           *(ramfuncs)                                    /* dcc and millis isr, delay */
+                           rs232_tms320.obj(.text:retain)                 /* uart rx and tx isr */
+                           organizer.obj(.text:_run_organizer)
+                           organizer.obj(.text:_search_locobuffer)
+                           organizer.obj(.text:_set_next_message)
+                           organizer.obj(.text:_build_speed_message_from_locobuffer)
+                           organizer.obj(.text:_build_f1_message_from_locobuffer)
+                           organizer.obj(.text:_build_f2_message_from_locobuffer)
+                           organizer.obj(.text:_build_loko_7a28s)
+                           organizer.obj(.text:_build_loko_7a128s)
+                           organizer.obj(.text:_build_loko_14a28s)
+                           organizer.obj(.text:_build_loko_14a128s)
+                           organizer.obj(.text:_build_function_7a_grp1)
+                           organizer.obj(.text:_build_function_14a_grp1)
+                           lenz_parser.obj(.text:_run_parser)
+                           status.obj(.text:_run_state)
+                           scheduler.obj(.text:_run_scheduler)            /* every pass of the main loop */
+                         }
+                         LOAD = FLASHD,
+                         RUN = RAML4,
+                         LOAD_START(_RamfuncsLoadStart),
+                         LOAD_END(_RamfuncsLoadEnd),
+                         RUN_START(_RamfuncsRunStart),
+                         PAGE = 0
+#else
    ramfuncs            : LOAD = FLASHD,
                          RUN = RAML0,
                          LOAD_START(_RamfuncsLoadStart),
                          LOAD_END(_RamfuncsLoadEnd),
                          RUN_START(_RamfuncsRunStart),
                          PAGE = 0
+#endif
+
+   Flash28_API         : LOAD = FLASHD,                   /* TI flash API for store.c, copied by init_store() */
+                         RUN = RAML4,
+                         LOAD_START(_Flash28_API_LoadStart),
+                         LOAD_END(_Flash28_API_LoadEnd),
+                         RUN_START(_Flash28_API_RunStart),
+                         PAGE = 0
+
+   /* FLASHH and FLASHG are not allocated: they hold the CV store of store.c */
 
    csmpasswds          : > CSM_PWL_P0, PAGE = 0
    csm_rsvd            : > CSM_RSVD,   PAGE = 0
@@ -179,7 +222,12 @@ SECTIONS
    /* Allocate FPU math areas: */
    FPUmathTables       : > FPUTABLES,  PAGE = 0, TYPE = NOLOAD
    
+   locoformat          : > RAML5,      PAGE = 1            /* loco_format[] of database.c */
+   turnoutstate        : > RAML5,      PAGE = 1            /* turnout_state[] of organizer.c */
+   warmstart           : > RAML1,      PAGE = 1,           /* snapshot.c, watchdog.c: kept over a reset */
+                         TYPE = NOINIT
    DMARAML5	           : > RAML5,      PAGE = 1
+   loconames           : > RAML6,      PAGE = 1            /* named loco database of database.c */
    DMARAML6	           : > RAML6,      PAGE = 1
    DMARAML7	           : > RAML7,      PAGE = 1
    DMARAML8	           : > RAML8,      PAGE = 1   
@@ -0,0 +1,411 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      accessory.c
+// history:   timed accessory pulses started
+//            routes (Fahrstrassen) added
+//            routes are kept in the flash store
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   accessory pulses with automatic deactivate
+//
+// The host used to send activate and deactivate for every coil.
+// Here the host sends only the activate, the station sends the
+// deactivate after dcc_acc_time (CV14).
+//
+// how:       every pulse gets an entry in acc_pulse[]:
+//            ACC_WAITING: accepted, but ACC_MAX_ACTIVE coils are already on;
+//                         started in order of arrival when a coil goes off.
+//            ACC_ON:      activate is sent, a timer of the timerwheel
+//                         sends the deactivate.
+//            A new activate for a turnout with a running pulse cancels the
+//            pending off and restarts the pulse; if the other coil was on,
+//            it is switched off first.
+//            A deactivate from the host ends the pulse early.
+//            If the organizer is full, start and off are retried on the
+//            next tick.
+//
+//            ACC_MAX_ACTIVE limits the coils which are on at the same
+//            time -> bounded inrush current on the booster, even if
+//            a route throws many turnouts at once.
+//
+//-----------------------------------------------------------------
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "config.h"                // general structures and definitions
+#include "events.h"                // route done
+#include "organizer.h"
+#include "timerwheel.h"
+#include "accessory.h"
+#include "store.h"
+
+unsigned char dcc_acc_time;             // this value is read from eemem (CV14)
+
+#if (DCC_ACC_PULSE == 1)
+
+#define ACC_FREE        0
+#define ACC_WAITING     1               // waiting for a free coil slot
+#define ACC_ON          2               // coil is on, timer runs
+
+typedef struct
+  {
+    unsigned int  addr;                 // turnout address
+    unsigned char output;               // coil
+    unsigned char state;                // ACC_FREE, ACC_WAITING, ACC_ON
+    unsigned char order;                // order of arrival (for ACC_WAITING)
+    t_tw_handle   timer;                // off timer (for ACC_ON)
+  } t_acc_pulse;
+
+t_acc_pulse acc_pulse[SIZE_ACC_PULSE];
+
+unsigned char acc_active;               // no of coils on
+unsigned char acc_order;                // running number of arrival
+t_tw_handle   acc_retry;                // retry timer for waiting entries
+
+static void acc_service(void);
+
+static void acc_retry_cb(unsigned int arg)
+  {
+    acc_retry = TW_NONE;
+    acc_service();
+  }
+
+static unsigned int acc_ticks(void)
+  {
+    return((dcc_acc_time + TW_TICK_MS - 1) / TW_TICK_MS);
+  }
+
+static unsigned char acc_find(unsigned int addr)
+  {
+    unsigned char i;
+    for (i=0; i<SIZE_ACC_PULSE; i++)
+      {
+        if ((acc_pulse[i].state != ACC_FREE) && (acc_pulse[i].addr == addr)) return(i);
+      }
+    return(SIZE_ACC_PULSE);
+  }
+
+static void acc_off_cb(unsigned int i)
+  {
+    if (!organizer_ready())
+      {
+        acc_pulse[i].timer = tw_start(1, acc_off_cb, i);
+        if (acc_pulse[i].timer != TW_NONE) return;
+      }                                       // no timer left: put it in anyway
+    do_accessory(0, acc_pulse[i].addr, acc_pulse[i].output, 0);
+    acc_pulse[i].state = ACC_FREE;
+    acc_active--;
+    acc_service();
+  }
+
+// switch the coil on and start its off timer
+static void acc_on(unsigned char i)
+  {
+    do_accessory(0, acc_pulse[i].addr, acc_pulse[i].output, 1);
+    acc_pulse[i].timer = tw_start(acc_ticks(), acc_off_cb, i);
+    if (acc_pulse[i].timer == TW_NONE)
+      {                                       // no timer left: off follows immediately
+        do_accessory(0, acc_pulse[i].addr, acc_pulse[i].output, 0);
+        acc_pulse[i].state = ACC_FREE;
+        acc_active--;
+      }
+  }
+
+// start waiting pulses, oldest first, as long as coil slots are free
+static void acc_service(void)
+  {
+    unsigned char i, oldest;
+
+    while (acc_active < ACC_MAX_ACTIVE)
+      {
+        oldest = SIZE_ACC_PULSE;
+        for (i=0; i<SIZE_ACC_PULSE; i++)
+          {
+            if (acc_pulse[i].state != ACC_WAITING) continue;
+            if ((oldest == SIZE_ACC_PULSE) ||
+                ((unsigned char)(acc_order - acc_pulse[i].order) >
+                 (unsigned char)(acc_order - acc_pulse[oldest].order))) oldest = i;
+          }
+        if (oldest == SIZE_ACC_PULSE) return;          // nothing waiting
+
+        if (!organizer_ready())
+          {
+            if (acc_retry == TW_NONE) acc_retry = tw_start(1, acc_retry_cb, 0);
+            return;
+          }
+        acc_pulse[oldest].state = ACC_ON;
+        acc_active++;
+        acc_on(oldest);
+      }
+  }
+
+unsigned char acc_pulse_on(unsigned int addr, unsigned char output)
+  {
+    unsigned char i;
+
+    if (dcc_acc_time == 0)
+      {                                       // host does the off
+        do_accessory(0, addr, output, 1);
+        return(1);
+      }
+
+    i = acc_find(addr);
+    if (i < SIZE_ACC_PULSE)
+      {
+        if (acc_pulse[i].state == ACC_WAITING)
+          {
+            acc_pulse[i].output = output;     // not yet on: just take the new coil
+            return(1);
+          }
+        // ACC_ON: cancel the pending off and restart the pulse
+        tw_cancel(acc_pulse[i].timer);
+        if (acc_pulse[i].output != output)
+          {
+            do_accessory(0, addr, acc_pulse[i].output, 0);
+            acc_pulse[i].output = output;
+          }
+        acc_on(i);
+        return(1);
+      }
+
+    for (i=0; i<SIZE_ACC_PULSE; i++)
+      {
+        if (acc_pulse[i].state == ACC_FREE) break;
+      }
+    if (i == SIZE_ACC_PULSE) return(0);
+
+    acc_pulse[i].addr = addr;
+    acc_pulse[i].output = output;
+    acc_pulse[i].order = acc_order++;
+    acc_pulse[i].state = ACC_WAITING;
+    acc_service();
+    return(1);
+  }
+
+void acc_pulse_off(unsigned int addr, unsigned char output)
+  {
+    unsigned char i;
+
+    i = acc_find(addr);
+    if (i == SIZE_ACC_PULSE)
+      {
+        do_accessory(0, addr, output, 0);
+        return;
+      }
+    if (acc_pulse[i].state == ACC_WAITING)
+      {
+        acc_pulse[i].state = ACC_FREE;        // was never on
+        return;
+      }
+    tw_cancel(acc_pulse[i].timer);
+    acc_off_cb(i);
+  }
+
+#endif // DCC_ACC_PULSE
+
+#if (DCC_ROUTES == 1)
+//---------------------------------------------------------------------------------
+// routes
+//
+// A route is a list of (turnout, output) and (extended accessory, aspect)
+// entries, set by one host command. The entries are handed over one per
+// tick: turnouts via acc_pulse_on (so ACC_MAX_ACTIVE paces the coils),
+// signals via do_extended_accessory. If the organizer or the pulse table
+// is full, the same entry is tried again on the next tick.
+// When the last entry is handed over, EV_ROUTE is posted and the
+// host parser reports route number and setting time. If no timer is left
+// for the next tick, the rest is given up and EV_ROUTE carries ROUTE_FAILED.
+// Only one route runs at a time.
+//
+// Routes are kept in the flash store (store.c), every value is one record:
+// key = STORE_KEY_ROUTE + nr * 64 + index
+//       index 0: count, 1 + 2*i: addr of entry i, 2 + 2*i: value of entry i
+
+#define ROUTE_KEY(nr, index)    (STORE_KEY_ROUTE + (nr) * 64 + (index))
+
+t_route route[SIZE_ROUTE];
+unsigned int  route_dirty;              // bit n: route n changed, not yet in store
+
+unsigned char route_running;            // SIZE_ROUTE = none
+unsigned char route_index;              // next entry of running route
+uint32_t      route_start;              // millis() at route_set
+
+static void route_step_cb(unsigned int arg)
+  {
+    t_route_entry *entry;
+    unsigned char sent;
+    uint32_t time;
+
+    entry = &route[route_running].entry[route_index];
+    sent = 0;
+    if (organizer_ready())
+      {
+        if (entry->addr & ROUTE_EXTENDED)
+          {
+            do_extended_accessory(entry->addr & ~ROUTE_EXTENDED, entry->value);
+            sent = 1;
+          }
+        else
+          {
+            sent = acc_pulse_on(entry->addr, entry->value);
+          }
+      }
+    if (sent) route_index++;
+
+    if (route_index < route[route_running].count)
+      {
+        if (tw_start(1, route_step_cb, 0) != TW_NONE) return;
+        time = ROUTE_FAILED;                  // no timer left: give up the rest
+      }
+    else
+      {
+        time = millis() - route_start;
+        if (time >= ROUTE_FAILED) time = ROUTE_FAILED - 1;
+      }
+
+    event_post(EV_ROUTE, route_running, (unsigned int)time);
+    route_running = SIZE_ROUTE;
+  }
+
+unsigned char route_set(unsigned char nr)
+  {
+    if (nr >= SIZE_ROUTE) return(ROUTE_ERR_NR);
+    if (route[nr].count == 0) return(ROUTE_ERR_EMPTY);
+    if (route_running != SIZE_ROUTE) return(ROUTE_ERR_BUSY);
+
+    route_running = nr;
+    route_index = 0;
+    route_start = millis();
+    route_step_cb(0);                         // first entry right now
+    return(ROUTE_OKAY);
+  }
+
+unsigned char route_store(unsigned char nr, unsigned char i, unsigned int addr, unsigned char value)
+  {
+    if ((nr >= SIZE_ROUTE) || (i >= SIZE_ROUTE_ENTRY)) return(ROUTE_ERR_NR);
+    if (nr == route_running) return(ROUTE_ERR_BUSY);
+
+    route[nr].entry[i].addr = addr;
+    route[nr].entry[i].value = value;
+    if (route[nr].count <= i) route[nr].count = i + 1;
+    route_dirty |= (1 << nr);
+    store_changed();
+    return(ROUTE_OKAY);
+  }
+
+unsigned char route_length(unsigned char nr, unsigned char count)
+  {
+    if ((nr >= SIZE_ROUTE) || (count > SIZE_ROUTE_ENTRY)) return(ROUTE_ERR_NR);
+    if (nr == route_running) return(ROUTE_ERR_BUSY);
+
+    route[nr].count = count;
+    route_dirty |= (1 << nr);
+    store_changed();
+    return(ROUTE_OKAY);
+  }
+
+// called by the store: pos == NULL -> changed routes, else compaction from route *pos on
+// entries first, count last: an interrupted save leaves the old count
+unsigned char route_save(unsigned int *pos)
+  {
+    unsigned char nr, i;
+
+    nr = 0;
+    if (pos)
+      {
+        if (*pos == 0) route_dirty = 0;
+        nr = *pos;
+      }
+    for (; nr<SIZE_ROUTE; nr++)
+      {
+        if (pos)
+          {
+            if (route[nr].count == 0) continue;
+            if (!store_step())
+              {
+                *pos = nr;
+                return(STORE_MORE);
+              }
+          }
+        else
+          {
+            if (!(route_dirty & (1 << nr))) continue;
+          }
+        for (i=0; i<route[nr].count; i++)
+          {
+            if (!store_put(ROUTE_KEY(nr, 1 + 2*i), route[nr].entry[i].addr)) return(STORE_FAIL);
+            if (!store_put(ROUTE_KEY(nr, 2 + 2*i), route[nr].entry[i].value)) return(STORE_FAIL);
+          }
+        if (!store_put(ROUTE_KEY(nr, 0), route[nr].count)) return(STORE_FAIL);
+        route_dirty &= ~(1 << nr);
+      }
+    return(STORE_DONE);
+  }
+
+static void route_apply(unsigned int key, unsigned int value)
+  {
+    unsigned char nr, index;
+
+    nr = (key - STORE_KEY_ROUTE) / 64;
+    index = (key - STORE_KEY_ROUTE) % 64;
+    if (nr >= SIZE_ROUTE) return;
+    if (index == 0)
+      {
+        if (value <= SIZE_ROUTE_ENTRY) route[nr].count = value;
+      }
+    else if (((index - 1) / 2) < SIZE_ROUTE_ENTRY)
+      {
+        if (index & 1) route[nr].entry[(index - 1) / 2].addr = value;
+        else route[nr].entry[(index - 1) / 2].value = value;
+      }
+  }
+#endif // DCC_ROUTES
+
+#if (DCC_ACC_PULSE == 0)
+
+unsigned char acc_pulse_on(unsigned int addr, unsigned char output)
+  {
+    do_accessory(0, addr, output, 1);
+    return(1);
+  }
+
+void acc_pulse_off(unsigned int addr, unsigned char output)
+  {
+    do_accessory(0, addr, output, 0);
+  }
+
+#endif // DCC_ACC_PULSE
+
+void init_accessory(void)
+  {
+    unsigned char i;
+
+    dcc_acc_time = eemem[eadr_dcc_acc_time];
+    #if (DCC_ACC_PULSE == 1)
+    for (i=0; i<SIZE_ACC_PULSE; i++) acc_pulse[i].state = ACC_FREE;
+    acc_active = 0;
+    acc_order = 0;
+    acc_retry = TW_NONE;
+    #endif
+    #if (DCC_ROUTES == 1)
+    for (i=0; i<SIZE_ROUTE; i++) route[i].count = 0;
+    route_running = SIZE_ROUTE;
+    route_dirty = 0;
+    store_replay(ROUTE_KEY(0, 0), ROUTE_KEY(SIZE_ROUTE, 0), route_apply);
+    #endif
+  }
@@ -0,0 +1,82 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      accessory.h
+// history:   timed accessory pulses started
+//            routes (Fahrstrassen) added
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   accessory pulses with automatic deactivate
+//            routes: lists of turnouts and signal aspects set by one command
+//
+// interface upstream:
+//            init_accessory(void)          // call once at program start
+//            acc_pulse_on(addr, output)    // activate, station sends the off
+//            acc_pulse_off(addr, output)   // deactivate from host
+//            route_set(nr)                 // execute a route
+//            route_store(nr, i, addr, value), route_length(nr, count)
+//            route_save(pos)               // write routes to the flash store
+//
+// interface downstream:
+//            do_accessory()                // organizer
+//            do_extended_accessory()       // organizer
+//            tw_start(), tw_cancel()       // timerwheel
+//            store_put(), store_replay()   // flash store
+//
+//-----------------------------------------------------------------
+#ifndef __ACCESSORY_H__
+#define __ACCESSORY_H__
+
+extern unsigned char dcc_acc_time;      // turn on time of acc in ms (CV14), 0 = host sends the off
+
+void init_accessory(void);
+
+// addr:   turnout address [0000-4095]
+// output: coil [0,1]
+// return: 0 if all pulse entries are in use
+unsigned char acc_pulse_on(unsigned int addr, unsigned char output);
+
+void acc_pulse_off(unsigned int addr, unsigned char output);
+
+#if (DCC_ROUTES == 1)
+#define ROUTE_EXTENDED      0x8000      // addr flag: extended accessory, value = aspect
+
+#define ROUTE_OKAY          0
+#define ROUTE_ERR_NR        1           // no such route / entry
+#define ROUTE_ERR_EMPTY     2           // route has no entries
+#define ROUTE_ERR_BUSY      3           // a route is running
+
+#define ROUTE_FAILED        0xFFFF      // EV_ROUTE b: entries left, no timer
+
+typedef struct
+  {
+    unsigned int  addr;                 // turnout [0000-4095] or ROUTE_EXTENDED | decoder [0000-2047]
+    unsigned char value;                // output [0,1] or aspect [0-31]
+  } t_route_entry;
+
+typedef struct
+  {
+    unsigned char count;                // no of used entries
+    t_route_entry entry[SIZE_ROUTE_ENTRY];
+  } t_route;
+
+extern t_route route[SIZE_ROUTE];
+
+unsigned char route_set(unsigned char nr);
+unsigned char route_store(unsigned char nr, unsigned char i, unsigned int addr, unsigned char value);
+unsigned char route_length(unsigned char nr, unsigned char count);
+unsigned char route_save(unsigned int *pos);           // called by store.c
+#endif
+
+#endif // __ACCESSORY_H__
@@ -0,0 +1,55 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      boot.c
+// history:   boot phase timestamps started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   time stamps of the init steps in main
+//
+// how:       The timebase (CpuTimer1) is started right after InitSysCtrl
+//            (PLL is set), so all times are from there; the boot rom and
+//            the c startup before main are not included.
+//            The dcc generator is started before the slow init steps, it
+//            sends the power up resets and idles while they run.
+//            dccout marks BOOT_FIRST_PACKET itself.
+//            The table is read by the Lenz extension 0xFB.
+//
+//-----------------------------------------------------------------
+
+#include "DSP28x_Project.h"     // Device Headerfile and Examples Include File
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "config.h"                // general structures and definitions
+#include "boot.h"
+
+uint32_t boot_time[NUM_BOOT_PHASE];
+
+void init_boot(void)
+  {
+    memset(boot_time, 0, sizeof(boot_time));
+  }
+
+void boot_mark(t_boot_phase phase)
+  {
+    boot_time[phase] = BOOT_CLOCK();
+  }
+
+uint32_t boot_us(t_boot_phase phase)
+  {
+    return(boot_time[phase] / BOOT_CLOCK_MHZ);
+  }
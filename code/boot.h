@@ -0,0 +1,58 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      boot.h
+// history:   boot phase timestamps started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   time stamps of the init steps in main
+//
+// interface upstream:
+//            init_boot(void)           // call after init_timebase
+//            boot_mark(phase)          // end of an init step
+//            boot_us(phase)            // time of a step in us since start of main
+//
+//-----------------------------------------------------------------
+#ifndef __BOOT_H__
+#define __BOOT_H__
+
+#include "timebase.h"
+
+// lower 32 bit of the timebase, wraps after 47s - long enough for the boot
+#define BOOT_CLOCK()        TB_CLOCK32()
+#define BOOT_CLOCK_MHZ      TB_MHZ
+
+// init steps in the order of main; each mark is the end of the step
+typedef enum {BOOT_PIE,             // pie, vector table, leds
+              BOOT_RAMFUNCS,        // copy of ramfuncs
+              BOOT_STORE,           // CVs from flash
+              BOOT_DCC,             // dcc generator and track power on
+              BOOT_DATABASE,        // loco format and names
+              BOOT_RS232,
+              BOOT_PARSER,
+              BOOT_ORGANIZER,
+              BOOT_PROGRAMMER,
+              BOOT_ACCESSORY,       // ramp, timerwheel, accessory
+              BOOT_KEYS,
+              BOOT_DONE,            // main loop starts
+              BOOT_FIRST_PACKET,    // end bit of first packet, set by dccout
+              NUM_BOOT_PHASE} t_boot_phase;
+
+extern uint32_t boot_time[NUM_BOOT_PHASE];  // SYSCLK cycles since init_timebase, 0: not yet
+
+void init_boot(void);
+void boot_mark(t_boot_phase phase);
+uint32_t boot_us(t_boot_phase phase);
+
+#endif // __BOOT_H__
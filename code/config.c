@@ -43,6 +43,7 @@
 
 #include "config.h"                // general structures and definitions
 #include "rs232.h"                 // tx ready
+#include "watchdog.h"              // last isr
 
 
 //======================================================================
@@ -86,21 +87,11 @@ const unsigned char opendcc_version PROGMEM = OPENDCC_VERSION;
 //       for siumlation: normal eeprom
 // Offsets are defined in config.h
 
-#if 0 // SDS TAPAS
-
-#if (DEBUG==3)
-uint8_t ee_mem[] EEMEM =
-#else
-   #if (__AVR_ATmega32__)
-        uint8_t ee_mem[] EEMEM =
-   #elif (__AVR_ATmega644P__)
-        uint8_t ee_mem[]  __attribute__((section(".EECV")))=
-   #elif (__AVR_ATmega328P__)//SDS : atmega328
-        uint8_t ee_mem[] EEMEM =
-   #else 
-        #warning EEPROM Definition for this AVR missing
-   #endif
-#endif
+// TAPAS: there is no eeprom. eemem_default holds the defaults (in flash),
+// eemem is the RAM mirror used at runtime: init_store() loads the defaults
+// and replays the changed values from the flash store (store.c).
+
+const unsigned char eemem_default[SIZE_EEMEM] =
 {
     [eadr_OpenDCC_Version]          = OPENDCC_VERSION,
     [eadr_baudrate]                 = 0, //sds quick & dirty DEFAULT_BAUD,
@@ -144,9 +135,9 @@ uint8_t ee_mem[] EEMEM =
     [eadr_s88_size1]                = 0x02,
     [eadr_s88_size2]                = 0x02,
     [eadr_s88_size3]                = 0x02,
-    [eadr_invert_accessory]         = 0x01,                 // bit 0: invert Lenz, bit 1: invert IB
+    [eadr_invert_accessory]         = 0x00,                 // bit 0: invert Lenz, bit 1: invert IB (TAPAS: not inverted)
     [eadr_dcc_acc_repeat]           = NUM_DCC_ACC_REPEAT,   // Accessory Command repeat counter
-    [eadr_dcc_acc_time]             = 100,                  // turn on time of acc (used by IB, default 100)
+    [eadr_dcc_acc_time]             = NUM_DCC_ACC_TIME,     // turn on time of acc (used by IB, default 100)
     [eadr_startmode_ibox]           = 0x00,                 // 0=Normal Mode,
                                                             // 1=fixed to P50X
     [eadr_feedback_s88_offset]      = 0,                    // offset for feedback numbers in s88 array, given in bytes
@@ -179,16 +170,13 @@ uint8_t ee_mem[] EEMEM =
     [eadr_I2C_present]              = 0,                    //  I2C present - return 0  
     [eadr_short_turnoff_time]       = MAIN_SHORT_DEAD_TIME,   // 34: Time until shutdown[eadr_reserved034]              = 0,          
     [eadr_prog_short_toff_time]     = PROG_SHORT_DEAD_TIME,          
-    #if (TURNOUT_FEEDBACK_ACTIVATED == 1)
-    [eadr_ext_stop_enabled]         = 0,                    // 36: 0=default, 1=enable external Stop Input
-    #else
-    [eadr_ext_stop_enabled]         = 1,                    // 36: 0=default, 1=enable external Stop Input
-    #endif
+    [eadr_ext_stop_enabled]         = 0,                    // 36: 0=default, 1=enable external Stop Input (TAPAS: no input)
     [eadr_ext_stop_deadtime]        = EXT_STOP_DEAD_TIME,        // 37: dead time after RUN, in millis(), SDS        
     [eadr_reserved038]              = 0,          
     [eadr_serial_id]                = 1,                    // 39: serial id, must be > 0         
 };
-#endif // SDS-TAPAS
+
+unsigned char eemem[SIZE_EEMEM];
 
 
 // SDS-TAPAS
@@ -230,8 +218,10 @@ void millis_init()
     CpuTimer0Regs.TCR.all = 0x4000; // start the timer0 ! (TIE=1,TSS=0, waarom was dit 0x4001, bits0..3 moeten altijd 0 zijn??)
 } // time_init
 
+#pragma CODE_SECTION(cpu_timer0_isr, "ramfuncs");   // runs while store.c writes the flash
 __interrupt void cpu_timer0_isr(void)
 {
+    WATCHDOG_ISR(PM_ISR_MILLIS);
     millisCounter++;
     // Acknowledge this interrupt to receive more interrupts from group 1
     PieCtrlRegs.PIEACK.all = PIEACK_GROUP1;
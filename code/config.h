@@ -117,6 +117,32 @@ _mydelay_us(double __us)
                                             // a short is detected on outputs
                                             // this is the default - it goes to CV34.
 
+#define MAIN_SHORT_TRIP             1       // 0: main short only polled by run_state
+                                            // 1: dcc isr cuts the main track within one
+                                            //    bit (<= 232us); CV34 and fast recovery
+                                            //    decide later whether it was a short (status.c)
+
+#define CURRENT_SENSE               0       // 0: no current measurement
+                                            // 1: adc samples main and prog current twice per
+                                            //    dcc bit (current.c): rms/peak for the host
+                                            //    (Lenz extension 0xFE), overload prediction, ack
+                                            // off until the sense circuit is built: an open adc
+                                            // input would give the programmer false acks
+
+#define CURRENT_OVERLOAD_MA      3000L      // level of overload (inputs see hardware.h)
+#define CURRENT_PREDICT_AHEAD       4       // look ahead for overload, in 8 samples (2..4ms)
+#define CURRENT_ACK_MA             60L      // ack: rise of prog current ...
+#define CURRENT_ACK_SAMPLES        10       // ... for at least 10 samples (1..2ms)
+#define CURRENT_ACK_HOLD          160       // a longer rise is a new load (> 10ms)
+
+#define DCC_PROG_TRACK              1       // 0: service mode on the main output, main track is off
+                                            // 1: prog track has its own generator (ePWM4,
+                                            //    dccout.c), main track keeps running
+
+#define DCC_DISTRICTS               4       // power districts incl. main, 1..4: 1 = main only
+                                            // districts 1..3: own generator on ePWM5, 6, 8,
+                                            // cut by TZ1..3 (GPIO12..14), see district.c
+
 #define PROG_SHORT_DEAD_TIME        40L     // wait 40ms before turning off power after
                                             // a short is detected on outputs
                                             // this is the default - it goes to CV35.
@@ -156,7 +182,7 @@ _mydelay_us(double __us)
 #define RAILCOMPLUS_SUPPORT     0           // 0: no special code
                                             // 1: add test code
 
-#define LOCO_DATABASE           UNNAMED       // NAMED    containing Addr, Format, Names, PictureID
+#define LOCO_DATABASE           NAMED       // NAMED    containing Addr, Format, Names, PictureID
                                             // UNNAMED  containing Addr, Format, (no Names)
 
 #define LOCO_DATABASE_MSG       TRAINCTRLR  // set p50xb answers according to traincontroller
@@ -182,6 +208,47 @@ _mydelay_us(double __us)
 #define DCC_FAST_CLOCK              1       // 0: standard DCC
                                             // 1: add commands for DCC fast clock
 
+#define DCC_RAMP                    1       // 0: no station side momentum
+                                            // 1: speed ramps are executed by the command station
+                                            //    (see ramp.c, Lenz extension 0x05 0xF3)
+
+#define DCC_ADVANCED_CONSIST        1       // 0: no multi unit support
+                                            // 1: add advanced consist (CV19) manager; one speed
+                                            //    packet to the consist address drives all members
+
+#define DCC_ACC_PULSE               1       // 0: host sends activate and deactivate
+                                            // 1: station sends the deactivate after CV14 (accessory.c)
+
+#define ACC_MAX_ACTIVE              2       // max. no of coils switched on at the same time
+
+#define DCC_ROUTES                  1       // 0: no routes
+                                            // 1: station executes routes (Fahrstrassen), see accessory.c
+
+#define DCC_STORE                   1       // 0: CVs of the station always start with defaults
+                                            // 1: changed CVs and routes are kept in flash (store.c)
+
+#define STORE_FLUSH_DELAY        1000L      // write to flash this time (ms) after the last change
+
+#define DCC_SNAPSHOT                1       // 0: every reset is a cold start
+                                            // 1: locobuffer, state and turnouts survive a
+                                            //    watchdog or external reset (snapshot.c)
+
+#define SNAPSHOT_PERIOD            20L      // ms between two snapshots of the locobuffer
+
+#define DCC_WATCHDOG                1       // 0: watchdog off (as after InitSysCtrl)
+                                            // 1: watchdog resets when a task hangs or starves,
+                                            //    post mortem to the pc after reboot (watchdog.c)
+
+#define DCC_RAIL_STATS              1       // 0: no statistic
+                                            // 1: count rail time per packet source and type,
+                                            //    keep top addresses (Lenz extension 0xF5)
+
+#define HOT_PATH_PROFILE            0       // 0: no profile
+                                            // 1: count cycles of dcc isr and main loop tasks
+                                            //    on CpuTimer2 (Lenz extension 0xFA, see profile.c)
+                                            // note: the placement of the hot path in RAM is a
+                                            //    linker option: --define=HOT_PATH_IN_RAM (F28069M.cmd)
+
 //=========================================================================================
 // 4. DCC Definitions
 //=========================================================================================
@@ -210,10 +277,27 @@ _mydelay_us(double __us)
 
 #define NUM_DCC_ACC_REPEAT     2        // Accessory Commands are repeated this number (--> CV)
 
+#define NUM_DCC_ACC_TIME       100      // turn on time of accessories in ms (--> CV14)
+                                        // 0: no automatic off, host sends the deactivate
+
 #define NUM_DCC_FUNC_REPEAT    0        // Function Commands are repeated this number (--> CV)
 
 #define NUM_DCC_POM_REPEAT     3        // Program on the main are repeated this number (--> CV)
 
+#define DCC_ADAPTIVE_REPEAT    1        // 1: repeat counts follow the rail load (see organizer.c)
+                                        //    between MIN and MAX; the values above are the start values
+
+#define DCC_SPEED_REPEAT_MIN   1        // speed has a refresh, but a stop must get out fast
+#define DCC_SPEED_REPEAT_MAX   5
+#define DCC_ACC_REPEAT_MIN     1        // accessories have no refresh
+#define DCC_ACC_REPEAT_MAX     4
+#define DCC_FUNC_REPEAT_MIN    0        // functions are refreshed by locobuffer
+#define DCC_FUNC_REPEAT_MAX    2
+#define DCC_POM_REPEAT_MIN     1        // decoder needs two identical pom packets
+#define DCC_POM_REPEAT_MAX     5
+
+#define DCC_REFRESH_LIMIT      400      // ms; a locobuffer refresh cycle longer then this is 'busy'
+
 // note: in addition, there is the locobuffer, where all commands are refreshed
 //       this locobuffer does not apply to accessory commands nor pom-commands
 
@@ -254,6 +338,21 @@ typedef enum {is_void,      // message with no special handling (like functions)
               is_prog,      // service mode - longer preambles
               is_prog_ack}  t_msg_type;
 
+#define NUM_MSG_TYPE  7
+
+// This enum tells where a message put to the tracks came from (rail statistic).
+
+typedef enum {from_hp,      // queue_hp
+              from_lp,      // queue_lp
+              from_repeat,  // repeatbuffer
+              from_refresh, // locobuffer refresh
+              from_dummy,   // dummy loco message (no loco active, keeps railcom alive)
+              from_idle,    // DCC_Idle and other station messages (reset at startup)
+              from_prog,    // queue_prog
+              from_estop}   t_msg_source;
+
+#define NUM_MSG_SOURCE  8
+
 
 typedef struct
   {
@@ -298,6 +397,8 @@ struct locomem
     t_format format: 2;                 // 00 = 14, 01=27, 10=28, 11=128 speed steps.
                                         // DCC27 is not supported
     unsigned char active: 1;            // 1: lok is in refresh, 0: lok is not refreshed
+    unsigned char consist: 1;           // 1: lok is member of an advanced consist,
+                                        //    speed is refreshed via the consist address
     unsigned char fl: 1;                // function light
     unsigned char f4_f1: 4;             // function 4 downto 1
     unsigned char f8_f5: 4;             // function 8 downto 5
@@ -371,6 +472,17 @@ extern unsigned char xpressnet_feedback_mode;   // filled from CV29
 #define SIZE_REPEATBUFFER    32       // immediate repeat (7 bytes each entry)
 //SDS#define SIZE_LOCOBUFFER      64       // no of simult. active locos (6 bytes each entry)
 #define SIZE_LOCOBUFFER      5 //SDS, meer dan genoeg nu!! (gebruik ram voor een display)
+#define SIZE_RAMP             8       // no of simult. running speed ramps (10 bytes each entry)
+#define SIZE_CONSIST         16       // no of locos in advanced consists (4 bytes each entry)
+#define SIZE_RAIL_TOP         8       // no of addresses in the rail statistic (6 bytes each entry)
+#define SIZE_TIMERWHEEL      16       // no of software timers (8 words each entry)
+#define SIZE_EVENT_RING      16       // no of events kept for the consumers (3 words each entry), power of 2
+#define SIZE_KEY_RING        16       // no of encoder steps and button edges from the isr (4 words each entry), power of 2
+#define SIZE_ACC_PULSE        8       // no of accepted accessory pulses (5 words each entry)
+#define SIZE_TURNOUT_STATE 8192       // no of turnouts with stored position (2048 decoders * 4, 2 bits each)
+#define SIZE_TURNOUT_JOURNAL  16       // no of changed turnouts waiting to be reported
+#define SIZE_ROUTE            8       // no of routes
+#define SIZE_ROUTE_ENTRY     12       // no of turnouts / signals per route (2 words each entry)
 
 
 
@@ -417,11 +529,15 @@ extern unsigned char xpressnet_feedback_mode;   // filled from CV29
 #define   eadr_reserved038              0x026  
 #define   eadr_serial_id                0x027  //    / CV39: serial number, must be > 1
 
-extern unsigned char eemem[] __attribute__((section("EECV")));    // EEMEM
+#define SIZE_EEMEM                    (eadr_serial_id+1)
+
+extern unsigned char eemem[SIZE_EEMEM];                     // RAM mirror, loaded by init_store()
+extern const unsigned char eemem_default[SIZE_EEMEM];       // defaults, see config.c
 
 #define EADR_LOCO_FORMAT     0x810080L  // base addr in mem
-#define ESIZE_LOCO_FORMAT    64         // no of locos with different format (max. 250)
-                                        // each entry requires 2 bytes
+#define ESIZE_LOCO_FORMAT  4096         // no of locos with different format (1 word each entry, RAML5)
+#define SIZE_FORMAT_CHANGED  16         // format changes per store flush (more: store compacts)
+#define SIZE_LOCO_NAMES     512         // no of locos with name (8 words each entry, RAML6)
 
 
 // This union allows to access 16 bits as word or as two bytes.
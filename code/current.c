@@ -0,0 +1,140 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      current.c
+// history:   track current sense started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   adc sampling of main and prog track current
+//
+// how:       ePWM3 (dcc signal, see dccout.c) starts SOC0 (main) and
+//            SOC1 (prog) at zero and at period, i.e. once in each half
+//            of a dcc bit. The end of SOC1 raises ADCINT1 (PIE group 1,
+//            which stays enabled while store.c writes the flash);
+//            current_isr passes both results to current_filter.c.
+//            The isr and the filter run from RAM.
+//
+//            Current is scaled with CURRENT_UA_PER_LSB (hardware.h) only
+//            for set up and telemetry, the isr works in adc counts.
+//            Recorded adc streams can be replayed on the host with
+//            tools/currentreplay.c, which uses the same filter code.
+//
+//-----------------------------------------------------------------
+
+#include "DSP28x_Project.h"     // Device Headerfile and Examples Include File
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "config.h"                // general structures and definitions
+#include "current.h"
+#include "watchdog.h"               // last isr
+
+#if (CURRENT_SENSE == 1)
+
+__interrupt void current_isr(void);
+
+t_cf_channel current_channel[2];
+static uint16_t current_predict_seen[2];    // predict_count at last query
+
+static uint16_t current_counts(uint32_t ma)
+  {
+    uint32_t counts;
+
+    counts = ma * 1000L / CURRENT_UA_PER_LSB;
+    if (counts > 4095) counts = 4095;
+    return((uint16_t)counts);
+  }
+
+static unsigned int current_ma(uint16_t counts)
+  {
+    return((unsigned int)(((uint32_t)counts * CURRENT_UA_PER_LSB) / 1000L));
+  }
+
+void init_current(void)
+  {
+    unsigned char i;
+
+    for (i=0; i<2; i++)
+      {
+        cf_init(&current_channel[i]);
+        current_channel[i].offset = CURRENT_OFFSET;
+        current_channel[i].overload = current_counts(CURRENT_OVERLOAD_MA);
+        current_channel[i].predict_ahead = CURRENT_PREDICT_AHEAD;
+        current_channel[i].ack_delta = current_counts(CURRENT_ACK_MA);
+        current_channel[i].ack_samples = CURRENT_ACK_SAMPLES;
+        current_channel[i].ack_hold = CURRENT_ACK_HOLD;
+        current_predict_seen[i] = 0;
+      }
+
+    InitAdc();                                  // power up and calibrate (F2806x_Adc.c)
+
+    EALLOW;
+    AdcRegs.ADCCTL2.bit.ADCNONOVERLAP = 1;
+    AdcRegs.ADCCTL1.bit.INTPULSEPOS = 1;        // ADCINT at end of conversion
+    AdcRegs.INTSEL1N2.bit.INT1E = 1;
+    AdcRegs.INTSEL1N2.bit.INT1CONT = 0;
+    AdcRegs.INTSEL1N2.bit.INT1SEL = 1;          // EOC1 -> ADCINT1
+    AdcRegs.ADCSOC0CTL.bit.CHSEL = CURRENT_ADC_MAIN;
+    AdcRegs.ADCSOC1CTL.bit.CHSEL = CURRENT_ADC_PROG;
+    AdcRegs.ADCSOC0CTL.bit.TRIGSEL = 9;         // ePWM3 SOCA
+    AdcRegs.ADCSOC1CTL.bit.TRIGSEL = 9;
+    AdcRegs.ADCSOC0CTL.bit.ACQPS = 6;           // 7 ADCCLK sample window
+    AdcRegs.ADCSOC1CTL.bit.ACQPS = 6;
+    PieVectTable.ADCINT1 = &current_isr;
+    EDIS;
+
+    // SOCA of the dcc pwm, on zero and on period
+    EPwm3Regs.ETSEL.bit.SOCASEL = ET_CTR_PRDZERO;
+    EPwm3Regs.ETPS.bit.SOCAPRD = ET_1ST;
+    EPwm3Regs.ETSEL.bit.SOCAEN = 1;
+
+    // Enable CPU INT1 and ADCINT1 in the PIE: Group 1 interrupt 1
+    IER |= M_INT1;
+    PieCtrlRegs.PIEIER1.bit.INTx1 = 1;
+  }
+
+#pragma CODE_SECTION(current_isr, "ramfuncs");     // runs while store.c writes the flash
+__interrupt void current_isr(void)
+  {
+    WATCHDOG_ISR(PM_ISR_CURRENT);
+    cf_sample(&current_channel[CURRENT_MAIN], AdcResult.ADCRESULT0);
+    cf_sample(&current_channel[CURRENT_PROG], AdcResult.ADCRESULT1);
+
+    AdcRegs.ADCINTFLGCLR.bit.ADCINT1 = 1;
+    // Acknowledge this interrupt to receive more interrupts from group 1
+    PieCtrlRegs.PIEACK.all = PIEACK_GROUP1;
+  }
+
+void current_telemetry(unsigned char out, t_current_telemetry *t)
+  {
+    t_cf_channel *ch;
+    t_cf_result result;
+    uint16_t count;
+
+    ch = &current_channel[out];
+    cf_read(ch, &result);
+    t->rms = current_ma(result.rms);
+    t->peak = current_ma(result.peak);
+
+    t->flags = 0;
+    count = ch->predict_count;
+    if (count != current_predict_seen[out]) t->flags |= CURRENT_PREDICTED;
+    current_predict_seen[out] = count;
+    if (ch->over) t->flags |= CURRENT_OVER;
+    if (ch->ack) t->flags |= CURRENT_ACK;
+  }
+
+#endif // CURRENT_SENSE
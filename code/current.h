@@ -0,0 +1,62 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      current.h
+// history:   track current sense started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   adc sampling of main and prog track current,
+//            telemetry and ack detection
+//
+// interface upstream:
+//            init_current(void)        // call after init_dccout (ePWM3 triggers the adc)
+//            current_telemetry(out, t) // rms, peak and flags in mA for the host
+//            ACK_IS_DETECTED           // for programmer.c
+//
+//-----------------------------------------------------------------
+#ifndef __CURRENT_H__
+#define __CURRENT_H__
+
+#include "current_filter.h"
+
+#if (CURRENT_SENSE == 1)
+
+#define CURRENT_MAIN        0
+#define CURRENT_PROG        1
+
+#define CURRENT_PREDICTED   0x80        // flags: overload predicted since last query
+#define CURRENT_OVER        0x40        //        level at or above CURRENT_OVERLOAD_MA
+#define CURRENT_ACK         0x20        //        ack pulse present
+
+typedef struct
+  {
+    unsigned int rms;                   // mA, last window
+    unsigned int peak;                  // mA, last window
+    unsigned char flags;
+  } t_current_telemetry;
+
+extern t_cf_channel current_channel[2];
+
+void init_current(void);
+void current_telemetry(unsigned char out, t_current_telemetry *t);
+
+#define ACK_IS_DETECTED  (current_channel[CURRENT_PROG].ack)
+
+#else
+
+#define ACK_IS_DETECTED  0              // TAPAS: no ack detector
+
+#endif // CURRENT_SENSE
+
+#endif // __CURRENT_H__
@@ -0,0 +1,180 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      current_filter.c
+// history:   track current pipeline started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   processing of one current sense channel
+//
+// how:       every sample (offset removed, clamped at 0) goes to
+//            - level: short low pass, base for slope, prediction and ack
+//            - sum of squares and peak over CF_WINDOW samples; the isr
+//              only latches the sums, the square root is done by cf_read
+//            - slope: level now minus level CF_SLOPE_LEN samples ago;
+//              if level + slope * predict_ahead reaches overload while
+//              level is still below, an overload is predicted
+//            - ack: level above a slow baseline by ack_delta for at least
+//              ack_samples in a row (S-9.2.3: +60mA for 6ms). The
+//              baseline is frozen while the level is raised, up to
+//              ack_hold samples; a longer rise is taken as new baseline.
+//            cf_sample runs in the adc isr from RAM: only shifts, adds and
+//            16x16 multiplies, no divide and no library call.
+//
+//-----------------------------------------------------------------
+
+#include <stdint.h>
+#include "current_filter.h"
+
+void cf_init(t_cf_channel *ch)
+  {
+    uint16_t i;
+
+    ch->level_q = 0;
+    ch->base_q = 0;
+    for (i=0; i<CF_SLOPE_LEN; i++) ch->hist[i] = 0;
+    ch->hist_idx = 0;
+    ch->sumsq = 0;
+    ch->peak = 0;
+    ch->n = 0;
+    ch->ack_run = 0;
+    ch->primed = 0;
+    ch->level = 0;
+    ch->slope = 0;
+    ch->predict = 0;
+    ch->over = 0;
+    ch->ack = 0;
+    ch->predict_count = 0;
+    ch->win_sumsq = 0;
+    ch->win_peak = 0;
+    ch->win_seq = 0;
+  }
+
+#pragma CODE_SECTION(cf_sample, "ramfuncs");
+void cf_sample(t_cf_channel *ch, uint16_t raw)
+  {
+    uint16_t x;
+    uint16_t level;
+    uint16_t base;
+    int32_t ahead;
+    unsigned char predict;
+    uint16_t i;
+
+    x = (raw > ch->offset) ? (raw - ch->offset) : 0;
+
+    if (!ch->primed)                                // start from the first sample, not from 0
+      {
+        ch->level_q = x << CF_FILTER_SHIFT;
+        ch->base_q = (uint32_t)x << CF_BASE_SHIFT;
+        for (i=0; i<CF_SLOPE_LEN; i++) ch->hist[i] = x;
+        ch->primed = 1;
+      }
+
+    // rms and peak window
+    ch->sumsq += (uint32_t)x * x;
+    if (x > ch->peak) ch->peak = x;
+    if (++ch->n == CF_WINDOW)
+      {
+        ch->win_sumsq = ch->sumsq;
+        ch->win_peak = ch->peak;
+        ch->win_seq++;
+        ch->sumsq = 0;
+        ch->peak = 0;
+        ch->n = 0;
+      }
+
+    // level and slope
+    ch->level_q += x - (ch->level_q >> CF_FILTER_SHIFT);
+    level = ch->level_q >> CF_FILTER_SHIFT;
+    ch->level = level;
+    ch->slope = (int16_t)(level - ch->hist[ch->hist_idx]);
+    ch->hist[ch->hist_idx] = level;
+    ch->hist_idx = (ch->hist_idx + 1) & (CF_SLOPE_LEN-1);
+
+    // overload prediction
+    ch->over = (level >= ch->overload);
+    predict = 0;
+    if (!ch->over && (ch->slope > 0))
+      {
+        ahead = (int32_t)level + (int32_t)ch->slope * ch->predict_ahead;
+        if (ahead >= ch->overload) predict = 1;
+      }
+    if (predict && !ch->predict) ch->predict_count++;
+    ch->predict = predict;
+
+    // ack
+    base = (uint16_t)(ch->base_q >> CF_BASE_SHIFT);
+    if (level >= base + ch->ack_delta)
+      {
+        ch->ack_run++;
+        if (ch->ack_run >= ch->ack_hold)
+          {
+            ch->base_q = (uint32_t)level << CF_BASE_SHIFT;      // loco started: new baseline
+            ch->ack_run = 0;
+            ch->ack = 0;
+          }
+        else if (ch->ack_run >= ch->ack_samples)
+          {
+            ch->ack = 1;
+          }
+      }
+    else
+      {
+        ch->ack_run = 0;
+        ch->ack = 0;
+        ch->base_q += level - (int32_t)(ch->base_q >> CF_BASE_SHIFT);
+      }
+  }
+
+static uint16_t cf_sqrt(uint32_t v)
+  {
+    uint32_t root, bit;
+
+    root = 0;
+    bit = (uint32_t)1 << 30;
+    while (bit > v) bit >>= 2;
+    while (bit)
+      {
+        if (v >= root + bit)
+          {
+            v -= root + bit;
+            root = (root >> 1) + bit;
+          }
+        else
+          {
+            root >>= 1;
+          }
+        bit >>= 2;
+      }
+    return((uint16_t)root);
+  }
+
+// main context: the isr may close a window while we copy, then copy again
+void cf_read(t_cf_channel *ch, t_cf_result *result)
+  {
+    uint32_t sumsq;
+    uint16_t peak, seq;
+
+    do
+      {
+        seq = ch->win_seq;
+        sumsq = ch->win_sumsq;
+        peak = ch->win_peak;
+      }
+    while (seq != ch->win_seq);
+
+    result->rms = cf_sqrt(sumsq / CF_WINDOW);
+    result->peak = peak;
+    result->seq = seq;
+  }
@@ -0,0 +1,84 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      current_filter.h
+// history:   track current pipeline started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   processing of one current sense channel, sample by sample.
+//            No device registers and no config.h: the same source is
+//            compiled by tools/currentreplay.c on the host.
+//
+// interface upstream:
+//            cf_init(ch)               // clear state, set up fields before
+//            cf_sample(ch, raw)        // one adc result, called by the isr
+//            cf_read(ch, result)       // consistent copy of last window (main)
+//
+//-----------------------------------------------------------------
+#ifndef __CURRENT_FILTER_H__
+#define __CURRENT_FILTER_H__
+
+#include <stdint.h>
+
+#define CF_FILTER_SHIFT     2       // level: low pass over 4 samples
+#define CF_BASE_SHIFT       6       // ack baseline: low pass over 64 samples
+#define CF_SLOPE_LEN        8       // slope is the change of level over 8 samples
+#define CF_WINDOW           256     // samples per rms / peak window
+                                    // (4095^2 * 256 still fits in 32 bit)
+
+typedef struct
+  {
+    // set up by the caller, in adc counts
+    uint16_t offset;                // reading at zero current
+    uint16_t overload;              // level of overload (short)
+    uint16_t predict_ahead;         // look ahead in CF_SLOPE_LEN sample units
+    uint16_t ack_delta;             // rise of level over baseline for an ack
+    uint16_t ack_samples;           // samples the rise must last
+    uint16_t ack_hold;              // a longer rise is a new load, not an ack
+
+    // state of the isr
+    uint16_t level_q;               // low pass, << CF_FILTER_SHIFT
+    uint32_t base_q;                // ack baseline, << CF_BASE_SHIFT
+    uint16_t hist[CF_SLOPE_LEN];    // past levels for the slope
+    uint16_t hist_idx;
+    uint32_t sumsq;
+    uint16_t peak;
+    uint16_t n;
+    uint16_t ack_run;
+    unsigned char primed;           // 0: next sample sets level and baseline
+
+    // results, written by the isr
+    uint16_t level;                 // filtered current
+    int16_t  slope;                 // change of level over CF_SLOPE_LEN samples
+    unsigned char predict;          // 1: overload ahead (level still below overload)
+    unsigned char over;             // 1: level at or above overload
+    unsigned char ack;              // 1: ack pulse present
+    uint16_t predict_count;         // no of predictions (rising edges)
+    uint32_t win_sumsq;             // last complete window
+    uint16_t win_peak;
+    uint16_t win_seq;               // incremented with every window
+  } t_cf_channel;
+
+typedef struct
+  {
+    uint16_t rms;                   // adc counts over offset
+    uint16_t peak;
+    uint16_t seq;
+  } t_cf_result;
+
+void cf_init(t_cf_channel *ch);
+void cf_sample(t_cf_channel *ch, uint16_t raw);
+void cf_read(t_cf_channel *ch, t_cf_result *result);
+
+#endif // __CURRENT_FILTER_H__
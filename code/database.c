@@ -19,6 +19,8 @@
 //                             LOK_NAME_LENGTH now per define
 //            2009-03-11 V0.04 data base is sent as message and as call
 //                             bugfix in total_data_base_size
+//            TAPAS: format database in RAM, sorted, kept in flash store
+//            TAPAS: named loco database, transfer task to the host
 //
 //
 //--------------------------------------------------------------------------
@@ -37,6 +39,9 @@
 #include <string.h>
 #include "config.h"                // general structures and definitions
 #include "database.h"
+#include "format_table.h"
+#include "store.h"
+#include "scheduler.h"              // parser sends the entries
 
 
 // mega32:   2kByte SRAM, 1kByte EEPROM --> SDS : idem atmega328p
@@ -44,12 +49,12 @@
 
 
 t_format dcc_default_format;            // dcc default: 0=DCC14, 2=DCC28, 3=DCC128
-                                        // this value is read from eeprom
+                                        // this value is read from eemem (CV24)
 
-unsigned char next_search_index;        // was asked continously - this is the index for the parser
+unsigned int next_search_index;         // was asked continously - this is the index for the parser
 
-unsigned char cur_database_entry;
-unsigned char total_database_entry;  // all locos with a name
+unsigned int cur_database_entry;
+unsigned int total_database_entry;   // all locos with a name
 unsigned char db_message[17]; 
 unsigned char db_message_ready;
 
@@ -70,33 +75,399 @@ unsigned char db_message_ready;
 //        - if entry == 0x0000, the entry is void.
 //  
 // 
-// Up to 64 locos may have different format (ESIZE_LOCO_FORMAT)
-
-// We allocate this storage to a fixed address to have access from the
-// parser with a constant offset to eeprom
-// (parser commands: read and write Special Option)
+// Up to ESIZE_LOCO_FORMAT locos may have different format.
 //
+// TAPAS: the entries are kept in RAM (loco_format[]), sorted by address,
+//        see format_table.c (binary search, also built on the host by
+//        tools/formatbench.c).
+//        A change is written to the flash store as record
+//        {STORE_KEY_FORMAT + addr, format}, FORMAT_VOID if back to default.
+//        A compaction of the store writes the entries in sorted order,
+//        so the replay at boot appends at the end (no moves).
+
+#define FORMAT_ADDR_MASK    FT_ADDR_MASK
+#define FORMAT_SHIFT        FT_SHIFT
+#define FORMAT_VOID         FT_VOID     // record value: loco has default format
+
+#pragma DATA_SECTION(loco_format, "locoformat");     // see F28069M.cmd
+unsigned int loco_format[ESIZE_LOCO_FORMAT];
+t_format_table format_table;            // loco_format[] and no of used entries
+
+unsigned int format_changed[SIZE_FORMAT_CHANGED];   // addresses not yet in store
+unsigned char format_changed_count;     // > SIZE_FORMAT_CHANGED: lost track, save all
+
+static unsigned int db_records(void);
+
+#define format_find(addr)           ft_find(&format_table, (addr))
+#define format_lookup(addr)         ft_lookup(&format_table, (addr))
+#define format_set(addr, format)    ft_set(&format_table, (addr), (format), dcc_default_format)
 
 t_format get_loco_format(unsigned int addr)
 {
-  return(dcc_default_format);     // not found - default format
+  unsigned char format;
+
+  format = format_lookup(addr & FORMAT_ADDR_MASK);
+  if (format == FORMAT_VOID) return(dcc_default_format);     // not found - default format
+  return(format);
 }
 
 
+// return: 0 if database is full
 unsigned char store_loco_format(unsigned int addr, t_format format)
 {
-  // SDS-TAPAS : eventueel nog in ram bewaren
+  unsigned char i;
+
+  addr &= FORMAT_ADDR_MASK;
+  if (get_loco_format(addr) == format) return(1);     // no change - called for every new loco
+  if ((format_lookup(addr) == FORMAT_VOID) && !store_room(db_records() + 1)) return(0);   // new entry
+  if (!format_set(addr, format)) return(0);
+
+  if (format_changed_count <= SIZE_FORMAT_CHANGED)
+    {
+      for (i=0; i<format_changed_count; i++)
+        {
+          if (format_changed[i] == addr) break;
+        }
+      if (i == format_changed_count)
+        {
+          if (format_changed_count < SIZE_FORMAT_CHANGED) format_changed[i] = addr;
+          format_changed_count++;
+        }
+    }
+  store_changed();
   return(1);
 }
 
+// called by the store: pos == NULL -> changed entries, else compaction
+// from loco address *pos on; the table may change between two steps,
+// the address (not the index) keeps the place.
+unsigned char format_save(unsigned int *pos)
+{
+  unsigned int i, addr;
+
+  if (pos)
+    {
+      if (*pos == 0) format_changed_count = 0;
+      for (i=format_find(*pos); i<format_table.count; i++)
+        {
+          addr = loco_format[i] & FORMAT_ADDR_MASK;
+          if (!store_step())
+            {
+              *pos = addr;
+              return(STORE_MORE);
+            }
+          if (!store_put(STORE_KEY_FORMAT + addr, loco_format[i] >> FORMAT_SHIFT)) return(STORE_FAIL);
+        }
+      return(STORE_DONE);
+    }
+  if (format_changed_count > SIZE_FORMAT_CHANGED) return(STORE_FAIL);    // store does a compaction
+  while (format_changed_count)
+    {
+      addr = format_changed[format_changed_count - 1];
+      if (!store_put(STORE_KEY_FORMAT + addr, format_lookup(addr))) return(STORE_FAIL);
+      format_changed_count--;
+    }
+  return(STORE_DONE);
+}
+
+static void format_apply(unsigned int key, unsigned int value)
+{
+  if (value > DCC128) value = dcc_default_format;     // FORMAT_VOID
+  format_set(key - STORE_KEY_FORMAT, value);
+}
+
+#if (LOCO_DATABASE == NAMED)
+//------------------------------------------------------------------------
+//------------------------------------------------------------------------
+// Database with names
+//------------------------------------------------------------------------
+//------------------------------------------------------------------------
+//
+// Every loco with a name has a slot in loco_name[] (fixed stride):
+//   addr, picture ID, LOK_NAME_LENGTH chars packed 2 per word (high byte first)
+// A slot does not move while the loco exists; loco_name_index[] holds
+// the used slots sorted by address (binary search, like the format database).
+//
+// Changed slots are marked in name_dirty and written to the flash store as
+// records {STORE_KEY_NAME + slot * 8 + word, value}, addr last.
+//
+// Transfer to the host: rewind_database() starts it, run_database() puts
+// one entry at a time to db_message, the parser sends it when the tx fifo
+// has room -> the transfer of 500 locos never blocks other commands.
+
+#if (LOK_NAME_LENGTH > 10)
+  #error LOK_NAME_LENGTH must fit into one Lenz message
+#endif
+
+#define NAME_WORDS          ((LOK_NAME_LENGTH + 1) / 2)
+#define NAME_RECORD         8           // keys per slot
+#define NAME_PUTS           (2 + NAME_WORDS)    // records of one loco in a compaction
+
+typedef struct
+  {
+    unsigned int addr;                  // 0 = slot free
+    unsigned int pic;                   // picture ID
+    unsigned int name[NAME_WORDS];
+  } t_loco_name;
+
+#pragma DATA_SECTION(loco_name, "loconames");       // see F28069M.cmd
+t_loco_name loco_name[SIZE_LOCO_NAMES];
+#pragma DATA_SECTION(loco_name_index, "loconames");
+unsigned int loco_name_index[SIZE_LOCO_NAMES];      // slots, sorted by addr
+
+unsigned int name_dirty[(SIZE_LOCO_NAMES + 15) / 16];   // slot changed, not yet in store
+unsigned char db_transfer;              // 1: transfer to host is running
+
+// return: position in loco_name_index of addr, or where it has to be inserted
+static unsigned int name_find(unsigned int addr)
+{
+  unsigned int low, high, mid;
+
+  low = 0;
+  high = total_database_entry;
+  while (low < high)
+    {
+      mid = (low + high) / 2;
+      if (loco_name[loco_name_index[mid]].addr < addr) low = mid + 1;
+      else high = mid;
+    }
+  return(low);
+}
+
+// return: slot of addr, SIZE_LOCO_NAMES if not found
+static unsigned int name_slot(unsigned int addr)
+{
+  unsigned int i;
+
+  i = name_find(addr);
+  if ((i < total_database_entry) && (loco_name[loco_name_index[i]].addr == addr)) return(loco_name_index[i]);
+  return(SIZE_LOCO_NAMES);
+}
+
+static void name_mark(unsigned int slot)
+{
+  name_dirty[slot / 16] |= (1 << (slot % 16));
+  store_changed();
+}
+
+// name: LOK_NAME_LENGTH chars, no trailing 0 required; name[0] == 0 deletes the loco
+// return: 0 if database is full
+unsigned char store_loco_name(unsigned int addr, unsigned char *name, unsigned int pic)
+{
+  unsigned int i, slot;
+
+  addr &= 0x3FFF;
+  if (addr == 0) return(0);
+  i = name_find(addr);
+  if ((i < total_database_entry) && (loco_name[loco_name_index[i]].addr == addr))
+    {
+      slot = loco_name_index[i];
+      if (name[0] == 0)
+        {                                               // delete
+          loco_name[slot].addr = 0;
+          total_database_entry--;
+          memmove(&loco_name_index[i], &loco_name_index[i+1], (total_database_entry - i) * sizeof(loco_name_index[0]));
+          name_mark(slot);
+          return(1);
+        }
+    }
+  else
+    {
+      if (name[0] == 0) return(1);                      // nothing to delete
+      if (total_database_entry == SIZE_LOCO_NAMES) return(0);
+      if (!store_room(db_records() + NAME_PUTS)) return(0);     // flash store full
+      for (slot=0; slot<SIZE_LOCO_NAMES; slot++)
+        {
+          if (loco_name[slot].addr == 0) break;
+        }
+      loco_name[slot].addr = addr;
+      memmove(&loco_name_index[i+1], &loco_name_index[i], (total_database_entry - i) * sizeof(loco_name_index[0]));
+      loco_name_index[i] = slot;
+      total_database_entry++;
+    }
+
+  loco_name[slot].pic = pic;
+  for (i=0; i<NAME_WORDS; i++)
+    {
+      loco_name[slot].name[i] = (unsigned int)(name[2*i] & 0xFF) << 8;
+      if (2*i + 1 < LOK_NAME_LENGTH) loco_name[slot].name[i] |= name[2*i + 1] & 0xFF;
+    }
+  name_mark(slot);
+  return(1);
+}
+
+// copy name (LOK_NAME_LENGTH chars, 0 padded) and picture ID
+// return: 0 if loco has no name
+unsigned char get_loco_name(unsigned int addr, unsigned char *name, unsigned int *pic)
+{
+  unsigned int i, slot;
+
+  slot = name_slot(addr & 0x3FFF);
+  if (slot == SIZE_LOCO_NAMES) return(0);
+  for (i=0; i<LOK_NAME_LENGTH; i++)
+    {
+      name[i] = (loco_name[slot].name[i / 2] >> ((i & 1) ? 0 : 8)) & 0xFF;
+    }
+  *pic = loco_name[slot].pic;
+  return(1);
+}
+
+// called by the store: pos == NULL -> changed slots, else compaction from slot *pos on
+unsigned char name_save(unsigned int *pos)
+{
+  unsigned int slot, key;
+  unsigned char i;
+
+  slot = 0;
+  if (pos)
+    {
+      if (*pos == 0) memset(name_dirty, 0, sizeof(name_dirty));
+      slot = *pos;
+    }
+  for (; slot<SIZE_LOCO_NAMES; slot++)
+    {
+      key = STORE_KEY_NAME + slot * NAME_RECORD;
+      if (pos)
+        {
+          if (loco_name[slot].addr == 0) continue;
+          if (!store_step())
+            {
+              *pos = slot;
+              return(STORE_MORE);
+            }
+        }
+      else
+        {
+          if (!(name_dirty[slot / 16] & (1 << (slot % 16)))) continue;
+        }
+      if (loco_name[slot].addr)
+        {
+          if (!store_put(key + 1, loco_name[slot].pic)) return(STORE_FAIL);
+          for (i=0; i<NAME_WORDS; i++)
+            {
+              if (!store_put(key + 2 + i, loco_name[slot].name[i])) return(STORE_FAIL);
+            }
+        }
+      if (!store_put(key, loco_name[slot].addr)) return(STORE_FAIL);
+      name_dirty[slot / 16] &= ~(1 << (slot % 16));
+    }
+  return(STORE_DONE);
+}
+
+static void name_apply(unsigned int key, unsigned int value)
+{
+  unsigned int slot;
+  unsigned char i;
+
+  slot = (key - STORE_KEY_NAME) / NAME_RECORD;
+  i = (key - STORE_KEY_NAME) % NAME_RECORD;
+  if (slot >= SIZE_LOCO_NAMES) return;
+  if (i == 0) loco_name[slot].addr = value & 0x3FFF;
+  else if (i == 1) loco_name[slot].pic = value;
+  else if (i - 2 < NAME_WORDS) loco_name[slot].name[i - 2] = value;
+}
+
+// after replay: sort used slots into the index (insertion sort, once at boot)
+static void name_build_index(void)
+{
+  unsigned int slot, i;
+
+  total_database_entry = 0;
+  for (slot=0; slot<SIZE_LOCO_NAMES; slot++)
+    {
+      if (loco_name[slot].addr == 0) continue;
+      i = total_database_entry;
+      while ((i > 0) && (loco_name[loco_name_index[i-1]].addr > loco_name[slot].addr))
+        {
+          loco_name_index[i] = loco_name_index[i-1];
+          i--;
+        }
+      loco_name_index[i] = slot;
+      total_database_entry++;
+    }
+}
+
+static void init_names(void)
+{
+  memset(loco_name, 0, sizeof(loco_name));
+  memset(name_dirty, 0, sizeof(name_dirty));
+  db_transfer = 0;
+  db_message_ready = 0;
+  store_replay(STORE_KEY_NAME, STORE_KEY_NAME + SIZE_LOCO_NAMES * NAME_RECORD, name_apply);
+  name_build_index();
+}
+
+// transfer task: prepare the next entry in db_message
+// entry: 0x0F 0xF9 FAddrH AddrL PicH PicL Name[LOK_NAME_LENGTH]   (F: format, upper 2 bits)
+// end:   0x03 0xF9 0x00 0x00
+void run_database(void)
+{
+  unsigned int slot, entry;
+  unsigned char i;
+
+  if (!db_transfer || db_message_ready) return;
+
+  if (cur_database_entry >= total_database_entry)
+    {
+      db_message[0] = 0x03;
+      db_message[1] = 0xF9;
+      db_message[2] = 0x00;
+      db_message[3] = 0x00;
+      db_transfer = 0;
+      db_message_ready = 1;
+      sched_ready(SCHED_PARSER);
+      return;
+    }
+  slot = loco_name_index[cur_database_entry++];
+  entry = ((unsigned int)get_loco_format(loco_name[slot].addr) << 14) | loco_name[slot].addr;
+  db_message[0] = 0x0F;
+  db_message[1] = 0xF9;
+  db_message[2] = entry >> 8;
+  db_message[3] = entry & 0xFF;
+  db_message[4] = loco_name[slot].pic >> 8;
+  db_message[5] = loco_name[slot].pic & 0xFF;
+  for (i=0; i<LOK_NAME_LENGTH; i++)
+    {
+      db_message[6 + i] = (loco_name[slot].name[i / 2] >> ((i & 1) ? 0 : 8)) & 0xFF;
+    }
+  db_message_ready = 1;
+  sched_ready(SCHED_PARSER);                // parser sends it
+}
+#endif // LOCO_DATABASE == NAMED
+
+// records of formats and names in a compaction of the store
+static unsigned int db_records(void)
+{
+  unsigned int records;
+
+  records = format_table.count;
+  #if (LOCO_DATABASE == NAMED)
+  records += total_database_entry * NAME_PUTS;
+  #endif
+  return(records);
+}
+
 void init_database(void)
 {
-  dcc_default_format = DCC_DEFAULT_FORMAT;
+  dcc_default_format = eemem[eadr_dcc_default_format];
+  format_table.entry = loco_format;
+  format_table.size = ESIZE_LOCO_FORMAT;
+  format_table.count = 0;
+  format_changed_count = 0;
+  store_replay(STORE_KEY_FORMAT, STORE_KEY_FORMAT + FORMAT_ADDR_MASK + 1, format_apply);
+  #if (LOCO_DATABASE == NAMED)
+  init_names();
+  #endif
 }
 
 void rewind_database(void)
 {
   next_search_index = 0;
+  #if (LOCO_DATABASE == NAMED)
+  cur_database_entry = 0;
+  db_transfer = 1;
+  sched_ready(SCHED_DATABASE);
+  #endif
 }
 
 unsigned char format_to_uint8(t_format myformat)
@@ -23,6 +23,10 @@
 //            has nothing to do with the actual dcc content)
 //
 // interface upstream: 
+//            get_loco_format(addr), store_loco_format(addr, format)
+//            format_save(pos)              // write formats to the flash store
+//            store_loco_name(addr, name, pic), get_loco_name(addr, name, pic)
+//            rewind_database(), run_database()  // transfer of names to host
 //
 //-----------------------------------------------------------------
 
@@ -30,6 +34,18 @@ void init_database(void);
 t_format get_loco_format(unsigned int addr);
 unsigned char format_to_uint8(t_format myformat);
 unsigned char store_loco_format(unsigned int addr, t_format format);
+unsigned char format_save(unsigned int *pos);       // called by store.c
+
+#if (LOCO_DATABASE == NAMED)
+extern unsigned char db_message[17];                // next entry for the host
+extern unsigned char db_message_ready;              // 1: db_message is valid, parser sends it
+
+unsigned char store_loco_name(unsigned int addr, unsigned char *name, unsigned int pic);
+unsigned char get_loco_name(unsigned int addr, unsigned char *name, unsigned int *pic);
+unsigned char name_save(unsigned int *pos);         // called by store.c
+void run_database(void);                            // transfer task
+#endif
+void rewind_database(void);                         // start transfer to host
 
 
 
@@ -0,0 +1,170 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      dccgen.c
+// history:   dcc generator for the programming track started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   dcc bit stream of one output
+//
+// how:       main puts packets into the ring (dg_put), with the xor
+//            already added; the isr of the output calls dg_bit once per
+//            bit and sets the pwm period for the returned value.
+//            A packet goes out repeat times, then the next one from the
+//            ring; is the ring empty, idle packets keep the decoders
+//            powered. Every packet starts with 'preamble' ones; the end
+//            bit is not counted.
+//
+//            One writer per index: head only by main, tail and the
+//            state only by the isr. dg_skip writes repeat_left = 0 in
+//            one store; the isr can not be interrupted by main, so no
+//            decrement gets lost. dg_flush writes head to tail: the
+//            caller blocks the isr (DINT).
+//
+//            dg_bit runs in the isr from RAM: no library call, no const
+//            data.
+//
+//-----------------------------------------------------------------
+
+#include <stdint.h>
+#include "dccgen.h"
+
+#define DG_PREAMBLE     0
+#define DG_START        1           // start bit before a byte, or end bit
+#define DG_BYTE         2
+
+void dg_init(t_dg_channel *g, unsigned char preamble)
+  {
+    g->preamble = preamble;
+    g->head = 0;
+    g->tail = 0;
+    g->out.repeat = 1;
+    g->out.size = 3;
+    g->out.dcc[0] = 0xFF;           // idle
+    g->out.dcc[1] = 0x00;
+    g->out.dcc[2] = 0xFF;
+    g->repeat_left = 0;
+    g->state = DG_PREAMBLE;
+    g->bits = preamble;
+    g->ibyte = 0;
+    g->cur = 0;
+    g->from_ring = 0;
+    g->packets = 0;
+  }
+
+// returns 0 if the ring is full
+unsigned char dg_put(t_dg_channel *g, const unsigned char *dcc, unsigned char size, unsigned char repeat)
+  {
+    t_dg_packet *p;
+    unsigned char i, next;
+
+    next = (g->head + 1) & (DG_RING - 1);
+    if (next == g->tail) return(0);
+    if (size > DG_MAX_SIZE) size = DG_MAX_SIZE;
+
+    p = &g->ring[g->head];
+    p->repeat = repeat ? repeat : 1;
+    p->size = size + 1;
+    p->dcc[size] = 0;
+    for (i=0; i<size; i++)
+      {
+        p->dcc[i] = dcc[i];
+        p->dcc[size] ^= dcc[i];
+      }
+    g->head = next;                 // publish after the packet is complete
+    return(1);
+  }
+
+unsigned char dg_depth(t_dg_channel *g)
+  {
+    return((g->head - g->tail) & (DG_RING - 1));
+  }
+
+unsigned char dg_repeat_left(t_dg_channel *g)
+  {
+    return(g->from_ring ? g->repeat_left : 0);
+  }
+
+void dg_skip(t_dg_channel *g)
+  {
+    g->repeat_left = 0;             // the packet on the rails is completed
+  }
+
+void dg_flush(t_dg_channel *g)
+  {
+    g->head = g->tail;
+    g->repeat_left = 0;
+  }
+
+// end bit is out: same packet again, next one from the ring or idle
+#pragma CODE_SECTION(dg_load, "ramfuncs");
+static void dg_load(t_dg_channel *g)
+  {
+    t_dg_packet *p;
+    unsigned char i;
+
+    if (g->repeat_left)
+      {
+        g->repeat_left--;
+      }
+    else if (g->tail != g->head)
+      {
+        p = &g->ring[g->tail];
+        g->out.size = p->size;
+        for (i=0; i<p->size; i++) g->out.dcc[i] = p->dcc[i];
+        g->repeat_left = p->repeat - 1;
+        g->from_ring = 1;
+        g->tail = (g->tail + 1) & (DG_RING - 1);
+      }
+    else if (g->from_ring)
+      {
+        g->out.size = 3;
+        g->out.dcc[0] = 0xFF;
+        g->out.dcc[1] = 0x00;
+        g->out.dcc[2] = 0xFF;
+        g->from_ring = 0;
+      }
+    g->packets++;
+    g->ibyte = 0;
+    g->bits = g->preamble;
+    g->state = DG_PREAMBLE;
+  }
+
+#pragma CODE_SECTION(dg_bit, "ramfuncs");
+unsigned char dg_bit(t_dg_channel *g)
+  {
+    unsigned char bit;
+
+    if (g->state == DG_PREAMBLE)
+      {
+        if (--g->bits == 0) g->state = DG_START;
+        return(1);
+      }
+    if (g->state == DG_START)
+      {
+        if (g->ibyte == g->out.size)
+          {
+            dg_load(g);
+            return(1);                  // end bit
+          }
+        g->cur = g->out.dcc[g->ibyte++];
+        g->bits = 8;
+        g->state = DG_BYTE;
+        return(0);                      // start bit
+      }
+    bit = (g->cur & 0x80) ? 1 : 0;      // DG_BYTE
+    g->cur <<= 1;
+    if (--g->bits == 0) g->state = DG_START;
+    return(bit);
+  }
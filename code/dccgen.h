@@ -0,0 +1,81 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      dccgen.h
+// history:   dcc generator for the programming track started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   one dcc bit stream with its own packet ring, bit by bit.
+//            No device registers and no config.h: the same source is
+//            compiled by tools/dccwave.c on the host.
+//
+// interface upstream:
+//            dg_init(g, preamble)      // clear ring, idle packets
+//            dg_put(g, dcc, size, rep) // packet to the ring, main only
+//            dg_depth(g)               // packets waiting in the ring
+//            dg_repeat_left(g)         // sends of the packet on the rails still to come
+//            dg_skip(g)                // no more repetitions (ack received)
+//            dg_flush(g)               // drop the ring, isr blocked by the caller
+//            dg_bit(g)                 // next bit to send, called by the isr
+//
+//-----------------------------------------------------------------
+#ifndef __DCCGEN_H__
+#define __DCCGEN_H__
+
+#include <stdint.h>
+
+#define DG_MAX_SIZE         6       // = MAX_DCC_SIZE of config.h
+#define DG_RING             8       // packets in the ring, power of 2
+#define DG_PREAMBLE_MAIN    14
+#define DG_PREAMBLE_PROG    20      // S-9.2.3: service mode needs >= 20
+
+typedef struct
+  {
+    unsigned char repeat;           // sends of this packet, >= 1
+    unsigned char size;             // bytes including the xor
+    unsigned char dcc[DG_MAX_SIZE+1];
+  } t_dg_packet;
+
+typedef struct
+  {
+    // set up by dg_init
+    unsigned char preamble;         // '1' bits before each packet
+
+    // ring: head written by main, tail by the isr
+    t_dg_packet ring[DG_RING];
+    volatile unsigned char head;
+    volatile unsigned char tail;
+
+    // state of the isr
+    t_dg_packet out;                // packet on the rails
+    volatile unsigned char repeat_left;
+    unsigned char state;
+    unsigned char bits;             // left in preamble or byte
+    unsigned char ibyte;
+    unsigned char cur;
+
+    // results, written by the isr
+    unsigned char from_ring;        // 1: packet on the rails came from the ring (no idle)
+    uint32_t packets;               // packets sent, idle included
+  } t_dg_channel;
+
+void dg_init(t_dg_channel *g, unsigned char preamble);
+unsigned char dg_put(t_dg_channel *g, const unsigned char *dcc, unsigned char size, unsigned char repeat);
+unsigned char dg_depth(t_dg_channel *g);
+unsigned char dg_repeat_left(t_dg_channel *g);
+void dg_skip(t_dg_channel *g);
+void dg_flush(t_dg_channel *g);
+unsigned char dg_bit(t_dg_channel *g);
+
+#endif // __DCCGEN_H__
@@ -42,10 +42,36 @@
 #include "config.h"                 // general structures and definitions
 #include <string.h>
 #include "dccout.h"                 // import own header
+#include "profile.h"                // cycle count of the isr
+#include "boot.h"                   // time of first packet
+#include "status.h"                 // main short trip
+#include "scheduler.h"              // organizer fills next_message
+#include "watchdog.h"               // last isr
+#include "dccgen.h"                 // prog track and district generators
+#include "district.h"               // power districts
+#include "timebase.h"               // TB_CLOCK32, estop latency
 
 void InitEPwm3(void);
 __interrupt void epwm_isr(void);
 
+#if ((DCC_PROG_TRACK == 1) || (DCC_DISTRICTS > 1)) && (MAX_DCC_SIZE != DG_MAX_SIZE)
+#error "DG_MAX_SIZE of dccgen.h must be MAX_DCC_SIZE"
+#endif
+
+#if (DCC_PROG_TRACK == 1)
+void InitEPwm4(void);
+__interrupt void epwm_prog_isr(void);
+
+t_dg_channel prog_gen;                  // generator of the prog track, see below
+#endif
+
+#if (DCC_DISTRICTS > 1)
+#if (DCC_DISTRICTS > DISTRICT_MAX)
+#error "DCC_DISTRICTS: TAPAS has outputs for 4 districts (DISTRICT_MAX)"
+#endif
+static void InitEPwmDistrict(unsigned char d);
+#endif
+
 //-----------------------------------------------------------------
 //------ message formats
 // DCC Baseline Packet 3 bytes (address data xor) form 42 bits
@@ -211,15 +237,23 @@ unsigned char next_message_count;
 //    -> #define DCCOUT_STATE_REG 
 //----------------------------------------------------------------------------------------
 
+uint32_t dccout_time;                   // DCC signal time since boot in us, advanced by every bit
+
+// The ISR and all it calls run from RAM (section ramfuncs, copied in main):
+// while store.c erases or programs the flash, only this interrupt stays enabled,
+// so the DCC signal continues. Therefore no library calls and no const data here.
+#pragma CODE_SECTION(do_send, "ramfuncs");
 void do_send(bool myout)
 {
   if (myout == 0)
     {                                     // 0 - make a long pwm pulse
       EPwm3Regs.TBPRD = 5260;       // Set timer period (116us)
+      dccout_time += PERIOD_0;
     }
   else
     {                                     // 1 - make a short pwm puls
       EPwm3Regs.TBPRD = 2630;       // Set timer period (58us)
+      dccout_time += PERIOD_1;
     }
 } // do_send
 
@@ -244,14 +278,105 @@ struct
   unsigned char bytes_in_message;                 // current size of message (decremented)
   unsigned char railcom_enabled;                  // if true: create cutout
   t_msg_type type;                                // type (for feedback)
+#if (DCC_RAIL_STATS == 1)
+  t_msg_source source;                            // source (for rail statistic)
+  uint32_t start;                                 // dccout_time at start of packet
+#endif
 } doi;
 
 #define MY_STATE_REG doi.state
 
+//----------------------------------------------------------------------------------------
+// emergency stop path
+// dccout_estop_pending is set from main (parser, keys, state engine) and read by the ISR.
+// The stop packet is inserted before next_message; a pending loco packet in next_message
+// is dropped, it was built before the halt and would restart the loco.
+// The latency runs from the reception of the stop command (dccout_estop_received),
+// else from dccout_emergency_stop, in TB_CLOCK32 ticks.
+
+volatile unsigned char dccout_estop_pending;    // no of stop packets still to send
+volatile unsigned char dccout_estop_measure;    // 1: latency measurement running
+uint32_t dccout_estop_request;                  // TB_CLOCK32 at request
+
+unsigned int dccout_estop_latency;
+unsigned int dccout_estop_latency_max;
+
+static unsigned char dcc_bc_stop[2] = {0x00, 0x71};     // 01DC000S: C=1 ignore D, S=1 e-stop (in RAM, see above)
+
+#pragma CODE_SECTION(load_estop, "ramfuncs");
+static void load_estop(unsigned char preamble)
+{
+  doi.current_dcc[0] = dcc_bc_stop[0];
+  doi.current_dcc[1] = dcc_bc_stop[1];
+  doi.bytes_in_message = 2;
+  doi.ibyte = 0;
+  doi.xor_byte = 0;
+  doi.type = is_stop;
+#if (DCC_RAIL_STATS == 1)
+  doi.source = from_estop;
+  doi.start = dccout_time;
+#endif
+
+  dccout_estop_pending--;
+  if ((next_message_count > 0) && (next_message.type == is_loco))
+    {
+      next_message_count = 0;
+      sched_ready(SCHED_ORGANIZER);
+    }
+
+  MY_STATE_REG = DOI_PREAMBLE + preamble;
+}
+
+//----------------------------------------------------------------------------------------
+// power up sequence
+// dccout_startup() is called in main before the slow init steps: the ISR sends
+// DCCOUT_STARTUP_RESETS resets from next_message and then idles of its own,
+// until the organizer runs (dccout_startup_done). On a warm start the locos
+// are still running: no resets, which would stop them, only idles.
+
+volatile unsigned char dccout_startup_idle;     // 1: isr fills gaps with idle packets
+
+#pragma CODE_SECTION(load_idle, "ramfuncs");
+static void load_idle(void)
+{
+  doi.current_dcc[0] = 0xFF;
+  doi.current_dcc[1] = 0x00;
+  doi.bytes_in_message = 2;
+  doi.ibyte = 0;
+  doi.xor_byte = 0;
+  doi.type = is_void;
+#if (DCC_RAIL_STATS == 1)
+  doi.source = from_idle;
+  doi.start = dccout_time;
+#endif
+
+  MY_STATE_REG = DOI_PREAMBLE + (14-3);
+}
+
+#if (HOT_PATH_PROFILE == 1)
+static void epwm_dcc(void);
+
+#pragma CODE_SECTION(epwm_isr, "ramfuncs");
+__interrupt void epwm_isr(void)
+{
+  uint32_t start;
+
+  start = PROFILE_TIME();
+  epwm_dcc();
+  profile_isr(start);
+}
+
+#pragma CODE_SECTION(epwm_dcc, "ramfuncs");
+static void epwm_dcc(void)
+#else
+#pragma CODE_SECTION(epwm_isr, "ramfuncs");
 __interrupt void epwm_isr(void)
+#endif
 {
   unsigned char state;
+  unsigned char i;
 
+  WATCHDOG_ISR(PM_ISR_DCC);
 
   // Clear INT flag for this timer
   EPwm3Regs.ETCLR.bit.INT = 1;
@@ -259,25 +384,48 @@ __interrupt void epwm_isr(void)
   // Acknowledge this interrupt to receive more interrupts from group 3
   PieCtrlRegs.PIEACK.all = PIEACK_GROUP3;
 
+  #if (MAIN_SHORT_TRIP == 1)
+  main_trip_sample();                     // cut the main track on short
+  #endif
+
   state = MY_STATE_REG & ~DOI_CNTMASK;    // take only 3 upper bits
   if (state == DOI_IDLE)
   {
     do_send(1);
 
+    if (dccout_estop_pending)
+    {
+      load_estop(14-3);
+      return;
+    }
     if (next_message_count > 0)
     {
-      memcpy(doi.current_dcc, next_message.dcc, sizeof(doi.current_dcc));
+      for (i=0; i<MAX_DCC_SIZE; i++) doi.current_dcc[i] = next_message.dcc[i];
       doi.bytes_in_message = next_message.size;
       // no size checking - if (doi.cur_size > MAX_DCC_SIZE) doi.cur_size = MAX_DCC_SIZE;
       doi.ibyte = 0;
       doi.xor_byte = 0;
       doi.type = next_message.type;   // remember type in case feedback is required
+#if (DCC_RAIL_STATS == 1)
+      doi.source = next_message.source;
+      doi.start = dccout_time;
+      dccout_rail_sent++;
+#endif
 
       next_message_count--;
+      if (next_message_count == 0) sched_ready(SCHED_ORGANIZER);
 
+#if (DCC_PROG_TRACK == 1)
+      MY_STATE_REG = DOI_PREAMBLE+(14-3);                         // service mode has its own generator
+#else
       if (PROG_TRACK_STATE) MY_STATE_REG = DOI_PREAMBLE+(20-3);   // long preamble if service mode
       else 				MY_STATE_REG = DOI_PREAMBLE+(14-3);     // 14 preamble bits
                                                                   // doi.bits_in_state = 14;  doi.state = dos_send_preamble;
+#endif
+    }
+    else if (dccout_startup_idle)
+    {
+      load_idle();
     }
     return;
   }
@@ -340,6 +488,30 @@ __interrupt void epwm_isr(void)
   if (state == DOI_END_BIT)
   {
     do_send(1);
+    if (boot_time[BOOT_FIRST_PACKET] == 0) boot_time[BOOT_FIRST_PACKET] = BOOT_CLOCK();
+#if (DCC_RAIL_STATS == 1)
+    {
+      uint32_t packet_time;
+      packet_time = dccout_time - doi.start;
+      rail_stats.time[doi.source] += packet_time;
+      rail_stats.packets[doi.source]++;
+      rail_stats.type_time[doi.type] += packet_time;
+    }
+#endif
+    if (dccout_estop_measure && (doi.type == is_stop))
+    {
+      uint32_t latency;
+      latency = (TB_CLOCK32() - dccout_estop_request) / TB_MHZ;
+      if (latency > 0xFFFF) latency = 0xFFFF;
+      dccout_estop_latency = (unsigned int)latency;
+      if (dccout_estop_latency > dccout_estop_latency_max) dccout_estop_latency_max = dccout_estop_latency;
+      dccout_estop_measure = 0;
+    }
+    if (dccout_estop_pending)
+    {
+      load_estop(14);                     // no cutout, full preamble right after the end bit
+      return;
+    }
     MY_STATE_REG = DOI_CUTOUT_1;
     return;
   }
@@ -362,6 +534,10 @@ __interrupt void epwm_isr(void)
 
 void init_dccout(void)
 {
+#if (DCC_DISTRICTS > 1)
+  unsigned char i;
+
+#endif
   MY_STATE_REG = DOI_IDLE; // doi.state = dos_idle;
   next_message_count = 0;
   next_message.size = 2;
@@ -369,7 +545,22 @@ void init_dccout(void)
   next_message.dcc[1] = 0;
 
   doi.railcom_enabled = 0; // voorlopig, want nog geen code voor cutout op tapas
+  dccout_estop_pending = 0;
+  dccout_estop_measure = 0;
+  dccout_startup_idle = 0;
+#if (DCC_RAIL_STATS == 1)
+  memset(&rail_stats, 0, sizeof(rail_stats));     // interrupts are not yet running
+  dccout_rail_sent = 0;
+#endif
 
+#if (DCC_PROG_TRACK == 1)
+  dg_init(&prog_gen, DG_PREAMBLE_PROG);
+  InitEPwm4();          // prog track off until enter_progmode
+#endif
+#if (DCC_DISTRICTS > 1)
+  district_init(DCC_DISTRICTS);
+  for (i=1; i<DCC_DISTRICTS; i++) InitEPwmDistrict(i);    // off until RUN_OKAY
+#endif
   InitEPwm3();
 
   do_send(1);           // init COMP regs.
@@ -378,6 +569,384 @@ void init_dccout(void)
 
 
 
+//-------------------------------------------------------------------------------------
+// Power up sequence
+//-------------------------------------------------------------------------------------
+// call before EINT; replaces the blocking dcc_startup_messages of main
+// warm: 1 if the locos are restored from a snapshot -> idles only
+
+void dccout_startup(unsigned char warm)
+{
+  next_message.size = 2;
+  next_message.type = is_void;
+  next_message.source = from_idle;
+  next_message.dcc[0] = 0x00;                     // broadcast reset
+  next_message.dcc[1] = 0x00;
+  if (warm) next_message_count = 0;
+  else      next_message_count = DCCOUT_STARTUP_RESETS;
+  dccout_startup_idle = 1;
+}
+
+void dccout_startup_done(void)
+{
+  dccout_startup_idle = 0;                        // organizer takes over
+}
+
+//-------------------------------------------------------------------------------------
+// Emergency stop
+//-------------------------------------------------------------------------------------
+// may be called from main context (parser, keys, state engine);
+// the broadcast stop is on the rails after the current packet, independent
+// of next_message_count and of the next run_organizer() pass.
+
+// the stop command came in at 'at' (TB_CLOCK32): the latency includes the
+// time it waited in the rx fifo and the main loop
+void dccout_estop_received(uint32_t at)
+{
+  DINT;
+  if (!dccout_estop_measure)
+  {
+    dccout_estop_request = at;
+    dccout_estop_measure = 1;
+  }
+  EINT;
+}
+
+void dccout_emergency_stop(void)
+{
+  DINT;
+  if (!dccout_estop_measure)
+  {
+    dccout_estop_request = TB_CLOCK32();          // no receive time, e.g. keys
+    dccout_estop_measure = 1;
+  }
+  dccout_estop_pending = DCCOUT_ESTOP_REPEAT;
+#if (DCC_DISTRICTS > 1)
+  district_estop();                               // after the packet on their rails
+#endif
+  EINT;
+}
+
+#if (DCC_RAIL_STATS == 1)
+//-------------------------------------------------------------------------------------
+// Rail statistic
+//-------------------------------------------------------------------------------------
+
+t_rail_stats rail_stats;
+volatile unsigned char dccout_rail_sent;
+
+void dccout_stats_reset(void)
+{
+  DINT;
+  memset(&rail_stats, 0, sizeof(rail_stats));
+  rail_stats.start = dccout_time;
+  EINT;
+}
+#endif
+
+//-------------------------------------------------------------------------------------
+// Programming track
+//-------------------------------------------------------------------------------------
+// With DCC_PROG_TRACK the prog track has a generator of its own on ePWM4 (GPIO6/7),
+// fed by its own ring (dccgen.c): the service mode with long preambles, resets and
+// ack runs while the main track keeps its refresh. The isr is INTx4 of PIE group 3,
+// after the main isr (INTx3) if both are pending; it only sets the next period.
+// The track is switched by the trip zone of ePWM4 (one shot, both outputs low);
+// the generator keeps running, so a packet starts clean after power on.
+// Without DCC_PROG_TRACK the service mode runs on the main generator and the
+// prog track can not be switched (PROG_TRACK_STATE is 0).
+
+#if (DCC_PROG_TRACK == 1)
+
+#pragma CODE_SECTION(epwm_prog_isr, "ramfuncs");
+__interrupt void epwm_prog_isr(void)
+{
+  WATCHDOG_ISR(PM_ISR_DCC_PROG);
+
+  EPwm4Regs.ETCLR.bit.INT = 1;
+  PieCtrlRegs.PIEACK.all = PIEACK_GROUP3;
+
+  if (dg_bit(&prog_gen)) EPwm4Regs.TBPRD = 2630;      // 1: 58us per half bit
+  else                   EPwm4Regs.TBPRD = 5260;      // 0: 116us
+}
+
+void dcc_prog_track_on(void)
+{
+  EALLOW;
+  EPwm4Regs.TZCLR.bit.OST = 1;
+  EDIS;
+}
+
+void dcc_prog_track_off(void)
+{
+  EALLOW;
+  EPwm4Regs.TZFRC.bit.OST = 1;
+  EDIS;
+  DINT;
+  dg_flush(&prog_gen);                            // nothing left for the next power on
+  EINT;
+}
+
+unsigned char dcc_prog_track_state(void)
+{
+  return(!EPwm4Regs.TZFLG.bit.OST);
+}
+
+// 0: ring full
+unsigned char dccout_prog_put(t_message *msg)
+{
+  return(dg_put(&prog_gen, msg->dcc, msg->size, msg->repeat));
+}
+
+unsigned char dccout_prog_depth(void)
+{
+  return(dg_depth(&prog_gen));
+}
+
+unsigned char dccout_prog_repeat_left(void)
+{
+  return(dg_repeat_left(&prog_gen));
+}
+
+void dccout_prog_skip(void)
+{
+  dg_skip(&prog_gen);
+}
+
+void InitEPwm4(void)
+{
+  EALLOW;
+  SysCtrlRegs.PCLKCR0.bit.TBCLKSYNC = 0;
+  EDIS;
+
+  InitEPwm4Gpio();
+
+  // same time base as ePWM3, see there
+  EPwm4Regs.TBCTL.bit.PRDLD = 1;
+  EPwm4Regs.TBCTL.bit.CTRMODE = TB_COUNT_UPDOWN;
+  EPwm4Regs.TBPRD = 2630;
+  EPwm4Regs.TBCTL.bit.PHSEN = TB_DISABLE;
+  EPwm4Regs.TBPHS.half.TBPHS = 0x0000;
+  EPwm4Regs.TBCTR = 0x0000;
+  EPwm4Regs.TBCTL.bit.HSPCLKDIV = TB_DIV1;
+  EPwm4Regs.TBCTL.bit.CLKDIV = TB_DIV2;
+
+  EPwm4Regs.AQCTLA.all = 0;
+  EPwm4Regs.AQCTLB.all = 0;
+  EPwm4Regs.AQCTLA.bit.ZRO = AQ_SET;
+  EPwm4Regs.AQCTLA.bit.PRD = AQ_CLEAR;
+  EPwm4Regs.AQCTLB.bit.ZRO = AQ_SET;
+  EPwm4Regs.AQCTLB.bit.PRD = AQ_CLEAR;
+
+  EPwm4Regs.DBCTL.bit.OUT_MODE  = 3;
+  EPwm4Regs.DBCTL.bit.IN_MODE   = 0;
+  EPwm4Regs.DBCTL.bit.POLSEL    = 2;
+  EPwm4Regs.DBCTL.bit.HALFCYCLE = 0;
+  EPwm4Regs.DBRED = 20;
+  EPwm4Regs.DBFED = 20;
+
+  // track switch: one shot trip forces both outputs low, set by software only
+  EALLOW;
+  EPwm4Regs.TZSEL.all = 0;
+  EPwm4Regs.TZCTL.bit.TZA = TZ_FORCE_LO;
+  EPwm4Regs.TZCTL.bit.TZB = TZ_FORCE_LO;
+  EPwm4Regs.TZFRC.bit.OST = 1;                    // off
+  PieVectTable.EPWM4_INT = &epwm_prog_isr;
+  EDIS;
+
+  EPwm4Regs.ETSEL.bit.INTSEL = ET_CTR_ZERO;
+  EPwm4Regs.ETSEL.bit.INTEN = 1;
+  EPwm4Regs.ETPS.bit.INTPRD = ET_1ST;
+
+  IER |= M_INT3;
+  PieCtrlRegs.PIEIER3.bit.INTx4 = 1;              // epwm4
+
+  EALLOW;
+  SysCtrlRegs.PCLKCR0.bit.TBCLKSYNC = 1;
+  EDIS;
+} // InitEPwm4
+
+#else
+
+void dcc_prog_track_on(void)
+{
+}
+
+void dcc_prog_track_off(void)
+{
+}
+
+#pragma CODE_SECTION(dcc_prog_track_state, "ramfuncs");     // asked by the dcc isr
+unsigned char dcc_prog_track_state(void)
+{
+  return(0);
+}
+
+#endif // DCC_PROG_TRACK
+
+#if (DCC_DISTRICTS > 1)
+//-------------------------------------------------------------------------------------
+// Power districts
+//-------------------------------------------------------------------------------------
+// District 0 is the main output above. Districts 1..3 have a generator each (see
+// district.c for their streams): ePWM5 (GPIO8/9), ePWM6 (GPIO10/11) and ePWM8
+// (GPIO42/43); ePWM7A would be GPIO40, the main track enable. The isrs are INTx5,
+// INTx6 and INTx8 of PIE group 3, after main and prog.
+// The fault output of the booster (active low) goes to TZ1..3 (GPIO12..14): the
+// trip zone of the district cuts its output at once, one shot, without the cpu;
+// district_check sees it in TZFLG. Software off is the same one shot, forced.
+
+static volatile struct EPWM_REGS * const district_pwm[DISTRICT_MAX] =
+  {
+    0,                                            // main: ePWM3
+    &EPwm5Regs,
+    &EPwm6Regs,
+    &EPwm8Regs
+  };
+
+#pragma CODE_SECTION(epwm_district1_isr, "ramfuncs");
+__interrupt void epwm_district1_isr(void)
+{
+  WATCHDOG_ISR(PM_ISR_DISTRICT);
+
+  EPwm5Regs.ETCLR.bit.INT = 1;
+  PieCtrlRegs.PIEACK.all = PIEACK_GROUP3;
+
+  if (dg_bit(DISTRICT_GEN(1))) EPwm5Regs.TBPRD = 2630;    // 1: 58us per half bit
+  else                         EPwm5Regs.TBPRD = 5260;    // 0: 116us
+}
+
+#pragma CODE_SECTION(epwm_district2_isr, "ramfuncs");
+__interrupt void epwm_district2_isr(void)
+{
+  WATCHDOG_ISR(PM_ISR_DISTRICT + 1);
+
+  EPwm6Regs.ETCLR.bit.INT = 1;
+  PieCtrlRegs.PIEACK.all = PIEACK_GROUP3;
+
+  if (dg_bit(DISTRICT_GEN(2))) EPwm6Regs.TBPRD = 2630;
+  else                         EPwm6Regs.TBPRD = 5260;
+}
+
+#pragma CODE_SECTION(epwm_district3_isr, "ramfuncs");
+__interrupt void epwm_district3_isr(void)
+{
+  WATCHDOG_ISR(PM_ISR_DISTRICT + 2);
+
+  EPwm8Regs.ETCLR.bit.INT = 1;
+  PieCtrlRegs.PIEACK.all = PIEACK_GROUP3;
+
+  if (dg_bit(DISTRICT_GEN(3))) EPwm8Regs.TBPRD = 2630;
+  else                         EPwm8Regs.TBPRD = 5260;
+}
+
+void district_hw_on(unsigned char d)
+{
+  EALLOW;
+  district_pwm[d]->TZCLR.bit.OST = 1;             // trips again at once if the fault is still there
+  EDIS;
+}
+
+void district_hw_off(unsigned char d)
+{
+  EALLOW;
+  district_pwm[d]->TZFRC.bit.OST = 1;
+  EDIS;
+}
+
+unsigned char district_hw_tripped(unsigned char d)
+{
+  return(district_pwm[d]->TZFLG.bit.OST);
+}
+
+unsigned char district_hw_fault(unsigned char d)
+{
+  return(!(GpioDataRegs.GPADAT.all & (1UL << (11 + d))));     // GPIO12..14, low active
+}
+
+static void InitEPwmDistrict(unsigned char d)
+{
+  volatile struct EPWM_REGS *pwm = district_pwm[d];
+
+  EALLOW;
+  SysCtrlRegs.PCLKCR0.bit.TBCLKSYNC = 0;
+  EDIS;
+
+  EALLOW;
+  switch(d)
+  {
+    case 1:
+      InitEPwm5Gpio();
+      GpioCtrlRegs.GPAPUD.bit.GPIO12 = 0;         // pullup: no booster, no fault
+      GpioCtrlRegs.GPAQSEL1.bit.GPIO12 = 3;       // async: the trip needs no sysclk samples
+      GpioCtrlRegs.GPAMUX1.bit.GPIO12 = 1;        // TZ1
+      PieVectTable.EPWM5_INT = &epwm_district1_isr;
+      PieCtrlRegs.PIEIER3.bit.INTx5 = 1;
+      break;
+    case 2:
+      InitEPwm6Gpio();
+      GpioCtrlRegs.GPAPUD.bit.GPIO13 = 0;
+      GpioCtrlRegs.GPAQSEL1.bit.GPIO13 = 3;
+      GpioCtrlRegs.GPAMUX1.bit.GPIO13 = 1;        // TZ2
+      PieVectTable.EPWM6_INT = &epwm_district2_isr;
+      PieCtrlRegs.PIEIER3.bit.INTx6 = 1;
+      break;
+    case 3:
+      InitEPwm8Gpio();
+      GpioCtrlRegs.GPAPUD.bit.GPIO14 = 0;
+      GpioCtrlRegs.GPAQSEL1.bit.GPIO14 = 3;
+      GpioCtrlRegs.GPAMUX1.bit.GPIO14 = 1;        // TZ3
+      PieVectTable.EPWM8_INT = &epwm_district3_isr;
+      PieCtrlRegs.PIEIER3.bit.INTx8 = 1;
+      break;
+  }
+  EDIS;
+
+  // same time base as ePWM3, see there
+  pwm->TBCTL.bit.PRDLD = 1;
+  pwm->TBCTL.bit.CTRMODE = TB_COUNT_UPDOWN;
+  pwm->TBPRD = 2630;
+  pwm->TBCTL.bit.PHSEN = TB_DISABLE;
+  pwm->TBPHS.half.TBPHS = 0x0000;
+  pwm->TBCTR = 0x0000;
+  pwm->TBCTL.bit.HSPCLKDIV = TB_DIV1;
+  pwm->TBCTL.bit.CLKDIV = TB_DIV2;
+
+  pwm->AQCTLA.all = 0;
+  pwm->AQCTLB.all = 0;
+  pwm->AQCTLA.bit.ZRO = AQ_SET;
+  pwm->AQCTLA.bit.PRD = AQ_CLEAR;
+  pwm->AQCTLB.bit.ZRO = AQ_SET;
+  pwm->AQCTLB.bit.PRD = AQ_CLEAR;
+
+  pwm->DBCTL.bit.OUT_MODE  = 3;
+  pwm->DBCTL.bit.IN_MODE   = 0;
+  pwm->DBCTL.bit.POLSEL    = 2;
+  pwm->DBCTL.bit.HALFCYCLE = 0;
+  pwm->DBRED = 20;
+  pwm->DBFED = 20;
+
+  // one shot trip by TZ1..3 of the district, both outputs low
+  EALLOW;
+  pwm->TZSEL.all = 0x0100 << (d - 1);             // OSHT1..3
+  pwm->TZCTL.bit.TZA = TZ_FORCE_LO;
+  pwm->TZCTL.bit.TZB = TZ_FORCE_LO;
+  pwm->TZFRC.bit.OST = 1;                         // off
+  EDIS;
+
+  pwm->ETSEL.bit.INTSEL = ET_CTR_ZERO;
+  pwm->ETSEL.bit.INTEN = 1;
+  pwm->ETPS.bit.INTPRD = ET_1ST;
+
+  IER |= M_INT3;
+
+  EALLOW;
+  SysCtrlRegs.PCLKCR0.bit.TBCLKSYNC = 1;
+  EDIS;
+} // InitEPwmDistrict
+
+#endif // DCC_DISTRICTS
+
 //-------------------------------------------------------------------------------------
 // RailCom Interface
 //-------------------------------------------------------------------------------------
@@ -31,6 +31,7 @@ struct next_message_s
   {
     unsigned char size;
     t_msg_type    type;
+    t_msg_source  source;                   // for rail statistic
     unsigned char dcc[MAX_DCC_SIZE];
   };
 
@@ -41,10 +42,59 @@ extern unsigned char next_message_count;     // load message and set count
 											   // if = 0 -> ready for next_message
 
 void init_dccout(void);                      // call once at boot up
+
+// power up: DCCOUT_STARTUP_RESETS resets (none if warm), then idle until startup_done
+
+#define DCCOUT_STARTUP_RESETS  20
+
+void dccout_startup(unsigned char warm);
+void dccout_startup_done(void);
 void dccout_enable_cutout(void);             // create railcom cutout
 void dccout_disable_cutout(void);
 unsigned char dccout_query_cutout(void);
 
+// emergency stop, bypassing the organizer queues:
+// the ISR sends DCCOUT_ESTOP_REPEAT broadcast stops right after the end bit
+// of the current packet. Latency (reception of the stop command until end bit
+// of the first stop packet) is measured in us.
+
+#define DCCOUT_ESTOP_REPEAT  3
+
+void dccout_estop_received(uint32_t at);        // TB_CLOCK32 of the command, before the stop
+void dccout_emergency_stop(void);
+extern unsigned int dccout_estop_latency;       // last measured latency in us
+extern unsigned int dccout_estop_latency_max;   // worst case since boot in us
+
+extern uint32_t dccout_time;                    // DCC signal time since boot in us
+
+#if (DCC_RAIL_STATS == 1)
+// rail statistic: the ISR adds the rail time of each packet (preamble to end bit)
+// to the counters of its source and type; all times in us.
+// the remaining time of the window was filled with '1' bits (no packet at all).
+
+typedef struct
+  {
+    uint32_t start;                             // dccout_time at begin of window
+    uint32_t time[NUM_MSG_SOURCE];              // rail time per source
+    uint32_t packets[NUM_MSG_SOURCE];           // packets per source
+    uint32_t type_time[NUM_MSG_TYPE];           // rail time per t_msg_type
+  } t_rail_stats;
+
+extern t_rail_stats rail_stats;
+extern volatile unsigned char dccout_rail_sent; // sends of next_message taken by the isr,
+                                                // read and cleared by the organizer (rail_top)
+
+void dccout_stats_reset(void);                  // start a new window
+#endif
+
+#if (DCC_PROG_TRACK == 1)
+// programming track: second generator with its own ring (dccgen.c)
+unsigned char dccout_prog_put(t_message *msg);  // 0: ring full
+unsigned char dccout_prog_depth(void);          // packets waiting in the ring
+unsigned char dccout_prog_repeat_left(void);    // sends of the packet on the rails still to come
+void dccout_prog_skip(void);                    // ack received: no more repetitions
+#endif
+
 void dcc_main_track_on(void);
 void dcc_main_track_off(void);
 void dcc_prog_track_on(void);
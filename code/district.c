@@ -0,0 +1,304 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      district.c
+// history:   power districts with own packet streams started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   streams and short handling of the power districts
+//
+// how:       The organizer feeds main (next_message) as before; every
+//            packet which goes to main is copied (district_mirror):
+//            - a mirror district gets all of them, it runs the same
+//              stream as main, only later by the depth of its ring
+//            - a filtered district gets broadcasts and accessory packets
+//            A loco routed to a filtered district (district_route) is not
+//            sent on main at all: the organizer puts its commands into
+//            the ring of the district (district_put) and refreshes it
+//            there, when district_wants_refresh. So a yard full of locos
+//            does not take refresh time from the main line.
+//            The routes are set by the pc, which knows where the locos
+//            are; a loco without route runs on main and the mirrors.
+//
+//            Short: the fault input of a district cuts its output in the
+//            hardware (trip zone), without the cpu. district_check then
+//            works like main_short_check of main_short.c: within the ignore
+//            time the output is switched on again when the input is
+//            clear; a short lasting longer gets three attempts of fast
+//            recovery, then the district stays off (DS_SHORT) until
+//            power off / on or district_set_power. The other districts
+//            and main go on.
+//
+//-----------------------------------------------------------------
+
+#include <stdint.h>
+#include "dccgen.h"
+#include "district.h"
+
+#define RECOVER_OFF_MS      4       // as FAST_RECOVER_OFF_TIME of status.c
+#define RECOVER_ON_MS       1
+#define RECOVER_ATTEMPTS    3
+
+t_district district[DISTRICT_MAX - 1];
+
+static unsigned char district_num;              // incl. main
+static unsigned char short_ignore_ms;
+
+static unsigned int route_addr[DISTRICT_ROUTES];    // 0: free
+static unsigned char route_district[DISTRICT_ROUTES];
+
+void district_init(unsigned char count)
+  {
+    unsigned char d, i;
+
+    if (count > DISTRICT_MAX) count = DISTRICT_MAX;
+    if (count < 1) count = 1;
+    district_num = count;
+    short_ignore_ms = 0;
+
+    for (d=1; d<DISTRICT_MAX; d++)
+      {
+        dg_init(DISTRICT_GEN(d), DG_PREAMBLE_MAIN);
+        district[d-1].mode = DISTRICT_MIRROR;
+        district[d-1].enabled = 1;
+        district[d-1].state = DS_OFF;
+        district[d-1].attempts = 0;
+        district[d-1].since = 0;
+        district[d-1].trips = 0;
+        district[d-1].shorts = 0;
+        district[d-1].lost = 0;
+      }
+    for (i=0; i<DISTRICT_ROUTES; i++)
+      {
+        route_addr[i] = 0;
+        route_district[i] = 0;
+      }
+  }
+
+void district_short_time(unsigned char ms)
+  {
+    short_ignore_ms = ms;
+  }
+
+unsigned char district_count(void)
+  {
+    return(district_num);
+  }
+
+static void power(unsigned char d, unsigned char on)
+  {
+    if (on)
+      {
+        district[d-1].state = DS_ON;
+        district_hw_on(d);
+      }
+    else
+      {
+        district[d-1].state = DS_OFF;
+        district_hw_off(d);
+      }
+  }
+
+// with the main track; a district with a short needs power off / on
+void district_power(unsigned char on)
+  {
+    unsigned char d;
+
+    for (d=1; d<district_num; d++)
+      {
+        if (!district[d-1].enabled) continue;
+        if (on && (district[d-1].state != DS_OFF)) continue;
+        power(d, on);
+      }
+  }
+
+// by the pc: off until it is enabled again
+unsigned char district_set_power(unsigned char d, unsigned char on)
+  {
+    if ((d == 0) || (d >= district_num)) return(0);
+    district[d-1].enabled = on;
+    power(d, on);
+    return(1);
+  }
+
+unsigned char district_set_mode(unsigned char d, unsigned char mode)
+  {
+    if ((d == 0) || (d >= district_num)) return(0);
+    if ((mode != DISTRICT_MIRROR) && (mode != DISTRICT_FILTERED)) return(0);
+    district[d-1].mode = mode;
+    return(1);
+  }
+
+// d = 0: back to main; returns 0 if d is no district or the table is full
+unsigned char district_route(unsigned int addr, unsigned char d)
+  {
+    unsigned char i, free = DISTRICT_ROUTES;
+
+    if ((addr == 0) || (d >= district_num)) return(0);
+    for (i=0; i<DISTRICT_ROUTES; i++)
+      {
+        if (route_addr[i] == addr)
+          {
+            if (d == 0) route_addr[i] = 0;
+            else route_district[i] = d;
+            return(1);
+          }
+        if ((route_addr[i] == 0) && (free == DISTRICT_ROUTES)) free = i;
+      }
+    if (d == 0) return(1);                      // had no route
+    if (free == DISTRICT_ROUTES) return(0);
+    route_district[free] = d;
+    route_addr[free] = addr;
+    return(1);
+  }
+
+// filtered district of this loco; 0: main (also if routed to a mirror)
+unsigned char district_of(unsigned int addr)
+  {
+    unsigned char i, d;
+
+    if (addr == 0) return(0);
+    for (i=0; i<DISTRICT_ROUTES; i++)
+      {
+        if (route_addr[i] != addr) continue;
+        d = route_district[i];
+        if (district[d-1].mode == DISTRICT_FILTERED) return(d);
+        return(0);
+      }
+    return(0);
+  }
+
+// 1..127: short address, 192..231: long address
+unsigned int district_loco_addr(const unsigned char *dcc)
+  {
+    if ((dcc[0] > 0) && (dcc[0] < 128)) return(dcc[0]);
+    if ((dcc[0] >= 192) && (dcc[0] < 232)) return(((unsigned int)(dcc[0] & 0x3F) << 8) | dcc[1]);
+    return(0);
+  }
+
+void district_put(unsigned char d, const unsigned char *dcc, unsigned char size)
+  {
+    if (!dg_put(DISTRICT_GEN(d), dcc, size, 1)) district[d-1].lost++;
+  }
+
+// dcc without xor
+void district_mirror(const unsigned char *dcc, unsigned char size)
+  {
+    unsigned char d, all;
+
+    all = (dcc[0] == 0) || ((dcc[0] >= 128) && (dcc[0] < 192));     // broadcast, accessory
+    for (d=1; d<district_num; d++)
+      {
+        if ((district[d-1].mode == DISTRICT_MIRROR) || all) district_put(d, dcc, size);
+      }
+  }
+
+unsigned char district_wants_refresh(unsigned char d)
+  {
+    if (district[d-1].mode != DISTRICT_FILTERED) return(0);
+    return(dg_depth(DISTRICT_GEN(d)) < DISTRICT_REFRESH);
+  }
+
+// the pending packets were built before the stop and would restart the
+// locos: drop them, the stop follows the packet on the rails
+void district_estop(void)
+  {
+    static unsigned char stop[2] = {0x00, 0x71};       // as dcc_bc_stop of dccout.c
+    unsigned char d;
+
+    for (d=1; d<district_num; d++)
+      {
+        dg_flush(DISTRICT_GEN(d));
+        dg_put(DISTRICT_GEN(d), stop, 2, DISTRICT_ESTOP);
+      }
+  }
+
+// every ms; returns bit d set for each district which went to DS_SHORT now
+unsigned int district_check(uint32_t now)
+  {
+    t_district *p;
+    unsigned char d;
+    unsigned int shorted = 0;
+
+    for (d=1; d<district_num; d++)
+      {
+        p = &district[d-1];
+        switch(p->state)
+          {
+            case DS_OFF:
+            case DS_SHORT:
+                break;
+            case DS_ON:
+                if (district_hw_tripped(d))
+                  {
+                    p->trips++;
+                    p->state = DS_IGNORE;
+                    p->since = now;
+                  }
+                break;
+            case DS_IGNORE:
+                // cut already: on again as soon as the input is clear, the
+                // hardware cuts again if the short is still there
+                if ((now - p->since) > short_ignore_ms)
+                  {
+                    if (district_hw_tripped(d) || district_hw_fault(d))
+                      {
+                        district_hw_off(d);
+                        p->attempts = RECOVER_ATTEMPTS;
+                        p->state = DS_RECOVER_OFF;
+                        p->since = now;
+                      }
+                    else
+                      {
+                        p->state = DS_ON;
+                      }
+                  }
+                else if (district_hw_tripped(d) && !district_hw_fault(d))
+                  {
+                    district_hw_on(d);
+                  }
+                break;
+            case DS_RECOVER_OFF:
+                if ((now - p->since) > RECOVER_OFF_MS)
+                  {
+                    district_hw_on(d);
+                    p->state = DS_RECOVER_ON;
+                    p->since = now;
+                  }
+                break;
+            case DS_RECOVER_ON:
+                if ((now - p->since) > RECOVER_ON_MS)
+                  {
+                    if (district_hw_tripped(d) || district_hw_fault(d))
+                      {
+                        district_hw_off(d);
+                        p->state = DS_RECOVER_OFF;
+                        p->since = now;
+                        if (--p->attempts == 0)
+                          {
+                            p->state = DS_SHORT;
+                            p->shorts++;
+                            shorted |= 1 << d;
+                          }
+                      }
+                    else
+                      {
+                        p->state = DS_ON;
+                      }
+                  }
+                break;
+          }
+      }
+    return(shorted);
+  }
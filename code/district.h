@@ -0,0 +1,109 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      district.h
+// history:   power districts with own packet streams started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   power districts: district 0 is the main output of dccout.c,
+//            districts 1..n-1 have a generator (dccgen.c) and a short
+//            check of their own.
+//            No device registers and no config.h: the same source is
+//            compiled by tools/dccwave.c on the host.
+//
+// interface upstream:
+//            district_init(count)          // all off, no routes, mirror
+//            district_short_time(ms)       // ignore time of a short
+//            district_power(on)            // with main: the enabled ones, not the shorted
+//            district_set_power(d, on)     // enable one district, clears a short
+//            district_set_mode(d, mode)    // mirror or filtered
+//            district_route(addr, d)       // loco to district d, 0: main
+//            district_of(addr)             // filtered district of a loco, 0: main
+//            district_loco_addr(dcc)       // loco address of a packet, 0: none
+//            district_mirror(dcc, size)    // packet goes to main: copy it
+//            district_put(d, dcc, size)    // packet for a filtered district
+//            district_wants_refresh(d)     // ring of district d runs low
+//            district_estop()              // stop broadcast to all, isr blocked
+//            district_check(now)           // short handling, new shorts as bit mask
+//
+// interface downstream (dccout.c on the target, the tool on the host):
+//            district_hw_on(d)             // output on, hardware trip armed
+//            district_hw_off(d)
+//            district_hw_tripped(d)        // output was cut by its fault input
+//            district_hw_fault(d)          // fault input active now
+//
+//-----------------------------------------------------------------
+#ifndef __DISTRICT_H__
+#define __DISTRICT_H__
+
+#include <stdint.h>
+#include "dccgen.h"
+
+#ifndef DISTRICT_MAX
+#define DISTRICT_MAX        4       // outputs incl. main; TAPAS: ePWM3, 5, 6, 8
+#endif
+#define DISTRICT_ROUTES     16      // locos with a district of their own
+#define DISTRICT_REFRESH    2       // filtered: refresh while the ring has less
+#define DISTRICT_ESTOP      3       // stop packets, as DCCOUT_ESTOP_REPEAT
+
+typedef enum {DISTRICT_MIRROR,      // all packets of main
+              DISTRICT_FILTERED     // only its own locos, broadcasts, accessories
+             } t_district_mode;
+
+typedef enum {DS_OFF,               // switched off
+              DS_ON,
+              DS_IGNORE,            // cut by the hardware, within the ignore time
+              DS_RECOVER_OFF,       // fast recovery: off for a while ...
+              DS_RECOVER_ON,        // ... and on again for a test
+              DS_SHORT              // off until power off / on
+             } t_district_state;
+
+typedef struct
+  {
+    t_dg_channel gen;               // bit stream, dg_bit by the isr of the output
+    unsigned char mode;             // t_district_mode
+    unsigned char enabled;          // 0: switched off by the pc, not with main
+    unsigned char state;            // t_district_state
+    unsigned char attempts;         // fast recovery attempts left
+    uint32_t since;                 // ms, begin of the state
+    unsigned int trips;             // cut by the hardware, since boot
+    unsigned int shorts;            // went to DS_SHORT, since boot
+    unsigned int lost;              // packets dropped: ring full
+  } t_district;
+
+// district d is district[d-1]; the main output has no entry
+extern t_district district[DISTRICT_MAX - 1];
+#define DISTRICT_GEN(d)     (&district[(d) - 1].gen)
+
+void district_init(unsigned char count);
+void district_short_time(unsigned char ms);
+unsigned char district_count(void);
+void district_power(unsigned char on);
+unsigned char district_set_power(unsigned char d, unsigned char on);
+unsigned char district_set_mode(unsigned char d, unsigned char mode);
+unsigned char district_route(unsigned int addr, unsigned char d);
+unsigned char district_of(unsigned int addr);
+unsigned int district_loco_addr(const unsigned char *dcc);
+void district_mirror(const unsigned char *dcc, unsigned char size);
+void district_put(unsigned char d, const unsigned char *dcc, unsigned char size);
+unsigned char district_wants_refresh(unsigned char d);
+void district_estop(void);
+unsigned int district_check(uint32_t now);
+
+void district_hw_on(unsigned char d);
+void district_hw_off(unsigned char d);
+unsigned char district_hw_tripped(unsigned char d);
+unsigned char district_hw_fault(unsigned char d);
+
+#endif // __DISTRICT_H__
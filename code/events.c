@@ -0,0 +1,102 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      events.c
+// history:   event ring started, replaces status_event
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   ring of events with payload
+//
+// how:       Producers write to a ring of SIZE_EVENT_RING entries with a
+//            free running sequence no (event_head). Nobody removes an
+//            event: every consumer keeps its own cursor (the sequence no
+//            of its next event) and reads at its own pace, so no consumer
+//            takes an event away from another one.
+//            A consumer which falls back more than SIZE_EVENT_RING events
+//            gets EV_LOST once and continues with the oldest event still
+//            in the ring; it should then read the state again.
+//            event_get costs O(1), also when there is nothing to read.
+//            All producers and consumers run in the main loop, no locking.
+//            The tasks of the consumers (event_notify) are made ready by
+//            every event_post, so they run only when there is something.
+//
+//-----------------------------------------------------------------
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "config.h"                // general structures and definitions
+#include "events.h"
+
+#if ((SIZE_EVENT_RING & (SIZE_EVENT_RING-1)) != 0)
+  #error SIZE_EVENT_RING must be a power of 2
+#endif
+
+t_event event_ring[SIZE_EVENT_RING];
+unsigned int event_head;                // sequence no of the next event to write
+static unsigned int event_waiters;      // bit per t_sched_task
+
+void init_events(void)
+  {
+    event_head = 0;                     // cursors of 0 start with the first event
+    event_waiters = 0;
+  }
+
+void event_post(t_event_type type, unsigned int a, unsigned int b)
+  {
+    t_event *ev;
+    unsigned char i;
+
+    ev = &event_ring[event_head & (SIZE_EVENT_RING-1)];
+    ev->type = type;
+    ev->a = a;
+    ev->b = b;
+    event_head++;
+
+    for (i=0; i<NUM_SCHED_TASK; i++)
+      {
+        if (event_waiters & (1 << i)) sched_ready((t_sched_task)i);
+      }
+  }
+
+unsigned char event_get(t_event_cursor *cursor, t_event *ev)
+  {
+    unsigned int behind;
+
+    behind = event_head - *cursor;
+    if (behind == 0) return(0);
+    if (behind > SIZE_EVENT_RING)
+      {
+        *cursor = event_head - SIZE_EVENT_RING;
+        ev->type = EV_LOST;
+        ev->a = behind - SIZE_EVENT_RING;
+        ev->b = 0;
+        return(1);
+      }
+    *ev = event_ring[*cursor & (SIZE_EVENT_RING-1)];
+    (*cursor)++;
+    return(1);
+  }
+
+void event_subscribe(t_event_cursor *cursor)
+  {
+    *cursor = event_head;
+  }
+
+void event_notify(t_sched_task task)
+  {
+    event_waiters |= 1 << task;
+  }
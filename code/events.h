@@ -0,0 +1,70 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      events.h
+// history:   event ring started, replaces status_event
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   ring of events with payload; every consumer reads with
+//            its own cursor
+//
+// interface upstream:
+//            init_events(void)         // call once, before the first event_post
+//            event_post(type, a, b)    // producer, main context only
+//            event_get(cursor, ev)     // consumer, 1 if an event was read
+//            event_subscribe(cursor)   // late consumer: only new events
+//            event_notify(task)        // make task ready with every event
+//
+//-----------------------------------------------------------------
+#ifndef __EVENTS_H__
+#define __EVENTS_H__
+
+#include "scheduler.h"              // t_sched_task
+
+typedef enum
+  {
+    EV_LOST,            // a: no of events the consumer missed (ring overrun)
+    EV_STATE,           // a: new opendcc_state, b: old state
+    EV_SHORT,           // a: EV_SHORT_MAIN, EV_SHORT_PROG or EV_SHORT_DISTRICT (b: district)
+    EV_EXT_STOP,        // external stop input
+    EV_LOCO_STOLEN,     // a: loco addr, b: old slot << 8 | new slot
+    EV_TURNOUT,         // a: turnout addr, b: output
+    EV_PROG_RESULT,     // a: prog_result, b: prog_data
+    EV_CLOCK,           // a: fast clock in minutes of the week, b: ratio
+    EV_ROUTE,           // a: route, b: setting time in ms or ROUTE_FAILED
+    EV_WATCHDOG         // a: watchdog resets, b: t_pm_reason
+  } t_event_type;
+
+#define EV_SHORT_MAIN   0
+#define EV_SHORT_PROG   1
+#define EV_SHORT_DISTRICT 2
+
+typedef struct
+  {
+    unsigned char type;                 // t_event_type
+    unsigned int  a;
+    unsigned int  b;
+  } t_event;
+
+// sequence no of the next event to read; a cursor of 0 (static init)
+// starts with the first event after reset
+typedef unsigned int t_event_cursor;
+
+void init_events(void);
+void event_post(t_event_type type, unsigned int a, unsigned int b);
+unsigned char event_get(t_event_cursor *cursor, t_event *ev);
+void event_subscribe(t_event_cursor *cursor);
+void event_notify(t_sched_task task);
+
+#endif // __EVENTS_H__
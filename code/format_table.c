@@ -0,0 +1,87 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      format_table.c
+// history:   sorted format table out of database.c
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   table of locos with a format other than default
+//
+// how:       the entries are sorted by address; lookup is a binary
+//            search: 5 steps at 16 entries, 13 at 4096. A new entry or
+//            a removed one moves the entries behind it (memmove).
+//
+//-----------------------------------------------------------------
+
+#include <string.h>
+#include "format_table.h"
+
+// binary search
+// return: index of addr, or index where addr has to be inserted
+unsigned int ft_find(t_format_table *t, unsigned int addr)
+{
+  unsigned int low, high, mid;
+
+  low = 0;
+  high = t->count;
+  while (low < high)
+    {
+      mid = (low + high) / 2;
+      if ((t->entry[mid] & FT_ADDR_MASK) < addr) low = mid + 1;
+      else high = mid;
+    }
+  return(low);
+}
+
+// return: format of loco, FT_VOID if not in table
+unsigned char ft_lookup(t_format_table *t, unsigned int addr)
+{
+  unsigned int i;
+
+  i = ft_find(t, addr);
+  if ((i < t->count) && ((t->entry[i] & FT_ADDR_MASK) == addr))
+    {
+      return(t->entry[i] >> FT_SHIFT);
+    }
+  return(FT_VOID);
+}
+
+// enter addr; the default format dflt removes the entry
+// return: 0 if table is full
+unsigned char ft_set(t_format_table *t, unsigned int addr, unsigned char format, unsigned char dflt)
+{
+  unsigned int i;
+  unsigned char found;
+
+  i = ft_find(t, addr);
+  found = (i < t->count) && ((t->entry[i] & FT_ADDR_MASK) == addr);
+
+  if (format == dflt)
+    {
+      if (found)
+        {
+          t->count--;
+          memmove(&t->entry[i], &t->entry[i+1], (t->count - i) * sizeof(t->entry[0]));
+        }
+      return(1);
+    }
+  if (!found)
+    {
+      if (t->count == t->size) return(0);
+      memmove(&t->entry[i+1], &t->entry[i], (t->count - i) * sizeof(t->entry[0]));
+      t->count++;
+    }
+  t->entry[i] = ((unsigned int)format << FT_SHIFT) | addr;
+  return(1);
+}
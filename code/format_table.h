@@ -0,0 +1,48 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      format_table.h
+// history:   sorted format table out of database.c
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   table of locos with a format other than default, sorted by
+//            address. No device registers and no config.h: the same
+//            source is compiled by tools/formatbench.c on the host.
+//
+// interface upstream (database.c):
+//            ft_find(t, addr)              // index of addr or where it has to be inserted
+//            ft_lookup(t, addr)            // format, FT_VOID if not in table
+//            ft_set(t, addr, format, dflt) // enter; dflt removes the entry
+//
+//-----------------------------------------------------------------
+#ifndef __FORMAT_TABLE_H__
+#define __FORMAT_TABLE_H__
+
+// entry: upper 2 bits format, lower 14 bits address
+#define FT_ADDR_MASK        0x3FFF
+#define FT_SHIFT            14
+#define FT_VOID             0xFF        // not in table: loco has default format
+
+typedef struct
+  {
+    unsigned int *entry;                // set up by the caller
+    unsigned int size;                  // no of entries of *entry
+    unsigned int count;                 // no of used entries
+  } t_format_table;
+
+unsigned int ft_find(t_format_table *t, unsigned int addr);
+unsigned char ft_lookup(t_format_table *t, unsigned int addr);
+unsigned char ft_set(t_format_table *t, unsigned int addr, unsigned char format, unsigned char dflt);
+
+#endif // __FORMAT_TABLE_H__
@@ -86,9 +86,11 @@
 #define MAIN_TRACK_ON     (GpioDataRegs.GPBCLEAR.bit.GPIO40 = 1)
 #define MAIN_TRACK_OFF    (GpioDataRegs.GPBSET.bit.GPIO40 = 1)
 #define MAIN_TRACK_STATE  (!GpioDataRegs.GPBDAT.bit.GPIO40)
-#define PROG_TRACK_ON    
-#define PROG_TRACK_OFF   
-#define PROG_TRACK_STATE  (0)
+// prog track: own generator on ePWM4, switched by its trip zone (dccout.c);
+// without DCC_PROG_TRACK these do nothing and the state is 0
+#define PROG_TRACK_ON     dcc_prog_track_on()
+#define PROG_TRACK_OFF    dcc_prog_track_off()
+#define PROG_TRACK_STATE  (dcc_prog_track_state())
 
 //sds 201611 : NMAIN_SHORT, NPROG_SHORT, zijn active low
 //sds 201611 : ACK_DETECTED active high
@@ -104,8 +106,15 @@
 #define MAIN_IS_SHORT    (GpioDataRegs.GPBDAT.bit.GPIO54 == 1)
 // TAPAS : not implemented in demo
 #define PROG_IS_SHORT    0
-#define ACK_IS_DETECTED  0
 #define EXT_STOP_ACTIVE  0
+// TAPAS : ACK_IS_DETECTED comes from the prog current, see current.h
+
+// current sense (CURRENT_SENSE in config.h): adc inputs and scale
+// not yet on the TAPAS board: inputs and scale are the planned ones
+#define CURRENT_ADC_MAIN     0          // ADCINA0
+#define CURRENT_ADC_PROG     1          // ADCINA1
+#define CURRENT_OFFSET       0          // adc counts at zero current
+#define CURRENT_UA_PER_LSB   806L       // 1V/A sense: 3.3V / 4096
 
 #endif   // hardware.h
 
@@ -5,6 +5,10 @@
 #include "config.h" 
 #include <string.h>
 #include "keys.h"
+#include "scheduler.h"
+#include "timebase.h"
+#include "timerwheel.h"
+#include "watchdog.h"
 
 /*
 rotary encoder : 
@@ -17,22 +21,67 @@ typedef enum {UP, DEBOUNCING_DOWN, DOWN, LONG_DOWN, DEBOUNCING_UP} debounceState
 
 typedef struct
 {
-  //uint8_t Pin; // index in deze array is dezelfde als in keys[i].Pin === keypins[i]
   debounceState_t State;
-  uint32_t LastMillis;
-  //uint8_t Key; // index in deze array is de keycode
+  uint32_t Edge;      // TB_CLOCK32() van de laatste flank
+  uint8_t Level;      // niveau na de laatste flank, 0 = ingedrukt
 } debouncedKey_t;
 
 // de index in deze array komt overeen met de keycode 
 debouncedKey_t keys[NUMBER_OF_DEBOUNCED_KEYS] = {0};
-volatile int turns; // aantal turns gedetecteerd vooraleer de main loop er iets mee doet
 
-static void detect_keys (void);
+// input ring: the isr's write (head), keys_Update reads (tail);
+// every index is written by one side only, so no DINT is needed
+#define KEYIN_ROT_CW    0     // encoder step
+#define KEYIN_ROT_CCW   1
+#define KEYIN_SW_DOWN   2     // edge of ROT_SW, level after the edge
+#define KEYIN_SW_UP     3
 
+#if ((SIZE_KEY_RING & (SIZE_KEY_RING-1)) != 0)
+  #error SIZE_KEY_RING must be a power of 2
+#endif
+
+typedef struct
+{
+  uint8_t What;       // KEYIN_xx
+  uint32_t Time;      // TB_CLOCK32() in the isr
+} keyInput_t;
+
+static keyInput_t keyRing[SIZE_KEY_RING];
+static volatile unsigned int keyHead;     // isr only
+static volatile unsigned int keyTail;     // keys_Update only
+unsigned int keys_Lost;                   // inputs dropped, ring was full
+
+static uint32_t rotLast;                  // time of the last encoder step
+static uint8_t rotLastWhat;
+static unsigned int rotVelocity;          // steps/s of the step in keys_Handler
+static t_tw_handle keysTimer = TW_NONE;   // wakes keys_Update for debounce and long press
+
+static uint32_t debounce_keys (uint32_t now);
+
+// xint1 and xint2 are both in PIE group 1 and do not nest: one producer
+// group 1 stays enabled while store.c writes the flash: isr's and keys_Push in RAM
+#pragma CODE_SECTION(keys_Push, "ramfuncs");
+static void keys_Push (uint8_t what)
+{
+  keyInput_t *in;
+
+  if ((keyHead - keyTail) >= SIZE_KEY_RING)
+  {
+    keys_Lost++;
+    return;
+  }
+  in = &keyRing[keyHead & (SIZE_KEY_RING-1)];
+  in->What = what;
+  in->Time = TB_CLOCK32();
+  keyHead++;                              // entry is complete
+  sched_ready(SCHED_KEYS);
+}
 
 // aangeroepen bij elke change van CLK
+#pragma CODE_SECTION(xint1_isr, "ramfuncs");
 __interrupt void xint1_isr(void)
 {
+  WATCHDOG_ISR(PM_ISR_ENCODER);
   // Acknowledge this interrupt to get more from group 1
   PieCtrlRegs.PIEACK.all = PIEACK_GROUP1;
 
@@ -45,23 +94,51 @@ __interrupt void xint1_isr(void)
   dt = digitalRead(PIN_ROT_DT);
   */
   if (clk == dt)
-    turns--;
+    keys_Push (KEYIN_ROT_CCW);
   else
-    turns++;
+    keys_Push (KEYIN_ROT_CW);
 } // xint1_isr
 
+// aangeroepen bij elke change van ROT_SW
+#pragma CODE_SECTION(xint2_isr, "ramfuncs");
+__interrupt void xint2_isr(void)
+{
+  WATCHDOG_ISR(PM_ISR_BUTTON);
+  PieCtrlRegs.PIEACK.all = PIEACK_GROUP1;
+
+  if (GpioDataRegs.GPADAT.bit.GPIO23 == 0)
+    keys_Push (KEYIN_SW_DOWN);
+  else
+    keys_Push (KEYIN_SW_UP);
+} // xint2_isr
+
+// timer wheel: a debounce or long press time is over
+static void keys_Wake (unsigned int arg)
+{
+  keysTimer = TW_NONE;
+  sched_ready(SCHED_KEYS);
+}
+
 void keys_Init (void)  
 {
+    keyHead = 0;                                // ring empty before the isr's are on
+    keyTail = 0;
+    keys_Lost = 0;
+    rotVelocity = 0;
+    rotLastWhat = KEYIN_ROT_CW;
+
     EALLOW;	// This is needed to write to EALLOW protected registers
     PieVectTable.XINT1 = &xint1_isr;
+    PieVectTable.XINT2 = &xint2_isr;
     EDIS;   // This is needed to disable write to EALLOW protected registers
 
     //
-    // Enable XINT1 and XINT2 in the PIE: Group 1 interrupt 4
+    // Enable XINT1 and XINT2 in the PIE: Group 1 interrupt 4 and 5
     // Enable INT1 which is connected to WAKEINT
     //
     PieCtrlRegs.PIECTRL.bit.ENPIE = 1;          // Enable the PIE block
     PieCtrlRegs.PIEIER1.bit.INTx4 = 1;          // Enable PIE Group 1 INT4
+    PieCtrlRegs.PIEIER1.bit.INTx5 = 1;          // Enable PIE Group 1 INT5
     IER |= M_INT1;                              // Enable CPU INT1
     EINT;                                       // Enable Global Interrupts
     
@@ -83,47 +160,104 @@ void keys_Init (void)
     GpioCtrlRegs.GPAMUX2.bit.GPIO23 = 0;        // GPIO
     GpioCtrlRegs.GPADIR.bit.GPIO23 = 0;         // input
     GpioCtrlRegs.GPAPUD.bit.GPIO23 = 1;         // disable pullup
+    GpioCtrlRegs.GPAQSEL2.bit.GPIO23 = 2;       // XINT Qual using 6 samples
 
-    GpioCtrlRegs.GPACTRL.bit.QUALPRD0 = 0xFF;
+    GpioCtrlRegs.GPACTRL.bit.QUALPRD2 = 0xFF;   // GPIO16..23: sample every 510 SYSCLK, 6 samples = 34us
 
     // configure XINT1
     GpioIntRegs.GPIOXINT1SEL.bit.GPIOSEL = 20;   // XINT1 is GPIO20
     XIntruptRegs.XINT1CR.bit.POLARITY = 3;      // Falling edge interrupt, 1 = rising edge, 3 = rising & falling
     XIntruptRegs.XINT1CR.bit.ENABLE = 1;        // Enable XINT1
 
+    // configure XINT2
+    GpioIntRegs.GPIOXINT2SEL.bit.GPIOSEL = 23;   // XINT2 is GPIO23
+    XIntruptRegs.XINT2CR.bit.POLARITY = 3;      // rising & falling
+    XIntruptRegs.XINT2CR.bit.ENABLE = 1;        // Enable XINT2
+
     EDIS;    
   /*
   pinMode(PIN_ROT_CLK,INPUT); // geen pullup van de arduino gebruiken, er zitten al 10K pullup op de module
   pinMode(PIN_ROT_DT,INPUT);  // geen pullup van de arduino gebruiken, er zitten al 10K pullup op de module
   attachInterrupt (0,isr,CHANGE);   // interrupt 0 is always connected to pin 2 on Arduino UNO
   */
+
+  // a key pressed at power up gives no edge: start from its level
+  keys[KEY_ENTER].Level = GpioDataRegs.GPADAT.bit.GPIO23;
+  keys[KEY_ENTER].Edge = TB_CLOCK32();
+  keys[KEY_ENTER].State = keys[KEY_ENTER].Level ? UP : DEBOUNCING_DOWN;
+  rotLast = TB_CLOCK32() - TB_MS(ROT_PAUSE);
   
 } // keys_Init
 
 void keys_Update (void)
 {
-  int copyTurns = 0;
+  keyInput_t in;
+  uint32_t dt, wait;
   uint8_t key;
 
-  DINT;
-  if (copyTurns != turns)
+  while (keyTail != keyHead)
   {
-    // isr heeft een beweging gedetecteerd
-    copyTurns = turns;
-    turns = 0;
-    EINT;
-    if (copyTurns > 0) key = KEY_ROTUP;
-    else if (copyTurns < 0) key = KEY_ROTDOWN;
-    if (keys_Handler)
-        keys_Handler (key | KEYEVENT_NONE );
+    in = keyRing[keyTail & (SIZE_KEY_RING-1)];
+    keyTail++;
+
+    if ((in.What == KEYIN_ROT_CW) || (in.What == KEYIN_ROT_CCW))
+    {
+      // velocity from the time between two steps in the same direction
+      dt = in.Time - rotLast;
+      if ((in.What != rotLastWhat) || (dt >= TB_MS(ROT_PAUSE)) || (dt == 0))
+        rotVelocity = 0;
+      else
+        rotVelocity = (unsigned int)((TB_MHZ * 1000000L) / dt);
+      rotLast = in.Time;
+      rotLastWhat = in.What;
+      key = (in.What == KEYIN_ROT_CW) ? KEY_ROTUP : KEY_ROTDOWN;
+      if (keys_Handler)
+        keys_Handler (key | KEYEVENT_NONE);
+    }
+    else
+    {
+      // debounce first with the time of this edge: a press shorter than
+      // DEBOUNCE_DELAY is seen, even if keys_Update comes late
+      debounce_keys (in.Time);
+      keys[KEY_ENTER].Edge = in.Time;
+      keys[KEY_ENTER].Level = (in.What == KEYIN_SW_UP);
+      switch (keys[KEY_ENTER].State)
+      {
+        case UP :
+          if (!keys[KEY_ENTER].Level) keys[KEY_ENTER].State = DEBOUNCING_DOWN;
+          break;
+        case DEBOUNCING_DOWN :
+          if (keys[KEY_ENTER].Level) keys[KEY_ENTER].State = UP;       // bounce
+          break;
+        case DOWN :
+        case LONG_DOWN :
+          if (keys[KEY_ENTER].Level) keys[KEY_ENTER].State = DEBOUNCING_UP;
+          break;
+        case DEBOUNCING_UP :
+          break;                                                        // wait for a stable level
+      }
+    }
   }
-  EINT;
 
-  // de button keys pollen en het debouncing state machine laten werken
-  detect_keys ();
+  wait = debounce_keys (TB_CLOCK32());
+
+  // no polling: the timer wheel calls again when the next time is over
+  if (keysTimer != TW_NONE)
+  {
+    tw_cancel (keysTimer);
+    keysTimer = TW_NONE;
+  }
+  if (wait)
+    keysTimer = tw_start ((unsigned int)(wait / TB_MS(TW_TICK_MS)) + 1, keys_Wake, 0);
  
 } // keys_Update
 
+// steps per second of the encoder step just handled, 0: first step after a pause
+unsigned int keys_RotVelocity (void)
+{
+  return (rotVelocity);
+} // keys_RotVelocity
+
 key_t keys_GetState (key_t key)
 {
     key_t keyCode;
@@ -137,70 +271,58 @@ key_t keys_GetState (key_t key)
 } // keys_GetState
 
 /****************************************************************************************/
+/* debounce from the edge times: a level is taken when it is stable for DEBOUNCE_DELAY */
+/* quick & dirty -> only ROT_SW for this demo                                          */
 /****************************************************************************************/
-/****************************************************************************************/
-/* quick & dirty -> only check ROT_SW for this demo */
-static void detect_keys (void)
+// return: time until the next decision, 0: none
+static uint32_t debounce_keys (uint32_t now)
 {
   int keycode;
+  uint32_t stable, wait;
+
+  wait = 0;
   for (keycode=0;keycode<NUMBER_OF_DEBOUNCED_KEYS;keycode++)
   {
+    stable = now - keys[keycode].Edge;
     switch(keys[keycode].State)
     {
       case UP : 
-        if (GpioDataRegs.GPADAT.bit.GPIO23 == 0 )
-        {
-          keys[keycode].LastMillis = millis();
-          keys[keycode].State = DEBOUNCING_DOWN;
-        }
+      case LONG_DOWN :
         break;
       case DEBOUNCING_DOWN :
-        if (GpioDataRegs.GPADAT.bit.GPIO23 != 0 )
+        if (stable < TB_MS(DEBOUNCE_DELAY))
         {
-          keys[keycode].State = UP;
+          wait = TB_MS(DEBOUNCE_DELAY) - stable;
+          break;
         }
-        else if ( (millis() - keys[keycode].LastMillis) > DEBOUNCE_DELAY )
-        {
-          keys[keycode].State = DOWN;
-          if (keys_Handler)
-            keys_Handler ( keycode | KEYEVENT_DOWN);
-        }
-        break;
+        keys[keycode].State = DOWN;
+        if (keys_Handler)
+          keys_Handler ( keycode | KEYEVENT_DOWN);
+        // no break: long press time runs from the edge
       case DOWN :
-        if (GpioDataRegs.GPADAT.bit.GPIO23 != 0 )
-        {
-          keys[keycode].State = DEBOUNCING_UP;
-          keys[keycode].LastMillis = millis();
-        }
-        else if ( (millis() - keys[keycode].LastMillis) > LONGPRESS_DELAY )
-        {
-          keys[keycode].State = LONG_DOWN;
-          if (keys_Handler)
-            keys_Handler (keycode | KEYEVENT_LONGDOWN);
-        }
-        break;
-      case LONG_DOWN :
-        if (GpioDataRegs.GPADAT.bit.GPIO23 != 0 )
+        if (stable < TB_MS(LONGPRESS_DELAY))
         {
-          keys[keycode].State = DEBOUNCING_UP;
-          keys[keycode].LastMillis = millis();
+          wait = TB_MS(LONGPRESS_DELAY) - stable;
+          break;
         }
+        keys[keycode].State = LONG_DOWN;
+        if (keys_Handler)
+          keys_Handler (keycode | KEYEVENT_LONGDOWN);
         break;
       case DEBOUNCING_UP :
-        if (GpioDataRegs.GPADAT.bit.GPIO23 == 0 )
-        {
-          keys[keycode].LastMillis = millis();
-        }
-        else if ( (millis() - keys[keycode].LastMillis) > DEBOUNCE_DELAY )
+        if (!keys[keycode].Level)
+          break;                          // pressed again, wait for the release edge
+        if (stable < TB_MS(DEBOUNCE_DELAY))
         {
-          keys[keycode].State = UP;
-          if (keys_Handler)
-            keys_Handler (keycode | KEYEVENT_UP);
+          wait = TB_MS(DEBOUNCE_DELAY) - stable;
+          break;
         }
+        keys[keycode].State = UP;
+        if (keys_Handler)
+          keys_Handler (keycode | KEYEVENT_UP);
         break;
     }
   }
-} // detect_keys
-
-
 
+  return (wait);
+} // debounce_keys
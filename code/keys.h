@@ -22,9 +22,15 @@ typedef uint8_t key_t;
 
 #define DEBOUNCE_DELAY 50
 #define LONGPRESS_DELAY 1000
+#define ROT_PAUSE 250     // ms; a step after a longer pause has velocity 0
 
 void keys_Init (void);
 void keys_Update (void);
+// steps/s of the encoder step in keys_Handler, from the isr time stamps
+unsigned int keys_RotVelocity (void);
+extern unsigned int keys_Lost;    // inputs dropped by the isr, ring was full
+// local ui: reads the events of the station (short)
+void ui_Update (void);
 // returns the key_state (UP, DOWN,LONGDOWN)
 key_t keys_GetState (key_t key);
 extern void keys_Handler( key_t key ) __attribute__ ((weak));
@@ -23,7 +23,7 @@
 //            init_parser(void)         // set up the queue structures
 //            run_parser(void)          // multitask replacement, must be called
 //                                      // every 20ms (approx)
-//            event_send(t_BC_message)
+//            event_send(state)         // broadcast of a state change
 //
 // interface downstream:
 //            rx_fifo_read()            // to rs232
@@ -45,6 +45,18 @@
 #include "status.h"                // timeout engine
 #include "organizer.h"
 #include "rs232.h"
+#include "ramp.h"
+#include "accessory.h"
+#include "store.h"
+#include "database.h"              // loco names
+#include "profile.h"               // cycle profile
+#include "boot.h"                  // boot time stamps
+#include "snapshot.h"              // warm start
+#include "current.h"               // track current
+#include "events.h"                // state, route and stolen loco events
+#include "scheduler.h"             // ready on rx, statistic
+#include "watchdog.h"              // post mortem
+#include "district.h"              // power districts
 
 #if (PARSER == LENZ)
 
@@ -66,6 +78,8 @@ unsigned char pcc[16];          // pc_message speicher
 
 unsigned char pcc_size, pcc_index;
 
+t_event_cursor parser_events;   // 0: we report from reset on
+
 //------------------------------------------------------------------------------
 // predefined pc_messages:
 
@@ -138,9 +152,9 @@ void pc_send_lenz(unsigned char *str)      // vorlï¿½ufig kein Timeout
 //
 // a) Zustandsï¿½nderungen
 
-void event_send(void)
+void event_send(t_opendcc_state state)
   {
-    switch(opendcc_state)
+    switch(state)
       {
         case RUN_OKAY:             // DCC running
             pc_send_lenz(pars_pcm = pcm_BC_alles_an);
@@ -174,7 +188,6 @@ void event_send(void)
         case PROG_ERROR:
             break;
       }
-    status_event.changed = 0;            // broad cast done
   }
 
 void pc_send_status(void)
@@ -200,21 +213,19 @@ void pc_send_status(void)
     if (opendcc_state == RUN_STOP) my_status |= 0x02;
     if (opendcc_state == RUN_OFF) my_status |= 0x01;
     // my_status &= ~0x04;  // manueller Start
-    if ( (opendcc_state == PROG_OKAY)
-       | (opendcc_state == PROG_SHORT)
-       | (opendcc_state == PROG_OFF)
-       | (opendcc_state == PROG_ERROR) ) my_status |= 0x08;          // Programmiermode
+    if (is_prog_state()) my_status |= 0x08;                         // Programmiermode
     //SDS niet nodig, want je bent hier al running my_status |= 0x40;  // wir behaupten mal "Kaltstart"
     pcm_status[2] = my_status;
     pc_send_lenz(pars_pcm = pcm_status);
   }
 
 //SDS added - quasi identiek aan xp_send_loco_addr uit xpnet.c
-void pc_send_loco_addr(unsigned int addr)     
+// kind: KKKK of the answer; 0=normal loco addr, 2=multi unit addr, 3=loco in multi unit
+void pc_send_loco_addr_kind(unsigned int addr, unsigned char kind)
   {
         pcm_build[0] = 0xE3;
-        pcm_build[1] = 0x30;                   // 0x30 + KKKK; here KKKK=0, normal loco addr
-        if (addr == 0) pcm_build[1] |= 0x04;   // KKKK=4 -> no result found
+        pcm_build[1] = 0x30 | kind;            // 0x30 + KKKK
+        if (addr == 0) pcm_build[1] = 0x34;    // KKKK=4 -> no result found
         if (addr > XP_SHORT_ADDR_LIMIT)
           {
             pcm_build[2] = addr / 256;
@@ -225,6 +236,28 @@ void pc_send_loco_addr(unsigned int addr)
         pc_send_lenz(pars_pcm = pcm_build);
   }
 
+void pc_send_loco_addr(unsigned int addr)     
+  {
+    pc_send_loco_addr_kind(addr, 0);
+  }
+
+#if (DCC_ADVANCED_CONSIST == 1)
+// answer to multi unit commands: ack or 0xE1 0x8n (n = CONSIST_ERR_*)
+void pc_send_consist_result(unsigned char result)
+  {
+    if (result == CONSIST_OKAY)
+      {
+        pc_send_lenz(pars_pcm = pcm_ack);
+      }
+    else
+      {
+        pcm_build[0] = 0xE1;
+        pcm_build[1] = 0x80 | result;
+        pc_send_lenz(pars_pcm = pcm_build);
+      }
+  }
+#endif
+
 void pc_send_lokdaten(unsigned int addr)
   {
     register unsigned char i, data;
@@ -377,6 +410,322 @@ void pc_send_fast_clock(void)
   }
 #endif
 
+void pc_send_estop_latency(void)
+  {
+    // 0x05 0xF4 LastH LastL MaxH MaxL (in us)
+    pcm_build[0] = 0x05;
+    pcm_build[1] = 0xF4;
+    pcm_build[2] = dccout_estop_latency >> 8;
+    pcm_build[3] = dccout_estop_latency & 0xFF;
+    pcm_build[4] = dccout_estop_latency_max >> 8;
+    pcm_build[5] = dccout_estop_latency_max & 0xFF;
+
+    pc_send_lenz(pars_pcm = pcm_build);
+  }
+
+#if (CURRENT_SENSE == 1)
+void pc_send_current(unsigned char out)
+  {
+    t_current_telemetry t;
+
+    // 0x06 0xFE Out|Flags RmsH RmsL PeakH PeakL (in mA)
+    current_telemetry(out, &t);
+    pcm_build[0] = 0x06;
+    pcm_build[1] = 0xFE;
+    pcm_build[2] = out | t.flags;
+    pcm_build[3] = t.rms >> 8;
+    pcm_build[4] = t.rms & 0xFF;
+    pcm_build[5] = t.peak >> 8;
+    pcm_build[6] = t.peak & 0xFF;
+
+    pc_send_lenz(pars_pcm = pcm_build);
+  }
+#endif
+
+#if (MAIN_SHORT_TRIP == 1)
+void pc_send_short_trip(void)
+  {
+    // 0x06 0xFD Trips LastH LastL MaxH MaxL (in SYSCLK cycles, 11.1ns)
+    pcm_build[0] = 0x06;
+    pcm_build[1] = 0xFD;
+    pcm_build[2] = main_trip_count & 0xFF;
+    pcm_build[3] = main_trip_latency >> 8;
+    pcm_build[4] = main_trip_latency & 0xFF;
+    pcm_build[5] = main_trip_latency_max >> 8;
+    pcm_build[6] = main_trip_latency_max & 0xFF;
+
+    pc_send_lenz(pars_pcm = pcm_build);
+  }
+#endif
+
+#if (DCC_DISTRICTS > 1)
+static unsigned char sat8(unsigned int v)
+  {
+    return((v > 0xFF) ? 0xFF : v);
+  }
+
+void pc_send_district(unsigned char d)
+  {
+    // 0x06 0xEF District Mode|State Trips Shorts Lost
+    // Mode: 0x80 filtered; State: t_district_state; counts up to 255
+    pcm_build[0] = 0x06;
+    pcm_build[1] = 0xEF;
+    pcm_build[2] = d;
+    pcm_build[3] = (district[d-1].mode == DISTRICT_FILTERED ? 0x80 : 0x00) | district[d-1].state;
+    pcm_build[4] = sat8(district[d-1].trips);
+    pcm_build[5] = sat8(district[d-1].shorts);
+    pcm_build[6] = sat8(district[d-1].lost);
+
+    pc_send_lenz(pars_pcm = pcm_build);
+  }
+#endif
+
+void pc_send_sched(unsigned char index)
+  {
+    // 0x06 0xF0 0x80 IdleH IdleL WakeH WakeL (idle in 0.1%)
+    // 0x06 0xF0 Task LatH LatL LateH LateL (max latency in us, deadline misses)
+    unsigned int v1, v2;
+
+    if (index & 0x80)
+      {
+        v1 = sched_stat.idle;
+        v2 = sched_stat.wakeups;
+      }
+    else
+      {
+        v1 = sched_stat.latency[index];
+        v2 = sched_stat.late[index];
+      }
+    pcm_build[0] = 0x06;
+    pcm_build[1] = 0xF0;
+    pcm_build[2] = index;
+    pcm_build[3] = v1 >> 8;
+    pcm_build[4] = v1 & 0xFF;
+    pcm_build[5] = v2 >> 8;
+    pcm_build[6] = v2 & 0xFF;
+
+    pc_send_lenz(pars_pcm = pcm_build);
+  }
+
+#if (DCC_WATCHDOG == 1)
+void pc_send_postmortem(void)
+  {
+    // 0x0F 0xFF Resets Reason Task Isr Hp Lp Prog Size P0..P5 (state before the last watchdog reset)
+    static unsigned char msg[16];          // pars_pcm points here
+
+    msg[0] = 0x0F;
+    msg[1] = 0xFF;
+    msg[2] = (postmortem.resets > 0xFF) ? 0xFF : postmortem.resets;
+    msg[3] = postmortem_reason;
+    msg[4] = postmortem_last.task;
+    msg[5] = postmortem_last.isr;
+    msg[6] = postmortem_last.queue_hp;
+    msg[7] = postmortem_last.queue_lp;
+    msg[8] = postmortem_last.queue_prog;
+    msg[9] = postmortem_last.packet_size;
+    memcpy(&msg[10], postmortem_last.packet, MAX_DCC_SIZE);
+    if (postmortem_reason == PM_STARVED) msg[4] = postmortem_last.starved;
+
+    pc_send_lenz(pars_pcm = msg);
+  }
+#endif
+
+#if (DCC_RAIL_STATS == 1)
+// percentage of part in total (both in us or packets), without 32 bit overflow
+static unsigned char rail_percent(uint32_t part, uint32_t total)
+  {
+    total = total / 100;
+    if (total == 0) return(0);
+    part = part / total;
+    if (part > 100) part = 100;
+    return((unsigned char)part);
+  }
+
+void pc_send_rail_stats(void)
+  {
+    // 0x06 0xF5 Util Idle New Repeat Refresh (all in %)
+    // Util, Idle: share of rail time since last reset
+    // New, Repeat, Refresh: share of packets (new = queue_hp + queue_lp)
+    uint32_t total, busy, all_packets;
+    unsigned char i;
+
+    total = dccout_time - rail_stats.start;
+    busy = 0;
+    for (i=0; i<NUM_MSG_SOURCE; i++) busy += rail_stats.time[i];
+    busy = busy - rail_stats.time[from_idle] - rail_stats.time[from_dummy];
+
+    all_packets = rail_stats.packets[from_hp] + rail_stats.packets[from_lp]
+                + rail_stats.packets[from_repeat] + rail_stats.packets[from_refresh];
+
+    pcm_build[0] = 0x06;
+    pcm_build[1] = 0xF5;
+    pcm_build[2] = rail_percent(busy, total);
+    pcm_build[3] = 100 - pcm_build[2];
+    pcm_build[4] = rail_percent(rail_stats.packets[from_hp] + rail_stats.packets[from_lp], all_packets);
+    pcm_build[5] = rail_percent(rail_stats.packets[from_repeat], all_packets);
+    pcm_build[6] = rail_percent(rail_stats.packets[from_refresh], all_packets);
+
+    pc_send_lenz(pars_pcm = pcm_build);
+  }
+
+void pc_send_rail_top(unsigned char index)
+  {
+    // 0x06 0xF5 0x80|Index KeyH KeyL CountH CountL
+    pcm_build[0] = 0x06;
+    pcm_build[1] = 0xF5;
+    pcm_build[2] = 0x80 | index;
+    pcm_build[3] = rail_top[index].key >> 8;
+    pcm_build[4] = rail_top[index].key & 0xFF;
+    pcm_build[5] = rail_top[index].count >> 8;
+    pcm_build[6] = rail_top[index].count & 0xFF;
+
+    pc_send_lenz(pars_pcm = pcm_build);
+  }
+#endif
+
+// 0x42 ADR ITTNZZZZ for a turnout decoder
+// I=0: done; TT=00: decoder without feedback; N: nibble; ZZZZ: 2 bits per turnout
+void pc_send_turnout_info(unsigned char decoder, unsigned char nibble)
+  {
+    pcm_build[0] = 0x42;
+    pcm_build[1] = decoder;
+    pcm_build[2] = (0b00 << 5) | (nibble << 4) | recall_turnout_nibble(((unsigned int)decoder << 2) + (nibble << 1));
+
+    pc_send_lenz(pars_pcm = pcm_build);
+  }
+
+// 0x42 ADR ITTNZZZZ for a feedback module; TAPAS has no s88: all inputs 0
+void pc_send_feedback_info(unsigned char module, unsigned char nibble)
+  {
+    pcm_build[0] = 0x42;
+    pcm_build[1] = module;
+    pcm_build[2] = (0b10 << 5) | (nibble << 4);
+
+    pc_send_lenz(pars_pcm = pcm_build);
+  }
+
+// report a changed turnout unsolicited, if the host can address it
+static void pc_send_turnout_change(unsigned int addr)
+  {
+    unsigned int decoder;
+
+    decoder = addr >> 2;
+    switch(xpressnet_feedback_mode)
+      {
+        default:
+        case 0:  if (decoder >= 64) return;     // mixed mode: decoder 64.. are feedback
+                 break;
+        case 1:  return;                        // only feedback
+        case 2:  if (decoder >= 256) return;
+                 break;
+      }
+    pc_send_turnout_info(decoder, (addr >> 1) & 0x01);
+  }
+
+void pc_send_special_option(unsigned int addr)
+  {
+    // 0x24 0x28 AddrH AddrL DAT
+    pcm_build[0] = 0x24;
+    pcm_build[1] = 0x28;
+    pcm_build[2] = addr >> 8;
+    pcm_build[3] = addr & 0xFF;
+    pcm_build[4] = eemem[addr];
+
+    pc_send_lenz(pars_pcm = pcm_build);
+  }
+
+void pc_send_store_status(void)
+  {
+    // 0x05 0xF7 LoadTimeH LoadTimeL RecordsH RecordsL (load time in us)
+    pcm_build[0] = 0x05;
+    pcm_build[1] = 0xF7;
+    pcm_build[2] = store_load_time >> 8;
+    pcm_build[3] = store_load_time & 0xFF;
+    pcm_build[4] = store_records >> 8;
+    pcm_build[5] = store_records & 0xFF;
+
+    pc_send_lenz(pars_pcm = pcm_build);
+  }
+
+#if (HOT_PATH_PROFILE == 1)
+void pc_send_profile(unsigned char index)
+  {
+    // 0x06 0xFA Index V3 V2 V1 V0 (32 bit value of the last window)
+    uint32_t value;
+
+    switch(index)
+      {
+        default:
+        case 0x00:  value = profile.isr_count ? profile.isr_cycles / profile.isr_count : 0;
+                    break;
+        case 0x01:  value = profile.isr_max;
+                    break;
+        case 0x02:  value = profile.isr_count;
+                    break;
+        case 0x03:  value = profile.loops;
+                    break;
+      }
+    if ((index & 0x80) && ((index & 0x7F) < NUM_SCHED_TASK)) value = profile.task[index & 0x7F];
+
+    pcm_build[0] = 0x06;
+    pcm_build[1] = 0xFA;
+    pcm_build[2] = index;
+    pcm_build[3] = (value >> 24) & 0xFF;
+    pcm_build[4] = (value >> 16) & 0xFF;
+    pcm_build[5] = (value >> 8) & 0xFF;
+    pcm_build[6] = value & 0xFF;
+
+    pc_send_lenz(pars_pcm = pcm_build);
+  }
+#endif
+
+void pc_send_boot_time(unsigned char phase)
+  {
+    // 0x06 0xFB Phase T3 T2 T1 T0 (us since start of main, 0: not reached)
+    uint32_t value;
+
+    value = boot_us((t_boot_phase)phase);
+
+    pcm_build[0] = 0x06;
+    pcm_build[1] = 0xFB;
+    pcm_build[2] = phase;
+    pcm_build[3] = (value >> 24) & 0xFF;
+    pcm_build[4] = (value >> 16) & 0xFF;
+    pcm_build[5] = (value >> 8) & 0xFF;
+    pcm_build[6] = value & 0xFF;
+
+    pc_send_lenz(pars_pcm = pcm_build);
+  }
+
+#if (DCC_SNAPSHOT == 1)
+void pc_send_warm_start(void)
+  {
+    // 0x05 0xFC Warm Locos TimeH TimeL (Warm: 1 = restored from snapshot)
+    pcm_build[0] = 0x05;
+    pcm_build[1] = 0xFC;
+    pcm_build[2] = snapshot_warm;
+    pcm_build[3] = snapshot_locos;
+    pcm_build[4] = snapshot_restore_time >> 8;
+    pcm_build[5] = snapshot_restore_time & 0xFF;
+
+    pc_send_lenz(pars_pcm = pcm_build);
+  }
+#endif
+
+#if (DCC_ROUTES == 1)
+void pc_send_route_done(unsigned char nr, unsigned int time)
+  {
+    // 0x04 0xF6 Route TimeH TimeL (setting time in ms, 0xFFFF: failed)
+    pcm_build[0] = 0x04;
+    pcm_build[1] = 0xF6;
+    pcm_build[2] = nr;
+    pcm_build[3] = time >> 8;
+    pcm_build[4] = time & 0xFF;
+
+    pc_send_lenz(pars_pcm = pcm_build);
+  }
+#endif
+
 void send_prog_result(void)
   {
     // Messages:
@@ -456,8 +805,43 @@ void send_prog_result(void)
 // List of all messages from the client
 // i: implemented, s: simulated, t: tested
 // i | s | t | V. | Code
+// i | - | - | new|0x02 0xF0 Task [XOR] "Scheduler statistic" -> 0x06 0xF0 Task LatH LatL LateH LateL
+//                 (max us from ready to start per window of 1s, deadline misses since reset)
+//                 Task 0 state, 1 organizer, 2 timer, 3 programmer, 4 parser, 5 keys, 6 ui,
+//                 7 database, 8 store, 9 snapshot, 10 watchdog (see scheduler.h)
+// i | - | - | new|0x02 0xF0 0x80 [XOR] "Idle time" -> 0x06 0xF0 0x80 IdleH IdleL WakeH WakeL
+//                 (time in IDLE in 0.1%, wakeups per window of 1s)
 // - | - | - | new|0x05 0xF1 TCODE1 TCODE2 TCODE3 TCODE4 [XOR] "DCC FAST CLOCK set"
 // - | - | - | new|0x01 0xF2 "DCC FAST CLOCK query"
+// i | - | - | new|0x05 0xF3 AddrH AddrL Speed Rate [XOR] "Locomotive speed ramp (station side momentum)"
+// i | - | - | new|0x01 0xF4 [XOR] "Emergency stop latency query" -> 0x05 0xF4 LastH LastL MaxH MaxL (us)
+// i | - | - | new|0x01 0xF5 [XOR] "Rail statistic query" -> 0x06 0xF5 Util Idle New Repeat Refresh (%)
+// i | - | - | new|0x02 0xF5 0x80|N [XOR] "Rail statistic top address N" -> 0x06 0xF5 0x80|N KeyH KeyL CntH CntL
+// i | - | - | new|0x02 0xF5 0x00 [XOR] "Rail statistic reset"
+// i | - | - | new|0x02 0xF6 Route [XOR] "Set route" -> ack; when done: 0x04 0xF6 Route TimeH TimeL (ms, 0xFFFF failed)
+// i | - | - | new|0x03 0xF6 0x80|Route Count [XOR] "Set route length" (0 = delete)
+// i | - | - | new|0x06 0xF6 0x80|Route Index AddrH AddrL Value [XOR] "Store route entry"
+//                 AddrH bit 7: 0 = turnout [0000-4095], Value = output
+//                              1 = extended accessory [0000-2047], Value = aspect
+// i | - | - | new|0x01 0xF7 [XOR] "Store status" -> 0x05 0xF7 LoadTimeH LoadTimeL RecordsH RecordsL (us)
+// i | - | - | new|0x0F 0xF8 AddrH AddrL PicH PicL Name[10] [XOR] "Store loco name" (Name[0] = 0: delete)
+// i | - | - | new|0x01 0xF9 [XOR] "Loco database transfer" -> ack, then one message per loco:
+//                 0x0F 0xF9 FAddrH AddrL PicH PicL Name[10] (F: format in bit 7,6), end: 0x03 0xF9 0x00 0x00
+// i | - | - | new|0x02 0xFA Index [XOR] "Cycle profile" -> 0x06 0xFA Index V3 V2 V1 V0 (per window of 1s)
+//                 Index 0: avg cycles dcc isr, 1: max cycles dcc isr, 2: no of dcc isr, 3: main loops,
+//                 0x80|Task: cycles of task (see 0xF0)
+// i | - | - | new|0x02 0xFB Phase [XOR] "Boot time" -> 0x06 0xFB Phase T3 T2 T1 T0 (us, see boot.h)
+//                 Phase 0..11: end of init step, 12: end of first dcc packet
+// i | - | - | new|0x01 0xFC [XOR] "Warm start status" -> 0x05 0xFC Warm Locos TimeH TimeL (restore time in us)
+// i | - | - | new|0x01 0xFD [XOR] "Main short trip" -> 0x06 0xFD Trips LastH LastL MaxH MaxL
+//                 (cycles of 11.1ns from the last sample before the short to the cutoff, see status.c)
+// i | - | - | new|0x02 0xFE Out [XOR] "Track current" -> 0x06 0xFE Out|Flags RmsH RmsL PeakH PeakL (mA)
+//                 Out 0: main, 1: prog; Flags 0x80: overload predicted since last query,
+//                 0x40: overload now, 0x20: ack now (see current.h)
+// i | - | - | new|0x01 0xFF [XOR] "Post mortem" -> 0x0F 0xFF Resets Reason Task Isr Hp Lp Prog Size P0..P5
+//                 (state before the last watchdog reset, sent unasked after the reset;
+//                 Reason 0: none, 1: Task did not return, 2: Task did not run in time;
+//                 Isr: last isr entered, Hp Lp Prog: queue depths, Size P0..P5: last packet, see watchdog.h)
 // i | - | - |    |0x21 0x10 0x31 "Request for Service Mode results"
 // - | - | - |    |0x22 0x11 REG [XOR] "Register Mode read request (Register Mode (REG=1..8))"
 // - | - | - |    |0x23 0x12 REG DAT [XOR] "Register Mode write request (Register Mode)"
@@ -472,11 +856,13 @@ void send_prog_result(void)
 // i | - | - |    |0x21 0x21 0x00 "Command station software-version request"
 // n | n | n |    |0x22 0x22 00000M00 [XOR] "Set command station power-up mode"
 // i | - | - |    |0x21 0x24 0x05 "Command station status request"
-// i | - | - | new|0x23 0x28 AddrH AddrL [XOR] "Command station special option read"
-// i | - | - | new|0x21 0x29 AddrH AddrL DAT [XOR] "Command station special option write"
+// i | - | - | new|0x23 0x28 AddrH AddrL [XOR] "Command station special option read" -> 0x24 0x28 AddrH AddrL DAT
+// i | - | - | new|0x24 0x29 AddrH AddrL DAT [XOR] "Command station special option write" -> 0x24 0x28 AddrH AddrL DAT
+//                 Addr: eadr_xxx (config.h), kept in the flash store
 // i | - | - |    |0x21 0x80 0xA1 "Stop operations request (emergency off)"
 // i | - | - |    |0x21 0x81 0xA0 "Resume operations request"
-// i | - | - |    |0x42 Addr Nibble [XOR] "Accessory Decoder/Feedback information request"
+// i | - | - |    |0x42 Addr Nibble [XOR] "Accessory Decoder/Feedback information request" -> 0x42 Addr ITTNZZZZ
+//                 changed turnouts are also sent unsolicited as 0x42 Addr ITTNZZZZ
 // i | - | - |    |0x52 Addr DAT [XOR] "Accessory Decoder operation request"
 // i | - | - |    |0x80 0x80 "Stop all locomotives request (emergency stop)"
 // i | - | - | 2  |0x91 loco_addr [XOR] "Emergency stop a locomotive"
@@ -489,8 +875,8 @@ void send_prog_result(void)
 // n | - | - |    |0xB3 loco_addr loco_data_1 loco_data_2 [XOR] "Locomotive operation" (X-Bus V1)
 // n | - | - |    |0xB4 loco_addr loco_data_1 loco_data_2 ModSel [XOR] "Locomotive operation" (X-Bus V2)
 // i | - | - | 3  |0xE3 0x00 AddrH AddrL [XOR] "Locomotive information request"
-// n | - | - |    |0xE4 0x01+R MTR AddrH AddrL [XOR] "Address inquiry member of a Multi-unit request"
-// n | - | - |    |0xE2 0x03+R MTR [XOR] "Address inquiry Multi-unit request"
+// i | - | - |    |0xE4 0x01+R MTR AddrH AddrL [XOR] "Address inquiry member of a Multi-unit request"
+// i | - | - |    |0xE2 0x03+R MTR [XOR] "Address inquiry Multi-unit request"
 // i | - | - |    |0xE3 0x05+R AddrH AddrL [XOR] "Address inquiry locomotive at command station stack request"
 // i | - | - | 3  |0xE3 0x07 AddrH AddrL [XOR] "Function status request"
 // - | - | - | 3.6|0xE3 0x08 AddrH AddrL [XOR] "Function status request F13-F28"
@@ -519,8 +905,8 @@ void send_prog_result(void)
 // i | - | - | new|0xE5 0x30 AddrH AddrL 0xFC+C CV [XOR] "Operations Mode Programming ExtAccessory read request"
 // n | - | - |    |0xE5 0x43 ADR1H ADR1L ADR2H ADR2L [XOR] "Establish Double Header"
 // n | - | - |    |0xE5 0x43 ADR1H ADR1L 0x00 0x00 [XOR] "Dissolve Double Header"
-// n | - | - |    |0xE4 0x40+R AddrH AddrL MTR [XOR] "Add a locomotive to a multi-unit request"
-// n | - | - |    |0xE4 0x42 AddrH AddrL MTR [XOR] "Remove a locomotive from a Multi-unit request"
+// i | - | - |    |0xE4 0x40+R AddrH AddrL MTR [XOR] "Add a locomotive to a multi-unit request"
+// i | - | - |    |0xE4 0x42 AddrH AddrL MTR [XOR] "Remove a locomotive from a Multi-unit request"
 // i | - | - |    |0xE3 0x44 AddrH AddrL [XOR] "Delete locomotive from command station stack request"
 // i | - | - | 3.6|0xF0 [XOR] "Read Version of Interface"
 // i | - | - | 3.6|0xF2 0x01 ADR [XOR] "Set Xpressnet ADR"
@@ -541,11 +927,11 @@ void parse_command(void)
         default:
             break;
         case 0x0:
-            #if (DCC_FAST_CLOCK == 1)
             switch(pcc[1])
               {
                 default:
                     break;
+                #if (DCC_FAST_CLOCK == 1)
                 case 0xF1:
                     // set clock
                     for(coil = 2; coil <= (pcc[0] & 0x0F); coil++ )   // use coil as temp
@@ -567,11 +953,9 @@ void parse_command(void)
                                         break;
                           }
                       }                            
+                    fast_clock_set();               // next minute from now on, posts EV_CLOCK
                     do_fast_clock(&fast_clock);
 
-                    // send clock_event to Xpressnet
-                    status_event.clock = 1;
-
                     // now send an answer
                     pc_send_fast_clock();
                     return;
@@ -579,8 +963,164 @@ void parse_command(void)
                     // query clock
                     pc_send_fast_clock();
                     return;
+                #endif
+                #if (DCC_RAMP == 1)
+                case 0xF3:
+                    // speed ramp 0x05 0xF3 AddrH AddrL Speed Rate
+                    // Speed: RVVVVVVV like 128 speed steps (0=stop, 1=e-stop)
+                    // Rate:  CVVVVVVV; C=0 linear, C=1 exponential;
+                    //        VVVVVVV = time per speed step in 7ms (scale of decoder CV3/CV4)
+                    //        0 = no ramp, set speed immediately
+                    if ((pcc[0] & 0x0F) < 5) break;
+                    addr = (pcc[2] & 0x3F) * 256 + pcc[3];
+                    if (do_loco_ramp(addr, pcc[4], pcc[5] & 0x7F, (pcc[5] & 0x80) ? RAMP_EXPONENTIAL : RAMP_LINEAR))
+                      {
+                        pc_send_lenz(pars_pcm = pcm_ack);
+                      }
+                    else
+                      {
+                        pc_send_lenz(pars_pcm = pcm_busy);    // all ramps in use or organizer full
+                      }
+                    return;
+                #endif
+                case 0xF4:
+                    // emergency stop latency (request to end of first stop packet)
+                    pc_send_estop_latency();
+                    return;
+                #if (DCC_RAIL_STATS == 1)
+                case 0xF5:
+                    // rail statistic
+                    if ((pcc[0] & 0x0F) == 1)
+                      {
+                        pc_send_rail_stats();
+                      }
+                    else if (pcc[2] & 0x80)
+                      {
+                        if ((pcc[2] & 0x7F) >= SIZE_RAIL_TOP) break;
+                        pc_send_rail_top(pcc[2] & 0x7F);
+                      }
+                    else
+                      {
+                        dccout_stats_reset();
+                        rail_top_reset();
+                        pc_send_lenz(pars_pcm = pcm_ack);
+                      }
+                    return;
+                #endif
+                #if (DCC_ROUTES == 1)
+                case 0xF6:
+                    // routes
+                    switch(pcc[0] & 0x0F)
+                      {
+                        case 2:  speed = route_set(pcc[2]);                         // use speed as temp
+                                 break;
+                        case 3:  speed = route_length(pcc[2] & 0x7F, pcc[3]);
+                                 break;
+                        case 6:  addr = ((unsigned int)pcc[4] << 8) | pcc[5];      // flag ROUTE_EXTENDED included
+                                 speed = route_store(pcc[2] & 0x7F, pcc[3], addr, pcc[6]);
+                                 break;
+                        default: speed = ROUTE_ERR_NR;
+                                 break;
+                      }
+                    if (speed == ROUTE_OKAY) pc_send_lenz(pars_pcm = pcm_ack);
+                    else if (speed == ROUTE_ERR_BUSY) pc_send_lenz(pars_pcm = pcm_busy);
+                    else pc_send_lenz(pars_pcm = pcm_unknown);
+                    return;
+                #endif
+                case 0xF7:
+                    // flash store status
+                    pc_send_store_status();
+                    return;
+                #if (LOCO_DATABASE == NAMED)
+                case 0xF8:
+                    // store loco name 0x0F 0xF8 AddrH AddrL PicH PicL Name[10]
+                    if ((pcc[0] & 0x0F) != (5 + LOK_NAME_LENGTH)) break;
+                    addr = ((pcc[2] & 0x3F) << 8) | pcc[3];
+                    if (store_loco_name(addr, &pcc[6], ((unsigned int)pcc[4] << 8) | pcc[5]))
+                      {
+                        pc_send_lenz(pars_pcm = pcm_ack);
+                      }
+                    else
+                      {
+                        pc_send_lenz(pars_pcm = pcm_busy);    // database full
+                      }
+                    return;
+                case 0xF9:
+                    // transfer loco database; entries follow from run_database
+                    rewind_database();
+                    pc_send_lenz(pars_pcm = pcm_ack);
+                    return;
+                #endif
+                case 0xFB:
+                    // boot time stamps
+                    if (((pcc[0] & 0x0F) != 2) || (pcc[2] >= NUM_BOOT_PHASE)) break;
+                    pc_send_boot_time(pcc[2]);
+                    return;
+                #if (DCC_SNAPSHOT == 1)
+                case 0xFC:
+                    // warm start status
+                    pc_send_warm_start();
+                    return;
+                #endif
+                #if (MAIN_SHORT_TRIP == 1)
+                case 0xFD:
+                    // main short trip count and cutoff latency
+                    pc_send_short_trip();
+                    return;
+                #endif
+                #if (CURRENT_SENSE == 1)
+                case 0xFE:
+                    // track current telemetry
+                    if (((pcc[0] & 0x0F) != 2) || (pcc[2] > CURRENT_PROG)) break;
+                    pc_send_current(pcc[2]);
+                    return;
+                #endif
+                #if (DCC_WATCHDOG == 1)
+                case 0xFF:
+                    // state before the last watchdog reset
+                    pc_send_postmortem();
+                    return;
+                #endif
+                #if (DCC_DISTRICTS > 1)
+                case 0xEF:
+                    // power districts
+                    // 0x02 0xEF D:             status of district D (1..3)
+                    // 0x03 0xEF D Cmd:         0x00 off, 0x01 on (clears a short),
+                    //                          0x10 mirror of main, 0x11 filtered
+                    // 0x04 0xEF AddrH AddrL D: loco to filtered district D, 0: main
+                    switch(pcc[0] & 0x0F)
+                      {
+                        case 2:  if ((pcc[2] == 0) || (pcc[2] >= district_count())) break;
+                                 pc_send_district(pcc[2]);
+                                 return;
+                        case 3:  if (pcc[3] & 0x10) speed = district_set_mode(pcc[2], pcc[3] & 0x01);
+                                 else speed = district_set_power(pcc[2], pcc[3] & 0x01);
+                                 if (!speed) break;
+                                 pc_send_lenz(pars_pcm = pcm_ack);
+                                 return;
+                        case 4:  if (pcc[4] >= district_count()) break;
+                                 addr = ((pcc[2] & 0x3F) << 8) | pcc[3];
+                                 if (district_route(addr, pcc[4])) pc_send_lenz(pars_pcm = pcm_ack);
+                                 else pc_send_lenz(pars_pcm = pcm_busy);    // table full
+                                 return;
+                      }
+                    pc_send_lenz(pars_pcm = pcm_unknown);
+                    return;
+                #endif
+                case 0xF0:
+                    // scheduler statistic
+                    if ((pcc[0] & 0x0F) != 2) break;
+                    if (((pcc[2] & 0x80) == 0) && (pcc[2] >= NUM_SCHED_TASK)) break;
+                    pc_send_sched(pcc[2]);
+                    return;
+                #if (HOT_PATH_PROFILE == 1)
+                case 0xFA:
+                    // cycle profile
+                    if ((pcc[0] & 0x0F) != 2) break;
+                    pc_send_profile(pcc[2]);
+                    return;
+                #endif
               }
-            #endif
             break;
 
         case 0x1: // rudolf killmann
@@ -612,7 +1152,7 @@ void parse_command(void)
                     break;
                 case 0x10: 
                    // Prog.-Ergebnis anfordern 0x21 0x10 0x31
-                   if (opendcc_state >= PROG_OKAY)
+                   if (is_prog_state())
                      {
                        //xxxold lprog_send_prog_result_again();  xxxold
                        send_prog_result();
@@ -715,6 +1255,24 @@ void parse_command(void)
                     // 3 = "Control Plus";
                    pc_send_lenz(pars_pcm = pcm_version);
                    return;
+               case 0x28:
+                   // special option read 0x23 0x28 AddrH AddrL
+                   if (pcc[0] != 0x23) break;
+                   addr = ((unsigned int)pcc[2] << 8) | pcc[3];
+                   if (addr >= SIZE_EEMEM) break;
+                   pc_send_special_option(addr);
+                   return;
+               case 0x29:
+                   // special option write 0x24 0x29 AddrH AddrL DAT, answer is the read back
+                   if (pcc[0] != 0x24) break;
+                   addr = ((unsigned int)pcc[2] << 8) | pcc[3];
+                   if (addr >= SIZE_EEMEM) break;
+                   if ((addr != eadr_OpenDCC_Version) && (addr != eadr_VersionMirror))
+                     {
+                       store_write(addr, pcc[4]);
+                     }
+                   pc_send_special_option(addr);
+                   return;
                case 0x24:
                    // Status Zentrale anfordern 0x21 0x24 0x05 ---> wird von TC benutzt!
                    pc_send_status();                          // Statusbyte zurï¿½ckliefern 
@@ -753,35 +1311,27 @@ void parse_command(void)
             //                  und mit TT 01 oder 00 quittiert. Das bedeutet 256 mï¿½gliche Weichen
             //  Adressen 64-127 werden als Feedback interpretiert, das bedeutet 512 mï¿½gliche Melder
 
-  		      switch(xpressnet_feedback_mode)
-  		      {
-  		          default:  
-  				      case 0:                             // mixed mode    
-    		            if (pcc[1] < 64)
-    		            {
-    		              // Nur fï¿½r Schaltinfo: (range 0..63)
-  		                addr = (pcc[1] << 2) + (unsigned char)((pcc[2] & 0x01) << 1);
-  		                pcm_build[0] = 0x42;
-  		                pc_send_lenz(pars_pcm = pcm_build);           
-    		            }
-    		            else
-    		            { // request feedback info, shift addr locally down (sub 64)
-  		                addr = ((pcc[1] - 64) << 3) + (unsigned char)((pcc[2] & 0x01) << 2);
-  		                pcm_build[0] = 0x42;
-  		                pc_send_lenz(pars_pcm = pcm_build);
-    		            }
-    		            return;
-  		          case 1:                           	   // only feedback
-    		            addr = ((pcc[1]) << 3) + (unsigned char)((pcc[2] & 0x01) << 2);
-  	                pcm_build[0] = 0x42;
-  	                pc_send_lenz(pars_pcm = pcm_build);
-    		            return;
-		            case 2:                           	   // only schaltinfo
-  		              addr = (pcc[1] << 2) + (unsigned char)((pcc[2] & 0x01) << 1);
-  	                pcm_build[0] = 0x42;
-  	                pc_send_lenz(pars_pcm = pcm_build); 
-    		            return;
-  		         }           
+            switch(xpressnet_feedback_mode)
+              {
+                default:
+                case 0:                             // mixed mode
+                    if (pcc[1] < 64)
+                      {
+                        // Nur fuer Schaltinfo: (range 0..63)
+                        pc_send_turnout_info(pcc[1], pcc[2] & 0x01);
+                      }
+                    else
+                      { // request feedback info, shift addr locally down (sub 64)
+                        pc_send_feedback_info(pcc[1], pcc[2] & 0x01);
+                      }
+                    return;
+                case 1:                             // only feedback
+                    pc_send_feedback_info(pcc[1], pcc[2] & 0x01);
+                    return;
+                case 2:                             // only schaltinfo
+                    pc_send_turnout_info(pcc[1], pcc[2] & 0x01);
+                    return;
+              }
 
         case 0x5:
             // Schaltbefehl 0x52 ADR DAT X-Or
@@ -795,19 +1345,21 @@ void parse_command(void)
             activate = (pcc[2] & 0b01000) >> 3;
             coil = pcc[2] & 0b01;
             if (invert_accessory & 0b01) coil = coil ^ 1;
-            do_accessory(0, addr, coil, activate);
-            pc_send_lenz(pars_pcm = pcm_ack);
-            if (pcc[1] < 0x40)                              // only xpressnet feedback if < 256
-              { // 28.07.2008
-                pcm_build[0] = 0x42;
-                pc_send_lenz(pars_pcm = pcm_build);
+            // the station sends the deactivate itself (after dcc_acc_time)
+            if (activate)
+              {
+                if (!acc_pulse_on(addr, coil)) do_accessory(0, addr, coil, 1);
               }
+            else acc_pulse_off(addr, coil);
+            pc_send_lenz(pars_pcm = pcm_ack);
+            // 28.07.2008: the 0x42 feedback follows from the turnout journal (run_parser)
             return;
         case 0x7:
             break;
 
         case 0x8:
             // Alle Loks anhalten 0x80 0x80
+            dccout_estop_received(rx_time);                                // xor byte came in
             set_opendcc_state(RUN_STOP);                                   // from organizer.c   
             pc_send_lenz(pars_pcm = pcm_ack);
             return;
@@ -816,6 +1368,9 @@ void parse_command(void)
             addr = (pcc[1] & 0x3F) * 256 + pcc[2];
             pc_send_lenz(pars_pcm = pcm_ack);
 
+            #if (DCC_RAMP == 1)
+            ramp_cancel(addr);
+            #endif
             // format dieser Lok rausfinden
             register unsigned char i;
             i = scan_locobuffer(addr);
@@ -855,6 +1410,19 @@ void parse_command(void)
                             pc_send_lokdaten(addr);
                             //SDS processed = 1;
                             break;
+                        #if (DCC_ADVANCED_CONSIST == 1)
+                        case 0x01:      // 0xE4 0x01+R MTR AddrH AddrL: next / previous member of MTR
+                        case 0x02:
+                            addr = ((pcc[3] & 0x3F) * 256) + pcc[4];
+                            result = consist_member_inquiry(pcc[2], addr, (pcc[1] & 0x0f) == 0x01);
+                            pc_send_loco_addr_kind(result, 3);
+                            break;
+                        case 0x03:      // 0xE2 0x03+R MTR: next / previous multi unit
+                        case 0x04:
+                            result = consist_inquiry(pcc[2], (pcc[1] & 0x0f) == 0x03);
+                            pc_send_loco_addr_kind(result, 2);
+                            break;
+                        #endif
                         case 0x05:
                             result = addr_inquiry_locobuffer(addr, 1); // forward
                             pc_send_loco_addr(result);
@@ -917,6 +1485,9 @@ void parse_command(void)
                     if (organizer_ready())
                       {
                         unsigned char myspeed;
+                        #if (DCC_RAMP == 1)
+                        ramp_cancel(addr);                                // direct speed overrules ramp
+                        #endif
                         myspeed = convert_speed_from_rail(speed, format); // map lenz to internal 0...127
                         do_loco_speed_f(0, addr, myspeed, format);
                         pc_send_lenz(pars_pcm = pcm_ack);
@@ -1053,10 +1624,23 @@ void parse_command(void)
                       }
                     break;
                 case 0x40:   //Lokverwaltung
-                    // !!! Lok zu MTR hinzufï¿½gen ab V3 0xE4 0x40 + R ADR High ADR Low MTR X-Or
-                    // !!! Lok aus MTR entfernen ab V3 0xE4 0x42 ADR High ADR Low MTR X-Or
+                    // Lok zu MTR hinzufï¿½gen ab V3 0xE4 0x40 + R ADR High ADR Low MTR X-Or
+                    // Lok aus MTR entfernen ab V3 0xE4 0x42 ADR High ADR Low MTR X-Or
                     // !!! DTR-Befehle ab V3 0xE5 0x43 ADR1 H ADR1 L ADR2 H ADR2 L X-Or
                     // !!! Lok aus Stack lï¿½schen ab V3 0xE3 0x44 ADR High ADR Low X-Or
+                    #if (DCC_ADVANCED_CONSIST == 1)
+                    addr = (pcc[2] & 0x3F) * 256 + pcc[3];
+                    switch(pcc[1] & 0x0F)
+                      {
+                        case 0x00:      // add, same direction
+                        case 0x01:      // add, reversed
+                            pc_send_consist_result(do_consist_add(addr, pcc[4], pcc[1] & 0x01));
+                            return;
+                        case 0x02:      // remove
+                            pc_send_consist_result(do_consist_remove(addr, pcc[4]));
+                            return;
+                      }
+                    #endif
                     break;
               }
             break;
@@ -1101,11 +1685,14 @@ void parse_command(void)
 /// run_parser: multitask replacement, must be called in loop
 
 
+static void parser_restart(void);
+
 static bool input_ready(void)
   {
     if(rs232_break_detected == 1)
       {
-        init_parser();
+        parser_restart();
+        event_subscribe(&parser_events);    // new connection: no old events
         init_rs232(BAUD_19200);  // reinit rs232 and get rid of old connection
       }
     return(rx_fifo_ready());
@@ -1115,11 +1702,55 @@ static bool input_ready(void)
 void run_parser(void)
   {
     unsigned char i, my_check;
+    unsigned int turnout;
+    t_event event;
         
-    if (status_event.changed) 
+    if (input_ready()) sched_ready(SCHED_PARSER);       // one byte per call: come again
+    if (event_get(&parser_events, &event))              // one event per call
+      {
+        sched_ready(SCHED_PARSER);
+        switch(event.type)
+          {
+            case EV_STATE:
+                event_send((t_opendcc_state)event.a);   // report any Status Change
+                break;
+            case EV_LOST:
+                event_send(opendcc_state);              // missed some: report where we are
+                break;
+            case EV_LOCO_STOLEN:
+                if ((event.b >> 8) == 0) send_lok_stolen(0, event.a);   // taken from the pc
+                break;
+            #if (DCC_ROUTES == 1)
+            case EV_ROUTE:
+                pc_send_route_done(event.a, event.b);
+                break;
+            #endif
+            #if (DCC_WATCHDOG == 1)
+            case EV_WATCHDOG:
+                pc_send_postmortem();
+                break;
+            #endif
+            #if (DCC_DISTRICTS > 1)
+            case EV_SHORT:
+                if (event.a == EV_SHORT_DISTRICT) pc_send_district(event.b);    // main: by EV_STATE
+                break;
+            #endif
+            default:
+                break;
+          }
+      }
+    if (get_turnout_change(&turnout))
+      {
+        pc_send_turnout_change(turnout);                // push instead of poll
+      }
+    #if (LOCO_DATABASE == NAMED)
+    if (db_message_ready && tx_fifo_ready())
       {
-        event_send();                                   // report any Status Change
+        pc_send_lenz(db_message);                       // one database entry per call
+        db_message_ready = 0;
+        sched_ready(SCHED_DATABASE);                    // build the next one
       }
+    #endif
 
     switch (parser_state)
       {
@@ -1186,10 +1817,17 @@ void run_parser(void)
 
 
 
-void init_parser(void)
+// at boot and after a break of the pc
+static void parser_restart(void)
   {
     parser_state = IDLE;
-    
+    invert_accessory = eemem[eadr_invert_accessory];
+  }
+
+void init_parser(void)
+  {
+    parser_restart();
+    parser_events = 0;                          // events since reset
   }
 
 #endif // (PARSER == LENZ)
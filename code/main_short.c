@@ -0,0 +1,200 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      main_short.c
+// history:   short state machine of the main track out of status.c
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   ignore time and fast recovery of a short on the main track
+//
+// how:       run_state calls main_short_check every ms.
+//            polled: the track stays on during the ignore time; is the
+//              input clear before, it was no short.
+//            trip (MAIN_SHORT_TRIP): the dcc isr has cut the track at
+//              the next bit already. Within the ignore time the track is
+//              switched on again as soon as the input is clear, the isr
+//              cuts again if the short is still there. Is the input clear
+//              at the end of the ignore time, the track is switched on if
+//              still cut: a blip leaves the track on, not off without
+//              any report.
+//            A short lasting longer gets three attempts of fast recovery
+//            (4ms off, 1ms on), then it is reported; again every ms it
+//            lasts, until it is gone for 1s.
+//
+//-----------------------------------------------------------------
+
+#include <stdint.h>
+#include "main_short.h"
+
+// values in ms
+#define FAST_RECOVER_ON_TIME        1
+#define FAST_RECOVER_OFF_TIME       4
+#define SLOW_RECOVER_TIME         1000  // 1s voor we opnieuw NO_SHORT melden na een kortsluiting
+#define RECOVER_ATTEMPTS            3
+
+shortState_t mainShortState;
+
+static uint32_t since;                  // now of the last change
+static unsigned char attempts;          // fast recovery left
+static unsigned char ignore_ms;
+static unsigned char trip_mode;         // 1: the isr cuts the track
+static unsigned char cut;               // cut by the isr, not on again yet
+
+void main_short_init(unsigned char trip)
+  {
+    mainShortState = NO_SHORT;
+    since = 0;
+    attempts = 0;
+    ignore_ms = 0;
+    trip_mode = trip;
+    cut = 0;
+  }
+
+void main_short_time(unsigned char ms)
+  {
+    ignore_ms = ms;
+  }
+
+// short on the main track: input active now or the isr has cut the track
+// since the last call
+static unsigned char seen(void)
+  {
+    if (main_hw_tripped())
+      {
+        cut = 1;
+        return(1);
+      }
+    return(main_hw_fault());
+  }
+
+static void power_on(void)
+  {
+    cut = 0;
+    main_hw_on();
+  }
+
+static void recover_off(uint32_t now)
+  {
+    main_hw_off();
+    cut = 0;
+    attempts = RECOVER_ATTEMPTS;
+    mainShortState = FASTREC_OFF;
+    since = now;
+  }
+
+// returns 1, if a short is to be reported (not during fast recovery)
+unsigned char main_short_check(uint32_t now)
+  {
+    unsigned char retval = 0;
+    unsigned char tripped;
+
+    switch(mainShortState)
+      {
+        case NO_SHORT:
+            cut = 0;
+            if (seen())
+              {
+                mainShortState = IGNORE_SHORT;
+                since = now;
+              }
+            break;
+        case IGNORE_SHORT:
+            if (!trip_mode)
+              {
+                if (!main_hw_fault())
+                  {
+                    mainShortState = NO_SHORT;
+                    power_on();
+                  }
+                else if ((now - since) > ignore_ms)
+                  {
+                    recover_off(now);
+                  }
+                break;
+              }
+            tripped = main_hw_tripped();
+            if (tripped) cut = 1;               // cut again since the last ms
+            if ((now - since) > ignore_ms)
+              {
+                if (tripped || main_hw_fault())
+                  {
+                    recover_off(now);
+                  }
+                else
+                  {
+                    mainShortState = NO_SHORT;  // gone, it was a blip
+                    if (cut) power_on();
+                  }
+              }
+            else if (cut && !main_hw_fault())
+              {
+                power_on();                     // the isr cuts again, if not gone
+              }
+            break;
+        case FASTREC_OFF:
+            if ((now - since) > FAST_RECOVER_OFF_TIME) // 4ms uit, en dan opnieuw aan en zien of de short weg is
+              {
+                main_hw_tripped();              // clear an old trip
+                power_on();
+                mainShortState = FASTREC_ON;
+                since = now;
+              }
+            break;
+        case FASTREC_ON:
+            if ((now - since) > FAST_RECOVER_ON_TIME) // 1ms wachten en dan short checken
+              {
+                if (seen())
+                  {
+                    mainShortState = FASTREC_OFF;
+                    since = now;
+                    main_hw_off();
+                    if (--attempts == 0)
+                      {
+                        mainShortState = SHORT;
+                        retval = 1;
+                      }
+                  }
+                else
+                  {
+                    mainShortState = NO_SHORT;
+                    power_on();
+                  }
+              }
+            break;
+        case SHORT:
+            if (seen())
+              {
+                since = now;
+                retval = 1;
+              }
+            else if ((now - since) > SLOW_RECOVER_TIME)
+              {
+                mainShortState = NO_SHORT;
+              }
+            break;
+      }
+    return(retval);
+  }
+
+// the track was switched off (off, prog): a short in its ignore time or
+// fast recovery must not switch it on again
+void main_short_off(void)
+  {
+    if ((mainShortState == IGNORE_SHORT) || (mainShortState == FASTREC_OFF)
+        || (mainShortState == FASTREC_ON))
+      {
+        mainShortState = NO_SHORT;
+      }
+    cut = 0;
+  }
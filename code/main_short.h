@@ -0,0 +1,55 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      main_short.h
+// history:   short state machine of the main track out of status.c
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   ignore time and fast recovery of a short on the main track.
+//            No device registers and no config.h: the same source is
+//            compiled by tools/shortreplay.c on the host.
+//
+// interface upstream (status.c):
+//            main_short_init(trip)         // no short; trip: the dcc isr cuts the track
+//            main_short_time(ms)           // ignore time of a short
+//            main_short_check(now)         // every ms; 1: short, report it
+//            main_short_off()              // track switched off on purpose
+//
+// interface downstream (status.c on the target, the tool on the host):
+//            main_hw_on()                  // track on
+//            main_hw_off()
+//            main_hw_tripped()             // track was cut by the isr since the last call
+//            main_hw_fault()               // short input active now
+//
+//-----------------------------------------------------------------
+#ifndef __MAIN_SHORT_H__
+#define __MAIN_SHORT_H__
+
+#include <stdint.h>
+
+typedef enum {NO_SHORT, IGNORE_SHORT, FASTREC_OFF, FASTREC_ON, SHORT} shortState_t;
+
+extern shortState_t mainShortState;
+
+void main_short_init(unsigned char trip);
+void main_short_time(unsigned char ms);
+unsigned char main_short_check(uint32_t now);
+void main_short_off(void);
+
+void main_hw_on(void);
+void main_hw_off(void);
+unsigned char main_hw_tripped(void);
+unsigned char main_hw_fault(void);
+
+#endif // __MAIN_SHORT_H__
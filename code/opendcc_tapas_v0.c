@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <inttypes.h>
+#include <string.h>
 
 #include "config.h"                // general structures and definitions - make your changes here
 #include "database.h"              // format and names
@@ -12,13 +13,31 @@
 #include "rs232.h"
 #include "lenz_parser.h"
 #include "keys.h"
+#include "ramp.h"
+#include "timerwheel.h"
+#include "accessory.h"
+#include "store.h"
+#include "profile.h"
+#include "boot.h"
+#include "snapshot.h"
+#include "current.h"
+#include "scheduler.h"
+#include "events.h"
+#include "watchdog.h"
+
+extern Uint16 RamfuncsLoadStart;      // from linker, see F28069M.cmd
+extern Uint16 RamfuncsLoadEnd;
+extern Uint16 RamfuncsRunStart;
 
 static void init_main(void);
 static void build_loko_7a28s(unsigned int nr, signed char speed, t_message *new_message);
+static void boot_step(t_boot_phase phase);
+static void led_blink(unsigned int arg);
+
+#define LED_BLINK_MS    500             // alive led (GPIO39)
 
 void main(void)
 {
-  Uint32 toggleMillis, dccMillis;
   t_message organizerMessage;
   //
   // Step 1. Initialize System Control:
@@ -26,6 +45,11 @@ void main(void)
   // This example function is found in the F2806x_SysCtrl.c file.
   //
   InitSysCtrl();
+  #if (DCC_WATCHDOG == 1)
+  init_watchdog();              // reset cause and post mortem, before anything else
+  #endif
+  init_timebase();              // CpuTimer1, 64 bit time
+  init_boot();                  // boot time stamps from here on
 
   //
   // Step 2. Initalize GPIO:
@@ -74,85 +98,139 @@ void main(void)
   EDIS;
   GpioDataRegs.GPBSET.bit.GPIO34 = 1; //SET = led off, CLEAR = led on
   GpioDataRegs.GPBSET.bit.GPIO39 = 1; //SET = led off, CLEAR = led on
+  boot_mark(BOOT_PIE);
+
+  // copy time critical code (dcc isr, millis isr, delay) to RAM;
+  // it must run while store.c writes the flash.
+  // With HOT_PATH_IN_RAM also the main loop hot path (see F28069M.cmd)
+  memcpy(&RamfuncsRunStart, &RamfuncsLoadStart, &RamfuncsLoadEnd - &RamfuncsLoadStart);
+  boot_mark(BOOT_RAMFUNCS);
 
   // setup
   millis_init();
+  init_timerwheel();            // software timers, needed by init_state
+  init_scheduler();             // isr may make tasks ready from now on
+  init_events();                // before init_state, which posts the first state
+
+  init_store();                 // CVs from flash to eemem[], before all other init
+  #if (HOT_PATH_PROFILE == 1)
+  init_profile();               // CpuTimer2 as cycle counter (after init_store)
+  #endif
+  boot_mark(BOOT_STORE);
+
+  // first the track: dcc generator with power up sequence (resets, then idles),
+  // short check and power on; the other init steps run behind it
+  init_dccout();                // timing engine for dcc
+  init_state();                 // short times from eemem, track i/o
+  #if (CURRENT_SENSE == 1)
+  init_current();               // adc, triggered by the dcc pwm
+  #endif
+  #if (DCC_SNAPSHOT == 1)
+  dccout_startup(snapshot_valid());     // warm start: no resets, the locos keep running
+  set_opendcc_state(snapshot_state());  // warm start: state before the reset
+  #else
+  dccout_startup(0);
+  set_opendcc_state(RUN_OKAY);  // start up with power enabled
+  #endif
+
+  // Enable global Interrupts and higher priority real-time debug events
+  EINT;   // Enable Global interrupt INTM
+  ERTM;   // Enable Global realtime interrupt DBGM
+  boot_step(BOOT_DCC);
 
   init_database();              // loco format and names
-  init_dccout();                // timing engine for dcc
+  boot_step(BOOT_DATABASE);
 
   init_rs232(BAUD_19200);
+  boot_step(BOOT_RS232);
 
-  init_state();                 // 5ms timer tick
   init_parser();                // command parser
+  boot_step(BOOT_PARSER);
 
   init_organizer();             // engine for command repetition,
                                 // memory of loco speeds and types
+  #if (DCC_SNAPSHOT == 1)
+  init_snapshot();              // warm start: locos are refreshed at once
+  #endif
+  boot_step(BOOT_ORGANIZER);
   init_programmer();            // State Engine des Programmers
+  boot_step(BOOT_PROGRAMMER);
+  #if (DCC_RAMP == 1)
+  init_ramp();                  // station side momentum
+  #endif
+  init_accessory();             // timed accessory pulses, routes
+  boot_step(BOOT_ACCESSORY);
 
-  set_opendcc_state(RUN_OKAY);  // start up with power enabled
-
-  // dcc_startup_messages();    // issue defined power up sequence on tracks (sds: vreemd dat dit ook in de GOLD uitgecomment is..)
   keys_Init ();
-
-  // Enable global Interrupts and higher priority real-time debug events
-  EINT;   // Enable Global interrupt INTM
-  ERTM;   // Enable Global realtime interrupt DBGM
-
-  toggleMillis = 0;
-  dccMillis = 0;
+  boot_step(BOOT_KEYS);
+
+  dccout_startup_done();        // organizer feeds dccout from now on
+  boot_step(BOOT_DONE);
+
+  tw_start(LED_BLINK_MS / TW_TICK_MS, led_blink, 0);
+
+  // tasks of the main loop: period in ms (0: only when made ready), deadline in us
+  sched_task(SCHED_STATE, run_state, 1, 1000);          // check short and ext stop; also by the short trip
+  sched_task(SCHED_ORGANIZER, run_organizer, 1, 2000);  // run command organizer, depending on state,
+                                                        // it will execute normal track operation
+                                                        // or programming; ready by dcc isr, shortest
+                                                        // message lasts > 4ms
+  sched_task(SCHED_TIMER, run_timerwheel, TW_TICK_MS, 1000);    // software timers, status tick
+  sched_task(SCHED_PROGRAMMER, run_programmer, 0, 5000);    // ready while a job runs
+  sched_task(SCHED_PARSER, run_parser, 10, 5000);       // check commands from pc; ready by rx isr and events
+  sched_task(SCHED_KEYS, keys_Update, 0, 10000);        // ready by encoder and button isr, debounce timer
+  sched_task(SCHED_UI, ui_Update, 0, 20000);            // events for the local ui
+  #if (LOCO_DATABASE == NAMED)
+  sched_task(SCHED_DATABASE, run_database, 0, 20000);   // transfer of loco names to pc
+  #endif
+  sched_task(SCHED_STORE, run_store, 10, 50000);        // write changed CVs to flash
+  #if (DCC_SNAPSHOT == 1)
+  sched_task(SCHED_SNAPSHOT, run_snapshot, 10, 50000);  // copy of locobuffer for warm start
+  #endif
+  #if (DCC_WATCHDOG == 1)
+  sched_task(SCHED_WATCHDOG, run_watchdog, WATCHDOG_CHECK_MS, 10000);  // feed only if all below run
+  watchdog_supervise(SCHED_STATE, 100);                 // max ms without a run
+  watchdog_supervise(SCHED_ORGANIZER, 100);
+  watchdog_supervise(SCHED_TIMER, 100);
+  watchdog_supervise(SCHED_PARSER, 200);
+  watchdog_supervise(SCHED_STORE, 500);
+  #if (DCC_SNAPSHOT == 1)
+  watchdog_supervise(SCHED_SNAPSHOT, 500);
+  #endif
+  #endif
+  event_notify(SCHED_PARSER);
+  event_notify(SCHED_UI);
+  #if (DCC_WATCHDOG == 1)
+  watchdog_start();             // after event_notify: the parser gets EV_WATCHDOG
+  #endif
 
   while(1)
   {
+    run_scheduler();                                // most urgent task, or IDLE
 
-    if ((millis() - toggleMillis) >= 500)
-    {
-      GpioDataRegs.GPBTOGGLE.bit.GPIO39 = 1;
-      toggleMillis = millis();
-    }
-
-
-    run_state();        // check short and keys
-    run_organizer();    // run command organizer, depending on state,
-                        // it will execute normal track operation
-                        // or programming
-    run_programmer();
-    run_parser();       // check commands from pc
-    keys_Update();
+    #if (HOT_PATH_PROFILE == 1)
+    run_profile();      // count main loop passes
+    #endif
 
     } // while (1)
 
 } // main
 
-static void dcc_startup_messages (void)
+// end of an init step after the track is powered: the main loop is not yet
+// running, so check for short here
+static void boot_step(t_boot_phase phase)
 {
-  t_message testmess;
-  t_message *testmessptr;
-  testmessptr = &testmess;
-
-  // 20 Reset Pakete
-
-  testmessptr = &DCC_Reset;
-  set_next_message(testmessptr);
-  next_message_count = 20;
-
-  while (next_message_count > 0)      // wait
-  {
-    delay(1);
-  }
-  // 10 Idle Pakete
-
-  testmessptr = &DCC_Idle;
-  set_next_message(testmessptr);
-  next_message_count = 10;
+  boot_mark(phase);
+  check_short();
+}
 
-  while (next_message_count > 0)      // wait
-  {
-    delay(1);
-  }
+// alive led, restarts its own timer
+static void led_blink(unsigned int arg)
+{
+  tw_start(LED_BLINK_MS / TW_TICK_MS, led_blink, 0);
+  GpioDataRegs.GPBTOGGLE.bit.GPIO39 = 1;
 }
 
 //
 // End of File
 //
-
@@ -34,6 +34,7 @@
 //  1. Data and support routines
 //  2. Build routines for DCC messages
 //  3. Turnout control (position memory)
+//  3a. Advanced consist (multi unit via CV19)
 //  4. Routines for Locobuffer (memory for actual loco states)
 //  5. Command Organizer (queues, engines for repeat and refresh of dcc messages)
 //  6. Upstream Interface (to be called by parser)
@@ -64,10 +65,15 @@
 #include "config.h"                // general structures and definitions
 #include "database.h"
 #include "dccout.h"
+#include "dccgen.h"                // DG_RING
+#include "district.h"              // power districts
 #include "status.h"                // opendcc_state
 
 #include "organizer.h" 
 #include "programmer.h"      // wegen programmer_busy();        
+#include "snapshot.h"        // warm start of turnout_state
+#include "events.h"          // stolen locos, changed turnouts
+#include "scheduler.h"       // sched_ready
 
 //------------------------------------------------------------------------
 // define a structure for DCC messages
@@ -786,12 +792,275 @@ static void build_dcc_fast_clock(t_fast_clock *my_clock, t_message *new_message)
 // addressing:   Turnout: 1 .... 8, 9 .... 16, ...
 //               Group:   |--1---|, |--2----|, ...
 //               addr:    0 .... 7
+//
+// TAPAS:     2 bits per turnout, as used by Lenz 0x42 (Schaltinformation):
+//            00 = not yet operated, 01 = output 0, 10 = output 1.
+//            8 turnouts per word, so the 2 turnouts of a Lenz nibble
+//            (decoder * 4 + N * 2, +1) are always in the same word:
+//            a nibble is one shift and mask.
+//            Every change is put to turnout_changed (journal), the host
+//            parser sends it as unsolicited 0x42, so the host need not poll.
+//            Operations from a handheld (slot != 0) are also put to
+//            turnout_manual.
+
+#define TURNOUT_STATE_MASK      0x03
+
+#pragma DATA_SECTION(turnout_state, "turnoutstate");     // see F28069M.cmd
+unsigned int turnout_state[SIZE_TURNOUT_STATE / 8];
+
+#if (DCC_SNAPSHOT == 1)
+#pragma DATA_SECTION(turnout_state_sum, "warmstart");    // survives a reset, see snapshot.c
+#endif
+unsigned int turnout_state_sum;                         // sum of turnout_state[], kept with every change
+
+typedef struct
+  {
+    unsigned int  addr[SIZE_TURNOUT_JOURNAL];
+    unsigned char read;                 // oldest entry
+    unsigned char count;                // no of entries
+  } t_turnout_journal;
+
+t_turnout_journal turnout_changed;      // for the host
+t_turnout_journal turnout_manual;       // from handheld
+
+static void journal_put(t_turnout_journal *journal, unsigned int addr)
+  {
+    unsigned char i;
+
+    for (i=0; i<journal->count; i++)
+      {
+        if (journal->addr[(journal->read + i) % SIZE_TURNOUT_JOURNAL] == addr) return;  // already there
+      }
+    if (journal->count == SIZE_TURNOUT_JOURNAL)
+      {                                           // full: drop oldest, host may poll
+        journal->read = (journal->read + 1) % SIZE_TURNOUT_JOURNAL;
+        journal->count--;
+      }
+    journal->addr[(journal->read + journal->count) % SIZE_TURNOUT_JOURNAL] = addr;
+    journal->count++;
+  }
+
+static unsigned int journal_get(t_turnout_journal *journal)
+  {
+    unsigned int addr;
+
+    addr = journal->addr[journal->read];
+    journal->read = (journal->read + 1) % SIZE_TURNOUT_JOURNAL;
+    journal->count--;
+    return(addr);
+  }
+
+static unsigned int turnout_sum(void)
+  {
+    unsigned int i, sum;
+
+    sum = 0;
+    for (i=0; i<(SIZE_TURNOUT_STATE / 8); i++) sum += turnout_state[i];
+    return(sum);
+  }
+
+static void init_turnout(void)
+  {
+    #if (DCC_SNAPSHOT == 1)
+    // warm start: the table survived the reset, if its sum is still right
+    if (!snapshot_valid() || (turnout_sum() != turnout_state_sum))
+    #endif
+      {
+        memset(turnout_state, 0, sizeof(turnout_state));
+        turnout_state_sum = 0;
+      }
+    turnout_changed.read = 0;
+    turnout_changed.count = 0;
+    turnout_manual.read = 0;
+    turnout_manual.count = 0;
+  }
+
+void save_turnout(unsigned char slot, unsigned int addr, unsigned char output)
+  {
+    unsigned int shift, old;
+
+    if (addr >= SIZE_TURNOUT_STATE) return;
+    shift = (addr % 8) * 2;
+    old = turnout_state[addr / 8];
+    turnout_state[addr / 8] = (old & ~(TURNOUT_STATE_MASK << shift)) | ((1 + (output & 0x01)) << shift);
+    turnout_state_sum += turnout_state[addr / 8] - old;
+    if (slot) journal_put(&turnout_manual, addr);
+    if (turnout_state[addr / 8] != old)
+      {
+        journal_put(&turnout_changed, addr);
+        event_post(EV_TURNOUT, addr, output & 0x01);
+      }
+  }
+
+// return: last output of turnout [0,1]; 0 if never operated
+unsigned char recall_turnout(unsigned int addr)
+  {
+    if (addr >= SIZE_TURNOUT_STATE) return(0);
+    return(((turnout_state[addr / 8] >> ((addr % 8) * 2)) & TURNOUT_STATE_MASK) == 2);
+  }
+
+// return: outputs of the 8 turnouts of this group, bit 0 = first turnout
+unsigned char recall_turnout_group(unsigned int group_addr)
+  {
+    unsigned int state;
+    unsigned char i, result;
+
+    if (group_addr >= SIZE_TURNOUT_STATE / 8) return(0);
+    state = turnout_state[group_addr];
+    result = 0;
+    for (i=0; i<8; i++)
+      {
+        if (((state >> (i * 2)) & TURNOUT_STATE_MASK) == 2) result |= (1 << i);
+      }
+    return(result);
+  }
 
-void save_turnout(unsigned char slot, unsigned int addr, unsigned char output)  {  }
-unsigned char recall_turnout(unsigned int addr)  {    return(0);  }
-unsigned char recall_turnout_group(unsigned int group_addr)  {    return(0);  }
-unsigned char get_number_of_manual_turnout_ops(void)  {    return(0);  }
-unsigned int recall_manual_turnout(void);
+// return: ZZZZ of Lenz 0x42 for turnouts addr, addr+1 (addr even)
+unsigned char recall_turnout_nibble(unsigned int addr)
+  {
+    if (addr >= SIZE_TURNOUT_STATE) return(0);
+    return((turnout_state[addr / 8] >> ((addr % 8) * 2)) & 0x0F);
+  }
+
+unsigned char get_turnout_change(unsigned int *addr)
+  {
+    if (turnout_changed.count == 0) return(0);
+    *addr = journal_get(&turnout_changed);
+    return(1);
+  }
+
+unsigned char get_number_of_manual_turnout_ops(void)
+  {
+    return(turnout_manual.count);
+  }
+
+unsigned int recall_manual_turnout(void)
+  {
+    if (turnout_manual.count == 0) return(0);
+    return(journal_get(&turnout_manual));
+  }
+
+#if (DCC_ADVANCED_CONSIST == 1)
+//============================================================================
+//
+// 3a. Advanced consist (multi unit via CV19)
+//
+//============================================================================
+//
+// purpose:   drive N locos with one speed packet instead of N.
+//
+// how:       every member gets the consist address written to CV19 by PoM
+//            (bit 7 = reversed inside the consist). From then on the decoders
+//            listen to the consist address for speed and direction.
+//            The consist address is kept in locobuffer like a normal loco,
+//            the members stay in locobuffer (for functions), but are marked
+//            with .consist and their speed is no longer refreshed.
+//            Speed commands to a member address are redirected to the
+//            consist address, the direction is flipped for reversed members.
+//
+// note:      consist addresses are short addresses (1..99, like Lenz MTR)
+//
+// interface: consist_find_member(addr)
+//            consist_is_member(addr)
+//            consist_inquiry(mtr, dir)
+//            consist_member_inquiry(mtr, addr, dir)
+//            upstream: do_consist_add(), do_consist_remove() -> see chapter 6
+
+t_consist_entry consist[SIZE_CONSIST];
+
+void init_consist(void)
+  {
+    unsigned char i;
+
+    for (i=0; i<SIZE_CONSIST; i++)
+      {
+        consist[i].addr = 0;
+        consist[i].mtr = 0;
+        consist[i].reversed = 0;
+      }
+  }
+
+// return: index in consist[] if addr is a member, SIZE_CONSIST if not
+unsigned char consist_find_member(unsigned int addr)
+  {
+    unsigned char i;
+
+    if (addr == 0) return(SIZE_CONSIST);
+    for (i=0; i<SIZE_CONSIST; i++)
+      {
+        if (consist[i].addr == addr) return(i);
+      }
+    return(SIZE_CONSIST);
+  }
+
+unsigned char consist_is_member(unsigned int addr)
+  {
+    return(consist_find_member(addr) < SIZE_CONSIST);
+  }
+
+static unsigned char consist_count_members(unsigned char mtr)
+  {
+    unsigned char i, n = 0;
+
+    for (i=0; i<SIZE_CONSIST; i++)
+      {
+        if ((consist[i].addr != 0) && (consist[i].mtr == mtr)) n++;
+      }
+    return(n);
+  }
+
+//-----------------------------------------------------------------------------------
+// scan the consist table and return the next consist address; 0 if not found
+// dir=1: forward (next higher mtr), dir=0: backward (next lower mtr)
+// same sort rules as addr_inquiry_locobuffer()
+
+unsigned char consist_inquiry(unsigned char mtr, unsigned char dir)
+  {
+    unsigned char i;
+    unsigned char next_mtr;
+
+    if (dir) next_mtr = 0xff;
+    else next_mtr = 0;
+    for (i=0; i<SIZE_CONSIST; i++)
+      {
+        if (consist[i].addr == 0) continue;
+        if (dir)
+          {
+            if ((consist[i].mtr > mtr) && (consist[i].mtr < next_mtr)) next_mtr = consist[i].mtr;
+          }
+        else
+          {
+            if ((consist[i].mtr < mtr) && (consist[i].mtr > next_mtr)) next_mtr = consist[i].mtr;
+          }
+      }
+    if (next_mtr == 0xff) next_mtr = 0;
+    return(next_mtr);
+  }
+
+// return the next member of consist mtr (sorted by address); 0 if not found
+unsigned int consist_member_inquiry(unsigned char mtr, unsigned int addr, unsigned char dir)
+  {
+    unsigned char i;
+    unsigned int next_addr;
+
+    if (dir) next_addr = 0xffff;
+    else next_addr = 0;
+    for (i=0; i<SIZE_CONSIST; i++)
+      {
+        if ((consist[i].addr == 0) || (consist[i].mtr != mtr)) continue;
+        if (dir)
+          {
+            if ((consist[i].addr > addr) && (consist[i].addr < next_addr)) next_addr = consist[i].addr;
+          }
+        else
+          {
+            if ((consist[i].addr < addr) && (consist[i].addr > next_addr)) next_addr = consist[i].addr;
+          }
+      }
+    if (next_addr == 0xffff) next_addr = 0;
+    return(next_addr);
+  }
+#endif // DCC_ADVANCED_CONSIST
 
 //============================================================================
 //
@@ -818,7 +1087,13 @@ unsigned int recall_manual_turnout(void);
 unsigned char cur_i;             // this locobuffer entry is currently used
 unsigned char cur_ref_level;     // level = 0
 
+#if (DCC_ADAPTIVE_REPEAT == 1)
+uint32_t refresh_cycle_start;    // millis() when cur_ref_level did wrap
+unsigned int refresh_cycle_time; // duration of last complete refresh cycle (ms), 0 = no loco
+#endif
+
 unsigned char lb_index;          // locobuufer index
+static unsigned char lb_owner[SIZE_LOCOBUFFER];  // slot which sent the last command
 
 t_message loco_search;
 t_message *loco_search_ptr;
@@ -833,12 +1108,17 @@ void init_locobuffer(void)
 
     cur_i = 0;                                           // refresh index
 	cur_ref_level = 0;
+    #if (DCC_ADAPTIVE_REPEAT == 1)
+    refresh_cycle_start = millis();
+    refresh_cycle_time = 0;
+    #endif
     loco_search_ptr = &loco_search;
     locobuff_mes_ptr = &locobuff_mes;
 
     for (j=0; j<SIZE_LOCOBUFFER; j++)
       {
         locobuffer[j].address = 0;
+        lb_owner[j] = 0;
       }
   }
 
@@ -887,11 +1167,18 @@ static unsigned char get_entry(unsigned char slot, unsigned int addr)
             if (locobuffer[i].active)
               {
                 lb_index = i;
+                if (lb_owner[i] != slot)
+                  {
+                    event_post(EV_LOCO_STOLEN, addr, ((unsigned int)lb_owner[i] << 8) | slot);
+                    lb_owner[i] = slot;
+                    retval = (1 << ORGZ_STOLEN);
+                  }
                 return(retval);
               }
             else
               {
                 lb_index = i;
+                lb_owner[i] = slot;
                 locobuffer[lb_index].address = addr;
                 locobuffer[lb_index].refresh = 0;
                 locobuffer[lb_index].format = get_loco_format(addr);
@@ -900,6 +1187,9 @@ static unsigned char get_entry(unsigned char slot, unsigned int addr)
                 locobuffer[lb_index].f4_f1 = 0;
                 locobuffer[lb_index].f8_f5 = 0;
                 locobuffer[lb_index].f12_f9 = 0;
+                #if (DCC_ADVANCED_CONSIST == 1)
+                locobuffer[lb_index].consist = consist_is_member(addr);
+                #endif
                 retval = (1 << ORGZ_NEW);
                 return(retval);
               }
@@ -912,6 +1202,7 @@ static unsigned char get_entry(unsigned char slot, unsigned int addr)
         if (locobuffer[i].address == 0)
           {
             lb_index = i;
+            lb_owner[i] = slot;
 
             locobuffer[lb_index].address = addr;
             locobuffer[lb_index].refresh = 0;
@@ -921,6 +1212,9 @@ static unsigned char get_entry(unsigned char slot, unsigned int addr)
             locobuffer[lb_index].f4_f1 = 0;
             locobuffer[lb_index].f8_f5 = 0;
             locobuffer[lb_index].f12_f9 = 0;
+            #if (DCC_ADVANCED_CONSIST == 1)
+            locobuffer[lb_index].consist = consist_is_member(addr);
+            #endif
             retval = (1 << ORGZ_NEW);
             return(retval);
           }
@@ -935,6 +1229,7 @@ static unsigned char get_entry(unsigned char slot, unsigned int addr)
           }
       }
     lb_index = found_i;
+    lb_owner[lb_index] = slot;
 
     locobuffer[lb_index].address = addr;
     locobuffer[lb_index].refresh = 0;
@@ -944,6 +1239,9 @@ static unsigned char get_entry(unsigned char slot, unsigned int addr)
     locobuffer[lb_index].f4_f1 = 0;
     locobuffer[lb_index].f8_f5 = 0;
     locobuffer[lb_index].f12_f9 = 0;
+    #if (DCC_ADVANCED_CONSIST == 1)
+    locobuffer[lb_index].consist = consist_is_member(addr);
+    #endif
     retval = (1 << ORGZ_NEW);  // okay, is probably stolen, but who cares? (it is our oldest loco)
     return(retval);
   }
@@ -1263,6 +1561,10 @@ t_message * build_f5_message_from_locobuffer(unsigned char i)
 // level 8: refresh all locos -> speed
 // level 9: refresh all locos -> func grp 3
 //
+// consist members are skipped on the speed levels, their speed is refreshed
+// once for all members with the consist address.
+// locos of a filtered district are skipped, they are refreshed in their
+// district (refresh_districts).
 //
 static t_message * get_next_item_from_locobuffer(void)    
   {
@@ -1291,6 +1593,10 @@ static t_message * get_next_item_from_locobuffer(void)
               {
                 // level has reached top: now fade out all refresh levels.
                 cur_ref_level = 0;
+                #if (DCC_ADAPTIVE_REPEAT == 1)
+                refresh_cycle_time = (unsigned int)(millis() - refresh_cycle_start);
+                refresh_cycle_start = millis();
+                #endif
                 unsigned char j; 
                 for (j=0; j<SIZE_LOCOBUFFER; j++)
                   {
@@ -1301,7 +1607,12 @@ static t_message * get_next_item_from_locobuffer(void)
                   }
               }
           }
+        #if (DCC_DISTRICTS > 1)
+        if (locobuffer[cur_i].active && (locobuffer[cur_i].address != 0) &&
+            (district_of(locobuffer[cur_i].address) == 0))  // the others: refresh_districts
+        #else
         if (locobuffer[cur_i].active && (locobuffer[cur_i].address != 0))
+        #endif
 		  {
             if (cur_ref_level & 0x01)
               {
@@ -1342,8 +1653,13 @@ static t_message * get_next_item_from_locobuffer(void)
     #endif
                   }
               }
+            #if (DCC_ADVANCED_CONSIST == 1)
+            else if (!locobuffer[cur_i].consist)            // members: speed goes via consist address
+                return(build_speed_message_from_locobuffer(cur_i));
+            #else
             else
                 return(build_speed_message_from_locobuffer(cur_i));
+            #endif
           }
       }
 //     return (&DCC_Idle);                   // void
@@ -1361,6 +1677,10 @@ t_message * search_locobuffer(void)
       {
         if (cur_ref_level > 0) cur_ref_level--;     // back one level
         cur_i = SIZE_LOCOBUFFER+1;                  // set to max -> void
+        #if (DCC_ADAPTIVE_REPEAT == 1)
+        refresh_cycle_time = 0;                     // nothing to refresh
+        refresh_cycle_start = millis();
+        #endif
         return(&DCC_Idle);
       }
     return(my_search_ptr);
@@ -1379,6 +1699,8 @@ t_message * search_locobuffer(void)
 //              queue_hp: new messages, high priority
 //              queue_lp: new messages, low priority
 //              queue_prog: this queue is only used during programming;
+//                          with DCC_PROG_TRACK the ring of the prog
+//                          generator takes its place (dccout.c)
 //              repeatbuffer: messages to be repeated
 //              locobuffer: messages to be refreshed (like speed messages)
 //
@@ -1428,6 +1750,26 @@ unsigned char lp_write;           // points to next write
                                   // rd = wr + 1: queue full
 // !!! unsigned char repeat_filled;
 
+static unsigned char queue_depth(unsigned char rd, unsigned char wr, unsigned char size)
+  {
+    if (wr >= rd) return(wr - rd);
+    return(size - rd + wr);
+  }
+
+#if (DCC_ADAPTIVE_REPEAT == 1)
+#define REPEAT_ADAPT_PERIOD   20        // in ticks of 5ms
+#define REPEAT_IDLE_PERIODS   5
+
+unsigned char repeat_adapt_timer;
+unsigned char repeat_idle_periods;
+
+#endif
+
+#if (DCC_DISTRICTS > 1)
+static unsigned char district_cur[DISTRICT_MAX];     // refresh_districts: locobuffer index
+static unsigned char district_f1[DISTRICT_MAX];      // 1: this round function group 1
+#endif
+
 void init_organizer(void)
   {
     unsigned char i;
@@ -1446,13 +1788,101 @@ void init_organizer(void)
       }
 
     init_locobuffer();
+    init_turnout();
+    #if (DCC_DISTRICTS > 1)
+    for (i=0; i<DISTRICT_MAX; i++)
+      {
+        district_cur[i] = 0;
+        district_f1[i] = 0;
+      }
+    #endif
+    #if (DCC_ADVANCED_CONSIST == 1)
+    init_consist();
+    #endif
+    #if (DCC_RAIL_STATS == 1)
+    rail_top_reset();
+    #endif
+
+    dcc_acc_repeat = eemem[eadr_dcc_acc_repeat];
+    dcc_pom_repeat = eemem[eadr_dcc_pom_repeat];
+    dcc_func_repeat = eemem[eadr_dcc_func_repeat];
+    dcc_speed_repeat = eemem[eadr_dcc_speed_repeat];
+    #if (DCC_ADAPTIVE_REPEAT == 1)
+    repeat_idle_periods = 0;
+    repeat_adapt_timer = 0;
+    #endif
+  }
+
+#if (DCC_ADAPTIVE_REPEAT == 1)
+//---------------------------------------------------------------------------------
+// adaptive repeat
+//
+// At an idle rail repeats cost nothing, under load they delay new commands and
+// stretch the refresh cycle. Every REPEAT_ADAPT_PERIOD the load is checked:
+//   busy: queue_hp or queue_lp are filling or the refresh cycle is longer then
+//         DCC_REFRESH_LIMIT -> all repeats one down, not below DCC_xx_REPEAT_MIN
+//   idle: queues empty and refresh fast for REPEAT_IDLE_PERIODS in a row
+//         -> all repeats one up, not above DCC_xx_REPEAT_MAX
+// The new values apply to messages built from now on.
+
+static unsigned char repeat_down(unsigned char value, unsigned char min)
+  {
+    if (value > min) value--;
+    return(value);
+  }
 
-    dcc_acc_repeat = NUM_DCC_ACC_REPEAT;
-    dcc_pom_repeat = NUM_DCC_POM_REPEAT;
-    dcc_func_repeat = NUM_DCC_FUNC_REPEAT;
-    dcc_speed_repeat = NUM_DCC_SPEED_REPEAT;
+static unsigned char repeat_up(unsigned char value, unsigned char max)
+  {
+    if (value < max) value++;
+    return(value);
   }
 
+// called every 5ms from run_state
+void repeat_adapt_tick(void)
+  {
+    unsigned char hp_depth, lp_depth;
+    uint32_t cycle;
+
+    if (++repeat_adapt_timer < REPEAT_ADAPT_PERIOD) return;
+    repeat_adapt_timer = 0;
+
+    if ((opendcc_state != RUN_OKAY) && (opendcc_state != RUN_PAUSE) && (opendcc_state != RUN_STOP))
+        return;                                      // organizer is not refreshing
+
+    hp_depth = queue_depth(hp_read, hp_write, SIZE_QUEUE_HP);
+    lp_depth = queue_depth(lp_read, lp_write, SIZE_QUEUE_LP);
+
+    // a starved refresh does not complete its cycle: the running one counts too
+    cycle = millis() - refresh_cycle_start;
+    if (cycle < refresh_cycle_time) cycle = refresh_cycle_time;
+
+    if ((hp_depth >= 2) ||
+        (lp_depth >= SIZE_QUEUE_LP / 4) ||
+        (cycle > DCC_REFRESH_LIMIT))
+      {
+        repeat_idle_periods = 0;
+        dcc_speed_repeat = repeat_down(dcc_speed_repeat, DCC_SPEED_REPEAT_MIN);
+        dcc_acc_repeat   = repeat_down(dcc_acc_repeat,   DCC_ACC_REPEAT_MIN);
+        dcc_func_repeat  = repeat_down(dcc_func_repeat,  DCC_FUNC_REPEAT_MIN);
+        dcc_pom_repeat   = repeat_down(dcc_pom_repeat,   DCC_POM_REPEAT_MIN);
+      }
+    else if ((hp_depth == 0) && (lp_depth == 0) &&
+             (cycle < DCC_REFRESH_LIMIT / 2))
+      {
+        if (++repeat_idle_periods < REPEAT_IDLE_PERIODS) return;
+        repeat_idle_periods = 0;
+        dcc_speed_repeat = repeat_up(dcc_speed_repeat, DCC_SPEED_REPEAT_MAX);
+        dcc_acc_repeat   = repeat_up(dcc_acc_repeat,   DCC_ACC_REPEAT_MAX);
+        dcc_func_repeat  = repeat_up(dcc_func_repeat,  DCC_FUNC_REPEAT_MAX);
+        dcc_pom_repeat   = repeat_up(dcc_pom_repeat,   DCC_POM_REPEAT_MAX);
+      }
+    else
+      {
+        repeat_idle_periods = 0;                     // moderate load: keep values
+      }
+  }
+#endif
+
 
 // return TRUE if found and replaced, return false, if not found
 bool find_in_queue_lp(t_message *new_message)
@@ -1629,12 +2059,38 @@ unsigned char put_in_queue_hp(t_message *new_message)
 // um Tastendruck und Kurzschluï¿½ï¿½berwachung zu haben!!!!!
 bool queue_prog_is_empty(void)
   {
+    #if (DCC_PROG_TRACK == 1)
+    return(dccout_prog_depth() == 0);       // all taken by the prog generator
+    #else
     if (prog_write == prog_read) return(1);
 	else 
       {
         run_organizer();
       }
     return(0);
+    #endif
+  }
+
+// the message taken last is still repeated: time to wait for the ack
+bool queue_prog_repeating(void)
+  {
+    #if (DCC_PROG_TRACK == 1)
+    return(dccout_prog_repeat_left() > 0);
+    #else
+    return(next_message_count > 1);         // again dirty: we ask the communication flag
+    #endif
+  }
+
+// ack received: skip further repetitions
+void queue_prog_skip_repeat(void)
+  {
+    #if (DCC_PROG_TRACK == 1)
+    dccout_prog_skip();
+    #else
+    DINT;
+    if (next_message_count>1) next_message_count=1;     // fool dccout - this is dirty!
+    EINT;
+    #endif
   }
 
 
@@ -1643,6 +2099,14 @@ bool queue_prog_is_empty(void)
 // bei write trotz full gibt es einen gnadenlosen fifo-flush,
 // also vorher organizer_ready() anfragen.
 
+#if (DCC_PROG_TRACK == 1)
+unsigned char put_in_queue_prog(t_message *new_message)
+  {
+    if (!dccout_prog_put(new_message)) return(1 << ORGZ_FULL);
+    if (dccout_prog_depth() >= DG_RING - 2) return(1 << ORGZ_FULL);     // one left -> say full
+    return(0);
+  }
+#else
 unsigned char put_in_queue_prog(t_message *new_message)
   {
     unsigned char i;
@@ -1666,6 +2130,7 @@ unsigned char put_in_queue_prog(t_message *new_message)
 
     return(0);
   }
+#endif
 
 
 unsigned char put_in_queue_low(t_message *new_message)
@@ -1851,50 +2316,200 @@ void clear_from_repeatbuffer(t_message *new_message)
 // downstream
 //----------------------------------------------------------------------------------
 //
-// set_next_message: forward the current message to dccout.c
-// next_message_count is the flag of DCCOUT - a new message has arrived
+#if (DCC_RAIL_STATS == 1)
+// rail_top: the addresses with the most packets on the rail.
+// This is a 'space saving' top list: if a new address does not fit,
+// it replaces the entry with the lowest count and inherits this count
+// (stored as error) - so count is an upper bound, count-error a lower bound.
+// key: bit15 = long loco address, bit14 = accessory decoder, rest = address
+// Counted are the sends on the rails: the isr counts each load of
+// next_message (dccout_rail_sent), this is credited to the message when the
+// organizer replaces it. Repeats of a prog message count each; a message
+// cut by an estop only with the sends done before.
+
+t_rail_top rail_top[SIZE_RAIL_TOP];
 
-void set_next_message (t_message *newmsg)
+void rail_top_reset(void)
   {
-    unsigned char my_repeat;
+    unsigned char i;
+    for (i=0; i<SIZE_RAIL_TOP; i++)
+      {
+        rail_top[i].key = 0;
+        rail_top[i].count = 0;
+        rail_top[i].error = 0;
+      }
+  }
 
-    memcpy(next_message.dcc, newmsg->dcc, newmsg->size);
+static unsigned int rail_top_key(unsigned char *dcc)
+  {
+    if (dcc[0] == 0) return(0);                                 // broadcast
+    if (dcc[0] < 128) return(dcc[0]);                           // short loco address
+    if (dcc[0] < 192)                                           // accessory decoder address
+        return(RAIL_KEY_ACC | (dcc[0] & 0x3F) | ((unsigned int)(~dcc[1] & 0x70) << 2));
+    if (dcc[0] < 232)                                           // long loco address
+        return(RAIL_KEY_LONG | ((unsigned int)(dcc[0] & 0x3F) << 8) | dcc[1]);
+    return(0);                                                  // idle
+  }
 
-    // now scan this message for speed command and replaces the speed value depending
-    // on organizer_halt_state
+static void rail_top_add(t_rail_top *entry, unsigned char n)
+  {
+    if (entry->count > 0xFFFF - n) entry->count = 0xFFFF;
+    else entry->count += n;
+  }
+
+static void rail_top_count(unsigned char *dcc, unsigned char n)
+  {
+    unsigned int key;
+    unsigned char i, min_i;
+
+    key = rail_top_key(dcc);
+    if (key == 0) return;
+
+    min_i = 0;
+    for (i=0; i<SIZE_RAIL_TOP; i++)
+      {
+        if (rail_top[i].key == key)
+          {
+            rail_top_add(&rail_top[i], n);
+            return;
+          }
+        if (rail_top[i].count < rail_top[min_i].count) min_i = i;
+      }
+    // not found: take the free or the weakest entry
+    rail_top[min_i].key = key;
+    rail_top[min_i].error = rail_top[min_i].count;
+    rail_top_add(&rail_top[min_i], n);
+  }
+
+// credit the sends of the old next_message before it is replaced;
+// called with next_message_count == 0, the isr does not load it meanwhile
+static void rail_top_sent(void)
+  {
+    unsigned char n;
 
+    n = dccout_rail_sent;
+    dccout_rail_sent = 0;
+    if (n) rail_top_count(next_message.dcc, n);
+  }
+#endif
+
+// set_next_message: forward the current message to dccout.c
+// next_message_count is the flag of DCCOUT - a new message has arrived
+// source is only used for the rail statistic.
+
+// scan this message for speed command and replace the speed value depending
+// on organizer_halt_state
+static void halt_speed(unsigned char *dcc)
+  {
     if (organizer_state.halted)
       {
-        if ( (next_message.dcc[0] > 0) &&
-             (next_message.dcc[0] < 112) ) // short adr.
+        if ( (dcc[0] > 0) &&
+             (dcc[0] < 112) ) // short adr.
           {
-            if (next_message.dcc[1] == 0x3F )  // (128 Speed Steps)
+            if (dcc[1] == 0x3F )  // (128 Speed Steps)
               {
-                // next_message.dcc[2] (msb=dir, 7 bit=speed, 0=stop, 1=e-stop)
-                next_message.dcc[2] &= 0x80; // keep dir
+                // dcc[2] (msb=dir, 7 bit=speed, 0=stop, 1=e-stop)
+                dcc[2] &= 0x80; // keep dir
               }
-            else if ((next_message.dcc[1] & 0x40) == 0x40 )
+            else if ((dcc[1] & 0x40) == 0x40 )
               {
-                next_message.dcc[1] &= 0xF0; // keep dir
+                dcc[1] &= 0xF0; // keep dir
               }
           }
-        if ((next_message.dcc[0] >= 192)  && // long adr. 
-            (next_message.dcc[0] < 232) )
+        if ((dcc[0] >= 192)  && // long adr. 
+            (dcc[0] < 232) )
           {
-            if (next_message.dcc[2] == 0x3F )  // (128 Speed Steps)
+            if (dcc[2] == 0x3F )  // (128 Speed Steps)
               {
-                // next_message.dcc[3] (msb=dir, 7 bit=speed, 0=stop, 1=e-stop)
-                next_message.dcc[3] &= 0x80; // keep dir
+                // dcc[3] (msb=dir, 7 bit=speed, 0=stop, 1=e-stop)
+                dcc[3] &= 0x80; // keep dir
               }
-            else if ((next_message.dcc[2] & 0x40) == 0x40 )
+            else if ((dcc[2] & 0x40) == 0x40 )
               {
-                next_message.dcc[2] &= 0xF0; // keep dir
+                dcc[2] &= 0xF0; // keep dir
               }
           }
       }
+  }
+
+#if (DCC_DISTRICTS > 1)
+//---------------------------------------------------------------------------------
+// power districts (district.c)
+// A loco routed to a filtered district does not go to main: its commands
+// go to the ring of the district, its refresh is done here, one loco per
+// call while the ring runs low - speed, in the next round function group 1.
+// The ring is kept short, so new commands find room.
+
+static void district_send(unsigned char d, t_message *msg)
+  {
+    unsigned char dcc[MAX_DCC_SIZE];
+
+    memcpy(dcc, msg->dcc, msg->size);
+    halt_speed(dcc);
+    district_put(d, dcc, msg->size);
+  }
+
+static void refresh_districts(void)
+  {
+    unsigned char d, n, i;
+    t_message *msg;
+
+    for (d=1; d<DCC_DISTRICTS; d++)
+      {
+        if (!district_wants_refresh(d)) continue;
+        for (n=0; n<SIZE_LOCOBUFFER; n++)
+          {
+            i = district_cur[d] + 1;
+            if (i >= SIZE_LOCOBUFFER)
+              {
+                i = 0;
+                district_f1[d] ^= 1;
+              }
+            district_cur[d] = i;
+            if (!locobuffer[i].active || (locobuffer[i].address == 0)) continue;
+            if (district_of(locobuffer[i].address) != d) continue;
+            if (district_f1[d])
+              {
+                if ((locobuffer[i].fl == 0) && (locobuffer[i].f4_f1 == 0)) continue;
+                msg = build_f1_message_from_locobuffer(i);
+              }
+            #if (DCC_ADVANCED_CONSIST == 1)
+            else if (locobuffer[i].consist) continue;   // speed via consist address
+            #endif
+            else msg = build_speed_message_from_locobuffer(i);
+            if (msg == &DCC_Idle) continue;
+            district_send(d, msg);
+            break;
+          }
+      }
+  }
+#endif // DCC_DISTRICTS
+
+void set_next_message (t_message *newmsg, t_msg_source source)
+  {
+    unsigned char my_repeat;
+    #if (DCC_DISTRICTS > 1)
+    unsigned char d;
+
+    d = district_of(district_loco_addr(newmsg->dcc));
+    if (d && (newmsg->type != is_prog))
+      {
+        district_send(d, newmsg);
+        sched_ready(SCHED_ORGANIZER);       // main still waits for a message
+        return;
+      }
+    #endif
+
+    #if (DCC_RAIL_STATS == 1)
+    rail_top_sent();
+    #endif
+
+    memcpy(next_message.dcc, newmsg->dcc, newmsg->size);
+    halt_speed(next_message.dcc);
 
     next_message.size = newmsg->size;
     next_message.type = newmsg->type;
+    next_message.source = source;
 
     if (newmsg->type == is_prog)
       {                                      // prog commands keep their repeat
@@ -1907,16 +2522,24 @@ void set_next_message (t_message *newmsg)
         next_message_count = 1;              // all other command have no repeat
                                              // -> repeat is done with repeat_buffer.
       }
+    #if (DCC_DISTRICTS > 1)
+    if (newmsg->type != is_prog) district_mirror(next_message.dcc, next_message.size);
+    #endif
   }
   
 void set_next_message_and_repeat (t_message *newmsg)
   {
     unsigned char my_repeat;
 
+    #if (DCC_RAIL_STATS == 1)
+    rail_top_sent();
+    #endif
+
     memcpy(next_message.dcc, newmsg->dcc, newmsg->size);
 
     next_message.size = newmsg->size;
     next_message.type = newmsg->type;
+    next_message.source = from_prog;
 
     my_repeat = newmsg->repeat;             //immediate repeat
     if (my_repeat == 0) my_repeat = 1;
@@ -1936,6 +2559,7 @@ void set_next_message_and_repeat (t_message *newmsg)
 // RUN_OFF:     only idle (we dont want to loose a command)    // Output disabled (2*Taste, PC)
 //
 // RUN_SHORT:   only idle (we dont want to loose a command)    // Kurzschluss;
+//              with DCC_DISTRICTS as RUN_OKAY: only main is off
 //
 // RUN_PAUSE:   run queues and refresh, but set speed 0        // DCC Running, all Engines Speed 0
 //
@@ -1959,6 +2583,14 @@ void run_organizer(void)
 
     my_search_ptr = &search_message;
 
+    #if (DCC_DISTRICTS > 1)
+    if ((opendcc_state == RUN_OKAY) || (opendcc_state == RUN_PAUSE) ||
+        (opendcc_state == RUN_STOP) || (opendcc_state == RUN_SHORT))
+      {
+        refresh_districts();                // own pace, not bound to main
+      }
+    #endif
+
     // is DCC_OUT ready?
     if (next_message_count != 0) return;
 
@@ -1969,13 +2601,16 @@ void run_organizer(void)
 	    case RUN_OKAY:      // all runnung
         case RUN_PAUSE:     // slow down
         case RUN_STOP:      // speed 0		
+        #if (DCC_DISTRICTS > 1)
+        case RUN_SHORT:     // only main is off, the other districts go on
+        #endif
             // check queue_hp
             if ((hp_write != hp_read) &&
                 (queue_hp[hp_read].dcc[0] != next_message.dcc[0]))
               {
                 // read message from queue_hp
                 next_mess_ptr = &queue_hp[hp_read];
-                set_next_message(next_mess_ptr);
+                set_next_message(next_mess_ptr, from_hp);
                 hp_read++;
                 if (hp_read == SIZE_QUEUE_HP) hp_read = 0;   // advance pointer
 
@@ -1989,7 +2624,7 @@ void run_organizer(void)
                   {
                     // read message from queue_lp
                     next_mess_ptr = &queue_lp[lp_read];
-                    set_next_message(next_mess_ptr);
+                    set_next_message(next_mess_ptr, from_lp);
                     lp_read++;
                     if (lp_read == SIZE_QUEUE_LP) lp_read = 0;   // advance pointer
 
@@ -2002,12 +2637,17 @@ void run_organizer(void)
                         (search_message.dcc[0] != next_message.dcc[0]) )
                       {
                         // read this message from repeatbuffer
-                        set_next_message(my_search_ptr);
+                        set_next_message(my_search_ptr, from_repeat);
                       }
                     else
                       {
                         my_search_ptr = search_locobuffer();
-                        set_next_message(my_search_ptr);
+                        if (my_search_ptr == &DCC_Idle)
+                            set_next_message(my_search_ptr, from_idle);
+                        else if (my_search_ptr == &loco_search)
+                            set_next_message(my_search_ptr, from_dummy);
+                        else
+                            set_next_message(my_search_ptr, from_refresh);
                         // if (my_search_ptr->dcc[0] != next_message.dcc[0] )
                         //  {
                         //    set_next_message(my_search_ptr);
@@ -2027,12 +2667,14 @@ void run_organizer(void)
             // set_next_message(my_search_ptr);
 			break;
 	
+        #if (DCC_DISTRICTS <= 1)
         case RUN_SHORT:
 		    // outputs are off, we do nothing; keep dccout alive with idle
 		    // my_search_ptr = &DCC_Idle;
             // set_next_message(my_search_ptr);
 			
 		    break;
+        #endif
 	
         case PROG_OKAY:
         case PROG_SHORT:
@@ -2050,7 +2692,7 @@ void run_organizer(void)
             else
               { // nichts gefunden, dann halt idle
                 my_search_ptr = &DCC_Idle;
-                set_next_message(my_search_ptr);
+                set_next_message(my_search_ptr, from_idle);
               }
 		    break;
 	  }
@@ -2071,6 +2713,7 @@ void run_organizer(void)
 //  Summary of commands to organizer:
 //      init_organizer(void)
 //      organizer_ready(void)
+//      organizer_queue_depths(hp, lp, prog)         waiting messages per queue
 //      do_loco_speed_f(slot, addr, speed, format)   set speed and format for a loco
 //      do_loco_speed(slot, addr, speed)             set speed for a loco
 //      do_loco_func_grp0(slot, addr, funct)         light
@@ -2085,6 +2728,8 @@ void run_organizer(void)
 //      do_pom_accessory(addr, cv, data)       program on the main
 //      do_all_stop(void)                      Halt all locos
 //      do_fast_clock(min. hour, day, ratio)
+//      do_consist_add(addr, mtr, reversed)    put loco into advanced consist (CV19)
+//      do_consist_remove(addr, mtr)           remove loco from advanced consist
 //
 // All commands share the same return bits - could just be or'ed.
 //
@@ -2113,6 +2758,30 @@ bool organizer_ready(void)
     return(1);                            // both queues have space
   }
 
+// no of waiting messages, for diagnosis (watchdog post mortem)
+void organizer_queue_depths(unsigned char *hp, unsigned char *lp, unsigned char *prog)
+  {
+    *hp = queue_depth(hp_read, hp_write, SIZE_QUEUE_HP);
+    *lp = queue_depth(lp_read, lp_write, SIZE_QUEUE_LP);
+    #if (DCC_PROG_TRACK == 1)
+    *prog = dccout_prog_depth();
+    #else
+    *prog = queue_depth(prog_read, prog_write, SIZE_QUEUE_PROG);
+    #endif
+  }
+
+
+#if (DCC_ADVANCED_CONSIST == 1)
+// speed for a consist member: remember it at the member (for loco info requests
+// and for the time after the consist is dissolved) and send it to the consist
+// address; reversed members see the direction flipped.
+static unsigned char consist_speed(unsigned char slot, unsigned char index, unsigned char speed)
+  {
+    enter_speed_to_locobuffer(slot, consist[index].addr, speed);
+    if (consist[index].reversed) speed ^= 0x80;
+    return(do_loco_speed(slot, consist[index].mtr, speed));
+  }
+#endif
 
 // Speed einstellen: dieses Kommando geht auch in die high priority queue falls gebremst wird;
 // immer in low priority queue, von dort wird es nach dem Ausgeben in repeatbuffer
@@ -2128,6 +2797,11 @@ unsigned char do_loco_speed_f(unsigned char slot, unsigned int addr, unsigned ch
     unsigned char index, retval;
     t_message *my_message;
 
+    #if (DCC_ADVANCED_CONSIST == 1)
+    index = consist_find_member(addr);
+    if (index < SIZE_CONSIST) return(consist_speed(slot, index, speed));
+    #endif
+
     retval = enter_speed_f_to_locobuffer(slot, addr, speed, format);
     index = last_locobuffer_index();
     if (retval & (1 << ORGZ_SLOW_DOWN) )
@@ -2158,6 +2832,11 @@ unsigned char do_loco_speed(unsigned char slot, unsigned int addr, unsigned char
     unsigned char index, retval;
     t_message *my_message;
 
+    #if (DCC_ADVANCED_CONSIST == 1)
+    index = consist_find_member(addr);
+    if (index < SIZE_CONSIST) return(consist_speed(slot, index, speed));
+    #endif
+
     retval = enter_speed_to_locobuffer(slot, addr, speed);
     index = last_locobuffer_index();
     if (retval & (1 << ORGZ_SLOW_DOWN) )
@@ -2282,6 +2961,87 @@ bool do_pom_loco_cvrd(unsigned int addr, unsigned int cv)
     return(retval);
   }
 
+#if (DCC_ADVANCED_CONSIST == 1)
+// add a loco to an advanced consist
+//
+// parameters: addr:     loco address (1..10239)
+//             mtr:      consist address (1..99)
+//             reversed: 1: loco runs reversed inside the consist
+//
+// return:     CONSIST_OKAY or CONSIST_ERR_*, see organizer.h
+//
+// the consist address is created in locobuffer with the format of the first
+// member; CV19 is written by PoM. A loco may only join while stopped.
+
+unsigned char do_consist_add(unsigned int addr, unsigned char mtr, unsigned char reversed)
+  {
+    unsigned char i, lb;
+
+    if ((addr == 0) || (mtr == 0) || (mtr > XP_SHORT_ADDR_LIMIT)) return(CONSIST_ERR_ADDR);
+    if ((addr <= XP_SHORT_ADDR_LIMIT) && consist_count_members(addr))
+        return(CONSIST_ERR_ADDR);                               // loco address is a consist address
+    if (consist_is_member(mtr)) return(CONSIST_ERR_ADDR);       // consist address is a member
+
+    i = consist_find_member(addr);
+    if (i < SIZE_CONSIST)
+      {
+        if (consist[i].mtr != mtr) return(CONSIST_ERR_IN_OTHER);
+      }
+    else
+      {
+        lb = scan_locobuffer(addr);
+        if ((lb < SIZE_LOCOBUFFER) && ((locobuffer[lb].speed & 0x7F) > 1)) return(CONSIST_ERR_SPEED);
+        for (i=0; i<SIZE_CONSIST; i++)
+          {
+            if (consist[i].addr == 0) break;
+          }
+        if (i == SIZE_CONSIST) return(CONSIST_ERR_FULL);
+      }
+
+    if (!organizer_ready()) return(CONSIST_ERR_FULL);
+
+    if (scan_locobuffer(mtr) == SIZE_LOCOBUFFER)
+      {                                                         // new consist: stopped, forward
+        enter_speed_f_to_locobuffer(0, mtr, 0x80, find_format_in_locobuffer(addr));
+      }
+
+    consist[i].addr = addr;
+    consist[i].mtr = mtr;
+    consist[i].reversed = reversed ? 1 : 0;
+
+    lb = scan_locobuffer(addr);
+    if (lb < SIZE_LOCOBUFFER) locobuffer[lb].consist = 1;
+
+    do_pom_loco(addr, 19, mtr | (consist[i].reversed << 7));
+    return(CONSIST_OKAY);
+  }
+
+// remove a loco from its consist; CV19 is cleared by PoM.
+// the loco continues with the speed last given to it as a member;
+// if it was the last member, the consist address is removed from locobuffer.
+
+unsigned char do_consist_remove(unsigned int addr, unsigned char mtr)
+  {
+    unsigned char i, lb;
+
+    i = consist_find_member(addr);
+    if (i == SIZE_CONSIST) return(CONSIST_ERR_NOT_IN);
+    if (consist[i].mtr != mtr) return(CONSIST_ERR_NOT_BASE);
+    if (!organizer_ready()) return(CONSIST_ERR_FULL);
+
+    consist[i].addr = 0;
+    consist[i].mtr = 0;
+
+    lb = scan_locobuffer(addr);
+    if (lb < SIZE_LOCOBUFFER) locobuffer[lb].consist = 0;
+
+    do_pom_loco(addr, 19, 0);
+
+    if (consist_count_members(mtr) == 0) delete_from_locobuffer(mtr);
+    return(CONSIST_OKAY);
+  }
+#endif // DCC_ADVANCED_CONSIST
+
 // 
 // parameters: addr:     turnout decoder [0000-4095]
 //             output:   coil (red, green) [0,1]
@@ -2370,6 +3130,8 @@ void do_all_stop(void)
 
     // future idea: we could also do a soft stop. (softhalt)
 
+    dccout_emergency_stop();            // first stop goes out right after the current packet
+
     DCC_BC_Brake.repeat = 10;
 
     put_in_queue_hp(&DCC_BC_Brake);
@@ -102,6 +102,7 @@ extern t_organizer_state organizer_state;
 extern unsigned char orgz_old_lok_owner;
 
 bool organizer_ready(void);                                     // true if command can be accepted
+void organizer_queue_depths(unsigned char *hp, unsigned char *lp, unsigned char *prog);
 
 unsigned char convert_speed_to_rail(unsigned char speed128, t_format format);
 unsigned char convert_speed_from_rail(unsigned char speed, t_format format);
@@ -159,6 +160,35 @@ void clear_location_locobuffer(unsigned int did);                              /
 bool do_searchid(t_unique_id* test_id);
 
 
+#if (DCC_ADVANCED_CONSIST == 1)
+// -- advanced consist (multi unit via CV19)
+// return values of do_consist_*; they match the Xpressnet error codes 0xE1 0x8n
+#define CONSIST_OKAY            0
+#define CONSIST_ERR_ADDR        1    // invalid loco or consist address
+#define CONSIST_ERR_IN_OTHER    3    // loco is already member of another consist
+#define CONSIST_ERR_SPEED       4    // loco speed is not zero
+#define CONSIST_ERR_NOT_IN      5    // loco is not member of a consist
+#define CONSIST_ERR_NOT_BASE    6    // addr is not the consist address of this loco
+#define CONSIST_ERR_FULL        8    // consist table or queues full
+
+typedef struct
+  {
+    unsigned int  addr;                 // member loco address, 0 = free entry
+    unsigned char mtr;                  // consist address (1..99)
+    unsigned char reversed;             // 1: member runs reversed inside the consist
+  } t_consist_entry;
+
+extern t_consist_entry consist[SIZE_CONSIST];   // kept in the warm start snapshot
+
+unsigned char do_consist_add(unsigned int addr, unsigned char mtr, unsigned char reversed);
+unsigned char do_consist_remove(unsigned int addr, unsigned char mtr);
+
+unsigned char consist_find_member(unsigned int addr);                          // index or SIZE_CONSIST
+unsigned char consist_is_member(unsigned int addr);
+unsigned char consist_inquiry(unsigned char mtr, unsigned char dir);           // returns next consist addr
+unsigned int consist_member_inquiry(unsigned char mtr, unsigned int addr, unsigned char dir);   // next member
+#endif
+
 //------------------------------------------------------------------
 
 void save_turnout(unsigned char slot, unsigned int addr, unsigned char output);
@@ -167,6 +197,10 @@ unsigned char recall_turnout(unsigned int addr);  // addr 0..
 
 unsigned char recall_turnout_group(unsigned int group_addr);
 
+unsigned char recall_turnout_nibble(unsigned int addr);         // 2 turnouts as Lenz ZZZZ, addr even
+
+unsigned char get_turnout_change(unsigned int *addr);           // next changed turnout, 0: none
+
 unsigned char get_number_of_manual_turnout_ops(void);           // collect flags in turnoutmanual
 
 unsigned int recall_manual_turnout(void);                       // get one manual entry and clear it
@@ -180,6 +214,9 @@ bool queue_prog_is_empty(void);
 
 unsigned char put_in_queue_prog(t_message *new_message);
 
+bool queue_prog_repeating(void);                // last message still repeated on the rails
+void queue_prog_skip_repeat(void);              // ack: end the repetitions
+
 
 
 
@@ -208,7 +245,27 @@ t_message * search_locobuffer(void);   // returns pointer to dcc message
 
 unsigned char put_in_queue_lp(t_message *new_message);
  
-void set_next_message (t_message *newmsg);
+void set_next_message (t_message *newmsg, t_msg_source source);
+
+#if (DCC_ADAPTIVE_REPEAT == 1)
+void repeat_adapt_tick(void);           // call every 5ms: adapt dcc_xx_repeat to rail load
+#endif
+
+#if (DCC_RAIL_STATS == 1)
+#define RAIL_KEY_LONG   0x8000          // key of rail_top: long loco address
+#define RAIL_KEY_ACC    0x4000          // key of rail_top: accessory decoder address
+
+typedef struct
+  {
+    unsigned int key;                   // address, see RAIL_KEY_xx
+    unsigned int count;                 // sends on the rails (upper bound)
+    unsigned int error;                 // max. overestimation of count
+  } t_rail_top;
+
+extern t_rail_top rail_top[SIZE_RAIL_TOP];
+
+void rail_top_reset(void);
+#endif
 
 
 
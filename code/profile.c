@@ -0,0 +1,94 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      profile.c
+// history:   cycle profile of the hot path started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   cycle count of dcc isr and main loop tasks
+//
+// how:       CpuTimer2 runs free at SYSCLK (TPR = 0) and counts down,
+//            so start - now is the no of cycles, also across wrap.
+//            The counters are collected for PROFILE_WINDOW ms and then
+//            copied to profile, which is read by the Lenz extension 0xFA.
+//
+//            To compare flash and RAM placement of the hot path:
+//            build once without and once with HOT_PATH_IN_RAM
+//            (see F28069M.cmd), both with HOT_PATH_PROFILE, and read
+//            0xFA in the same track state. The tasks with the highest
+//            cycles per window are the candidates for the ramfuncs list.
+//
+//-----------------------------------------------------------------
+
+#include "DSP28x_Project.h"     // Device Headerfile and Examples Include File
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "config.h"                // general structures and definitions
+#include "profile.h"
+
+#if (HOT_PATH_PROFILE == 1)
+
+t_profile profile;                      // last complete window
+static t_profile profile_run;           // window in progress
+static uint32_t profile_start;          // millis() of window start
+
+void init_profile(void)
+  {
+    // CpuTimer2 was used by init_store as us stopwatch, now cycle counter
+    CpuTimer2Regs.TCR.bit.TSS = 1;
+    CpuTimer2Regs.PRD.all = 0xFFFFFFFF;
+    CpuTimer2Regs.TPR.all = 0;
+    CpuTimer2Regs.TPRH.all = 0;
+    CpuTimer2Regs.TCR.bit.TRB = 1;
+    CpuTimer2Regs.TCR.bit.TSS = 0;
+
+    memset(&profile, 0, sizeof(profile));
+    memset(&profile_run, 0, sizeof(profile_run));
+    profile_start = millis();
+  }
+
+void run_profile(void)
+  {
+    profile_run.loops++;
+    if ((millis() - profile_start) >= PROFILE_WINDOW)
+      {
+        profile_start = millis();
+        DINT;
+        profile = profile_run;
+        memset(&profile_run, 0, sizeof(profile_run));
+        EINT;
+      }
+  }
+
+// called at the end of epwm_isr, must run from RAM like the isr itself
+#pragma CODE_SECTION(profile_isr, "ramfuncs");
+void profile_isr(uint32_t start)
+  {
+    uint32_t cycles;
+
+    cycles = start - PROFILE_TIME();
+    profile_run.isr_cycles += cycles;
+    profile_run.isr_count++;
+    if (cycles > profile_run.isr_max) profile_run.isr_max = cycles;
+  }
+
+void profile_task(t_sched_task task, uint32_t start)
+  {
+    profile_run.task[task] += start - PROFILE_TIME();
+  }
+
+#endif // HOT_PATH_PROFILE
@@ -0,0 +1,59 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      profile.h
+// history:   cycle profile of the hot path started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   cycle count of dcc isr and main loop tasks,
+//            base for the placement list of ramfuncs (F28069M.cmd)
+//
+// interface upstream:
+//            init_profile(void)        // call once, after init_store
+//            run_profile(void)         // call once per main loop
+//            profile_task(task, start) // called by run_scheduler
+//            profile_isr(start)        // called by epwm_isr
+//
+//-----------------------------------------------------------------
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include "scheduler.h"              // tasks
+
+#if (HOT_PATH_PROFILE == 1)
+
+// CpuTimer2 is free running at SYSCLK and counts down
+#define PROFILE_TIME()      (CpuTimer2Regs.TIM.all)
+
+#define PROFILE_WINDOW      1000L       // ms, measured values are per window
+
+typedef struct
+  {
+    uint32_t isr_cycles;                // sum of cycles in epwm_isr
+    uint32_t isr_count;                 // no of epwm_isr
+    uint32_t isr_max;                   // longest epwm_isr in cycles
+    uint32_t loops;                     // passes of the main loop
+    uint32_t task[NUM_SCHED_TASK];      // cycles per task, interrupts included
+  } t_profile;
+
+extern t_profile profile;               // last complete window
+
+void init_profile(void);
+void run_profile(void);
+void profile_isr(uint32_t start);
+void profile_task(t_sched_task task, uint32_t start);
+
+#endif // HOT_PATH_PROFILE
+
+#endif // __PROFILE_H__
@@ -27,6 +27,14 @@
 // interface downstream:
 //            put_in_queue_prog         // send command to organizer
 //            queue_prog_is_empty       // ask organizer about queue
+//            queue_prog_repeating      // command still on the rails (ack window)
+//            queue_prog_skip_repeat    // ack received
+//
+// DCC_PROG_TRACK:
+//            the prog track has its own generator: enter_progmode only
+//            powers the prog track, opendcc_state and the main track stay
+//            as they are. The track stays on until a run state is set
+//            while no job runs, or RUN_OFF.
 //
 // 2do:       
 //--------------------------------------------------------------------------
@@ -44,6 +52,9 @@
 #include "dccout.h"                // next message
 #include "organizer.h"
 #include "programmer.h"
+#include "current.h"                // ACK_IS_DETECTED
+#include "events.h"                 // programming result
+#include "scheduler.h"              // ready while busy
 //
 // Es gibt drei "switch-Schleifen", damit auch umfangreichere Kommandos
 // im quasi Multitasking durchgebracht werden kï¿½nnen. Jede Schleife
@@ -273,6 +284,16 @@ t_message *page_preset_ptr = &page_preset;
 
 t_opendcc_state opendcc_state_before_prog = RUN_STOP;
 
+#if (DCC_PROG_TRACK == 1)
+void enter_progmode(void)
+  {
+    if (PROG_TRACK_STATE) return;       // already powered
+    prog_event.bidi_pending = 0;        // clear any bidi result queues - we do real prog
+    PROG_TRACK_ON;
+    pDCC_Reset.repeat = 20;             // 20 reset packets -> power on cycle
+    put_in_queue_prog(dcc_reset_ptr);
+  }
+#else
 void enter_progmode(void)
   {
     switch(opendcc_state)
@@ -307,10 +328,14 @@ void enter_progmode(void)
             break;
       }
   }
+#endif
 
 
 void leave_progmode(void)
   {
+    #if (DCC_PROG_TRACK == 1)
+    PROG_TRACK_OFF;                     // main track was not touched
+    #else
     while (next_message_count != 0);    // busy wait for current message to terminate
                                         // do not allow organizer to load next command!
     switch(opendcc_state_before_prog)
@@ -331,6 +356,7 @@ void leave_progmode(void)
         	set_opendcc_state(RUN_OFF);
             break;
       }
+    #endif
   }
 
 void reset_programmer(void)
@@ -344,7 +370,9 @@ void reset_programmer(void)
 void show_prog_error(void)
   {
     prog_result_size = 0;          // 12.01.2008: in case of Error, we have no data
+    #if (DCC_PROG_TRACK == 0)      // own prog track: the main track goes on, prog_result tells
     set_opendcc_state(PROG_ERROR);
+    #endif
   }
 
 //===================================================================================
@@ -572,10 +600,7 @@ void run_prog_inner_task(void)
                     if (partsum < 17) return;               // exits here, seems not to be a real ACK
                   }
 
-                DINT;
-                // skip further repetitions -> fool dccout - this is dirty! 
-                if (next_message_count>1) next_message_count=1;     
-                EINT;
+                queue_prog_skip_repeat();                   // skip further repetitions
                 
                 pi_result = PT_OKAY;              // 0 = we got a result
                 prog_inner_state = SETUP_3RD_RESET;
@@ -587,8 +612,7 @@ void run_prog_inner_task(void)
             //sds LED_CTRL_OFF;
 
 
-            if (next_message_count > 1) return;   // again dirty: we ask the communication flag
-                                                  // our message goes with rep 5, so 5...1
+            if (queue_prog_repeating()) return;   // our message goes with rep 5, so 5...1
                                                   // is our time to wait for ACK;                                               
 
             //sds LED_CTRL_ON;
@@ -606,7 +630,7 @@ void run_prog_inner_task(void)
             break;
 
         case DO_3RD_RESET:
-            if (queue_prog_is_empty()) return;
+            if (!queue_prog_is_empty()) return;          // wait until the resets are taken
 
             prog_ctrl.mode = P_IDLE;                         // clear request
             prog_inner_state = PI_IDLE;
@@ -793,6 +817,11 @@ void run_prog_byte_task(void)
 
 void run_programmer(void)
   {
+    if (prog_event.busy || (prog_seq_state != PS_IDLE) || (prog_byte_state != PB_IDLE))
+      {
+        sched_ready(SCHED_PROGRAMMER);                      // polls the ack: again next pass
+      }
+
     if ((millis() - last_bit_check) > TIME_REMEMBER_BIT_OP )
       {
         decoder_can_bit_operations = 0;                     // ist ab jetzt void
@@ -815,6 +844,7 @@ void run_programmer(void)
     switch (prog_seq_state)
       {
         case PS_IDLE:
+            if (prog_event.busy) event_post(EV_PROG_RESULT, prog_result, prog_data);
             prog_event.busy = 0;            // we are done - no more busy
             break;
         case PS_START:
@@ -1092,14 +1122,12 @@ void init_programmer(void)
     memcpy (&direct_ctrl, &direct_ctrl_default, sizeof(prog_ctrl));
     memcpy (&registermode_ctrl, &registermode_ctrl_default, sizeof(prog_ctrl));
 
-    //SDS eeprom problem
-    i = 3;
+    i = eemem[eadr_extend_prog_resets];
     if (i > 10) i= 10;  // limit
     direct_ctrl.cycles[0] += i;
     registermode_ctrl.cycles[0] += i;
     
-    //SDS eeprom problem
-    i = 3; // from config.cpp
+    i = eemem[eadr_extend_prog_command];
     if (i > 10) i= 10;  // limit
     direct_ctrl.cycles[3] += i;
     registermode_ctrl.cycles[3] += i;
@@ -0,0 +1,223 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      ramp.c
+// history:   station side momentum (speed ramps) started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   speed ramps for locos
+//
+// Automation software emulates momentum by sending a stream of small
+// speed steps. Here the host sends only the target speed and a rate,
+// the ramp engine does the steps on the status tick and feeds them
+// to the organizer with do_loco_speed().
+//
+// how:       every active ramp accumulates the time since its last step.
+//            step time = rate * RAMP_MS_PER_STEP; the due steps are
+//            applied at most every RAMP_PACKET_TIME, so one ramp never
+//            puts more than 20 speed packets per second in the queues.
+//            RAMP_LINEAR:      one speed step per step time
+//            RAMP_EXPONENTIAL: step size grows with the distance to the
+//                              target (fast start, soft arrival)
+//            A change of direction ramps down to 0 first, then turns and
+//            ramps up again.
+//            Brake steps are put to queue_hp by the organizer
+//            (ORGZ_SLOW_DOWN), we don't have to care here.
+//
+//            A direct speed command or an emergency stop of the loco
+//            cancels its ramp (ramp_cancel), every state other than
+//            RUN_OKAY cancels all ramps (ramp_cancel_all).
+//
+//-----------------------------------------------------------------
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "config.h"                // general structures and definitions
+#include "status.h"                // opendcc_state
+#include "organizer.h"
+#include "ramp.h"
+
+#if (DCC_RAMP == 1)
+
+typedef struct
+  {
+    unsigned int  addr;                 // loco address, 0 = entry free
+    unsigned char speed;                // speed last sent, msb = direction
+    unsigned char target;               // target speed, msb = direction
+    unsigned char rate;                 // step time in RAMP_MS_PER_STEP
+    unsigned char curve;                // RAMP_LINEAR, RAMP_EXPONENTIAL
+    unsigned int  elapsed;              // ms since last step
+    unsigned int  since_packet;         // ms since last speed packet
+  } t_ramp;
+
+t_ramp ramp[SIZE_RAMP];
+
+uint32_t ramp_timerval;                 // last call of ramp_tick
+
+// speed 0 = stop, 1 = emergency stop, 2..127 = steps 1..126
+// ramps run on the level 0..126 and never touch the emergency stop
+
+static unsigned char speed_to_level(unsigned char speed)
+  {
+    speed &= 0x7F;
+    if (speed < 2) return(0);
+    return(speed - 1);
+  }
+
+static unsigned char level_to_speed(unsigned char level)
+  {
+    if (level == 0) return(0);
+    return(level + 1);
+  }
+
+void init_ramp(void)
+  {
+    unsigned char i;
+
+    for (i=0; i<SIZE_RAMP; i++) ramp[i].addr = 0;
+    ramp_timerval = millis();
+  }
+
+void ramp_cancel(unsigned int addr)
+  {
+    unsigned char i;
+
+    for (i=0; i<SIZE_RAMP; i++)
+      {
+        if (ramp[i].addr == addr) ramp[i].addr = 0;
+      }
+  }
+
+void ramp_cancel_all(void)
+  {
+    unsigned char i;
+
+    for (i=0; i<SIZE_RAMP; i++) ramp[i].addr = 0;
+  }
+
+unsigned char ramp_is_active(unsigned int addr)
+  {
+    unsigned char i;
+
+    if (addr == 0) return(0);
+    for (i=0; i<SIZE_RAMP; i++)
+      {
+        if (ramp[i].addr == addr) return(1);
+      }
+    return(0);
+  }
+
+unsigned char do_loco_ramp(unsigned int addr, unsigned char target, unsigned char rate, unsigned char curve)
+  {
+    unsigned char i, lb;
+
+    if (addr == 0) return(0);
+
+    if ((rate == 0) || ((target & 0x7F) == 1))      // immediate or emergency stop
+      {
+        if (!organizer_ready()) return(0);          // no room: the pc repeats it
+        ramp_cancel(addr);
+        do_loco_speed(0, addr, target);
+        return(1);
+      }
+
+    for (i=0; i<SIZE_RAMP; i++)                     // running ramp: only change target
+      {
+        if (ramp[i].addr == addr) break;
+      }
+    if (i == SIZE_RAMP)
+      {
+        for (i=0; i<SIZE_RAMP; i++)
+          {
+            if (ramp[i].addr == 0) break;
+          }
+        if (i == SIZE_RAMP) return(0);              // full
+
+        lb = scan_locobuffer(addr);                 // start at the speed the loco has now
+        if (lb < SIZE_LOCOBUFFER) ramp[i].speed = locobuffer[lb].speed;
+        else ramp[i].speed = target & 0x80;
+        ramp[i].elapsed = 0;
+        ramp[i].since_packet = RAMP_PACKET_TIME;    // first step without delay
+        ramp[i].addr = addr;
+      }
+    ramp[i].target = target;
+    ramp[i].rate = rate;
+    ramp[i].curve = curve;
+    return(1);
+  }
+
+//-----------------------------------------------------------------------------------
+// ramp_tick: called from state_tick every status tick
+
+void ramp_tick(void)
+  {
+    unsigned char i, cur, goal, dir, diff;
+    unsigned int ms, step_time, steps;
+    uint32_t now;
+
+    now = millis();
+    ms = (unsigned int)(now - ramp_timerval);
+    ramp_timerval = now;
+
+    if (opendcc_state != RUN_OKAY) return;
+
+    for (i=0; i<SIZE_RAMP; i++)
+      {
+        if (ramp[i].addr == 0) continue;
+
+        ramp[i].elapsed += ms;
+        ramp[i].since_packet += ms;
+        if (ramp[i].since_packet < RAMP_PACKET_TIME) continue;
+        if (!organizer_ready()) continue;           // try again next tick
+
+        step_time = ramp[i].rate * RAMP_MS_PER_STEP;
+        steps = ramp[i].elapsed / step_time;
+        if (steps == 0) continue;
+        ramp[i].elapsed -= steps * step_time;
+
+        cur = speed_to_level(ramp[i].speed);
+        dir = ramp[i].speed & 0x80;
+        if ((ramp[i].target ^ ramp[i].speed) & 0x80) goal = 0;     // turn: first down to stop
+        else goal = speed_to_level(ramp[i].target);
+
+        if (ramp[i].curve == RAMP_EXPONENTIAL)
+          {
+            if (cur > goal) diff = cur - goal;
+            else diff = goal - cur;
+            steps = steps * (1 + diff / 16);
+          }
+        if (cur < goal)
+          {
+            if ((goal - cur) > steps) cur += steps;
+            else cur = goal;
+          }
+        else
+          {
+            if ((cur - goal) > steps) cur -= steps;
+            else cur = goal;
+          }
+        if (cur == 0) dir = ramp[i].target & 0x80;  // stopped: now we can turn
+
+        ramp[i].speed = level_to_speed(cur) | dir;
+        ramp[i].since_packet = 0;
+        do_loco_speed(0, ramp[i].addr, ramp[i].speed);
+
+        if (ramp[i].speed == ramp[i].target) ramp[i].addr = 0;     // done
+      }
+  }
+
+#endif // DCC_RAMP
@@ -0,0 +1,57 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      ramp.h
+// history:   station side momentum (speed ramps) started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   speed ramps for locos, executed by the command station
+//            (host sends target and rate once, we do the steps)
+//
+// interface upstream:
+//            init_ramp(void)           // call once at program start
+//            ramp_tick(void)           // called from run_state (status tick)
+//            do_loco_ramp(...)         // start a ramp for a loco
+//            ramp_cancel(addr)         // direct speed command overrules ramp
+//
+// interface downstream:
+//            do_loco_speed()           // organizer
+//
+//-----------------------------------------------------------------
+#ifndef __RAMP_H__
+#define __RAMP_H__
+
+#define RAMP_LINEAR         0       // constant time per speed step
+#define RAMP_EXPONENTIAL    1       // big steps when far from target, small steps near target
+
+#define RAMP_MS_PER_STEP    7       // rate 1 = 7ms per step (128 step scale) -> 0.9s for full range
+                                    // this is the same scale as CV3/CV4 of the decoder
+#define RAMP_PACKET_TIME    50      // min. time between two speed packets of one ramp (ms)
+
+void init_ramp(void);
+void ramp_tick(void);
+
+// addr:   loco address
+// target: speed 0..127 incl. direction (msb = forward), same coding as locobuffer
+// rate:   time per speed step in RAMP_MS_PER_STEP, 0 = immediate
+// curve:  RAMP_LINEAR or RAMP_EXPONENTIAL
+// return: 0 if ramp table is full or (rate 0, e-stop) the organizer is busy,
+//         1 if ramp accepted
+unsigned char do_loco_ramp(unsigned int addr, unsigned char target, unsigned char rate, unsigned char curve);
+
+void ramp_cancel(unsigned int addr);
+void ramp_cancel_all(void);
+unsigned char ramp_is_active(unsigned int addr);
+
+#endif // __RAMP_H__
@@ -62,6 +62,8 @@ bool rx_fifo_ready (void);
 
 unsigned char rx_fifo_read (void);
 
+extern uint32_t rx_time;                // TB_CLOCK32 at reception of the char last read
+
 unsigned char rs232_is_break(void);
 
 
@@ -49,6 +49,9 @@
 #include "hardware.h"
 #include "status.h"
 #include "rs232.h"
+#include "scheduler.h"
+#include "watchdog.h"
+#include "timebase.h"               // rx time stamps
 
 #ifndef FALSE 
   #define FALSE  (1==0)
@@ -83,6 +86,8 @@ __interrupt void uartTx_isr(void);
 
 #define RxBuffer_Size  64              // mind. 16
 unsigned char RxBuffer[RxBuffer_Size];
+static uint32_t RxTime[RxBuffer_Size];      // TB_CLOCK32 at reception of the char
+uint32_t rx_time;                           // of the char last read
 
 
 #define TxBuffer_Size  64              // on sniffer: 128
@@ -206,6 +211,7 @@ unsigned char rs232_is_break(void)
 
 __interrupt void uartRx_isr(void)
 {
+  WATCHDOG_ISR(PM_ISR_UART_RX);
   PieCtrlRegs.PIEACK.all = PIEACK_GROUP9;
 
   if (SciaRegs.SCIRXST.bit.FE == 1)
@@ -227,10 +233,12 @@ __interrupt void uartRx_isr(void)
           // !!!
         }
       RxBuffer[rx_write_ptr] = SciaRegs.SCIRXBUF.bit.RXDT;
+      RxTime[rx_write_ptr] = TB_CLOCK32();
 
       rx_write_ptr++;
       if (rx_write_ptr == RxBuffer_Size) rx_write_ptr=0;
       rx_fill++;
+      sched_ready(SCHED_PARSER);
       if (rx_fill > (RxBuffer_Size - 10))
         {
           // we are full, stop remote Tx -> set CTS off !!!!
@@ -249,6 +257,7 @@ __interrupt void uartRx_isr(void)
 //vervangt atmega328p USART_UDRE_vect
 __interrupt void  uartTx_isr(void)
 {
+  WATCHDOG_ISR(PM_ISR_UART_TX);
   PieCtrlRegs.PIEACK.all = PIEACK_GROUP9;
 
   if (tx_read_ptr != tx_write_ptr)
@@ -375,6 +384,7 @@ unsigned char rx_fifo_read (void)
   unsigned char retval;
 
   retval = RxBuffer[rx_read_ptr];
+  rx_time = RxTime[rx_read_ptr];
   rx_read_ptr++;
   if (rx_read_ptr == RxBuffer_Size) rx_read_ptr=0;
 
@@ -0,0 +1,182 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      scheduler.c
+// history:   cooperative scheduler for the main loop started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   runs the tasks of the main loop when they have work
+//
+// how:       Every task has a ready flag. It is set by an interrupt
+//            (dcc isr: next_message taken, uart rx, encoder, short trip),
+//            by another task (sched_ready) or by the period of the task.
+//            The ready time is taken from the timebase; the deadline of
+//            the task is added. run_scheduler starts the ready task with
+//            the earliest deadline; a task is never interrupted by
+//            another task (cooperative), so a task must return soon.
+//            The flag is cleared before the task is called: a task with
+//            more work than one call sets its flag again.
+//
+//            Is no task ready, the cpu goes into IDLE until the next
+//            interrupt. A flag set by an interrupt just before IDLE is
+//            seen with the next interrupt; the dcc isr comes once per
+//            bit, every 116us ("1") to 232us ("0"), also with the track
+//            off (the pwm is never stopped). The shortest deadline is
+//            1000us (SCHED_STATE), so such a flag waits at most a
+//            quarter of it; the millis isr (1ms) alone would not do.
+//
+//            The flags are words of their own, set with one write:
+//            no read-modify-write between isr and main.
+//
+//-----------------------------------------------------------------
+
+#include "DSP28x_Project.h"     // Device Headerfile and Examples Include File
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "config.h"                // general structures and definitions
+#include "timebase.h"              // TB_CLOCK32
+#include "profile.h"
+#include "scheduler.h"
+#include "watchdog.h"               // WATCHDOG_TASK
+
+typedef struct
+  {
+    t_sched_run run;                    // NULL: not registered
+    unsigned int period;                // ms, 0: no period
+    uint32_t deadline;                  // timebase ticks
+    uint32_t next;                      // millis() of the next period
+  } t_sched_entry;
+
+static t_sched_entry sched_entry[NUM_SCHED_TASK];
+static volatile unsigned char sched_flag[NUM_SCHED_TASK];
+static volatile uint32_t sched_due[NUM_SCHED_TASK];     // TB_CLOCK32() when made ready
+static uint32_t sched_beat[NUM_SCHED_TASK];             // millis() at the end of the last run
+
+t_sched_stat sched_stat;                // last complete window
+static t_sched_stat sched_run;          // current window
+static uint32_t sched_idle;             // ticks in IDLE, current window
+static uint32_t sched_start;            // millis() of the window
+
+void init_scheduler(void)
+  {
+    memset(sched_entry, 0, sizeof(sched_entry));
+    memset((void *)sched_flag, 0, sizeof(sched_flag));
+    memset(&sched_stat, 0, sizeof(sched_stat));
+    memset(&sched_run, 0, sizeof(sched_run));
+    sched_idle = 0;
+    sched_start = millis();
+  }
+
+void sched_task(t_sched_task task, t_sched_run run, unsigned int period, unsigned int deadline)
+  {
+    sched_entry[task].run = run;
+    sched_entry[task].period = period;
+    sched_entry[task].deadline = TB_US(deadline);
+    sched_entry[task].next = millis();
+    sched_beat[task] = millis();
+    sched_ready(task);                  // first call at once
+  }
+
+// called by the dcc isr, must run from RAM like the isr itself
+#pragma CODE_SECTION(sched_ready, "ramfuncs");
+void sched_ready(t_sched_task task)
+  {
+    if (sched_flag[task]) return;       // keep the first ready time
+    sched_due[task] = TB_CLOCK32();
+    sched_flag[task] = 1;
+  }
+
+static void sched_window(void)
+  {
+    if ((millis() - sched_start) < SCHED_WINDOW) return;
+    sched_start = millis();
+    sched_run.idle = (unsigned int)(sched_idle / TB_US(SCHED_WINDOW));   // 0.1% of the window
+    memcpy(sched_run.late, sched_stat.late, sizeof(sched_run.late));    // not per window
+    sched_stat = sched_run;
+    memset(&sched_run, 0, sizeof(sched_run));
+    sched_idle = 0;
+  }
+
+void run_scheduler(void)
+  {
+    t_sched_entry *entry;
+    unsigned char task, best;
+    uint32_t now, ms, latency;
+    int32_t left, best_left;
+    #if (HOT_PATH_PROFILE == 1)
+    uint32_t prof_start;
+    #endif
+
+    sched_window();
+
+    ms = millis();
+    for (task=0; task<NUM_SCHED_TASK; task++)
+      {
+        entry = &sched_entry[task];
+        if (entry->period && ((int32_t)(ms - entry->next) >= 0))
+          {
+            entry->next += entry->period;
+            if ((int32_t)(ms - entry->next) >= 0) entry->next = ms + entry->period;  // do not catch up
+            sched_ready((t_sched_task)task);
+          }
+      }
+
+    // earliest deadline first; on equal deadline the lower task no
+    now = TB_CLOCK32();
+    best = NUM_SCHED_TASK;
+    best_left = 0;
+    for (task=0; task<NUM_SCHED_TASK; task++)
+      {
+        if (!sched_flag[task] || !sched_entry[task].run) continue;
+        left = (int32_t)(sched_due[task] + sched_entry[task].deadline - now);
+        if ((best == NUM_SCHED_TASK) || (left < best_left))
+          {
+            best = task;
+            best_left = left;
+          }
+      }
+
+    if (best == NUM_SCHED_TASK)
+      {
+        asm(" IDLE");                   // until the next interrupt
+        sched_idle += TB_CLOCK32() - now;
+        sched_run.wakeups++;
+        return;
+      }
+
+    sched_flag[best] = 0;
+    latency = (now - sched_due[best]) / TB_MHZ;
+    if (latency > 0xFFFF) latency = 0xFFFF;
+    if (latency > sched_run.latency[best]) sched_run.latency[best] = (unsigned int)latency;
+    if ((best_left < 0) && (sched_stat.late[best] < 0xFFFF)) sched_stat.late[best]++;
+
+    WATCHDOG_TASK(best);
+    #if (HOT_PATH_PROFILE == 1)
+    prof_start = PROFILE_TIME();
+    sched_entry[best].run();
+    profile_task((t_sched_task)best, prof_start);
+    #else
+    sched_entry[best].run();
+    #endif
+    WATCHDOG_TASK(PM_NO_TASK);
+    sched_beat[best] = millis();
+  }
+
+uint32_t sched_heartbeat(t_sched_task task)
+  {
+    return(sched_beat[task]);
+  }
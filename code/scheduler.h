@@ -0,0 +1,72 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      scheduler.h
+// history:   cooperative scheduler for the main loop started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   runs the tasks of the main loop when they have work,
+//            most urgent deadline first; idle time in IDLE
+//
+// interface upstream:
+//            init_scheduler(void)                  // call once, before EINT
+//            sched_task(task, run, period, deadline)   // register a task
+//            sched_ready(task)                     // task has work, also from isr
+//            run_scheduler(void)                   // main loop: one task or IDLE
+//            sched_stat                            // measured values of last window
+//            sched_heartbeat(task)                 // millis() at the end of the last run
+//
+//-----------------------------------------------------------------
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+// tasks; the order is the priority, if two deadlines are equal
+typedef enum {SCHED_STATE,          // short check
+              SCHED_ORGANIZER,      // next message for dccout
+              SCHED_TIMER,          // timer wheel
+              SCHED_PROGRAMMER,
+              SCHED_PARSER,
+              SCHED_KEYS,
+              SCHED_UI,
+              SCHED_DATABASE,
+              SCHED_STORE,
+              SCHED_SNAPSHOT,
+              SCHED_WATCHDOG,       // feeds the watchdog
+              NUM_SCHED_TASK} t_sched_task;
+
+#define SCHED_WINDOW        1000L       // ms, measured values are per window
+
+typedef void (*t_sched_run)(void);
+
+typedef struct
+  {
+    unsigned int idle;                  // time in IDLE, 0.1%
+    unsigned int wakeups;               // no of IDLE left
+    unsigned int latency[NUM_SCHED_TASK];   // max us from ready to start
+    unsigned int late[NUM_SCHED_TASK];  // deadline misses since reset
+  } t_sched_stat;
+
+extern t_sched_stat sched_stat;         // last complete window
+
+void init_scheduler(void);
+
+// period: ms, task is made ready every period (0: only by sched_ready)
+// deadline: us, from ready to start of the task
+void sched_task(t_sched_task task, t_sched_run run, unsigned int period, unsigned int deadline);
+
+void sched_ready(t_sched_task task);
+void run_scheduler(void);
+uint32_t sched_heartbeat(t_sched_task task);
+
+#endif // __SCHEDULER_H__
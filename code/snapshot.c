@@ -0,0 +1,192 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      snapshot.c
+// history:   warm start snapshot started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   copy of locobuffer and state in RAM which survives a reset
+//
+// how:       The F28069 keeps its RAM over a watchdog or external reset.
+//            The section warmstart (RAML1, see F28069M.cmd) is not
+//            initialised by the c startup; it holds two snapshots, written
+//            in turn every SNAPSHOT_PERIOD ms. A reset during the write
+//            spoils only one of them, the other stays valid.
+//
+//            At boot the valid snapshot with the higher seq is restored:
+//            opendcc_state before the track is powered (snapshot_state),
+//            locobuffer (speed, functions, format) after init_organizer.
+//            The locos are refreshed as soon as the main loop runs.
+//            consist[] goes with it: the members in locobuffer are marked
+//            with .consist and the decoders still have their CV19.
+//            turnout_state[] is not copied (1024 words); organizer.c keeps
+//            its checksum in warmstart and keeps the table if it matches.
+//
+//            After power loss the RAM content is random, the check fails
+//            and the station starts cold.
+//
+//-----------------------------------------------------------------
+
+#include "DSP28x_Project.h"     // Device Headerfile and Examples Include File
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "config.h"                // general structures and definitions
+#include "status.h"                // opendcc_state
+#include "organizer.h"             // locobuffer
+#include "boot.h"                  // boot clock
+#include "snapshot.h"
+
+#if (DCC_SNAPSHOT == 1)
+
+#define SNAPSHOT_MAGIC  0x5AFE
+#define SNAPSHOT_NONE   0xFF
+
+typedef struct
+  {
+    unsigned int magic;
+    unsigned int seq;                           // incremented with every snapshot
+    unsigned int state;                         // opendcc_state
+    struct locomem loco[SIZE_LOCOBUFFER];
+#if (DCC_ADVANCED_CONSIST == 1)
+    t_consist_entry consist[SIZE_CONSIST];
+#endif
+    unsigned int check;                         // over seq .. consist
+  } t_snapshot;
+
+#pragma DATA_SECTION(snapshot, "warmstart");    // see F28069M.cmd
+t_snapshot snapshot[2];
+
+unsigned char snapshot_warm;
+unsigned char snapshot_locos;
+unsigned int snapshot_restore_time;
+
+static unsigned char snapshot_next;             // slot for next write
+static unsigned int snapshot_seq;
+static uint32_t snapshot_last;                  // millis() of last write
+
+static unsigned int snapshot_check(t_snapshot *snap)
+  {
+    unsigned int *p;
+    unsigned int check;
+    unsigned int i;
+
+    p = &snap->seq;                             // magic is not included
+    check = SNAPSHOT_MAGIC;
+    for (i=0; i<(sizeof(t_snapshot) - sizeof(snap->magic) - sizeof(snap->check)); i++)
+      {
+        check = ((check << 1) | (check >> 15)) ^ p[i];   // rotate: also catches moved words
+      }
+    return(check);
+  }
+
+// return: slot of the newest valid snapshot, SNAPSHOT_NONE if none
+static unsigned char snapshot_find(void)
+  {
+    unsigned char valid[2];
+    unsigned char i;
+
+    for (i=0; i<2; i++)
+      {
+        valid[i] = (snapshot[i].magic == SNAPSHOT_MAGIC) && (snapshot[i].check == snapshot_check(&snapshot[i]));
+      }
+    if (valid[0] && valid[1])
+      {
+        if ((int16)(snapshot[1].seq - snapshot[0].seq) > 0) return(1);
+        return(0);
+      }
+    if (valid[0]) return(0);
+    if (valid[1]) return(1);
+    return(SNAPSHOT_NONE);
+  }
+
+unsigned char snapshot_valid(void)
+  {
+    return(snapshot_find() != SNAPSHOT_NONE);
+  }
+
+// state to start with, before the track is powered
+t_opendcc_state snapshot_state(void)
+  {
+    unsigned char slot;
+
+    slot = snapshot_find();
+    if (slot == SNAPSHOT_NONE) return(RUN_OKAY);
+    switch((t_opendcc_state)snapshot[slot].state)
+      {
+        case RUN_STOP:
+        case RUN_OFF:
+            return((t_opendcc_state)snapshot[slot].state);
+        case RUN_SHORT:
+        case PROG_SHORT:
+            return(RUN_OFF);                    // no power to a short
+        default:
+            return(RUN_OKAY);
+      }
+  }
+
+void init_snapshot(void)
+  {
+    uint32_t start;
+    unsigned char slot;
+    unsigned char i;
+
+    start = BOOT_CLOCK();
+    snapshot_warm = 0;
+    snapshot_locos = 0;
+    snapshot_seq = 0;
+    snapshot_next = 0;
+
+    slot = snapshot_find();
+    if (slot != SNAPSHOT_NONE)
+      {
+        snapshot_warm = 1;
+        snapshot_seq = snapshot[slot].seq;
+        snapshot_next = slot ^ 1;
+        memcpy(locobuffer, snapshot[slot].loco, sizeof(locobuffer));
+        #if (DCC_ADVANCED_CONSIST == 1)
+        memcpy(consist, snapshot[slot].consist, sizeof(consist));
+        #endif
+        for (i=0; i<SIZE_LOCOBUFFER; i++)
+          {
+            if (locobuffer[i].address && locobuffer[i].active) snapshot_locos++;
+          }
+      }
+    snapshot_last = millis();
+    snapshot_restore_time = (unsigned int)((BOOT_CLOCK() - start) / BOOT_CLOCK_MHZ);
+  }
+
+void run_snapshot(void)
+  {
+    t_snapshot *snap;
+
+    if ((millis() - snapshot_last) < SNAPSHOT_PERIOD) return;
+    snapshot_last = millis();
+
+    snap = &snapshot[snapshot_next];
+    snap->magic = 0;                            // invalid while written
+    snap->seq = ++snapshot_seq;
+    snap->state = opendcc_state;
+    memcpy(snap->loco, locobuffer, sizeof(locobuffer));
+    #if (DCC_ADVANCED_CONSIST == 1)
+    memcpy(snap->consist, consist, sizeof(consist));
+    #endif
+    snap->check = snapshot_check(snap);
+    snap->magic = SNAPSHOT_MAGIC;
+    snapshot_next ^= 1;
+  }
+
+#endif // DCC_SNAPSHOT
@@ -0,0 +1,44 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      snapshot.h
+// history:   warm start snapshot started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   copy of locobuffer and state in RAM which survives a reset
+//
+// interface upstream:
+//            snapshot_valid(void)      // a snapshot survived the reset
+//            snapshot_state(void)      // opendcc_state to start with
+//            init_snapshot(void)       // restore, call after init_organizer
+//            run_snapshot(void)        // task, takes a new snapshot periodically
+//
+//-----------------------------------------------------------------
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#if (DCC_SNAPSHOT == 1)
+
+extern unsigned char snapshot_warm;         // 1: last boot was restored from snapshot
+extern unsigned char snapshot_locos;        // no of locos restored
+extern unsigned int snapshot_restore_time;  // time of restore in us
+
+unsigned char snapshot_valid(void);
+t_opendcc_state snapshot_state(void);
+void init_snapshot(void);
+void run_snapshot(void);
+
+#endif // DCC_SNAPSHOT
+
+#endif // __SNAPSHOT_H__
@@ -19,7 +19,7 @@
 // content:   control of LED via state engines
 //            timertick
 //            check for key strokes and output short
-//            shorts are stored and and a status_event.changed is set.
+//            shorts and state changes are posted as events (events.c).
 //            It is up to the selected parser, to report this event
 //            to the host.
 //               Lenz uses a push system (event_send), IB gets polled.           
@@ -40,6 +40,14 @@
 #include "programmer.h"               
 
  #include "lenz_parser.h"             
+#include "ramp.h"
+#include "timerwheel.h"
+#include "timebase.h"
+#include "events.h"
+#include "scheduler.h"
+#include "dccout.h"                  // prog track switch
+#include "district.h"
+#include "main_short.h"
 
 
 //---------------------------------------------------------------------------
@@ -56,47 +64,60 @@ unsigned char prog_short_ignore_time;   // is loaded during init from eeprom
 
 t_opendcc_state opendcc_state;            // this is the current running state
 
-t_status_event status_event;              // message flag for other programs
-
 unsigned char ext_stop_enabled = 0;       // if true: external stop input is enabled (CV36) 
 
 uint32_t ext_stop_deadtime = EXT_STOP_DEAD_TIME;      // CV37
 uint32_t extStopOkLastMillis;
 
-uint32_t state_timerval; //sds : zelfde type als millis()
+#define STATE_TICK_MS               5     // status tick: timeouts, ramps
 // values in ms
 #define FAST_RECOVER_ON_TIME        1
 #define FAST_RECOVER_OFF_TIME       4
 #define SLOW_RECOVER_TIME         1000  // 1s voor we opnieuw NO_SHORT melden na een kortsluiting
 //sds #define BLOCK_SHORT_after_PowerOn     25    // Shorts are ignored immediately after power on, voorlopig niet gebruikt (copy from bidi-booster)
 
-typedef enum {NO_SHORT, IGNORE_SHORT, FASTREC_OFF, FASTREC_ON, SHORT} shortState_t;
-shortState_t mainShortState,progShortState;
+shortState_t progShortState;           // main: main_short.c
 uint32_t shortLastMillis;
 uint8_t shortFastRecoverAttemptsLeft;
-static bool main_short_check();
 static bool prog_short_check();
+static void state_tick(unsigned int arg);
+#if (MAIN_SHORT_TRIP == 1)
+static void main_trip_init(void);
+#endif
 
 
 void init_state(void)
 {
-    ext_stop_enabled = 0;
+    ext_stop_enabled = eemem[eadr_ext_stop_enabled];
+    ext_stop_deadtime = eemem[eadr_ext_stop_deadtime];
     extStopOkLastMillis = 0;
 
 
-    // load timing values from eeprom -> TAPAS NO
-    main_short_ignore_time = 8; // sds : in ms
+    // load timing values from eemem (loaded by init_store)
+    main_short_ignore_time = eemem[eadr_short_turnoff_time]; // sds : in ms
+
+    prog_short_ignore_time = eemem[eadr_prog_short_toff_time]; // sds : in ms
 
-    prog_short_ignore_time = 40; // sds : in ms
+    #if (DCC_DISTRICTS > 1)
+    district_short_time(main_short_ignore_time);
+    #endif
+
+    #if (MAIN_SHORT_TRIP == 1)
+    main_trip_init();                       // before the dcc isr runs
+    #endif
+    main_short_init(MAIN_SHORT_TRIP);
+    main_short_time(main_short_ignore_time);
 
     // clear all timeouts
     no_timeout.parser = 0;  // sds: nog nodig in lenz_parser.cpp
 
     #if (DCC_FAST_CLOCK==1)
-      fast_clock.ratio = 8; //SDS from config.cpp
+      fast_clock.ratio = eemem[eadr_fast_clock_ratio];
+      fast_clock_set();
     #endif
-    mainShortState = NO_SHORT;
     progShortState = NO_SHORT;
+
+    tw_start(STATE_TICK_MS / TW_TICK_MS, state_tick, 0);   // init_timerwheel is done, a timer is free
     
     // TAPAS : configure I/O
     // nSHORTMAIN = io54, input with pullup
@@ -144,14 +165,84 @@ static void prog_off(void)
     PROG_TRACK_OFF;
     reset_programmer();
 }
+// a run state ends the service mode; with an own prog generator a running
+// job goes on, the main track does not need the prog track
+static void prog_release(void)
+{
+#if (DCC_PROG_TRACK == 1)
+    if (!prog_event.busy) prog_off();
+#else
+    prog_off();
+#endif
+}
+
+#if (MAIN_SHORT_TRIP == 1)
+//-----------------------------------------------------------------
+// main short trip
+// GPIO54 can neither drive a trip zone (TZ1..3 are on GPIO12..17, 28, 29)
+// nor an XINT (GPIO0..31 only) of the F28069. The input is sampled by the
+// dcc isr on every bit instead: it runs from RAM, independent of the main
+// loop and also while store.c writes the flash.
+// The isr only cuts the track and sets main_trip; main_short_check decides
+// with the usual times whether it was a short.
+
+volatile unsigned char main_trip;           // track was cut by the isr
+unsigned int main_trip_count;               // no of trips since boot
+unsigned int main_trip_latency;             // last trip: SYSCLK cycles from
+unsigned int main_trip_latency_max;         // the sample before to the cutoff
+static uint32_t main_trip_sampled;          // TB_CLOCK32 of last sample
+
+static void main_trip_init(void)
+{
+    main_trip = 0;
+    main_trip_count = 0;
+    main_trip_latency = 0;
+    main_trip_latency_max = 0;
+    main_trip_sampled = TB_CLOCK32();
+}
+
+#pragma CODE_SECTION(main_trip_sample, "ramfuncs");
+void main_trip_sample(void)
+{
+    uint32_t now;
+    uint32_t latency;
+
+    if (MAIN_IS_SHORT && MAIN_TRACK_STATE)
+    {
+        MAIN_TRACK_OFF;
+        now = TB_CLOCK32();
+        latency = now - main_trip_sampled;      // the short began after the last sample
+        if (latency > 0xFFFF) latency = 0xFFFF;
+        main_trip_latency = (unsigned int)latency;
+        if (main_trip_latency > main_trip_latency_max) main_trip_latency_max = main_trip_latency;
+        main_trip_count++;
+        main_trip = 1;
+        sched_ready(SCHED_STATE);
+    }
+    else
+    {
+        now = TB_CLOCK32();
+    }
+    main_trip_sampled = now;
+}
+#endif // MAIN_SHORT_TRIP
 
+// the power districts follow the main track; one with a short stays off
+// until power off / on
 static void main_on(void)
 {
     MAIN_TRACK_ON;
+    #if (DCC_DISTRICTS > 1)
+    district_power(1);
+    #endif
 }
 static void main_off(void)
 {
+    main_short_off();
     MAIN_TRACK_OFF;
+    #if (DCC_DISTRICTS > 1)
+    district_power(0);
+    #endif
 }
 
 void set_opendcc_state(t_opendcc_state next)
@@ -167,35 +258,40 @@ void set_opendcc_state(t_opendcc_state next)
 
   if (next == opendcc_state) return;      // no change
 
+  event_post(EV_STATE, next, opendcc_state);
   opendcc_state = next;
-  status_event.changed = 1;
-  status_event.changed_xp = 1;
+
+  #if (DCC_RAMP == 1)
+  if (next != RUN_OKAY) ramp_cancel_all();  // no ramp continues after stop, off or short
+  #endif
 
   switch(next)
   {
       case RUN_OKAY:                  // DCC running
-          prog_off();
+          prog_release();
           main_on();
           organizer_state.halted = 0;   // enable speed commands again
           break;
       case RUN_STOP:                  // DCC Running, all Engines Emergency Stop
           do_all_stop();
-          prog_off();
+          prog_release();
           main_on();
           break;
       case RUN_OFF:                   // Output disabled (2*Taste, PC)
         GpioDataRegs.GPBCLEAR.bit.GPIO39 = 1;
           prog_off();
           main_off();
-          status_event.power_off = 1;
           break;
       case RUN_SHORT:                 // Kurzschluï¿½
-          prog_off();
+          prog_release();
+          #if (DCC_DISTRICTS > 1)
+          MAIN_TRACK_OFF;             // only district 0, the others go on
+          #else
           main_off();
-          status_event.power_off = 1;
+          #endif
           break;
       case RUN_PAUSE:                 // DCC Running, all Engines Speed 0
-          prog_off();
+          prog_release();
           main_on();
           break;
 
@@ -207,12 +303,10 @@ void set_opendcc_state(t_opendcc_state next)
       case PROG_SHORT:                //
           prog_off();
           main_off();
-          status_event.power_off = 1;
           break;
       case PROG_OFF:
           prog_off();
           main_off();
-          status_event.power_off = 1;
           break;
       case PROG_ERROR:
           prog_on();
@@ -223,8 +317,6 @@ void set_opendcc_state(t_opendcc_state next)
 
 #if (DCC_FAST_CLOCK==1)
 
-unsigned int fc_value;
-
 t_fast_clock fast_clock =      // we start, Monday, 8:00
   {
     0,    // unsigned char minute;
@@ -233,37 +325,90 @@ t_fast_clock fast_clock =      // we start, Monday, 8:00
     8,    // unsigned char ratio;
   };
 
+//-----------------------------------------------------------------
+// fast clock on the timebase
+// At every set or ratio change the clock is anchored: fc_epoch is the
+// timebase, fc_base the clock (minutes of the week) at this moment.
+// Minute n after the anchor starts exactly at
+//      fc_epoch + n * FC_REAL_MINUTE / ratio
+// computed from scratch for every minute, so no error adds up.
+// A one shot wheel timer wakes us at this time; the wheel has 1ms
+// resolution, if it is early we wait for the next tick.
+
+#define FC_REAL_MINUTE      TB_MS(60000L)       // one minute in timebase ticks
+#define FC_WEEK             (7 * 24 * 60)       // minutes of a week
+
+static uint64_t fc_epoch;                       // timebase of the anchor
+static uint32_t fc_base;                        // clock at the anchor, minutes of week
+static uint32_t fc_minutes;                     // fast minutes since anchor
+static uint64_t fc_next;                        // timebase of next minute
+static t_tw_handle fc_timer = TW_NONE;
+
+static void fast_clock_cb(unsigned int arg);
+
+static void fast_clock_schedule(void)
+  {
+    uint64_t now;
+    uint64_t ticks;
+
+    fc_next = fc_epoch + ((uint64_t)(fc_minutes + 1) * FC_REAL_MINUTE) / fast_clock.ratio;
+    now = tb_now();
+    ticks = (fc_next > now) ? ((fc_next - now + TB_MS(TW_TICK_MS) - 1) / TB_MS(TW_TICK_MS)) : 1;
+    fc_timer = tw_start((unsigned int)ticks, fast_clock_cb, 0);    // <= 60000 ms
+  }
 
-void dcc_fast_clock_step(void)     // this occurs every 5ms realtime (sds : overblijfsel van TICK_PERIOD)
+// anchor the clock to now; call after fast_clock was changed (host, eemem)
+void fast_clock_set(void)
   {
-    if (fast_clock.ratio)
+    tw_cancel(fc_timer);
+    fc_timer = TW_NONE;
+    fc_epoch = tb_now();
+    fc_base = ((uint32_t)fast_clock.day_of_week * 24 + fast_clock.hour) * 60 + fast_clock.minute;
+    fc_minutes = 0;
+    if (fast_clock.ratio) fast_clock_schedule();
+    event_post(EV_CLOCK, (unsigned int)fc_base, fast_clock.ratio);
+  }
+
+static void fast_clock_cb(unsigned int arg)
+  {
+    uint32_t clock;
+
+    fc_timer = TW_NONE;
+    if (tb_now() < fc_next)                     // wheel rounding: a tick too early
       {
-        fc_value += fast_clock.ratio;
-        if (fc_value >= 12000)         // 1min = 60000ms 
-          {
-            fc_value = 0;
-            fast_clock.minute++;
-            if (fast_clock.minute >= 60)
-              {
-                fast_clock.minute = 0;
-                fast_clock.hour++;
-                if (fast_clock.hour >= 24)
-                  {
-                    fast_clock.hour = 0;
-                    fast_clock.day_of_week++;
-                    if (fast_clock.day_of_week >=7) fast_clock.day_of_week = 0;
-                  }
-              }
-            // now send this to DCC (but not during programming or when stopped)
-            if (opendcc_state == RUN_OKAY) do_fast_clock(&fast_clock);
-
-            // send clock_event to Xpressnet
-            status_event.clock = 1;
-          }
+        fc_timer = tw_start(1, fast_clock_cb, 0);
+        return;
       }
+    fc_minutes++;
+    clock = (fc_base + fc_minutes) % FC_WEEK;
+    fast_clock.minute = clock % 60;
+    fast_clock.hour = (clock / 60) % 24;
+    fast_clock.day_of_week = clock / (24 * 60);
+    fast_clock_schedule();
+
+    // now send this to DCC (but not during programming or when stopped)
+    if (opendcc_state == RUN_OKAY) do_fast_clock(&fast_clock);
+
+    event_post(EV_CLOCK, (unsigned int)clock, fast_clock.ratio);
   }
 
 #endif // DCC_FAST_CLOCK
+
+//-----------------------------------------------------------------
+// status tick, every STATE_TICK_MS from the timer wheel; restarts itself
+// (the timer is freed before the callback, so tw_start can not fail here)
+static void state_tick(unsigned int arg)
+{
+    tw_start(STATE_TICK_MS / TW_TICK_MS, state_tick, 0);
+    timeout_tick();
+    #if (DCC_RAMP == 1)
+        ramp_tick();
+    #endif
+    #if (DCC_ADAPTIVE_REPEAT == 1)
+        repeat_adapt_tick();
+    #endif
+} // state_tick
+
 //-----------------------------------------------------------------
 // run_state is a task, called periodically to check for key and
 // output shorts.
@@ -274,51 +419,70 @@ void dcc_fast_clock_step(void)     // this occurs every 5ms realtime (sds : over
 
 void run_state(void)
 {
-    if ((millis() - state_timerval) > 5) 
+    check_short();
+    // check external stop
+    if ((ext_stop_enabled) && (opendcc_state != RUN_OFF))
     {
-        state_timerval = millis();
-        timeout_tick();
-        #if (DCC_FAST_CLOCK==1)
-            dcc_fast_clock_step();
-        #endif
+        if (!EXT_STOP_ACTIVE) extStopOkLastMillis = millis();
+        else if ((millis() - extStopOkLastMillis) > ext_stop_deadtime)
+        {
+            // we hebben een extStop event!
+            set_opendcc_state(RUN_OFF);
+            event_post(EV_EXT_STOP, 0, 0);
+        }
     }
+
+} // run_state
+
+// short check alone, also called by main during boot (track is on before the
+// main loop runs)
+void check_short(void)
+{
+    #if (DCC_DISTRICTS > 1)
+    unsigned int shorted;
+    unsigned char d;
+
+    // districts: each one alone, also while main has a short
+    shorted = district_check(millis());
+    for (d=1; d<DCC_DISTRICTS; d++)
+    {
+        if (shorted & (1 << d)) event_post(EV_SHORT, EV_SHORT_DISTRICT, d);
+    }
+    #endif
+
     // check main short
     if ((opendcc_state != RUN_SHORT) && (opendcc_state != PROG_SHORT))
     {
-        if (main_short_check() == true)
+        if (main_short_check(millis()))
         {
             set_opendcc_state(RUN_SHORT);
-            if (hwEvent_Handler)
-                hwEvent_Handler(HWEVENT_MAINSHORT);
+            event_post(EV_SHORT, EV_SHORT_MAIN, 0);
         }
         // check prog short
-        if (prog_short_check() == true)
+        #if (DCC_PROG_TRACK == 1)
+        if ((prog_short_check() == true) && PROG_TRACK_STATE)
         {
-            set_opendcc_state(PROG_SHORT);
-            if (hwEvent_Handler)
-                hwEvent_Handler(HWEVENT_PROGSHORT);
+            prog_off();                 // the main track goes on
+            event_post(EV_SHORT, EV_SHORT_PROG, 0);
         }
-    }
-    // check external stop
-    if ((ext_stop_enabled) && (opendcc_state != RUN_OFF))
-    {
-        if (!EXT_STOP_ACTIVE) extStopOkLastMillis = millis();
-        else if ((millis() - extStopOkLastMillis) > ext_stop_deadtime)
+        #else
+        if (prog_short_check() == true)
         {
-            // we hebben een extStop event!
-            set_opendcc_state(RUN_OFF);
-            if (hwEvent_Handler)
-                hwEvent_Handler(HWEVENT_EXTSTOP);
+            set_opendcc_state(PROG_SHORT);
+            event_post(EV_SHORT, EV_SHORT_PROG, 0);
         }
+        #endif
     }
-
-} // run_state
+} // check_short
 
 // returns true, if we are in prog state
 // sds, houden, gebruikt door lenz_parser
 unsigned char is_prog_state(void)
 {
     unsigned char retval = 0;
+    #if (DCC_PROG_TRACK == 1)
+    if (PROG_TRACK_STATE) return(1);    // own generator: service mode while the prog track is on
+    #endif
     switch(opendcc_state)
     {
         case RUN_OKAY:             // wir laufen ganz normal:
@@ -339,82 +503,33 @@ unsigned char is_prog_state(void)
 } // is_prog_state
 
 
-// return : false = no_short (ook tijdens de fast recovery), true = short
-static bool main_short_check()
+// main short: hooks of main_short.c
+void main_hw_on(void)
 {
-    bool retval = false; // no_short
-    switch(mainShortState)
+    main_on();
+}
+
+void main_hw_off(void)
+{
+    MAIN_TRACK_OFF;                     // the districts go on
+}
+
+unsigned char main_hw_tripped(void)
+{
+    #if (MAIN_SHORT_TRIP == 1)
+    if (main_trip)
     {
-        case NO_SHORT :
-            
-            if (MAIN_IS_SHORT)
-            {
-                mainShortState =  IGNORE_SHORT;
-                shortLastMillis = millis();
-            }
-            break;
-        case IGNORE_SHORT :
-            if (!MAIN_IS_SHORT)
-            {
-                mainShortState = NO_SHORT;
-                MAIN_TRACK_ON;
-            }
-            else
-            {
-                if ((millis() - shortLastMillis) > main_short_ignore_time)
-                {
-                    mainShortState = FASTREC_OFF;
-                    shortFastRecoverAttemptsLeft = 3;
-                    MAIN_TRACK_OFF;
-                    shortLastMillis = millis();
-                }
-            }
-            break;
-        case FASTREC_OFF : 
-            if ((millis() - shortLastMillis) > FAST_RECOVER_OFF_TIME) // 4ms uit, en dan opnieuw aan en zien of de short weg is
-            {
-                MAIN_TRACK_ON;
-                mainShortState = FASTREC_ON;
-                shortLastMillis = millis();
-            }
-            break;
-        case FASTREC_ON : 
-            if ((millis() - shortLastMillis) > FAST_RECOVER_ON_TIME) // 1ms wachten en dan short checken
-            {
-                if (MAIN_IS_SHORT)
-                {
-                    mainShortState = FASTREC_OFF;
-                    shortLastMillis = millis();
-                    MAIN_TRACK_OFF;
-                    shortFastRecoverAttemptsLeft--;
-                    if (!shortFastRecoverAttemptsLeft)
-                    {
-                        mainShortState = SHORT;
-                        retval = true;
-                    }
-                }
-                else
-                {
-                    mainShortState = NO_SHORT;
-                    MAIN_TRACK_ON;
-                }
-            }
-            break;
-        case SHORT : 
-            if (MAIN_IS_SHORT)
-            {
-                shortLastMillis = millis();
-                retval = true;
-            }
-            else if ((millis() - shortLastMillis) > SLOW_RECOVER_TIME)
-            {
-                mainShortState = NO_SHORT; 
-            }
-            break;
+        main_trip = 0;
+        return(1);
     }
-    return (retval);
-    
-} // main_short_check
+    #endif
+    return(0);
+}
+
+unsigned char main_hw_fault(void)
+{
+    return(MAIN_IS_SHORT);
+}
 
 // return : false = no_short (ook tijdens de fast recovery), true = short
 static bool prog_short_check()
@@ -41,29 +41,17 @@ typedef struct       // each member will be decremented on every tick until 0
 extern t_no_timeout no_timeout;
 extern t_opendcc_state opendcc_state;            // this is the current state of the box
 
-// Interface for OpenDCC-Parser
-
-typedef struct 
-  {
-    unsigned char changed: 1;       // if != 0: there was (could be) a state change
-                                    //        set by set_opendcc_state - cleared by host parser
-    unsigned char changed_xp: 1;    // mirror for Xpressnet
-                                    //        set by set_opendcc_state - cleared by xpressnet master
-    unsigned char power_off: 1;     // there was a power off event, power has been turned off (not *is* off)
-                                    //        set by set_opendcc_state - cleared by host parser (ib)
-    unsigned char clock: 1;         // there was a minute tick for DCC Layout time
-                                    //        set by fast_clock - cleared by xpressnet master
-    unsigned char read_occ: 1;      // occupancy detector should resend data
-                                    //        set by host parser - cleared by xpressnet master
-  } t_status_event;
-
-extern t_status_event status_event;         // Message flag: there was a change in status
+// Changes of state, shorts and the fast clock are posted as events (events.h)
 
 // ---------------------------------------------------------------------------------
 // fast clock record
 
 extern t_fast_clock fast_clock;
 
+#if (DCC_FAST_CLOCK == 1)
+void fast_clock_set(void);                  // fast_clock was changed: restart from now
+#endif
+
 
 
 //===================================================================================
@@ -72,12 +60,18 @@ extern t_fast_clock fast_clock;
 
 void set_opendcc_state(t_opendcc_state next);
 void run_state(void);
+void check_short(void);          // main and prog short, part of run_state
 unsigned char is_prog_state(void);
 unsigned char is_power_on(void);
 
 extern unsigned char ext_stop_enabled;
-typedef enum {HWEVENT_MAINSHORT, HWEVENT_PROGSHORT, HWEVENT_EXTSTOP, HWEVENT_NODCC} hwEvent_t;
-extern void hwEvent_Handler( hwEvent_t event ) __attribute__ ((weak));
+
+#if (MAIN_SHORT_TRIP == 1)
+void main_trip_sample(void);                        // called by the dcc isr on every bit
+extern unsigned int main_trip_count;
+extern unsigned int main_trip_latency;              // SYSCLK cycles
+extern unsigned int main_trip_latency_max;
+#endif
 
 #endif // __STATUS_H__
 
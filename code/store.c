@@ -0,0 +1,502 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      store.c
+// history:   flash store for CVs and config started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   log structured store in two flash sectors,
+//            replaces the eeprom of the AVR OpenDCC
+//
+// The F28069 has no eeprom. All settings are read from RAM (eemem[],
+// loco_format[], loco_name[], route[]); this store keeps the changes in flash.
+//
+// how:       FLASHH and FLASHG (16k words each) are used alternately.
+//            Active is the sector with a valid header; if both are valid
+//            (power fail before erase of the old one), the higher seq wins.
+//
+//            word 0:       STORE_MAGIC
+//            word 1:       seq (incremented with every compaction)
+//            word 2...:    records {key, value, key ^ value ^ STORE_CHECK}
+//
+//            Changes are appended as records, later records overrule
+//            earlier ones. A record with bad check (power fail during
+//            programming) is skipped. A write is done STORE_FLUSH_DELAY
+//            after the last change, so a turn of the rotary encoder or a
+//            route download gives one flash write, not hundreds.
+//
+//            If the active sector is full, the live data is written
+//            to the other sector (compaction), header last. Only after the
+//            header is complete the old sector becomes invalid.
+//            Both sectors are used in turn -> wear is spread over both,
+//            one erase per 5000 changes of a CV.
+//
+//            The compaction runs in steps, STORE_STEP records per pass of
+//            run_store, so the main loop and the parser go on; the save
+//            callbacks keep their place in a cursor. A change made during
+//            the compaction is written as normal change after the header.
+//
+//            The erase of a sector takes some 100ms; during erase and
+//            programming only the dcc and the millis interrupt are enabled,
+//            both run from RAM, the sci is not served. The erase is
+//            therefore done only while the track power is off (RUN_OFF),
+//            never at once: a compaction which finds its target not erased
+//            waits for that, the changes stay in RAM until then.
+//
+// note:      needs the TI F2806x flash API library (Flash2806x_API_V100.lib),
+//            section Flash28_API is run from RAM, see F28069M.cmd. Include
+//            path and library are in the project (INSTALLROOT_FLASHAPI,
+//            C2000Ware libraries/flash_api/f2806x/v100); the API config
+//            (Flash2806x_API_Config.h) has to be set for 90MHz.
+//
+//-----------------------------------------------------------------
+
+#include "DSP28x_Project.h"     // Device Headerfile and Examples Include File
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "config.h"                // general structures and definitions
+#include "status.h"                // opendcc_state
+#include "accessory.h"             // routes
+#include "database.h"              // loco formats
+#include "store.h"
+#include "watchdog.h"              // feed during erase and write
+
+unsigned int store_load_time;           // time of init_store in us
+unsigned int store_records;             // no of records in active sector
+
+#if (DCC_STORE == 1)
+
+#include "Flash2806x_API_Library.h"
+
+extern Uint16 Flash28_API_LoadStart;    // from linker, see F28069M.cmd
+extern Uint16 Flash28_API_LoadEnd;
+extern Uint16 Flash28_API_RunStart;
+
+#define STORE_SECTOR_SIZE   0x4000      // words
+#define STORE_MAGIC         0x0DCC
+#define STORE_FIRST         2           // first record, after magic and seq
+#define STORE_RECORD        3           // words per record
+#define STORE_CHECK         0x5A5A
+#define STORE_NONE          0xFF
+#define STORE_CAPACITY      ((STORE_SECTOR_SIZE - STORE_FIRST) / STORE_RECORD)  // records
+#define STORE_STEP          16          // records per pass of a compaction (~150us each)
+#define STORE_BLANK_STEP    1024        // words checked per pass for erased target
+
+// phases of a compaction
+#define COMPACT_NONE        0
+#define COMPACT_BLANK       1           // target erased? else wait for the erase
+#define COMPACT_EEMEM       2
+#define COMPACT_FORMAT      3
+#define COMPACT_NAME        4
+#define COMPACT_ROUTE       5
+#define COMPACT_HEADER      6
+
+// part of a compaction which is not checked by store_room: all eemem cells
+// and all routes at full size
+#if (DCC_ROUTES == 1)
+#define STORE_FIXED         (SIZE_EEMEM + SIZE_ROUTE * (1 + 2 * SIZE_ROUTE_ENTRY))
+#else
+#define STORE_FIXED         (SIZE_EEMEM)
+#endif
+
+static volatile Uint16 * const store_base[2] = { (volatile Uint16 *) 0x3D8000,   // FLASHH
+                                                 (volatile Uint16 *) 0x3DC000 }; // FLASHG
+static const Uint16 store_sector_mask[2] = { SECTORH, SECTORG };
+
+unsigned char store_active;             // sector with valid data, STORE_NONE = nothing stored yet
+unsigned char store_target;             // sector store_put writes to
+unsigned int  store_next;               // next free word in store_target
+unsigned int  store_seq;                // seq of store_active
+unsigned char store_erase_pending;      // old sector, erased when track is off
+
+unsigned char store_compacting;         // phase of a compaction, COMPACT_NONE
+unsigned int  store_pos;                // cursor of the phase
+unsigned int  store_step_end;           // store_records at the end of this pass
+
+unsigned char store_pending;            // 1: unsaved changes
+uint32_t      store_last_change;        // millis() of last change
+unsigned int  store_dirty[(SIZE_EEMEM + 15) / 16];    // changed eemem cells
+
+//-----------------------------------------------------------------------------
+// flash access
+// only the PIE groups INT1 and INT3 stay enabled. Every isr in them runs from
+// RAM (ramfuncs), with all it calls:
+//   INT1: cpu_timer0_isr (millis), current_isr, xint1_isr / xint2_isr (keys)
+//   INT3: epwm_isr (main), epwm_prog_isr, epwm_district1..3_isr
+// A new vector in these groups must be put to ramfuncs as well.
+
+static unsigned char store_program(unsigned int pos, Uint16 *data, unsigned int len)
+  {
+    FLASH_ST status;
+    Uint16 result;
+    Uint16 ier;
+
+    ier = IER;
+    IER &= (M_INT1 | M_INT3);
+    result = Flash_Program((Uint16 *)(store_base[store_target] + pos), data, len, &status);
+    IER = ier;
+    return(result == STATUS_SUCCESS);
+  }
+
+static void store_erase(unsigned char sector)
+  {
+    FLASH_ST status;
+    Uint16 ier;
+
+    ier = IER;
+    IER &= (M_INT1 | M_INT3);
+    Flash_Erase(store_sector_mask[sector], &status);
+    IER = ier;
+  }
+
+static unsigned char store_valid(unsigned char sector)
+  {
+    return(store_base[sector][0] == STORE_MAGIC);
+  }
+
+//-----------------------------------------------------------------------------
+// records
+
+unsigned char store_put(unsigned int key, unsigned int value)
+  {
+    Uint16 record[STORE_RECORD];
+    unsigned int pos;
+
+    if (store_next > STORE_SECTOR_SIZE - STORE_RECORD) return(0);      // full
+
+    record[0] = key;
+    record[1] = value;
+    record[2] = key ^ value ^ STORE_CHECK;
+    pos = store_next;
+    store_next += STORE_RECORD;               // a failed record is skipped on read
+    if (!store_program(pos, record, STORE_RECORD)) return(0);
+    store_records++;
+    return(1);
+  }
+
+// compaction: 1 if this pass may write another record
+unsigned char store_step(void)
+  {
+    return(store_records < store_step_end);
+  }
+
+void store_replay(unsigned int key_from, unsigned int key_to, t_store_apply apply)
+  {
+    volatile Uint16 *record;
+    unsigned int pos;
+
+    if (store_active == STORE_NONE) return;
+
+    for (pos = STORE_FIRST; pos <= STORE_SECTOR_SIZE - STORE_RECORD; pos += STORE_RECORD)
+      {
+        record = store_base[store_active] + pos;
+        if (record[0] == 0xFFFF) break;                                 // end of log
+        if ((record[0] ^ record[1] ^ STORE_CHECK) != record[2]) continue;   // interrupted
+        if ((record[0] >= key_from) && (record[0] < key_to)) apply(record[0], record[1]);
+      }
+  }
+
+// find end of log in active sector
+static void store_scan(void)
+  {
+    unsigned int pos;
+
+    store_records = 0;
+    for (pos = STORE_FIRST; pos <= STORE_SECTOR_SIZE - STORE_RECORD; pos += STORE_RECORD)
+      {
+        if (store_base[store_active][pos] == 0xFFFF) break;
+        store_records++;
+      }
+    store_next = pos;
+  }
+
+//-----------------------------------------------------------------------------
+// eemem
+
+static void store_apply_eemem(unsigned int key, unsigned int value)
+  {
+    if (key - STORE_KEY_EEMEM < SIZE_EEMEM) eemem[key - STORE_KEY_EEMEM] = value;
+  }
+
+// pos == NULL: write the changed cells
+// else compaction: all cells which differ from default, from *pos on
+static unsigned char store_save_eemem(unsigned int *pos)
+  {
+    unsigned int i;
+
+    i = 0;
+    if (pos)
+      {
+        if (*pos == 0) memset(store_dirty, 0, sizeof(store_dirty));
+        i = *pos;
+      }
+    for (; i<SIZE_EEMEM; i++)
+      {
+        if (pos)
+          {
+            if (eemem[i] == eemem_default[i]) continue;
+            if (!store_step())
+              {
+                *pos = i;
+                return(STORE_MORE);
+              }
+          }
+        else
+          {
+            if (!(store_dirty[i / 16] & (1 << (i % 16)))) continue;
+          }
+        if (!store_put(STORE_KEY_EEMEM + i, eemem[i])) return(STORE_FAIL);
+        store_dirty[i / 16] &= ~(1 << (i % 16));
+      }
+    return(STORE_DONE);
+  }
+
+void store_write(unsigned int addr, unsigned char value)
+  {
+    if (addr >= SIZE_EEMEM) return;
+    eemem[addr] = value;
+    store_dirty[addr / 16] |= (1 << (addr % 16));
+    store_changed();
+  }
+
+void store_changed(void)
+  {
+    store_pending = 1;
+    store_last_change = millis();
+  }
+
+// formats and names are checked before a new entry is taken: the sum of
+// the tables at full size does not fit one sector (ESIZE_LOCO_FORMAT +
+// SIZE_LOCO_NAMES * 7 records), a compaction has to.
+unsigned char store_room(unsigned int records)
+  {
+    return(STORE_FIXED + records <= STORE_CAPACITY);
+  }
+
+//-----------------------------------------------------------------------------
+// flush and compaction
+
+// write the changed entries to the active sector
+static unsigned char store_save(void)
+  {
+    if (store_save_eemem(NULL) != STORE_DONE) return(0);
+    if (format_save(NULL) != STORE_DONE) return(0);
+    #if (LOCO_DATABASE == NAMED)
+    if (name_save(NULL) != STORE_DONE) return(0);
+    #endif
+    #if (DCC_ROUTES == 1)
+    if (route_save(NULL) != STORE_DONE) return(0);
+    #endif
+    return(1);
+  }
+
+static void store_compact_start(void)
+  {
+    store_target = (store_active == 0) ? 1 : 0;
+    store_compacting = COMPACT_BLANK;
+    store_pos = 0;
+  }
+
+// one step of the compaction per pass of run_store
+static void store_compact_step(void)
+  {
+    unsigned char result;
+    unsigned int i;
+    Uint16 word;
+
+    result = STORE_DONE;
+    store_step_end = store_records + STORE_STEP;
+    switch(store_compacting)
+      {
+        case COMPACT_BLANK:
+            if (store_erase_pending == store_target) return;    // erased at RUN_OFF
+            for (i=0; (i<STORE_BLANK_STEP) && (store_pos<STORE_SECTOR_SIZE); i++, store_pos++)
+              {
+                if (store_base[store_target][store_pos] != 0xFFFF)
+                  {
+                    store_erase_pending = store_target;
+                    store_pos = 0;                          // check again after the erase
+                    return;
+                  }
+              }
+            if (store_pos < STORE_SECTOR_SIZE) return;
+            store_next = STORE_FIRST;
+            store_records = 0;
+            break;
+        case COMPACT_EEMEM:
+            result = store_save_eemem(&store_pos);
+            break;
+        case COMPACT_FORMAT:
+            result = format_save(&store_pos);
+            break;
+        #if (LOCO_DATABASE == NAMED)
+        case COMPACT_NAME:
+            result = name_save(&store_pos);
+            break;
+        #endif
+        #if (DCC_ROUTES == 1)
+        case COMPACT_ROUTE:
+            result = route_save(&store_pos);
+            break;
+        #endif
+        case COMPACT_HEADER:
+            word = store_seq + 1;                 // header last: seq, then magic
+            store_program(1, &word, 1);
+            word = STORE_MAGIC;
+            store_program(0, &word, 1);
+
+            if (store_active != STORE_NONE) store_erase_pending = store_active;
+            store_active = store_target;
+            store_seq++;
+            store_compacting = COMPACT_NONE;
+            store_pending = 1;                    // changes made during the compaction
+            return;
+      }
+    if (result == STORE_MORE) return;
+    if (result == STORE_FAIL)
+      {                                           // flash defect: keep the old sector
+                                                  // (a full sector is not, see store_room)
+        store_target = store_active;
+        store_next = STORE_SECTOR_SIZE;           // try again with next change
+        store_compacting = COMPACT_NONE;
+        return;
+      }
+    store_compacting++;
+    store_pos = 0;
+  }
+
+void run_store(void)
+  {
+    if (store_compacting != COMPACT_NONE)
+      {
+        store_compact_step();
+      }
+    else if (store_pending && ((millis() - store_last_change) >= STORE_FLUSH_DELAY))
+      {
+        store_pending = 0;
+        if ((store_active == STORE_NONE) || !store_save()) store_compact_start();
+      }
+    if ((store_erase_pending != STORE_NONE) && (opendcc_state == RUN_OFF))
+      {
+        store_erase(store_erase_pending);
+        store_erase_pending = STORE_NONE;
+      }
+  }
+
+void init_store(void)
+  {
+    unsigned char other;
+    uint32_t elapsed;
+
+    // CpuTimer2 as stopwatch in us (millis() does not run before EINT)
+    CpuTimer2Regs.TCR.bit.TSS = 1;
+    CpuTimer2Regs.PRD.all = 0xFFFFFFFF;
+    CpuTimer2Regs.TPR.all = (90-1);
+    CpuTimer2Regs.TPRH.all = 0;
+    CpuTimer2Regs.TCR.bit.TRB = 1;
+    CpuTimer2Regs.TCR.bit.TSS = 0;
+
+    memcpy(&Flash28_API_RunStart, &Flash28_API_LoadStart, &Flash28_API_LoadEnd - &Flash28_API_LoadStart);
+    Flash_CPUScaleFactor = SCALE_FACTOR;
+    #if (DCC_WATCHDOG == 1)
+    Flash_CallbackPtr = &watchdog_kick;
+    #else
+    Flash_CallbackPtr = NULL;
+    #endif
+
+    memcpy(eemem, eemem_default, SIZE_EEMEM);
+    memset(store_dirty, 0, sizeof(store_dirty));
+    store_pending = 0;
+    store_compacting = COMPACT_NONE;
+    store_pos = 0;
+    store_step_end = 0;
+    store_erase_pending = STORE_NONE;
+    store_active = STORE_NONE;
+    store_seq = 0;
+
+    if (store_valid(0) && store_valid(1))
+      {
+        if ((int16)(store_base[1][1] - store_base[0][1]) > 0) store_active = 1;
+        else store_active = 0;
+      }
+    else if (store_valid(0)) store_active = 0;
+    else if (store_valid(1)) store_active = 1;
+
+    if (store_active == STORE_NONE)
+      {
+        store_target = 0;
+        store_next = STORE_SECTOR_SIZE;       // first change makes a compaction to sector 0
+        store_records = 0;
+      }
+    else
+      {
+        store_seq = store_base[store_active][1];
+        store_target = store_active;
+        store_scan();
+        other = store_active ^ 1;
+        if ((store_base[other][0] != 0xFFFF) ||           // old sector or
+            (store_base[other][1] != 0xFFFF) ||           // interrupted compaction
+            (store_base[other][STORE_FIRST] != 0xFFFF)) store_erase_pending = other;
+        store_replay(STORE_KEY_EEMEM, STORE_KEY_EEMEM + SIZE_EEMEM, store_apply_eemem);
+      }
+
+    elapsed = 0xFFFFFFFF - CpuTimer2Regs.TIM.all;
+    CpuTimer2Regs.TCR.bit.TSS = 1;
+    if (elapsed > 0xFFFF) elapsed = 0xFFFF;
+    store_load_time = (unsigned int)elapsed;
+  }
+
+#else  // DCC_STORE
+
+void init_store(void)
+  {
+    memcpy(eemem, eemem_default, SIZE_EEMEM);
+  }
+
+void run_store(void)
+  {
+  }
+
+void store_write(unsigned int addr, unsigned char value)
+  {
+    if (addr < SIZE_EEMEM) eemem[addr] = value;     // until power off
+  }
+
+void store_replay(unsigned int key_from, unsigned int key_to, t_store_apply apply)
+  {
+  }
+
+unsigned char store_put(unsigned int key, unsigned int value)
+  {
+    return(1);
+  }
+
+unsigned char store_step(void)
+  {
+    return(1);
+  }
+
+void store_changed(void)
+  {
+  }
+
+unsigned char store_room(unsigned int records)
+  {
+    return(1);
+  }
+
+#endif // DCC_STORE
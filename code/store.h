@@ -0,0 +1,72 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      store.h
+// history:   flash store for CVs and config started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   log structured store in two flash sectors,
+//            replaces the eeprom of the AVR OpenDCC
+//
+// interface upstream:
+//            init_store(void)          // call once at program start, before all
+//                                      // other init_xxx (they read eemem[])
+//            run_store(void)           // task, writes changes to flash
+//            store_write(addr, value)  // change a CV of the command station
+//            store_replay(from, to, apply) // read back records of other modules
+//            store_put(key, value)     // write a record (only from a save callback)
+//            store_step(void)          // save callback in a compaction: 1 if this
+//                                      // pass may write another record
+//            store_changed(void)       // other module has unsaved data
+//            store_room(records)       // 1: a compaction with that many records
+//                                      // of the database still fits one sector
+//
+//-----------------------------------------------------------------
+#ifndef __STORE_H__
+#define __STORE_H__
+
+// key ranges of the records
+#define STORE_KEY_EEMEM     0x0000      // + eadr_xxx, value = CV
+#define STORE_KEY_ROUTE     0x1000      // + route * 64 + index, see accessory.c
+#define STORE_KEY_FORMAT    0x4000      // + loco addr, value = format, see database.c
+#define STORE_KEY_NAME      0x8000      // + slot * 8 + word, see database.c
+#define STORE_KEY_END       0x9000
+
+// save callbacks xxx_save(pos) of the other modules:
+//   pos == NULL: write the changed entries
+//   else compaction, in steps over several passes of run_store: *pos == 0
+//   at the first call (forget the changes, all is written now), then write
+//   the entries from *pos on until store_step() is 0 and set *pos to the
+//   entry to go on with. An entry changed later is written as change.
+#define STORE_FAIL          0           // flash full or defect
+#define STORE_DONE          1
+#define STORE_MORE          2           // compaction: call again with *pos
+
+typedef void (*t_store_apply)(unsigned int key, unsigned int value);
+
+extern unsigned int store_load_time;    // time of init_store in us
+extern unsigned int store_records;      // no of records in active sector
+
+void init_store(void);
+void run_store(void);
+
+void store_write(unsigned int addr, unsigned char value);
+
+void store_replay(unsigned int key_from, unsigned int key_to, t_store_apply apply);
+unsigned char store_put(unsigned int key, unsigned int value);
+unsigned char store_step(void);
+void store_changed(void);
+unsigned char store_room(unsigned int records);
+
+#endif // __STORE_H__
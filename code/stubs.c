@@ -6,6 +6,9 @@
 #include "status.h"
 #include "keys.h"
 #include "organizer.h"
+#include "ramp.h"
+#include "events.h"
+#include "scheduler.h"
 
 static bool handleSpeedKeys (key_t key);
 
@@ -13,6 +16,7 @@ static bool handleSpeedKeys (key_t key);
 #define UISTATE_LOC_DO_SPEED    2
 #define UISTATE_DEFAULT         UISTATE_LOC_DO_SPEED
 #define UISTATE_EVENT_MAINSHORT 100
+#define UISTATE_EVENT_ESTOP     101
 
 // dit is volgens DCC128
 #define DIRECTION_FORWARD 0x80
@@ -22,27 +26,30 @@ static bool handleSpeedKeys (key_t key);
 #define UI_NUM_SPEED_STEPS 128
 #define DCC_MINSPEED 2 // 0 en 1 zijn stops, 0 = STOP, 1 = EMERGENCY STOP
 #define DCC_MAXSPEED 127
-uint32_t speedkeyLastMillis;
+// speed steps per encoder step: 1 up to ROT_SLOW steps/s, then one more per ROT_ACCEL steps/s
+#define ROT_SLOW  20
+#define ROT_ACCEL 4
+#define ROT_MAXSTEP 8
 uint8_t ui_CurSpeed = 0 | DIRECTION_FORWARD ;
 uint8_t ui_State = UISTATE_DEFAULT;
 
-void hwEvent_Handler (hwEvent_t event)
+static t_event_cursor ui_events = 0;     // from reset on
+
+void ui_Update (void)
 {
-  // stub -> TODO
-  if (event == HWEVENT_MAINSHORT)
+  t_event event;
+
+  if (!event_get(&ui_events, &event))
+    return;
+  sched_ready(SCHED_UI); // one event per call
+
+  if ((event.type == EV_SHORT) && (event.a == EV_SHORT_MAIN))
   {
     ui_State = UISTATE_EVENT_MAINSHORT;
   }
-  if (event == HWEVENT_PROGSHORT)
-  {
-    // should not happen on tapas demo
-  }
-  else if (event == HWEVENT_EXTSTOP)
-  {
-    // should not happen on tapas demo
-  }
+  // EV_SHORT on prog and EV_EXT_STOP should not happen on tapas demo
 
-} // hwEvent_Handler
+} // ui_Update
 
 
 void keys_Handler (key_t key)
@@ -58,7 +65,17 @@ void keys_Handler (key_t key)
         return;
     
     
-    if (ui_State == UISTATE_EVENT_MAINSHORT)
+    // long press on the rotary switch = emergency stop for all locos
+    // the stop packet is sent by the dccout ISR right after the current packet
+    if ((keyCode == KEY_ENTER) && (keyEvent == KEYEVENT_LONGDOWN))
+    {
+        ui_CurSpeed &= DIRECTION_BIT;
+        set_opendcc_state(RUN_STOP);
+        ui_State = UISTATE_EVENT_ESTOP;
+        return;
+    }
+
+    if ((ui_State == UISTATE_EVENT_MAINSHORT) || (ui_State == UISTATE_EVENT_ESTOP))
     {
         if (keyCode == KEY_ENTER)
         {
@@ -80,16 +97,17 @@ static bool handleSpeedKeys (key_t key)
     uint8_t keyCode, keyEvent;
     bool keyHandled = false;
     uint8_t speedStep, curSpeed, dirBit;
+    unsigned int velocity;
 
     keyCode = key & KEYCODEFILTER;
     keyEvent = key & KEYEVENTFILTER;
     
     
     // als we snel aan de knop draaien gaat de speed sneller vooruit
-    if ((millis() - speedkeyLastMillis) > 50) speedStep = 1;
-    else if ((millis() - speedkeyLastMillis) > 30) speedStep = 3;
-    else speedStep = 8;
-    speedkeyLastMillis = millis();
+    velocity = keys_RotVelocity ();
+    if (velocity <= ROT_SLOW) speedStep = 1;
+    else if (velocity >= ROT_SLOW + (ROT_MAXSTEP - 1) * ROT_ACCEL) speedStep = ROT_MAXSTEP;
+    else speedStep = 1 + (velocity - ROT_SLOW) / ROT_ACCEL;
         
     curSpeed = ui_CurSpeed & 0x7F; // remove direction bit
     dirBit = ui_CurSpeed & DIRECTION_BIT;
@@ -126,6 +144,9 @@ static bool handleSpeedKeys (key_t key)
     {
       if (organizer_ready())
       {
+          #if (DCC_RAMP == 1)
+          ramp_cancel(3);   // manual speed overrules a running ramp
+          #endif
           do_loco_speed (1,3, ui_CurSpeed);
       }      
     }
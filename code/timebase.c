@@ -0,0 +1,64 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      timebase.c
+// history:   64 bit timebase started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   monotonic time in SYSCLK cycles since start of main
+//
+// how:       CpuTimer1 counts down from 0xFFFFFFFF at SYSCLK, without
+//            interrupt. tb_now() compares with the last read value:
+//            a smaller value means the timer wrapped, the upper 32 bit
+//            are incremented. No interrupt is needed, so the timebase
+//            also runs while store.c writes the flash.
+//            millis() (CpuTimer0) is not changed, its users keep working.
+//
+//-----------------------------------------------------------------
+
+#include "DSP28x_Project.h"     // Device Headerfile and Examples Include File
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "config.h"                // general structures and definitions
+#include "timebase.h"
+
+static uint32_t tb_high;                // upper 32 bit
+static uint32_t tb_last;                // last lower 32 bit
+
+void init_timebase(void)
+  {
+    CpuTimer1Regs.TCR.bit.TSS = 1;
+    CpuTimer1Regs.PRD.all = 0xFFFFFFFF;
+    CpuTimer1Regs.TPR.all = 0;
+    CpuTimer1Regs.TPRH.all = 0;
+    CpuTimer1Regs.TCR.bit.TIE = 0;
+    CpuTimer1Regs.TCR.bit.TRB = 1;
+    CpuTimer1Regs.TCR.bit.TSS = 0;
+
+    tb_high = 0;
+    tb_last = 0;
+  }
+
+uint64_t tb_now(void)
+  {
+    uint32_t low;
+
+    low = TB_CLOCK32();
+    if (low < tb_last) tb_high++;
+    tb_last = low;
+    return(((uint64_t)tb_high << 32) | low);
+  }
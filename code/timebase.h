@@ -0,0 +1,43 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      timebase.h
+// history:   64 bit timebase started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   monotonic time in SYSCLK cycles since start of main
+//
+// interface upstream:
+//            init_timebase(void)       // first call after InitSysCtrl
+//            tb_now(void)              // 64 bit time, main context only
+//            TB_CLOCK32()              // lower 32 bit, also in interrupts
+//
+//-----------------------------------------------------------------
+#ifndef __TIMEBASE_H__
+#define __TIMEBASE_H__
+
+#define TB_MHZ              90                          // SYSCLK
+#define TB_US(us)           ((uint64_t)(us) * TB_MHZ)   // convert to timebase ticks
+#define TB_MS(ms)           ((uint64_t)(ms) * (TB_MHZ * 1000L))
+
+// CpuTimer1 runs free at SYSCLK and counts down
+#define TB_CLOCK32()        (0xFFFFFFFF - CpuTimer1Regs.TIM.all)
+
+void init_timebase(void);
+
+// the upper 32 bit are counted in software: tb_now must be called at
+// least once per wrap of CpuTimer1 (47s); run_timerwheel does it every loop.
+uint64_t tb_now(void);
+
+#endif // __TIMEBASE_H__
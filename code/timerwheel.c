@@ -0,0 +1,194 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      timerwheel.c
+// history:   timer wheel for one shot software timers started
+//            hierarchical wheel with 1ms tick, driven by the timebase
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   one shot timers with callback
+//
+// how:       hierarchical timer wheel: TW_LEVELS wheels of TW_SLOTS slots.
+//            Every timer keeps its absolute expiry (tw_time + ticks) and
+//            is put to the lowest level where expiry and tw_time differ
+//            only in the slot bits of this level:
+//              level 0: one slot per tick      (up to 63 ms ahead)
+//              level 1: one slot per 64 ticks  (up to 4 s)
+//              level 2: one slot per 4096 ticks
+//            When the index of a level wraps to 0, the next slot of the
+//            level above is cascaded: its timers are put in again and
+//            fall to a lower level. All timers in the current slot of
+//            level 0 are due.
+//            Lists are double linked by index, so start, cancel and the
+//            expiry of one timer are O(1); a cascade touches only the
+//            timers of one slot.
+//            All timers come from a fixed pool of SIZE_TIMERWHEEL entries.
+//
+//            run_timerwheel compares the timebase with the next tick; if
+//            no tick is due it returns at once.
+//
+//-----------------------------------------------------------------
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "config.h"                // general structures and definitions
+#include "timebase.h"
+#include "timerwheel.h"
+
+#define TW_FREE         0xFFFF          // slot of an unused entry
+#define TW_MASK         (TW_SLOTS-1)
+
+typedef struct
+  {
+    unsigned char next;                 // next timer in this slot, TW_NONE = end
+    unsigned char prev;                 // previous timer, TW_NONE = head
+    unsigned int  slot;                 // level * TW_SLOTS + index, TW_FREE = entry free
+    uint32_t      expires;              // tw_time of expiry
+    t_tw_callback cb;
+    unsigned int  arg;
+  } t_tw_timer;
+
+t_tw_timer tw_timer[SIZE_TIMERWHEEL];
+unsigned char tw_slot[TW_LEVELS * TW_SLOTS];    // head of list per slot
+uint32_t tw_time;                               // ticks since init
+static uint64_t tw_next_tick;                   // timebase of next tick
+
+void init_timerwheel(void)
+  {
+    unsigned int i;
+
+    for (i=0; i<SIZE_TIMERWHEEL; i++) tw_timer[i].slot = TW_FREE;
+    for (i=0; i<(TW_LEVELS * TW_SLOTS); i++) tw_slot[i] = TW_NONE;
+    tw_time = 0;
+    tw_next_tick = tb_now() + TB_MS(TW_TICK_MS);
+  }
+
+static void tw_link(unsigned char i)
+  {
+    uint32_t expires;
+    unsigned int slot;
+
+    expires = tw_timer[i].expires;
+    if ((expires >> TW_SLOT_BITS) == (tw_time >> TW_SLOT_BITS))
+      {
+        slot = expires & TW_MASK;
+      }
+    else if ((expires >> (2*TW_SLOT_BITS)) == (tw_time >> (2*TW_SLOT_BITS)))
+      {
+        slot = TW_SLOTS + ((expires >> TW_SLOT_BITS) & TW_MASK);
+      }
+    else
+      {
+        slot = 2*TW_SLOTS + ((expires >> (2*TW_SLOT_BITS)) & TW_MASK);
+      }
+
+    tw_timer[i].slot = slot;
+    tw_timer[i].prev = TW_NONE;
+    tw_timer[i].next = tw_slot[slot];
+    if (tw_slot[slot] != TW_NONE) tw_timer[tw_slot[slot]].prev = i;
+    tw_slot[slot] = i;
+  }
+
+static void tw_unlink(unsigned char i)
+  {
+    if (tw_timer[i].prev == TW_NONE) tw_slot[tw_timer[i].slot] = tw_timer[i].next;
+    else tw_timer[tw_timer[i].prev].next = tw_timer[i].next;
+    if (tw_timer[i].next != TW_NONE) tw_timer[tw_timer[i].next].prev = tw_timer[i].prev;
+    tw_timer[i].slot = TW_FREE;
+  }
+
+t_tw_handle tw_start(unsigned int ticks, t_tw_callback cb, unsigned int arg)
+  {
+    unsigned char i;
+
+    for (i=0; i<SIZE_TIMERWHEEL; i++)
+      {
+        if (tw_timer[i].slot == TW_FREE) break;
+      }
+    if (i == SIZE_TIMERWHEEL) return(TW_NONE);
+
+    if (ticks == 0) ticks = 1;
+    tw_timer[i].expires = tw_time + ticks;
+    tw_timer[i].cb = cb;
+    tw_timer[i].arg = arg;
+    tw_link(i);
+    return(i);
+  }
+
+void tw_cancel(t_tw_handle handle)
+  {
+    if (handle >= SIZE_TIMERWHEEL) return;
+    if (tw_timer[handle].slot == TW_FREE) return;
+    tw_unlink(handle);
+  }
+
+// put all timers of a slot in again, relative to the new tw_time
+static void tw_cascade(unsigned int slot)
+  {
+    unsigned char i, next;
+
+    i = tw_slot[slot];
+    tw_slot[slot] = TW_NONE;
+    while (i != TW_NONE)
+      {
+        next = tw_timer[i].next;
+        tw_link(i);
+        i = next;
+      }
+  }
+
+// advance the wheel by one tick and fire the due timers.
+// a callback may start or cancel timers: a new timer is at least one
+// tick ahead, so it never goes to the slot which is just emptied.
+static void tw_tick(void)
+  {
+    unsigned char i;
+    unsigned int slot;
+
+    tw_time++;
+    if ((tw_time & TW_MASK) == 0)
+      {
+        if (((tw_time >> TW_SLOT_BITS) & TW_MASK) == 0)
+          {
+            tw_cascade(2*TW_SLOTS + ((tw_time >> (2*TW_SLOT_BITS)) & TW_MASK));
+          }
+        tw_cascade(TW_SLOTS + ((tw_time >> TW_SLOT_BITS) & TW_MASK));
+      }
+
+    slot = tw_time & TW_MASK;
+    while ((i = tw_slot[slot]) != TW_NONE)
+      {
+        tw_unlink(i);                          // free before callback, so it may restart a timer
+        tw_timer[i].cb(tw_timer[i].arg);
+      }
+  }
+
+// task: catch up with the timebase; more than one tick only if the
+// main loop was blocked (e.g. flash write in store.c)
+void run_timerwheel(void)
+  {
+    uint64_t now;
+
+    now = tb_now();
+    if (now < tw_next_tick) return;
+    do
+      {
+        tw_next_tick += TB_MS(TW_TICK_MS);
+        tw_tick();
+      }
+    while (now >= tw_next_tick);
+  }
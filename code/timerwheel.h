@@ -0,0 +1,51 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      timerwheel.h
+// history:   timer wheel for one shot software timers started
+//            hierarchical wheel with 1ms tick, driven by the timebase
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   one shot timers with callback
+//
+// interface upstream:
+//            init_timerwheel(void)     // call once at program start
+//            run_timerwheel(void)      // task, advances the wheel to tb_now()
+//            tw_start(ticks, cb, arg)  // start a timer, returns handle
+//            tw_cancel(handle)         // stop a running timer
+//
+//-----------------------------------------------------------------
+#ifndef __TIMERWHEEL_H__
+#define __TIMERWHEEL_H__
+
+#define TW_TICK_MS          1       // one tick of the wheel
+#define TW_LEVELS           3       // 64^3 ticks > longest delay (65535)
+#define TW_SLOT_BITS        6
+#define TW_SLOTS            (1 << TW_SLOT_BITS)     // per level
+#define TW_NONE             0xFF    // invalid handle
+
+typedef void (*t_tw_callback)(unsigned int arg);
+typedef unsigned char t_tw_handle;
+
+void init_timerwheel(void);
+void run_timerwheel(void);
+
+// ticks:  delay in TW_TICK_MS, 0 is treated as 1
+// cb:     called from run_timerwheel (main context) when the timer expires
+// return: handle or TW_NONE if all timers are in use
+t_tw_handle tw_start(unsigned int ticks, t_tw_callback cb, unsigned int arg);
+
+void tw_cancel(t_tw_handle handle);
+
+#endif // __TIMERWHEEL_H__
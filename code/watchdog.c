@@ -0,0 +1,173 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      watchdog.c
+// history:   watchdog supervision with post mortem record started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   hardware watchdog with task supervision, post mortem
+//
+// how:       InitSysCtrl switches the watchdog off; watchdog_start
+//            switches it on (reset mode, 839ms) before the main loop.
+//            run_scheduler stores a heartbeat (millis) after every task.
+//            run_watchdog runs every WATCHDOG_CHECK_MS as a task itself
+//            and feeds the watchdog only if every supervised task ran
+//            within its time:
+//            - a task which does not return stops the main loop: no feed
+//            - a task which does not get the cpu (starved) is entered in
+//              postmortem.starved, from then on no feed
+//            - an isr which does not end stops the main loop: no feed
+//            The reset follows at the latest 839ms later.
+//
+//            Flash erase and write block the main loop for a long time;
+//            the flash api calls watchdog_kick during that time (from
+//            RAM). After a flash operation the supervision starts anew.
+//
+//            postmortem lies in the section warmstart (see snapshot.c)
+//            and is written while running: the scheduler enters the
+//            current task, every isr its id; run_watchdog copies the
+//            queue depths and the last packet. After the reset the WDFLAG
+//            of the watchdog tells that the content is from before the
+//            reset; it is copied to postmortem_last and sent to the pc
+//            (EV_WATCHDOG, Lenz extension 0xFF).
+//
+//-----------------------------------------------------------------
+
+#include "DSP28x_Project.h"     // Device Headerfile and Examples Include File
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "config.h"                // general structures and definitions
+#include "dccout.h"                // next_message
+#include "organizer.h"             // queue depths
+#include "events.h"
+#include "scheduler.h"
+#include "watchdog.h"
+
+#if (DCC_WATCHDOG == 1)
+
+#define POSTMORTEM_MAGIC    0xDEAD
+
+// WDCR
+#define WD_FLAG             0x0080      // reset was caused by the watchdog, write 1 to clear
+#define WD_DISABLE          0x0040
+#define WD_CHECK            0x0028      // WDCHK must be written as 101, else reset
+
+#pragma DATA_SECTION(postmortem, "warmstart");      // see F28069M.cmd
+t_postmortem postmortem;
+
+t_postmortem postmortem_last;
+t_pm_reason postmortem_reason;
+
+static unsigned int wd_limit[NUM_SCHED_TASK];       // ms, 0: not supervised
+static volatile unsigned char wd_flash;             // flash api was busy
+static uint32_t wd_grace;                           // millis() after the last flash operation
+
+void init_watchdog(void)
+  {
+    unsigned char i;
+
+    EALLOW;
+    if ((SysCtrlRegs.WDCR & WD_FLAG) && (postmortem.magic == POSTMORTEM_MAGIC))
+      {
+        postmortem_last = postmortem;
+        postmortem_reason = (postmortem.starved != PM_NO_TASK) ? PM_STARVED : PM_HANG;
+        postmortem.resets++;
+      }
+    else
+      {
+        postmortem_reason = PM_NONE;        // power up: RAM is random
+        postmortem.resets = 0;
+      }
+    SysCtrlRegs.WDCR = WD_FLAG | WD_DISABLE | WD_CHECK;     // clear flag, off until watchdog_start
+    EDIS;
+
+    postmortem.task = PM_NO_TASK;
+    postmortem.starved = PM_NO_TASK;
+    postmortem.isr = PM_ISR_NONE;
+    postmortem.queue_hp = 0;
+    postmortem.queue_lp = 0;
+    postmortem.queue_prog = 0;
+    postmortem.packet_size = 0;
+    postmortem.magic = POSTMORTEM_MAGIC;
+
+    for (i=0; i<NUM_SCHED_TASK; i++) wd_limit[i] = 0;
+    wd_flash = 0;
+  }
+
+void watchdog_supervise(t_sched_task task, unsigned int ms)
+  {
+    wd_limit[task] = ms;
+  }
+
+void watchdog_start(void)
+  {
+    wd_grace = millis();
+    watchdog_kick();
+    EALLOW;
+    SysCtrlRegs.WDCR = WD_CHECK | WATCHDOG_WDPS;            // on, reset mode
+    EDIS;
+
+    if (postmortem_reason != PM_NONE)
+      {
+        event_post(EV_WATCHDOG, postmortem.resets, postmortem_reason);
+      }
+  }
+
+// feed the watchdog; also called by the flash api, must run from RAM
+#pragma CODE_SECTION(watchdog_kick, "ramfuncs");
+void watchdog_kick(void)
+  {
+    EALLOW;
+    SysCtrlRegs.WDKEY = 0x0055;
+    SysCtrlRegs.WDKEY = 0x00AA;
+    EDIS;
+    wd_flash = 1;
+  }
+
+void run_watchdog(void)
+  {
+    uint32_t now, beat;
+    unsigned char i;
+
+    now = millis();
+    if (wd_flash)
+      {
+        wd_flash = 0;
+        wd_grace = now;                     // all tasks waited for the flash
+      }
+
+    for (i=0; i<NUM_SCHED_TASK; i++)
+      {
+        if (!wd_limit[i]) continue;
+        beat = sched_heartbeat((t_sched_task)i);
+        if ((int32_t)(beat - wd_grace) < 0) beat = wd_grace;
+        if (((now - beat) > wd_limit[i]) && (postmortem.starved == PM_NO_TASK))
+          {
+            postmortem.starved = i;
+          }
+      }
+    if (postmortem.starved != PM_NO_TASK) return;           // no more feed: reset follows
+
+    organizer_queue_depths(&postmortem.queue_hp, &postmortem.queue_lp, &postmortem.queue_prog);
+    postmortem.packet_size = next_message.size;
+    memcpy(postmortem.packet, next_message.dcc, sizeof(postmortem.packet));
+
+    watchdog_kick();
+    wd_flash = 0;                           // our own feed is no flash operation
+  }
+
+#endif // DCC_WATCHDOG
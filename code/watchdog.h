@@ -0,0 +1,98 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// Copyright (c) 2006 Kufer
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      watchdog.h
+// history:   watchdog supervision with post mortem record started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   lowcost central station for dcc
+// content:   hardware watchdog, fed only while all supervised tasks
+//            run; record of the last state before a watchdog reset
+//
+// interface upstream:
+//            init_watchdog(void)           // after InitSysCtrl: reads the reset cause
+//            watchdog_supervise(task, ms)  // task must run at least every ms
+//            watchdog_start(void)          // enable, before the main loop
+//            run_watchdog(void)            // task, every WATCHDOG_CHECK_MS
+//            watchdog_kick(void)           // flash api callback, from RAM
+//            WATCHDOG_ISR(id)              // first line of every isr
+//            WATCHDOG_TASK(task)           // set by run_scheduler
+//
+//-----------------------------------------------------------------
+#ifndef __WATCHDOG_H__
+#define __WATCHDOG_H__
+
+#include "scheduler.h"              // t_sched_task
+
+#if (DCC_WATCHDOG == 1)
+
+#define WATCHDOG_CHECK_MS   10          // period of run_watchdog
+#define WATCHDOG_WDPS       7           // WDCLK / 512 / 64: 256 counts = 839ms
+
+// last isr entered
+#define PM_ISR_NONE         0
+#define PM_ISR_DCC          1
+#define PM_ISR_MILLIS       2
+#define PM_ISR_CURRENT      3
+#define PM_ISR_UART_RX      4
+#define PM_ISR_UART_TX      5
+#define PM_ISR_ENCODER      6
+#define PM_ISR_BUTTON       7
+#define PM_ISR_DCC_PROG     8
+#define PM_ISR_DISTRICT     9           // + district - 1: 9..11
+
+#define PM_NO_TASK          0xFF        // between two tasks (scheduler, IDLE)
+
+// reason of the last reset, see pc_send_postmortem
+typedef enum {PM_NONE,                  // power up or reset pin
+              PM_HANG,                  // watchdog: task did not return
+              PM_STARVED                // watchdog: task did not run
+             } t_pm_reason;
+
+// kept in the section warmstart (no init, survives a reset); written
+// while running, so it tells the state at the moment of the reset
+typedef struct
+  {
+    unsigned int magic;
+    unsigned int resets;                // watchdog resets since power up
+    unsigned char task;                 // task running now, PM_NO_TASK
+    unsigned char starved;              // task which missed its time, PM_NO_TASK
+    unsigned char isr;                  // last isr entered
+    unsigned char queue_hp;             // organizer queues at the last check
+    unsigned char queue_lp;
+    unsigned char queue_prog;
+    unsigned char packet_size;          // next_message at the last check
+    unsigned char packet[MAX_DCC_SIZE];
+  } t_postmortem;
+
+extern t_postmortem postmortem;         // live record
+extern t_postmortem postmortem_last;    // record before the last reset
+extern t_pm_reason postmortem_reason;   // reason of the last reset
+
+#define WATCHDOG_ISR(id)        postmortem.isr = (id)
+#define WATCHDOG_TASK(t)        postmortem.task = (t)
+
+void init_watchdog(void);
+void watchdog_supervise(t_sched_task task, unsigned int ms);
+void watchdog_start(void);
+void run_watchdog(void);
+void watchdog_kick(void);
+
+#else
+
+#define WATCHDOG_ISR(id)
+#define WATCHDOG_TASK(t)
+
+#endif // DCC_WATCHDOG
+
+#endif // __WATCHDOG_H__
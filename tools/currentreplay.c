@@ -0,0 +1,241 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      currentreplay.c
+// history:   replay of current sense streams started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   host tool for the TAPAS build
+// content:   feeds a recorded adc stream through the current filter
+//            of the station (code/current_filter.c, same source as in
+//            the current isr) and prints rms/peak per window and every
+//            overload prediction, overload and ack.
+//
+// build:     gcc -Wall -Wno-unknown-pragmas -I code -o currentreplay
+//                tools/currentreplay.c code/current_filter.c
+//
+// usage:     currentreplay [options] FILE      (FILE - : stdin)
+//              -z N   offset in adc counts            (default 0)
+//              -o N   overload in adc counts          (default 3722, 3A)
+//              -p N   look ahead in 8 sample units    (default 4)
+//              -a N   ack rise in adc counts          (default 74, 60mA)
+//              -n N   ack min samples                 (default 10)
+//              -h N   ack max samples                 (default 160)
+//              -q     events and summary only
+//
+//            FILE has one sample per line: "main [prog]" as raw adc
+//            counts (0..4095), '#' starts a comment. Two samples are
+//            taken per dcc bit (58..116us apart).
+//            A line "#= SAMPLE CHANNEL EVENT" is an expected event
+//            (predict, overload, ack on, ack off): then every event must
+//            be expected, in that order.
+//            Exit code 0, 1 if the events do not match, 2 on bad input.
+//
+//            tools/current_sample.txt: synthetic stream with its expected
+//            events, an ack pulse and a loco start on the prog track and
+//            an overload ramp on the main track:
+//            currentreplay -q tools/current_sample.txt
+//
+//            Defaults are those of config.h and hardware.h for
+//            806uA per count.
+//
+//-----------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "current_filter.h"
+
+#define MAX_EVENTS      64
+
+typedef struct
+  {
+    unsigned long sample;
+    int channel;
+    char what[24];
+  } t_event;
+
+static const char *channel_name[2] = {"main", "prog"};
+
+static t_event expect[MAX_EVENTS], seen[MAX_EVENTS];
+static int expects, seens;
+
+static void event(unsigned long sample, int channel, const char *what)
+  {
+    if (seens < MAX_EVENTS)
+      {
+        seen[seens].sample = sample;
+        seen[seens].channel = channel;
+        strncpy(seen[seens].what, what, sizeof(seen[0].what) - 1);
+        seen[seens].what[sizeof(seen[0].what) - 1] = 0;
+      }
+    seens++;
+  }
+
+// "#= SAMPLE CHANNEL EVENT"; return 0 if bad
+static int read_expect(const char *line)
+  {
+    char channel[8], what[2][12];
+    t_event *e;
+    int n;
+
+    if (expects == MAX_EVENTS) return(0);
+    e = &expect[expects];
+    n = sscanf(line + 2, "%lu %7s %11s %11s", &e->sample, channel, what[0], what[1]);
+    if (n < 3) return(0);
+    if (!strcmp(channel, channel_name[0])) e->channel = 0;
+    else if (!strcmp(channel, channel_name[1])) e->channel = 1;
+    else return(0);
+    if (n == 4) snprintf(e->what, sizeof(e->what), "%s %s", what[0], what[1]);
+    else snprintf(e->what, sizeof(e->what), "%s", what[0]);
+    expects++;
+    return(1);
+  }
+
+static int compare_events(void)
+  {
+    int i, failed = 0;
+
+    if (seens > MAX_EVENTS)
+      {
+        printf("%d events, more than %d\n", seens, MAX_EVENTS);
+        return(1);
+      }
+    for (i=0; (i<expects) || (i<seens); i++)
+      {
+        if ((i < expects) && (i < seens) && (expect[i].sample == seen[i].sample)
+            && (expect[i].channel == seen[i].channel) && !strcmp(expect[i].what, seen[i].what)) continue;
+        if (i < expects) printf("expected %lu %s %s", expect[i].sample, channel_name[expect[i].channel], expect[i].what);
+        else printf("expected nothing");
+        if (i < seens) printf(", got %lu %s %s\n", seen[i].sample, channel_name[seen[i].channel], seen[i].what);
+        else printf(", got nothing\n");
+        failed = 1;
+      }
+    return(failed);
+  }
+
+static void usage(void)
+  {
+    fprintf(stderr, "usage: currentreplay [-z offset] [-o overload] [-p ahead] "
+                    "[-a ack_delta] [-n ack_samples] [-h ack_hold] [-q] FILE\n");
+    exit(2);
+  }
+
+int main(int argc, char *argv[])
+  {
+    t_cf_channel ch[2];
+    t_cf_result result;
+    uint16_t setup[6] = {0, 3722, 4, 74, 10, 160};
+    unsigned char last_predict[2] = {0, 0}, last_over[2] = {0, 0}, last_ack[2] = {0, 0};
+    uint16_t last_seq[2] = {0, 0};
+    unsigned long sample, predicts[2] = {0, 0}, overs[2] = {0, 0}, acks[2] = {0, 0};
+    int quiet = 0, channels = 1, i, n;
+    long raw[2];
+    char line[128];
+    const char *opt;
+    FILE *f;
+
+    for (i=1; i<argc-1; i++)
+      {
+        if (!strcmp(argv[i], "-q"))
+          {
+            quiet = 1;
+            continue;
+          }
+        if ((argv[i][0] != '-') || !argv[i][1] || argv[i][2]) usage();
+        opt = strchr("zopanh", argv[i][1]);
+        if (!opt || (i+1 >= argc-1)) usage();
+        setup[opt - "zopanh"] = (uint16_t)strtoul(argv[++i], NULL, 0);
+      }
+    if (i != argc-1) usage();
+    f = strcmp(argv[i], "-") ? fopen(argv[i], "r") : stdin;
+    if (!f)
+      {
+        perror(argv[i]);
+        return(2);
+      }
+
+    for (i=0; i<2; i++)
+      {
+        cf_init(&ch[i]);
+        ch[i].offset = setup[0];
+        ch[i].overload = setup[1];
+        ch[i].predict_ahead = setup[2];
+        ch[i].ack_delta = setup[3];
+        ch[i].ack_samples = setup[4];
+        ch[i].ack_hold = setup[5];
+      }
+
+    sample = 0;
+    while (fgets(line, sizeof(line), f))
+      {
+        if (!strncmp(line, "#=", 2) && !read_expect(line))
+          {
+            fprintf(stderr, "bad expected event: %s", line);
+            return(2);
+          }
+        if (strchr(line, '#')) *strchr(line, '#') = 0;
+        n = sscanf(line, "%ld %ld", &raw[0], &raw[1]);
+        if (n <= 0) continue;
+        if ((raw[0] < 0) || (raw[0] > 4095) || ((n == 2) && ((raw[1] < 0) || (raw[1] > 4095))))
+          {
+            fprintf(stderr, "sample %lu: out of range\n", sample);
+            return(2);
+          }
+        if (n == 2) channels = 2;
+        for (i=0; i<n; i++)
+          {
+            cf_sample(&ch[i], (uint16_t)raw[i]);
+            if (ch[i].predict && !last_predict[i])
+              {
+                printf("%8lu %s predict level %u slope %+d\n", sample, channel_name[i], ch[i].level, ch[i].slope);
+                event(sample, i, "predict");
+                predicts[i]++;
+              }
+            if (ch[i].over && !last_over[i])
+              {
+                printf("%8lu %s overload level %u\n", sample, channel_name[i], ch[i].level);
+                event(sample, i, "overload");
+                overs[i]++;
+              }
+            if (ch[i].ack != last_ack[i])
+              {
+                printf("%8lu %s ack %s\n", sample, channel_name[i], ch[i].ack ? "on" : "off");
+                event(sample, i, ch[i].ack ? "ack on" : "ack off");
+                if (ch[i].ack) acks[i]++;
+              }
+            last_predict[i] = ch[i].predict;
+            last_over[i] = ch[i].over;
+            last_ack[i] = ch[i].ack;
+
+            if (!quiet && (ch[i].win_seq != last_seq[i]))
+              {
+                cf_read(&ch[i], &result);
+                printf("%8lu %s window rms %u peak %u\n", sample, channel_name[i], result.rms, result.peak);
+              }
+            last_seq[i] = ch[i].win_seq;
+          }
+        sample++;
+      }
+    if (f != stdin) fclose(f);
+
+    for (i=0; i<channels; i++)
+      {
+        printf("%s: %lu samples, %lu predictions, %lu overloads, %lu acks\n",
+               channel_name[i], sample, predicts[i], overs[i], acks[i]);
+      }
+    if (!expects) return(0);
+    if (compare_events()) return(1);
+    printf("%d events as expected\n", expects);
+    return(0);
+  }
@@ -0,0 +1,1166 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      dccwave.c
+// history:   waveform simulation of main and prog track started
+//            power districts added
+//
+//-----------------------------------------------------------------
+//
+// purpose:   host tool for the TAPAS build
+// content:   runs the generators of main, prog and the power districts
+//            side by side on one time line and decodes all outputs again.
+//
+//            All outputs use the generator of the station
+//            (code/dccgen.c, same source as the prog and district isrs);
+//            main and districts with 14 preamble bits, prog with 20.
+//            Main is modelled with dccgen too: on the target it runs
+//            epwm_isr of dccout.c, which is not portable. Bit timing,
+//            preamble and one isr per bit are the same; its own run time
+//            is taken as -c like the others.
+//            Every bit is one isr on a single cpu: if isrs are due at the
+//            same time, main (INTx3) runs first and delays the others by
+//            the isr time. The pwm keeps the bit timing, the isr only has
+//            to set the period within the first half of the bit (58us).
+//            The pwms start in phase (TBCLKSYNC, as init_dccout), the
+//            worst case for the first bits; -p staggers them.
+//
+//            main: the organizer keeps the ring filled with a refresh
+//                  of N locos, all the time; every 100ms an accessory.
+//                  Each packet is copied by district_mirror.
+//            prog: a direct mode verify byte as run_prog_inner_task,
+//                  polled every 1ms: power on (20 resets), 3 resets,
+//                  5 verify, 2 resets. With -a the decoder answers the
+//                  2nd verify with a 6ms ack; the tool then skips the
+//                  repetitions (dg_skip).
+//            districts (-d N, code/district.c): district 1 mirrors main,
+//                  districts 2.. are yards (filtered) with locos routed
+//                  to them; they are refreshed when district_wants_refresh,
+//                  every 50ms one of them gets a new speed, which has to
+//                  go to its yard and not to main.
+//                  A fault window (-f) drives the fault input; the output
+//                  is cut by the trip zone at the next bit and stays cut
+//                  until district_check switches it on again. A district
+//                  in DS_SHORT is switched on by the pc 50ms after the
+//                  fault (district_set_power).
+//            -e:   emergency stop as dccout_emergency_stop: main and all
+//                  districts have to carry the stop within 20ms.
+//            -r:   main is fed by a model of run_organizer with queue_lp,
+//                  repeatbuffer and refresh; the pc load steps up from 2s
+//                  to 6s. Curves of command latency and refresh interval,
+//                  fixed repeats (-r 0) or DCC_ADAPTIVE_REPEAT (-r 1).
+//
+//            A receiver per output checks preamble (main, districts >= 14,
+//            prog >= 20), start bits and xor of every packet; it resyncs
+//            after the output was cut.
+//            -S:   rail statistic of each output as DCC_RAIL_STATS on the
+//                  target: share of the rail time per kind of packet and
+//                  the addresses with the most packets (keys as rail_top
+//                  of organizer.c); exact counts, no space saving list.
+//
+// build:     gcc -Wall -Wno-unknown-pragmas -I code -o dccwave
+//                tools/dccwave.c code/dccgen.c code/district.c
+//
+// usage:     dccwave [options]
+//              -t N   simulated time in ms                (default 500)
+//              -l N   locos in the main refresh, 1..50    (default 5)
+//              -s N   start of the prog job in ms         (default 20)
+//              -c N   isr time in ns                      (default 1500)
+//              -p N   start of output k later by k*N us   (default 0, in phase)
+//              -a     decoder acks the verify
+//              -d N   outputs incl. main, 1..4            (default 1)
+//              -y N   locos per yard                      (default 4)
+//              -i N   short ignore time in ms             (default 8, CV34)
+//              -f D,FROM,UNTIL  fault on district D, ms   (up to 4 times)
+//              -e N   emergency stop at N ms              (default none)
+//              -r N   organizer model, 0: fixed, 1: adaptive repeats
+//              -R N   pc commands per s at high load      (default 40)
+//              -S N   rail statistic, top N addresses     (default none)
+//              -q     summary only
+//
+//            e.g. dccwave -q -d 4 -f 2,150,300 -f 3,100,103 -e 450
+//                 dccwave -q -r 1 -R 40 -t 9000
+//
+//            Exit code 0: all outputs valid, main refresh never stopped,
+//            routing, short isolation and stop as expected,
+//            1: a check failed, 2: bad usage.
+//
+//-----------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "dccgen.h"
+#include "district.h"
+
+#define NS_BIT_1        116000L         // one bit, both halves
+#define NS_BIT_0        232000L
+#define NS_HALF_1       58000L          // isr must be done before
+#define NS_MS           1000000L
+#define ACK_NS          (6 * NS_MS)
+#define ESTOP_NS        (20 * NS_MS)
+#define YARD_ADDR       60              // loco k of yard d: 60 + 10*d + k, main 1..50
+#define MAX_FAULTS      4
+#define RAIL_KEY_LONG   0x8000          // as organizer.h
+#define RAIL_KEY_ACC    0x4000
+#define MAX_RAIL_TOP    32
+
+enum {MAIN, PROG, DIST1};               // DIST1 + d - 1: district d
+#define OUTPUTS         (DIST1 + DISTRICT_MAX - 1)
+
+enum {K_IDLE, K_LOCO, K_ACC, K_OTHER, KINDS};  // rail statistic per kind of packet
+static const char *kind_name[KINDS] = {"idle", "loco", "acc", "other"};
+
+// receiver of one output
+typedef struct
+  {
+    int state;                          // 0: preamble, 1: byte, 2: after byte
+    int sync;                           // 0: after power on, no errors until a preamble
+    int ones;                           // preamble bits
+    int bits;
+    unsigned char byte;
+    unsigned char dcc[DG_MAX_SIZE+2];
+    int size;
+    int preamble;                       // of the packet being received
+    int min_preamble;
+    unsigned long packets, errors;
+    unsigned long accessories;
+    unsigned long foreign;              // loco packets which do not belong here
+    int64_t stop_at;                    // first stop broadcast after -e
+    int64_t last_loco_ns[256];
+    int64_t max_refresh_ns;
+    unsigned char *seq;                 // mirror check: packets without idle, 3 bytes
+    unsigned long seq_len;
+    int64_t kind_ns[KINDS];             // rail time, preamble to end bit
+    unsigned long *key_count;           // -S: packets per rail_top key
+  } t_receiver;
+
+typedef struct
+  {
+    int d;
+    int64_t from, until;
+    int64_t dark_from, dark_until;      // receiver saw no bits
+    unsigned long during[DIST1 + DISTRICT_MAX - 1];     // packets per output meanwhile
+  } t_fault;
+
+// programmer model, states as in run_prog_inner_task
+enum {P_WAIT, P_POWER_ON, P_1ST_RESET, P_VERIFY, P_ACK_WINDOW, P_3RD_RESET, P_DONE};
+
+static t_dg_channel gen[2];
+static t_receiver rx[OUTPUTS];
+static char out_name[OUTPUTS][8];
+static int quiet = 0;
+static int districts = 1;
+static int64_t now_ns;
+
+static unsigned long main_idle = 0;
+static unsigned long verify_sent = 0;
+static int64_t ack_until = -1;
+static int ack_enabled = 0;
+static int64_t estop_ns = -1;
+
+static t_fault fault[MAX_FAULTS];
+static int faults = 0;
+static unsigned char latched[DISTRICT_MAX];     // trip zone of district d
+
+static int repeat_mode = -1;                    // -r: organizer model, 0 fixed, 1 adaptive
+static int rail_top_n = 0;                      // -S: length of the top list
+static void org_seen(const unsigned char *dcc, int64_t now);
+
+static void usage(void)
+  {
+    fprintf(stderr, "usage: dccwave [-t ms] [-l locos] [-s start_ms] [-c isr_ns] [-p us] [-a]\n"
+                    "               [-d outputs] [-y locos] [-i ms] [-f d,from,until] [-e ms]\n"
+                    "               [-r 0|1] [-R cmd/s] [-S top] [-q]\n");
+    exit(2);
+  }
+
+static t_dg_channel *gen_of(int out)
+  {
+    if (out < DIST1) return(&gen[out]);
+    return(DISTRICT_GEN(out - DIST1 + 1));
+  }
+
+// 0: main, prog; 1..: district
+static int district_of_out(int out)
+  {
+    return((out < DIST1) ? 0 : out - DIST1 + 1);
+  }
+
+//------------------------------------------------------------------
+// hardware of the districts, as dccout.c with the trip zone
+
+static unsigned char fault_now(unsigned char d)
+  {
+    int i;
+
+    for (i=0; i<faults; i++)
+      {
+        if ((fault[i].d == d) && (now_ns >= fault[i].from) && (now_ns < fault[i].until)) return(1);
+      }
+    return(0);
+  }
+
+void district_hw_on(unsigned char d)
+  {
+    latched[d] = fault_now(d);          // OST latches again on a low input
+  }
+
+void district_hw_off(unsigned char d)
+  {
+    latched[d] = 1;
+  }
+
+unsigned char district_hw_tripped(unsigned char d)
+  {
+    return(latched[d]);
+  }
+
+unsigned char district_hw_fault(unsigned char d)
+  {
+    return(fault_now(d));
+  }
+
+//------------------------------------------------------------------
+// receivers
+
+static int is_yard_loco(unsigned int addr, int *d)
+  {
+    if ((addr < YARD_ADDR + 10) || (addr >= YARD_ADDR + 10 * DISTRICT_MAX)) return(0);
+    *d = (addr - YARD_ADDR) / 10;
+    return(1);
+  }
+
+//------------------------------------------------------------------
+// rail statistic
+
+// as rail_top_key of organizer.c, 0: idle or broadcast
+static unsigned int rail_key(const unsigned char *dcc)
+  {
+    if (dcc[0] == 0) return(0);
+    if (dcc[0] < 128) return(dcc[0]);
+    if (dcc[0] < 192) return(RAIL_KEY_ACC | (dcc[0] & 0x3F) | ((unsigned int)(~dcc[1] & 0x70) << 2));
+    if (dcc[0] < 232) return(RAIL_KEY_LONG | ((unsigned int)(dcc[0] & 0x3F) << 8) | dcc[1]);
+    return(0);
+  }
+
+// time of the packet on the rails: preamble, start bits, bytes, end bit
+static int64_t packet_ns(const t_receiver *r)
+  {
+    int64_t ns = r->preamble * NS_BIT_1 + NS_BIT_1;
+    int i, b;
+
+    for (i=0; i<r->size; i++)
+      {
+        ns += NS_BIT_0;
+        for (b=0; b<8; b++) ns += (r->dcc[i] & (1 << b)) ? NS_BIT_1 : NS_BIT_0;
+      }
+    return(ns);
+  }
+
+// prog: service mode packets, no addresses
+static void rail_count(int out)
+  {
+    t_receiver *r = &rx[out];
+    int kind;
+
+    if (r->dcc[0] == 0xFF) kind = K_IDLE;
+    else if (out == PROG) kind = K_OTHER;
+    else if ((r->dcc[0] >= 128) && (r->dcc[0] < 192)) kind = K_ACC;
+    else if (district_loco_addr(r->dcc)) kind = K_LOCO;
+    else kind = K_OTHER;
+    r->kind_ns[kind] += packet_ns(r);
+    if (r->key_count && (out != PROG)) r->key_count[rail_key(r->dcc)]++;
+  }
+
+static void rail_show(int out)
+  {
+    t_receiver *r = &rx[out];
+    unsigned int top[MAX_RAIL_TOP], key;
+    int64_t total = 0;
+    int i, k, n = 0;
+
+    for (k=0; k<KINDS; k++) total += r->kind_ns[k];
+    printf("%s rails:", out_name[out]);
+    for (k=0; k<KINDS; k++) printf(" %s %.1f%%", kind_name[k], total ? 100.0 * r->kind_ns[k] / total : 0.0);
+    for (key=1; key<0x10000; key++)
+      {
+        if (!r->key_count[key]) continue;
+        for (i=n; (i > 0) && (r->key_count[top[i-1]] < r->key_count[key]); i--)
+          {
+            if (i < rail_top_n) top[i] = top[i-1];
+          }
+        if (i < rail_top_n)
+          {
+            top[i] = key;
+            if (n < rail_top_n) n++;
+          }
+      }
+    printf(", top");
+    for (i=0; i<n; i++)
+      {
+        key = top[i];
+        if (key & RAIL_KEY_LONG) printf(" L%u", key & 0x3FFF);
+        else if (key & RAIL_KEY_ACC) printf(" A%u", key & 0x3FFF);
+        else printf(" %u", key);
+        printf(":%lu", r->key_count[key]);
+      }
+    printf("\n");
+  }
+
+static void packet_done(int out, int64_t now)
+  {
+    t_receiver *r = &rx[out];
+    unsigned char x = 0;
+    unsigned int addr;
+    int i, d, own;
+
+    for (i=0; i<r->size; i++) x ^= r->dcc[i];
+    r->packets++;
+    if (x || (r->size < 3))
+      {
+        r->errors++;
+        printf("%10.3f %s error: xor or size\n", now / 1e6, out_name[out]);
+        return;
+      }
+    if (r->preamble < r->min_preamble) r->min_preamble = r->preamble;
+    rail_count(out);
+    for (i=0; i<faults; i++)
+      {
+        if ((now >= fault[i].from) && (now < fault[i].until)) fault[i].during[out]++;
+      }
+
+    if ((out == MAIN) && (repeat_mode >= 0)) org_seen(r->dcc, now);
+    if (out == PROG)
+      {
+        if ((r->dcc[0] & 0xF0) == 0x70)                 // direct mode
+          {
+            verify_sent++;
+            if (ack_enabled && (verify_sent == 2)) ack_until = now + ACK_NS;
+          }
+      }
+    else
+      {
+        addr = district_loco_addr(r->dcc);
+        d = district_of_out(out);
+        if (r->dcc[0] == 0xFF)
+          {
+            if ((out == MAIN) && r->max_refresh_ns) main_idle++;    // not the one before the first put
+          }
+        else if ((r->dcc[0] == 0x00) && (r->dcc[1] == 0x71))
+          {
+            if ((estop_ns >= 0) && (now >= estop_ns) && (r->stop_at < 0)) r->stop_at = now;
+          }
+        else if ((r->dcc[0] >= 128) && (r->dcc[0] < 192))
+          {
+            r->accessories++;
+          }
+        if (addr)
+          {
+            // main and mirrors: no yard loco; a yard: only its own
+            if (!is_yard_loco(addr, &own)) own = 0;
+            if ((d && (district[d-1].mode == DISTRICT_FILTERED)) ? (own != d) : (own != 0))
+              {
+                r->foreign++;
+                printf("%10.3f %s error: loco %u\n", now / 1e6, out_name[out], addr);
+              }
+            if (addr < 256)
+              {
+                if ((r->last_loco_ns[addr] >= 0) && (now - r->last_loco_ns[addr] > r->max_refresh_ns))
+                    r->max_refresh_ns = now - r->last_loco_ns[addr];
+                r->last_loco_ns[addr] = now;
+              }
+          }
+        if ((r->dcc[0] != 0xFF) && r->seq)
+          {
+            memcpy(&r->seq[r->seq_len * 3], r->dcc, 3);
+            r->seq_len++;
+          }
+      }
+
+    if (!quiet)
+      {
+        printf("%10.3f %s preamble %2d:", now / 1e6, out_name[out], r->preamble);
+        for (i=0; i<r->size; i++) printf(" %02X", r->dcc[i]);
+        printf("\n");
+      }
+  }
+
+static void receive(int out, unsigned char bit, int64_t now)
+  {
+    t_receiver *r = &rx[out];
+
+    switch (r->state)
+      {
+        case 0:
+            if (bit)
+              {
+                r->ones++;
+                break;
+              }
+            if (r->ones < 10)                           // S-9.2: receiver needs 10
+              {
+                if (r->sync)
+                  {
+                    r->errors++;
+                    printf("%10.3f %s error: preamble %d\n", now / 1e6, out_name[out], r->ones);
+                  }
+                r->ones = 0;
+                break;
+              }
+            r->sync = 1;
+            r->preamble = r->ones;
+            r->size = 0;
+            r->bits = 0;
+            r->byte = 0;
+            r->state = 1;
+            break;
+        case 1:
+            r->byte = (r->byte << 1) | bit;
+            if (++r->bits < 8) break;
+            if (r->size < (int)sizeof(r->dcc)) r->dcc[r->size++] = r->byte;
+            r->state = 2;
+            break;
+        case 2:
+            if (bit)                                    // end bit
+              {
+                packet_done(out, now);
+                r->ones = 0;
+                r->state = 0;
+              }
+            else
+              {
+                r->bits = 0;
+                r->byte = 0;
+                r->state = 1;
+              }
+            break;
+      }
+  }
+
+// no power on the rails: the decoder loses the packet
+static void receive_dark(int out)
+  {
+    t_receiver *r = &rx[out];
+
+    r->state = 0;
+    r->ones = 0;
+    r->sync = 0;
+  }
+
+//------------------------------------------------------------------
+// organizer model
+
+static void put(int track, unsigned char d0, unsigned char d1, unsigned char d2, int size, int repeat)
+  {
+    unsigned char dcc[3];
+
+    dcc[0] = d0;
+    dcc[1] = d1;
+    dcc[2] = d2;
+    if (!dg_put(&gen[track], dcc, size, repeat))
+      {
+        printf("%s: ring full\n", out_name[track]);
+        exit(1);
+      }
+  }
+
+// as set_next_message: a loco of a filtered district goes there, all
+// other packets to main and a copy to the districts
+static void send(unsigned char d0, unsigned char d1, unsigned char d2, int size)
+  {
+    unsigned char dcc[3];
+    unsigned char d;
+
+    dcc[0] = d0;
+    dcc[1] = d1;
+    dcc[2] = d2;
+    d = district_of(district_loco_addr(dcc));
+    if (d)
+      {
+        district_put(d, dcc, size);
+        return;
+      }
+    put(MAIN, d0, d1, d2, size, 1);
+    district_mirror(dcc, size);
+  }
+
+//------------------------------------------------------------------
+// organizer model for -r, as run_organizer with DCC_ADAPTIVE_REPEAT:
+// queue_lp first, then the repeatbuffer (highest repeat left), then the
+// locobuffer refresh: 6 levels as get_next_item_from_locobuffer, the even
+// ones speed, level 1 function group 1 (light on), f5..f12 are off.
+// The pc sends speed commands to the locos and every 4th an accessory:
+// LOAD_LOW cmd/s, from LOAD_FROM to LOAD_UNTIL the rate of -R, at random
+// intervals of 0.5 .. 1.5 times the mean (same sequence every run). A command
+// for a loco which is still in queue_lp replaces it (find_in_queue_lp);
+// a full queue_lp lets the pc wait.
+// Every 250ms a line of the curves:
+//   latency from the pc command to the end of its first packet,
+//   refresh: longest time between two packets of the same loco.
+
+#define LOAD_LOW            2           // cmd/s
+#define LOAD_FROM           2000        // ms
+#define LOAD_UNTIL          6000
+#define CURVE_MS            250
+
+#define ORG_LP              16          // SIZE_QUEUE_LP
+#define ORG_REPEATBUFFER    32          // SIZE_REPEATBUFFER
+#define ORG_PC              64          // commands waiting in the pc
+
+#define SPEED_REPEAT        3           // NUM_DCC_xx_REPEAT, start values
+#define ACC_REPEAT          2
+#define SPEED_REPEAT_MIN    1           // DCC_xx_REPEAT_MIN / MAX
+#define SPEED_REPEAT_MAX    5
+#define ACC_REPEAT_MIN      1
+#define ACC_REPEAT_MAX      4
+#define REFRESH_LIMIT_MS    400         // DCC_REFRESH_LIMIT
+#define ADAPT_MS            100         // REPEAT_ADAPT_PERIOD
+#define IDLE_PERIODS        5           // REPEAT_IDLE_PERIODS
+
+typedef struct
+  {
+    unsigned char dcc[2];
+    int repeat;
+  } t_org_msg;
+
+static t_org_msg org_lp[ORG_LP];
+static int org_lp_rd, org_lp_n;
+static t_org_msg org_rep[ORG_REPEATBUFFER];
+static unsigned char org_pc[ORG_PC][2];
+static int64_t org_pc_at[ORG_PC];
+static int org_pc_rd, org_pc_n;
+
+static int org_locos;
+static unsigned char org_speed[50];             // locobuffer: speed byte per loco
+static int64_t org_loco_at[50];                 // pc time of the pending command, -1: none
+static int64_t org_acc_at[64];
+static int org_ref_i, org_ref_level;            // refresh: loco, cur_ref_level
+static int64_t org_cycle_start, org_cycle_ms;
+static int speed_repeat, acc_repeat, idle_periods;
+
+// one line of the curves
+static int64_t cv_last_pkt[50];
+static int64_t cv_lat_sum, cv_lat_max, cv_ref_max;
+static unsigned long cv_lat_n, cv_new, cv_repeat, cv_refresh;
+static long cv_load;
+
+static void org_init(int locos)
+  {
+    int i;
+
+    org_locos = locos;
+    org_lp_rd = org_lp_n = 0;
+    org_pc_rd = org_pc_n = 0;
+    memset(org_rep, 0, sizeof(org_rep));
+    for (i=0; i<50; i++)
+      {
+        org_speed[i] = 0x62 + (i & 0x0F);
+        org_loco_at[i] = -1;
+        cv_last_pkt[i] = -1;
+      }
+    for (i=0; i<64; i++) org_acc_at[i] = -1;
+    org_ref_i = org_ref_level = 0;
+    org_cycle_start = 0;
+    org_cycle_ms = 0;
+    speed_repeat = SPEED_REPEAT;
+    acc_repeat = ACC_REPEAT;
+    idle_periods = 0;
+    cv_lat_sum = cv_lat_max = cv_ref_max = 0;
+    cv_lat_n = cv_new = cv_repeat = cv_refresh = 0;
+  }
+
+// the pc: a new command
+static void org_command(unsigned long n, int64_t now)
+  {
+    int k, i;
+
+    if (org_pc_n == ORG_PC) return;             // pc gives up
+    i = (org_pc_rd + org_pc_n) % ORG_PC;
+    if ((n % 4) == 3)
+      {
+        k = (n / 4) % 64;
+        org_pc[i][0] = 0x80 | k;                // activate output 0
+        org_pc[i][1] = 0xF8;
+      }
+    else
+      {
+        k = n % org_locos;
+        org_pc[i][0] = k + 1;
+        org_pc[i][1] = 0;                       // speed taken when it is queued
+      }
+    org_pc_at[i] = now;
+    org_pc_n++;
+  }
+
+// the parser: pc commands into queue_lp
+static void org_parse(void)
+  {
+    unsigned char *pc;
+    int i, k, j;
+
+    while (org_pc_n)
+      {
+        pc = org_pc[org_pc_rd];
+        if (pc[0] < 128)
+          {
+            k = pc[0] - 1;
+            org_speed[k] = 0x62 + (((org_speed[k] & 0x1F) - 1) % 27);      // a new speed
+            if (org_loco_at[k] < 0) org_loco_at[k] = org_pc_at[org_pc_rd];
+            for (j=0; j<org_lp_n; j++)                                      // find_in_queue_lp
+              {
+                i = (org_lp_rd + j) % ORG_LP;
+                if (org_lp[i].dcc[0] == pc[0]) break;
+              }
+            if (j < org_lp_n)
+              {
+                org_lp[i].dcc[1] = org_speed[k];
+                org_lp[i].repeat = speed_repeat;
+                org_pc_rd = (org_pc_rd + 1) % ORG_PC;
+                org_pc_n--;
+                continue;
+              }
+          }
+        if (org_lp_n == ORG_LP) return;                                     // busy
+        i = (org_lp_rd + org_lp_n) % ORG_LP;
+        if (pc[0] < 128)
+          {
+            org_lp[i].dcc[0] = pc[0];
+            org_lp[i].dcc[1] = org_speed[pc[0] - 1];
+            org_lp[i].repeat = speed_repeat;
+          }
+        else
+          {
+            org_lp[i].dcc[0] = pc[0];
+            org_lp[i].dcc[1] = pc[1];
+            org_lp[i].repeat = acc_repeat;
+            org_acc_at[pc[0] & 0x3F] = org_pc_at[org_pc_rd];
+          }
+        org_lp_n++;
+        org_pc_rd = (org_pc_rd + 1) % ORG_PC;
+        org_pc_n--;
+      }
+  }
+
+// run_organizer: next packet for main
+static void org_next(int64_t now)
+  {
+    t_org_msg *m;
+    int i, best;
+
+    if (org_lp_n)
+      {
+        m = &org_lp[org_lp_rd];
+        org_lp_rd = (org_lp_rd + 1) % ORG_LP;
+        org_lp_n--;
+        send(m->dcc[0], m->dcc[1], 0, 2);
+        cv_new++;
+        // update_repeatbuffer: same address replaced, else the lowest
+        best = 0;
+        for (i=0; i<ORG_REPEATBUFFER; i++)
+          {
+            if (org_rep[i].repeat && (org_rep[i].dcc[0] == m->dcc[0])) break;
+            if (org_rep[i].repeat < org_rep[best].repeat) best = i;
+          }
+        if (i == ORG_REPEATBUFFER) i = best;
+        org_rep[i] = *m;
+        return;
+      }
+    best = -1;
+    for (i=0; i<ORG_REPEATBUFFER; i++)
+      {
+        if (org_rep[i].repeat && ((best < 0) || (org_rep[i].repeat > org_rep[best].repeat))) best = i;
+      }
+    if (best >= 0)
+      {
+        org_rep[best].repeat--;
+        send(org_rep[best].dcc[0], org_rep[best].dcc[1], 0, 2);
+        cv_repeat++;
+        return;
+      }
+    if (org_ref_level == 1) send(org_ref_i + 1, 0x90, 0, 2);        // function group 1
+    else send(org_ref_i + 1, org_speed[org_ref_i], 0, 2);
+    cv_refresh++;
+    if (++org_ref_i == org_locos)
+      {
+        org_ref_i = 0;
+        do org_ref_level = (org_ref_level + 1) % 6;
+        while ((org_ref_level & 1) && (org_ref_level != 1));        // f5..f12 off: skipped
+        if (org_ref_level == 0)
+          {
+            org_cycle_ms = (now - org_cycle_start) / NS_MS;
+            org_cycle_start = now;
+          }
+      }
+  }
+
+// repeat_adapt_tick, every ADAPT_MS
+static void org_adapt(int64_t now)
+  {
+    int64_t cycle;
+
+    cycle = (now - org_cycle_start) / NS_MS;                        // running cycle
+    if (cycle < org_cycle_ms) cycle = org_cycle_ms;
+    if ((org_lp_n >= ORG_LP / 4) || (cycle > REFRESH_LIMIT_MS))
+      {
+        idle_periods = 0;
+        if (speed_repeat > SPEED_REPEAT_MIN) speed_repeat--;
+        if (acc_repeat > ACC_REPEAT_MIN) acc_repeat--;
+      }
+    else if ((org_lp_n == 0) && (cycle < REFRESH_LIMIT_MS / 2))
+      {
+        if (++idle_periods < IDLE_PERIODS) return;
+        idle_periods = 0;
+        if (speed_repeat < SPEED_REPEAT_MAX) speed_repeat++;
+        if (acc_repeat < ACC_REPEAT_MAX) acc_repeat++;
+      }
+    else idle_periods = 0;
+  }
+
+// receiver of main: first packet of a command, refresh interval
+static void org_seen(const unsigned char *dcc, int64_t now)
+  {
+    int64_t *at = NULL;
+    int k;
+
+    if ((dcc[0] > 0) && (dcc[0] <= org_locos))
+      {
+        k = dcc[0] - 1;
+        if ((dcc[1] == org_speed[k]) && (org_loco_at[k] >= 0)) at = &org_loco_at[k];
+        if ((cv_last_pkt[k] >= 0) && (now - cv_last_pkt[k] > cv_ref_max)) cv_ref_max = now - cv_last_pkt[k];
+        cv_last_pkt[k] = now;
+      }
+    else if ((dcc[0] >= 128) && (dcc[0] < 192) && (org_acc_at[dcc[0] & 0x3F] >= 0))
+      {
+        at = &org_acc_at[dcc[0] & 0x3F];
+      }
+    if (!at) return;
+    cv_lat_sum += now - *at;
+    if (now - *at > cv_lat_max) cv_lat_max = now - *at;
+    cv_lat_n++;
+    *at = -1;
+  }
+
+static void org_curve(int64_t now)
+  {
+    unsigned long n = cv_new + cv_repeat + cv_refresh;
+
+    if (now == 0)
+      {
+        printf("    ms  cmd/s  lp  speed acc  latency avg/max ms  refresh ms  new/repeat/refresh %%\n");
+        return;
+      }
+    if (!n) n = 1;
+    printf("%6.0f %5ld %4d %4d %4d %10.1f %7.1f %10.1f %9lu %4lu %4lu\n",
+           now / 1e6, cv_load, org_lp_n, speed_repeat, acc_repeat,
+           cv_lat_n ? cv_lat_sum / 1e6 / cv_lat_n : 0.0, cv_lat_max / 1e6, cv_ref_max / 1e6,
+           cv_new * 100 / n, cv_repeat * 100 / n, cv_refresh * 100 / n);
+    cv_lat_sum = cv_lat_max = cv_ref_max = 0;
+    cv_lat_n = cv_new = cv_repeat = cv_refresh = 0;
+  }
+
+// the packets of a mirror are those of main, in the same order; some
+// may be missing: cut by a short or flushed by the stop
+static int mirror_equal(int out)
+  {
+    unsigned long i, m = 0;
+
+    for (i=0; i<rx[out].seq_len; i++)
+      {
+        while ((m < rx[MAIN].seq_len) && memcmp(&rx[out].seq[i * 3], &rx[MAIN].seq[m * 3], 3)) m++;
+        if (m == rx[MAIN].seq_len) return(0);
+        m++;
+      }
+    return(1);
+  }
+
+int main(int argc, char *argv[])
+  {
+    long sim_ms = 500, locos = 5, start_ms = 20, isr_ns = 1500, yard_locos = 4, ignore_ms = 8;
+    long load_high = 40;
+    unsigned long cmd_n = 0, rnd = 1;
+    int64_t next_cmd = 0;
+    int64_t t[OUTPUTS], now, cpu_free, delay, max_delay[OUTPUTS], next_poll, job_start = -1, job_end = -1;
+    long phase_us = 0;
+    unsigned long main_at_start = 0, main_at_end = 0;
+    int i, k, out, outputs, prog_state = P_WAIT, next_loco = 0, failed = 0;
+    int yard_next[DISTRICT_MAX], yard_cmd = 0, estop_done = 0;
+    long d_arg, from_arg, until_arg;
+    unsigned int shorted;
+    unsigned char bit, d;
+    char *p;
+
+    for (i=1; i<argc; i++)
+      {
+        if (!strcmp(argv[i], "-q")) quiet = 1;
+        else if (!strcmp(argv[i], "-a")) ack_enabled = 1;
+        else if ((argv[i][0] == '-') && argv[i][1] && !argv[i][2] && (i+1 < argc))
+          {
+            switch (argv[i][1])
+              {
+                case 't': sim_ms = strtol(argv[++i], NULL, 0); break;
+                case 'l': locos = strtol(argv[++i], NULL, 0); break;
+                case 's': start_ms = strtol(argv[++i], NULL, 0); break;
+                case 'c': isr_ns = strtol(argv[++i], NULL, 0); break;
+                case 'p': phase_us = strtol(argv[++i], NULL, 0); break;
+                case 'd': districts = strtol(argv[++i], NULL, 0); break;
+                case 'y': yard_locos = strtol(argv[++i], NULL, 0); break;
+                case 'i': ignore_ms = strtol(argv[++i], NULL, 0); break;
+                case 'e': estop_ns = strtol(argv[++i], NULL, 0) * NS_MS; break;
+                case 'r': repeat_mode = strtol(argv[++i], NULL, 0); break;
+                case 'R': load_high = strtol(argv[++i], NULL, 0); break;
+                case 'S': rail_top_n = strtol(argv[++i], NULL, 0); break;
+                case 'f':
+                    if (faults == MAX_FAULTS) usage();
+                    d_arg = strtol(argv[++i], &p, 0);
+                    if (*p++ != ',') usage();
+                    from_arg = strtol(p, &p, 0);
+                    if (*p++ != ',') usage();
+                    until_arg = strtol(p, &p, 0);
+                    if (*p || (until_arg <= from_arg) || (from_arg < 0)) usage();
+                    fault[faults].d = d_arg;
+                    fault[faults].from = from_arg * NS_MS;
+                    fault[faults].until = until_arg * NS_MS;
+                    fault[faults].dark_from = fault[faults].dark_until = -1;
+                    memset(fault[faults].during, 0, sizeof(fault[faults].during));
+                    faults++;
+                    break;
+                default: usage();
+              }
+          }
+        else usage();
+      }
+    if ((sim_ms <= 0) || (locos < 1) || (locos > 50) || (start_ms < 0) || (isr_ns < 0)) usage();
+    if ((phase_us < 0) || (phase_us > NS_BIT_0 / 1000)) usage();
+    if ((districts < 1) || (districts > DISTRICT_MAX) || (yard_locos < 1) || (yard_locos > 9)) usage();
+    if ((ignore_ms < 0) || (ignore_ms > 255)) usage();
+    if ((repeat_mode > 1) || (load_high < 0) || (load_high > 1000) || ((repeat_mode >= 0) && (estop_ns >= 0))) usage();
+    for (i=0; i<faults; i++) if ((fault[i].d < 1) || (fault[i].d >= districts)) usage();
+    if ((rail_top_n < 0) || (rail_top_n > MAX_RAIL_TOP)) usage();
+    outputs = DIST1 + districts - 1;
+
+    strcpy(out_name[MAIN], "main");
+    strcpy(out_name[PROG], "prog");
+    for (out=DIST1; out<OUTPUTS; out++) sprintf(out_name[out], "dist%d", district_of_out(out));
+
+    dg_init(&gen[MAIN], DG_PREAMBLE_MAIN);
+    dg_init(&gen[PROG], DG_PREAMBLE_PROG);
+    memset(rx, 0, sizeof(rx));
+    for (out=0; out<OUTPUTS; out++)
+      {
+        rx[out].min_preamble = 99;
+        rx[out].stop_at = -1;
+        for (i=0; i<256; i++) rx[out].last_loco_ns[i] = -1;
+        if (rail_top_n) rx[out].key_count = calloc(0x10000, sizeof(unsigned long));
+        max_delay[out] = 0;
+        t[out] = out * phase_us * 1000L;
+      }
+    rx[MAIN].seq = malloc(sim_ms * 4 * 3);              // < 4 packets per ms
+    rx[DIST1].seq = malloc(sim_ms * 4 * 3);
+
+    // as init_dccout and init_state; district 1 mirrors, the others are yards
+    now_ns = 0;
+    district_init(districts);
+    district_short_time(ignore_ms);
+    for (d=2; d<districts; d++)
+      {
+        district_set_mode(d, DISTRICT_FILTERED);
+        for (k=0; k<yard_locos; k++) district_route(YARD_ADDR + 10 * d + k, d);
+        yard_next[d] = 0;
+      }
+    for (d=1; d<DISTRICT_MAX; d++) latched[d] = 1;
+    district_power(1);                                  // main_on
+    if (repeat_mode >= 0) org_init(locos);
+
+    cpu_free = 0;
+    next_poll = 0;
+
+    while (1)
+      {
+        out = MAIN;                                     // on a tie main first (INTx3)
+        for (i=1; i<outputs; i++) if (t[i] < t[out]) out = i;
+        now = t[out];
+        if (now >= sim_ms * NS_MS) break;
+
+        // main loop, every 1ms: short check, organizer and programmer
+        while (next_poll <= now)
+          {
+            now_ns = next_poll;
+            shorted = district_check(next_poll / NS_MS);
+            for (d=1; d<districts; d++)
+              {
+                if (shorted & (1 << d))
+                  {
+                    if (!quiet) printf("%10.3f dist%d short\n", next_poll / 1e6, d);
+                  }
+              }
+            for (i=0; i<faults; i++)
+              {
+                // the pc switches it on again after the fault
+                d = fault[i].d;
+                if ((next_poll == fault[i].until + 50 * NS_MS) && (district[d-1].state == DS_SHORT))
+                  {
+                    district_set_power(d, 1);
+                    if (!quiet) printf("%10.3f dist%d on by pc\n", next_poll / 1e6, d);
+                  }
+              }
+
+            if ((estop_ns >= 0) && (next_poll >= estop_ns) && !estop_done)
+              {
+                // dccout_emergency_stop
+                dg_flush(&gen[MAIN]);
+                put(MAIN, 0x00, 0x71, 0, 2, DISTRICT_ESTOP);
+                district_estop();
+                estop_done = 1;
+              }
+            if (repeat_mode >= 0)
+              {
+                if (repeat_mode && ((next_poll % (ADAPT_MS * NS_MS)) == 0)) org_adapt(next_poll);
+                cv_load = ((next_poll >= LOAD_FROM * NS_MS) && (next_poll < LOAD_UNTIL * NS_MS)) ? load_high : LOAD_LOW;
+                if (cv_load && (next_poll >= next_cmd))
+                  {
+                    // 0.5 .. 1.5 of the mean interval, always the same sequence
+                    org_command(cmd_n++, next_poll);
+                    rnd = rnd * 1103515245UL + 12345;
+                    next_cmd = next_poll + (500000L + ((rnd >> 8) % 1000000L)) / cv_load * 1000L;
+                  }
+                org_parse();
+                while (dg_depth(&gen[MAIN]) < 1) org_next(next_poll);     // next_message
+                if ((next_poll % (CURVE_MS * NS_MS)) == 0) org_curve(next_poll);
+              }
+            else if (!estop_done)
+              {
+                if ((next_poll % (100 * NS_MS)) == 50 * NS_MS)
+                    send(0x80 | ((next_poll / (100 * NS_MS)) & 0x3F), 0xF8, 0, 2);     // accessory
+                if (((next_poll % (50 * NS_MS)) == 25 * NS_MS) && (districts > 2))
+                  {
+                    d = 2 + yard_cmd % (districts - 2);
+                    send(YARD_ADDR + 10 * d + (yard_cmd % yard_locos), 0x70 | (yard_cmd & 0x0F), 0, 2);
+                    yard_cmd++;
+                  }
+                while (dg_depth(&gen[MAIN]) < 2)
+                  {
+                    send(next_loco + 1, 0x60 | ((next_loco * 3) & 0x1F), 0, 2);    // speed 28
+                    next_loco = (next_loco + 1) % locos;
+                  }
+                for (d=2; d<districts; d++)             // refresh_districts
+                  {
+                    while (district_wants_refresh(d))
+                      {
+                        district_put(d, (unsigned char[]) {YARD_ADDR + 10 * d + yard_next[d], 0x60}, 2);
+                        yard_next[d] = (yard_next[d] + 1) % yard_locos;
+                      }
+                  }
+              }
+            switch (prog_state)
+              {
+                case P_WAIT:
+                    if (next_poll < start_ms * NS_MS) break;
+                    job_start = next_poll;
+                    main_at_start = rx[MAIN].packets;
+                    put(PROG, 0, 0, 0, 2, 20);                  // enter_progmode
+                    prog_state = P_POWER_ON;
+                    break;
+                case P_POWER_ON:
+                    if (dg_depth(&gen[PROG])) break;
+                    put(PROG, 0, 0, 0, 2, 3);
+                    prog_state = P_1ST_RESET;
+                    break;
+                case P_1ST_RESET:
+                    if (dg_depth(&gen[PROG])) break;
+                    put(PROG, 0x74, 0x07, 0x03, 3, 5);         // verify CV8 = 3
+                    prog_state = P_VERIFY;
+                    break;
+                case P_VERIFY:
+                    if (dg_depth(&gen[PROG])) break;
+                    prog_state = P_ACK_WINDOW;
+                    // fall through
+                case P_ACK_WINDOW:
+                    if (next_poll < ack_until)
+                      {
+                        dg_skip(&gen[PROG]);
+                        if (!quiet) printf("%10.3f prog ack\n", next_poll / 1e6);
+                      }
+                    else if (dg_repeat_left(&gen[PROG])) break;
+                    put(PROG, 0, 0, 0, 2, 2);
+                    prog_state = P_3RD_RESET;
+                    break;
+                case P_3RD_RESET:
+                    if (dg_depth(&gen[PROG])) break;
+                    job_end = next_poll;
+                    main_at_end = rx[MAIN].packets;
+                    prog_state = P_DONE;
+                    break;
+              }
+            next_poll += NS_MS;
+          }
+
+        // isr
+        now_ns = now;
+        delay = (cpu_free > now) ? cpu_free - now : 0;
+        if (delay > max_delay[out]) max_delay[out] = delay;
+        cpu_free = now + delay + isr_ns;
+        bit = dg_bit(gen_of(out));
+        d = district_of_out(out);
+        if (d && !latched[d] && fault_now(d)) latched[d] = 1;      // trip zone, no cpu
+        if (d && latched[d])
+          {
+            receive_dark(out);
+            for (i=0; i<faults; i++)
+              {
+                if ((fault[i].d != d) || (now < fault[i].from)) continue;
+                if (fault[i].dark_from < 0) fault[i].dark_from = now;
+                fault[i].dark_until = now;
+              }
+          }
+        else
+          {
+            receive(out, bit, now);
+          }
+        t[out] = now + (bit ? NS_BIT_1 : NS_BIT_0);
+      }
+
+    k = MAIN;
+    for (out=0; out<outputs; out++)
+      {
+        printf("%s: %lu packets, %lu errors, min preamble %d, max isr delay %.1fus\n",
+               out_name[out], rx[out].packets, rx[out].errors, rx[out].min_preamble, max_delay[out] / 1e3);
+        if (rx[out].errors) failed = 1;
+        if (max_delay[out] > max_delay[k]) k = out;
+        if ((out != PROG) && (rx[out].min_preamble < DG_PREAMBLE_MAIN)) failed = 1;
+      }
+    if (rail_top_n)
+      {
+        for (out=0; out<outputs; out++) rail_show(out);
+      }
+    printf("worst isr delay %.1fus (%s), limit %.1fus, pwms %s\n", max_delay[k] / 1e3, out_name[k],
+           NS_HALF_1 / 1e3, phase_us ? "staggered" : "in phase");
+    if (max_delay[k] >= NS_HALF_1) failed = 1;
+    if (rx[PROG].packets && (rx[PROG].min_preamble < DG_PREAMBLE_PROG)) failed = 1;
+
+    printf("main: max refresh %.1fms for %ld locos, %lu idle, %lu foreign\n",
+           rx[MAIN].max_refresh_ns / 1e6, locos, main_idle, rx[MAIN].foreign);
+    if (main_idle && !estop_done) failed = 1;           // the refresh must never stop
+    if (rx[MAIN].foreign) failed = 1;                   // yard locos stay off main
+
+    for (d=1; d<districts; d++)
+      {
+        out = DIST1 + d - 1;
+        printf("dist%d: %s, state %d, %u trips, %u shorts, %u lost, %lu accessories (main %lu)",
+               d, (district[d-1].mode == DISTRICT_MIRROR) ? "mirror" : "filtered", district[d-1].state,
+               district[d-1].trips, district[d-1].shorts, district[d-1].lost,
+               rx[out].accessories, rx[MAIN].accessories);
+        if (district[d-1].lost) failed = 1;
+        if (rx[out].foreign) failed = 1;
+        if (district[d-1].mode == DISTRICT_MIRROR)
+          {
+            printf(", %lu of %lu main packets, same order: %s\n",
+                   rx[out].seq_len, rx[MAIN].seq_len, mirror_equal(out) ? "yes" : "NO");
+            if (!mirror_equal(out) || !rx[out].seq_len) failed = 1;
+          }
+        else
+          {
+            printf(", max refresh %.1fms for %ld locos\n", rx[out].max_refresh_ns / 1e6, yard_locos);
+            if (!rx[out].max_refresh_ns) failed = 1;
+          }
+      }
+
+    // a short stays in its district: the others go on
+    for (i=0; i<faults; i++)
+      {
+        d = fault[i].d;
+        printf("fault dist%d %.0f..%.0fms: dark %.1f..%.1fms", d, fault[i].from / 1e6, fault[i].until / 1e6,
+               fault[i].dark_from / 1e6, fault[i].dark_until / 1e6);
+        if ((fault[i].until - fault[i].from) / NS_MS < ignore_ms)
+          {
+            // short blip: on again as soon as the input is clear
+            printf(", blip");
+            if (fault[i].dark_until > fault[i].until + 2 * NS_MS) failed = 1;
+          }
+        else if ((fault[i].until - fault[i].from) / NS_MS > ignore_ms + 20)
+          {
+            // lasting: off until the pc switches it on, 50ms after the fault
+            printf(", lasting");
+            if (fault[i].dark_until < fault[i].until + 40 * NS_MS) failed = 1;
+            if (!district[d-1].shorts) failed = 1;
+          }
+        if (fault[i].dark_from < 0) failed = 1;
+        if (fault[i].dark_from > fault[i].from + NS_BIT_0 + NS_HALF_1) failed = 1;     // cut within a bit
+        for (out=0; out<outputs; out++)
+          {
+            if ((out == DIST1 + d - 1) || (out == PROG)) continue;
+            for (k=0; k<faults; k++)                    // dark itself meanwhile
+              {
+                if ((fault[k].d == district_of_out(out)) && (fault[k].from < fault[i].until)
+                    && (fault[k].until + 60 * NS_MS > fault[i].from)) break;
+              }
+            if (k < faults) continue;
+            printf(", %s %lu", out_name[out], fault[i].during[out]);
+            if ((fault[i].until - fault[i].from > 20 * NS_MS) && !fault[i].during[out]) failed = 1;
+          }
+        printf("\n");
+      }
+    if (faults)
+      {
+        // any district without a lasting fault must not be shorted
+        for (d=1; d<districts; d++)
+          {
+            k = 0;
+            for (i=0; i<faults; i++)
+                if ((fault[i].d == d) && ((fault[i].until - fault[i].from) / NS_MS >= ignore_ms)) k = 1;
+            if (!k && district[d-1].shorts)
+              {
+                printf("dist%d: short without a lasting fault\n", d);
+                failed = 1;
+              }
+          }
+      }
+
+    if (estop_done)
+      {
+        printf("estop at %.0fms:", estop_ns / 1e6);
+        for (out=0; out<outputs; out++)
+          {
+            if (out == PROG) continue;
+            d = district_of_out(out);
+            if (d && (district[d-1].state != DS_ON)) continue;
+            if (rx[out].stop_at < 0)
+              {
+                printf(" %s none", out_name[out]);
+                failed = 1;
+              }
+            else
+              {
+                printf(" %s %.1fms", out_name[out], (rx[out].stop_at - estop_ns) / 1e6);
+                if (rx[out].stop_at - estop_ns > ESTOP_NS) failed = 1;
+              }
+          }
+        printf("\n");
+      }
+
+    if (job_end >= 0)
+      {
+        printf("prog: job %.1f..%.1fms, %lu verify sent, main sent %lu packets meanwhile\n",
+               job_start / 1e6, job_end / 1e6, verify_sent, main_at_end - main_at_start);
+        if (main_at_end == main_at_start) failed = 1;
+        if (ack_enabled && (verify_sent > 3)) failed = 1;   // 2nd acked, one may be on the rails
+        if (!ack_enabled && (verify_sent != 5)) failed = 1;
+      }
+    else if (job_start >= 0)
+      {
+        printf("prog: job not done within %ldms\n", sim_ms);
+        failed = 1;
+      }
+
+    printf("%s\n", failed ? "FAILED" : "ok");
+    return(failed);
+  }
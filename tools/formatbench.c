@@ -0,0 +1,198 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      formatbench.c
+// history:   timing of the format table started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   host tool for the TAPAS build
+// content:   fills the loco format table (code/format_table.c, same
+//            source as in database.c) with random locos and prints the
+//            time per lookup (found and not found), per change of a
+//            format and per new entry plus its removal (memmove).
+//
+// build:     gcc -O2 -Wall -Wno-unknown-pragmas -I code -o formatbench
+//                tools/formatbench.c code/format_table.c
+//
+// usage:     formatbench [options] [SIZE...]      (default 16 4096)
+//              -l N   operations per measurement      (default 1000000)
+//              -s N   seed of the random addresses    (default 1)
+//
+//            The times are those of the host; on the target (90MHz,
+//            C28x) the relation between the sizes is what counts, the
+//            search steps are printed with them.
+//            Exit code 0: every lookup matched a plain reference table,
+//            the table stayed sorted; 1: a check failed, 2: bad usage.
+//
+//-----------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "format_table.h"
+
+#define MAX_SIZE        (FT_ADDR_MASK + 1 - 2)  // addresses 1..16383, one left free
+#define DEFAULT_FORMAT  2                       // DCC28
+
+static unsigned int entry[MAX_SIZE + 1];
+static unsigned char ref[FT_ADDR_MASK + 1];     // format per address, FT_VOID: none
+static unsigned int present[MAX_SIZE];          // addresses in the table
+static unsigned int absent[FT_ADDR_MASK + 1];   // addresses not in the table
+static unsigned int n_absent;
+static volatile unsigned long sink;             // keeps the lookups
+
+static double now_ns(void)
+  {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return(ts.tv_sec * 1e9 + ts.tv_nsec);
+  }
+
+static unsigned char random_format(void)
+  {
+    static const unsigned char other[3] = {0, 1, 3};   // DCC14, DCC27, DCC128
+
+    return(other[rand() % 3]);
+  }
+
+static int check(t_format_table *t, unsigned int size)
+  {
+    unsigned int i, addr;
+
+    if (t->count != size)
+      {
+        printf("size %u: %u entries in the table\n", size, t->count);
+        return(1);
+      }
+    for (i=1; i<t->count; i++)
+      {
+        if ((t->entry[i-1] & FT_ADDR_MASK) >= (t->entry[i] & FT_ADDR_MASK))
+          {
+            printf("size %u: not sorted at %u\n", size, i);
+            return(1);
+          }
+      }
+    for (addr=1; addr<=FT_ADDR_MASK; addr++)
+      {
+        if (ft_lookup(t, addr) != ref[addr])
+          {
+            printf("size %u: loco %u has format %u, expected %u\n", size, addr, ft_lookup(t, addr), ref[addr]);
+            return(1);
+          }
+      }
+    return(0);
+  }
+
+static int bench(unsigned int size, unsigned long loops)
+  {
+    t_format_table t;
+    unsigned int i, addr, steps;
+    unsigned long k;
+    double start, hit, miss, change, insert;
+
+    t.entry = entry;
+    t.size = size;
+    t.count = 0;
+    memset(ref, FT_VOID, sizeof(ref));
+
+    for (i=0; i<size; i++)
+      {
+        do addr = 1 + rand() % FT_ADDR_MASK;
+        while (ref[addr] != FT_VOID);
+        ref[addr] = random_format();
+        present[i] = addr;
+        if (!ft_set(&t, addr, ref[addr], DEFAULT_FORMAT))
+          {
+            printf("size %u: table full at %u entries\n", size, i);
+            return(1);
+          }
+      }
+    n_absent = 0;
+    for (addr=1; addr<=FT_ADDR_MASK; addr++)
+      {
+        if (ref[addr] == FT_VOID) absent[n_absent++] = addr;
+      }
+    if (check(&t, size)) return(1);
+
+    start = now_ns();
+    for (k=0; k<loops; k++) sink += ft_lookup(&t, present[k % size]);
+    hit = (now_ns() - start) / loops;
+
+    start = now_ns();
+    for (k=0; k<loops; k++) sink += ft_lookup(&t, absent[k % n_absent]);
+    miss = (now_ns() - start) / loops;
+
+    start = now_ns();
+    for (k=0; k<loops; k++)
+      {
+        addr = present[k % size];
+        ref[addr] = (ref[addr] == 0) ? 3 : 0;
+        ft_set(&t, addr, ref[addr], DEFAULT_FORMAT);
+      }
+    change = (now_ns() - start) / loops;
+
+    // a new loco and its way back to default: room for one more entry
+    t.size = size + 1;
+    start = now_ns();
+    for (k=0; k<loops; k++)
+      {
+        addr = absent[(k * 7919) % n_absent];
+        ft_set(&t, addr, 3, DEFAULT_FORMAT);
+        ft_set(&t, addr, DEFAULT_FORMAT, DEFAULT_FORMAT);
+      }
+    insert = (now_ns() - start) / loops;
+    t.size = size;
+    if (check(&t, size)) return(1);
+
+    for (steps=0; (1U << steps) <= size; steps++);
+    printf("%6u %6u %10.1f %10.1f %10.1f %12.1f\n", size, steps, hit, miss, change, insert);
+    return(0);
+  }
+
+static void usage(void)
+  {
+    fprintf(stderr, "usage: formatbench [-l loops] [-s seed] [SIZE...]\n");
+    exit(2);
+  }
+
+int main(int argc, char *argv[])
+  {
+    unsigned long loops = 1000000;
+    unsigned int size[16];
+    int sizes = 0, failed = 0, i;
+
+    srand(1);
+    for (i=1; i<argc; i++)
+      {
+        if (!strcmp(argv[i], "-l") && (i+1 < argc)) loops = strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "-s") && (i+1 < argc)) srand((unsigned int)strtoul(argv[++i], NULL, 0));
+        else if ((argv[i][0] == '-') || (sizes == 16)) usage();
+        else size[sizes++] = (unsigned int)strtoul(argv[i], NULL, 0);
+      }
+    if (!sizes)
+      {
+        size[0] = 16;
+        size[1] = 4096;
+        sizes = 2;
+      }
+    if (loops < 1) usage();
+    for (i=0; i<sizes; i++)
+      {
+        if ((size[i] < 1) || (size[i] > MAX_SIZE)) usage();
+      }
+
+    printf("  size  steps  found[ns] absent[ns] change[ns] new+del[ns]\n");
+    for (i=0; i<sizes; i++) failed |= bench(size[i], loops);
+    return(failed);
+  }
@@ -0,0 +1,627 @@
+#!/usr/bin/env python3
+#-----------------------------------------------------------------
+#
+# OpenDCC
+#
+# This source file is subject of the GNU general public license 2,
+# that is available at the world-wide-web at
+# http://www.gnu.org/licenses/gpl.txt
+#
+#-----------------------------------------------------------------
+#
+# file:      mapbudget.py
+# history:   memory budget report started
+#
+#-----------------------------------------------------------------
+#
+# purpose:   host tool for the TAPAS build
+# content:   reads the TI linker output (map, linkInfo XML and the
+#            debug info of the .out), reports memory per area, per module
+#            and the largest symbols, and fails if a budget is exceeded.
+#
+# usage:     python tools/mapbudget.py code/Debug/Example_2806xEPwmUpAQ.map
+#                   [--xml FILE] [--out FILE] [--budget tools/mapbudget.ini] [--top N]
+#
+#            The linkInfo XML (<name>_linkInfo.xml next to the map) is
+#            used if present, else the map alone. Sizes of variables are
+#            taken from the DWARF info of <name>.out, if present. Exit code 1 if a
+#            budget is exceeded or a module or symbol of the budget file
+#            is not in the map (unless listed in [optional]), 2 on bad
+#            input.
+#
+#            As CCS post-build step:
+#            python ${PROJECT_ROOT}/../tools/mapbudget.py ${BuildArtifactFileBaseName}.map
+#
+# note:      sizes are in 16 bit words (C28x).
+#            Symbol sizes come from the type in the debug info (built
+#            with -g, as the CCS Debug configuration). A symbol without
+#            (assembler, library) gets the distance to the next symbol in
+#            the same input section; static variables are not in the
+#            symbol table, their space is added to the symbol before.
+#            Data is blocked: an object does not cross a 64 word page
+#            unless it is larger, then it starts on one. Before a symbol
+#            on a page boundary there may be a hole, which the map does
+#            not show; the symbol before gets the smallest size which
+#            explains the move (1 if the next one is a page or larger).
+#
+#-----------------------------------------------------------------
+
+import argparse
+import configparser
+import os
+import re
+import struct
+import sys
+import xml.etree.ElementTree as ET
+
+# sections which hold code (all others are data)
+CODE_SECTIONS = ('.text', 'ramfuncs', 'Flash28_API', 'codestart', '.reset', 'vectors')
+
+PAGE = 64                               # data page of the C28x, words
+
+
+class Area:
+    def __init__(self, name, page, origin, length, used):
+        self.name = name
+        self.page = page
+        self.origin = origin
+        self.length = length
+        self.used = used
+
+    def contains(self, addr):
+        return self.origin <= addr < self.origin + self.length
+
+    def is_ram(self):
+        return self.name.startswith('RAM')
+
+    def is_flash(self):
+        return self.name.startswith(('FLASH', 'BEGIN', 'OTP'))
+
+
+class Component:
+    def __init__(self, section, module, run, load, size, uninit):
+        self.section = section
+        self.module = module
+        self.run = run
+        self.load = load
+        self.size = size
+        self.uninit = uninit
+
+    def is_code(self):
+        return self.section.split(':')[0] in CODE_SECTIONS or self.section.startswith('.text')
+
+
+class Image:
+    def __init__(self):
+        self.areas = []
+        self.components = []
+        self.symbols = []               # (addr, name)
+
+    def area_of(self, addr):
+        for a in self.areas:
+            if a.contains(addr) and (a.is_ram() or a.is_flash()):
+                return a
+        for a in self.areas:
+            if a.contains(addr):
+                return a
+        return None
+
+
+#-----------------------------------------------------------------
+# linkInfo XML
+
+def xml_int(node, tag, default=None):
+    e = node.find(tag)
+    if e is None or e.text is None:
+        return default
+    return int(e.text, 0)
+
+
+def read_xml(path):
+    img = Image()
+    root = ET.parse(path).getroot()
+
+    files = {}
+    for f in root.iter('input_file'):
+        name = f.findtext('name')
+        if f.findtext('kind') == 'archive':
+            name = f.findtext('file') + ':' + name
+        files[f.get('id')] = name
+
+    for oc in root.iter('object_component'):
+        ref = oc.find('input_file_ref')
+        module = files.get(ref.get('idref'), '?') if ref is not None else '?'
+        run = xml_int(oc, 'run_address')
+        load = xml_int(oc, 'load_address', run)
+        size = xml_int(oc, 'size', 0)
+        if run is None or size == 0 or oc.findtext('name').startswith('.debug'):
+            continue
+        uninit = oc.findtext('uninitialized') == 'true'
+        img.components.append(Component(oc.findtext('name'), module, run, load, size, uninit))
+
+    for m in root.iter('memory_area'):
+        img.areas.append(Area(m.findtext('name'), xml_int(m, 'page_id'), xml_int(m, 'origin'),
+                              xml_int(m, 'length'), xml_int(m, 'used_space', 0)))
+
+    for s in root.iter('symbol'):
+        img.symbols.append((xml_int(s, 'value'), s.findtext('name')))
+    return img
+
+
+#-----------------------------------------------------------------
+# map file
+
+RE_AREA = re.compile(r'^\s+(\w+)\s+([0-9a-f]{8})\s+([0-9a-f]{8})\s+([0-9a-f]{8})\s+([0-9a-f]{8})\s+\w+')
+RE_PAGE = re.compile(r'^PAGE (\d+):')
+RE_OUTPUT = re.compile(r'^(\S+)?\s*(\*|\S+)?\s+(\d)\s+([0-9a-f]{8})\s+([0-9a-f]{8})\s*(.*)$')
+RE_INPUT = re.compile(r'^\s+([0-9a-f]{8})\s+([0-9a-f]{8})\s+(.*)$')
+RE_SYMBOL = re.compile(r'^(\d)\s+([0-9a-f]{8})\s+(\S+)\s*$')
+RE_RUN = re.compile(r'RUN ADDR = ([0-9a-f]{8})')
+
+
+def read_map(path):
+    img = Image()
+    with open(path, encoding='latin-1') as f:
+        lines = f.read().splitlines()
+
+    part = None
+    page = 0
+    out_name = None
+    out_origin = 0
+    out_run = None
+    out_uninit = False
+    lib = None
+    for line in lines:
+        if line.startswith('MEMORY CONFIGURATION'):
+            part = 'memory'
+            continue
+        if line.startswith('SECTION ALLOCATION MAP'):
+            part = 'sections'
+            continue
+        if line.startswith('MODULE SUMMARY') or line.startswith('LINKER GENERATED'):
+            part = None
+            continue
+        if line.startswith('GLOBAL SYMBOLS: SORTED BY Symbol Address'):
+            part = 'symbols'
+            continue
+        if line.startswith('GLOBAL SYMBOLS'):
+            part = None
+            continue
+
+        if part == 'memory':
+            m = RE_PAGE.match(line)
+            if m:
+                page = int(m.group(1))
+                continue
+            m = RE_AREA.match(line)
+            if m:
+                img.areas.append(Area(m.group(1), page, int(m.group(2), 16),
+                                      int(m.group(3), 16), int(m.group(4), 16)))
+
+        elif part == 'sections':
+            if line and not line[0].isspace() and not line.startswith(('-', 'output', 'section')):
+                m = RE_OUTPUT.match(line)
+                if m is None:
+                    out_name = line.strip()     # long name, origin on next line
+                    continue
+                if m.group(1) and m.group(1) != '*':
+                    out_name = m.group(1)
+                out_origin = int(m.group(4), 16)
+                run = RE_RUN.search(m.group(6))
+                out_run = int(run.group(1), 16) if run else None
+                out_uninit = 'UNINITIALIZED' in m.group(6) or 'DSECT' in m.group(6)
+                lib = None
+                continue
+            m = RE_INPUT.match(line)
+            if m and out_name:
+                addr = int(m.group(1), 16)
+                size = int(m.group(2), 16)
+                rest = m.group(3)
+                if '--HOLE--' in rest or size == 0:
+                    continue
+                sect = re.search(r'\((\S+)\)\s*$', rest)
+                obj = rest[:sect.start()].strip() if sect else rest.strip()
+                if ':' in obj:
+                    left, obj = [x.strip() for x in obj.split(':', 1)]
+                    if left:
+                        lib = left
+                    obj = lib + ':' + obj
+                else:
+                    lib = None
+                run = addr if out_run is None else out_run + addr - out_origin
+                img.components.append(Component(sect.group(1) if sect else out_name, obj,
+                                                run, addr, size, out_uninit))
+
+        elif part == 'symbols':
+            m = RE_SYMBOL.match(line)
+            if m:
+                img.symbols.append((int(m.group(2), 16), m.group(3)))
+    return img
+
+
+#-----------------------------------------------------------------
+# debug info of the .out (TI COFF, DWARF 2/3)
+#
+# Only what is needed for the size of a variable: the DIE tree of
+# .debug_info with its attributes, the type chain down to a byte_size.
+# DWARF bytes are C28x bytes, 16 bit: sizes come out in words.
+
+DW_TAG_ARRAY = 0x01
+DW_TAG_POINTER = 0x0f
+DW_TAG_SUBRANGE = 0x21
+DW_TAG_VARIABLE = 0x34
+DW_AT_LOCATION = 0x02
+DW_AT_BYTE_SIZE = 0x0b
+DW_AT_UPPER_BOUND = 0x2f
+DW_AT_COUNT = 0x37
+DW_AT_TYPE = 0x49
+DW_OP_ADDR = 0x03
+POINTER_SIZE = 2                        # words, if the pointer type has no byte_size
+
+
+def coff_sections(data):
+    nsec, symptr, nsyms, opthdr = (struct.unpack_from('<H', data, 2)[0],
+                                   struct.unpack_from('<I', data, 8)[0],
+                                   struct.unpack_from('<I', data, 12)[0],
+                                   struct.unpack_from('<H', data, 16)[0])
+    strtab = symptr + nsyms * 18
+    sections = {}
+    for i in range(nsec):
+        off = 22 + opthdr + i * 48
+        name = data[off:off + 8]
+        if name[:4] == b'\0\0\0\0':     # long name in the string table
+            o = strtab + struct.unpack_from('<I', data, off + 4)[0]
+            name = data[o:data.index(b'\0', o)]
+        size, raw = struct.unpack_from('<II', data, off + 16)
+        sections[name.rstrip(b'\0').decode('latin-1')] = data[raw:raw + size]
+    return sections
+
+
+def uleb(b, p):
+    value = shift = 0
+    while True:
+        x = b[p]
+        p += 1
+        value |= (x & 0x7f) << shift
+        shift += 7
+        if not x & 0x80:
+            return value, p
+
+
+def sleb(b, p):
+    value = shift = 0
+    while True:
+        x = b[p]
+        p += 1
+        value |= (x & 0x7f) << shift
+        shift += 7
+        if not x & 0x80:
+            if x & 0x40:
+                value -= 1 << shift
+            return value, p
+
+
+def dwarf_abbrevs(b, p):
+    table = {}
+    while True:
+        code, p = uleb(b, p)
+        if code == 0:
+            return table
+        tag, p = uleb(b, p)
+        children = b[p]
+        p += 1
+        attrs = []
+        while True:
+            at, p = uleb(b, p)
+            form, p = uleb(b, p)
+            if at == 0 and form == 0:
+                break
+            attrs.append((at, form))
+        table[code] = (tag, children, attrs)
+
+
+def dwarf_form(b, p, form, addr_size, cu):
+    # returns (value, next p); references as offset in .debug_info
+    fixed = {0x0b: 1, 0x0c: 1, 0x11: 1, 0x05: 2, 0x12: 2, 0x06: 4, 0x0e: 4, 0x10: 4,
+             0x13: 4, 0x17: 4, 0x07: 8, 0x14: 8, 0x01: addr_size}
+    if form in fixed:
+        n = fixed[form]
+        value = int.from_bytes(b[p:p + n], 'little')
+        if form in (0x11, 0x12, 0x13, 0x14):
+            value += cu
+        return value, p + n
+    if form == 0x08:
+        e = b.index(b'\0', p)
+        return b[p:e].decode('latin-1'), e + 1
+    if form == 0x0d:
+        return sleb(b, p)
+    if form == 0x0f:
+        return uleb(b, p)
+    if form == 0x15:
+        value, p = uleb(b, p)
+        return value + cu, p
+    if form in (0x0a, 0x03, 0x04, 0x09, 0x18):     # blocks
+        if form == 0x0a:
+            n, p = b[p], p + 1
+        elif form == 0x03:
+            n, p = struct.unpack_from('<H', b, p)[0], p + 2
+        elif form == 0x04:
+            n, p = struct.unpack_from('<I', b, p)[0], p + 4
+        else:
+            n, p = uleb(b, p)
+        return b[p:p + n], p + n
+    if form == 0x19:
+        return 1, p
+    if form == 0x16:
+        form, p = uleb(b, p)
+        return dwarf_form(b, p, form, addr_size, cu)
+    raise ValueError('DWARF form 0x%x' % form)
+
+
+def read_dwarf(path):
+    # returns {address: size in words} of the variables with a fixed address
+    with open(path, 'rb') as f:
+        sections = coff_sections(f.read())
+    info = sections.get('.debug_info')
+    abbrev = sections.get('.debug_abbrev')
+    if not info or not abbrev:
+        return {}
+
+    dies = {}                           # offset -> [tag, attrs, children]
+    p = 0
+    while p < len(info):
+        cu = p
+        length, version, abbrev_off, addr_size = struct.unpack_from('<IHIB', info, p)
+        end = p + 4 + length
+        table = dwarf_abbrevs(abbrev, abbrev_off)
+        p += 11
+        parents = []
+        while p < end:
+            off = p
+            code, p = uleb(info, p)
+            if code == 0:
+                if parents:
+                    parents.pop()
+                continue
+            tag, children, attrs = table[code]
+            values = {}
+            for at, form in attrs:
+                values[at], p = dwarf_form(info, p, form, addr_size, cu)
+            die = [tag, values, []]
+            dies[off] = die
+            if parents:
+                parents[-1][2].append(die)
+            if children:
+                parents.append(die)
+        p = end
+
+    def type_size(off, depth=0):
+        die = dies.get(off)
+        if die is None or depth > 32:
+            return None
+        tag, values, children = die
+        if DW_AT_BYTE_SIZE in values:
+            return values[DW_AT_BYTE_SIZE]
+        if tag == DW_TAG_ARRAY:
+            size = type_size(values.get(DW_AT_TYPE), depth + 1)
+            for sub in children:
+                if size is None or sub[0] != DW_TAG_SUBRANGE:
+                    continue
+                if DW_AT_COUNT in sub[1]:
+                    size *= sub[1][DW_AT_COUNT]
+                elif DW_AT_UPPER_BOUND in sub[1]:
+                    size *= sub[1][DW_AT_UPPER_BOUND] + 1
+                else:
+                    size = None         # open array: extern t x[]
+            return size
+        if tag == DW_TAG_POINTER:
+            return POINTER_SIZE
+        if DW_AT_TYPE in values:        # typedef, const, volatile
+            return type_size(values[DW_AT_TYPE], depth + 1)
+        return None
+
+    sizes = {}
+    for tag, values, children in dies.values():
+        loc = values.get(DW_AT_LOCATION)
+        if tag != DW_TAG_VARIABLE or not isinstance(loc, bytes) or loc[:1] != bytes([DW_OP_ADDR]):
+            continue
+        size = type_size(values.get(DW_AT_TYPE))
+        if size:
+            addr = int.from_bytes(loc[1:5], 'little')
+            sizes[addr] = max(size, sizes.get(addr, 0))
+    return sizes
+
+
+#-----------------------------------------------------------------
+# evaluation
+
+def module_usage(img):
+    # module -> [code flash, const flash, ram]
+    usage = {}
+    for c in img.components:
+        u = usage.setdefault(c.module, [0, 0, 0])
+        run_area = img.area_of(c.run)
+        load_area = img.area_of(c.load)
+        if load_area is not None and load_area.is_flash() and not c.uninit:
+            u[0 if c.is_code() else 1] += c.size
+        if run_area is not None and run_area.is_ram():
+            u[2] += c.size
+    return usage
+
+
+def symbol_sizes(img, debug_sizes):
+    # size of data symbols: from the debug info, else the distance to the
+    # next symbol within the component
+    syms = sorted((a, n) for a, n in img.symbols
+                  if not n.startswith(('.', '___')) and not n.endswith(('Start', 'End')))
+    result = []
+    for c in img.components:
+        if c.is_code():
+            continue
+        area = img.area_of(c.run)
+        if area is None or not area.is_ram():
+            continue
+        end = c.run + c.size
+        inside = [(a, n) for a, n in syms if c.run <= a < end]
+        for i, (a, n) in enumerate(inside):
+            nxt = inside[i + 1][0] if i + 1 < len(inside) else end
+            size = nxt - a
+            if a in debug_sizes:
+                size = debug_sizes[a]
+            elif i + 1 < len(inside) and nxt % PAGE == 0 and a % PAGE != 0:
+                # next symbol moved to a new page: size - after + 1 did not fit
+                after = (inside[i + 2][0] if i + 2 < len(inside) else end) - nxt
+                size = max(1, size - after + 1) if after < PAGE else 1
+            result.append((size, n, c.module, area.name))
+    # aliases (same address) get size 0, keep the largest per name
+    best = {}
+    for s in result:
+        if s[1] not in best or s[0] > best[s[1]][0]:
+            best[s[1]] = s
+    return sorted(best.values(), key=lambda s: (-s[0], s[1]))
+
+
+def parse_limit(text, total=None):
+    text = text.strip()
+    if text.endswith('%'):
+        if total is None:
+            raise ValueError('percent needs a known size: ' + text)
+        return total * float(text[:-1]) / 100.0
+    return int(text, 0)
+
+
+def check_budget(path, img, usage, symbols):
+    # returns (fails, notes); a module or symbol not in the map fails,
+    # unless it is in [optional] (feature switched off in config.h)
+    cfg = configparser.ConfigParser(inline_comment_prefixes=('#', ';'), interpolation=None,
+                                    allow_no_value=True)
+    cfg.optionxform = str
+    if not cfg.read(path):
+        print('mapbudget: budget file %s not found' % path, file=sys.stderr)
+        sys.exit(2)
+
+    fails = []
+    notes = []
+    optional = set(cfg.options('optional')) if cfg.has_section('optional') else set()
+    if cfg.has_section('memory'):
+        for name, limit in cfg.items('memory'):
+            areas = [a for a in img.areas if a.name == name]
+            if not areas:
+                fails.append('memory %s: not in map' % name)
+                continue
+            a = areas[0]
+            if a.used > parse_limit(limit, a.length):
+                fails.append('memory %s: used 0x%x > budget %s' % (name, a.used, limit))
+
+    for section, column, what in (('module.flash', None, 'flash'), ('module.ram', 2, 'ram')):
+        if not cfg.has_section(section):
+            continue
+        for name, limit in cfg.items(section):
+            u = usage.get(name)
+            if u is None:
+                if name in optional:
+                    notes.append('module %s: not in map, optional' % name)
+                else:
+                    fails.append('module %s: not in map (misspelt, or map older than the code)' % name)
+                continue
+            used = u[0] + u[1] if column is None else u[column]
+            if used > parse_limit(limit):
+                fails.append('module %s %s: 0x%x > budget %s' % (name, what, used, limit))
+
+    if cfg.has_section('symbol'):
+        sizes = {s[1]: s[0] for s in symbols}
+        for name, limit in cfg.items('symbol'):
+            if name not in sizes:
+                if name in optional:
+                    notes.append('symbol %s: not in map, optional' % name)
+                else:
+                    fails.append('symbol %s: not in map (misspelt, or map older than the code)' % name)
+                continue
+            if sizes[name] > parse_limit(limit):
+                fails.append('symbol %s: 0x%x > budget %s' % (name, sizes[name], limit))
+    return fails, notes
+
+
+def report(img, usage, symbols, top):
+    print('memory areas (words)')
+    print('  %-12s %4s %8s %8s %8s %6s' % ('name', 'page', 'length', 'used', 'free', 'used%'))
+    for a in img.areas:
+        if not (a.is_ram() or a.is_flash()):
+            continue
+        print('  %-12s %4d %8x %8x %8x %5.1f%%' % (a.name, a.page, a.length, a.used,
+                                                   a.length - a.used, 100.0 * a.used / a.length))
+
+    print()
+    print('modules (words)')
+    print('  %-34s %8s %8s %8s' % ('module', 'code', 'const', 'ram'))
+    total = [0, 0, 0]
+    for name, u in sorted(usage.items(), key=lambda kv: -(kv[1][0] + kv[1][1] + kv[1][2])):
+        if u == [0, 0, 0]:
+            continue
+        print('  %-34s %8d %8d %8d' % (name, u[0], u[1], u[2]))
+        total = [t + v for t, v in zip(total, u)]
+    print('  %-34s %8d %8d %8d' % ('total', total[0], total[1], total[2]))
+
+    print()
+    print('largest symbols in RAM (words)')
+    print('  %-34s %8s  %-24s %s' % ('symbol', 'size', 'module', 'area'))
+    for size, name, module, area in symbols[:top]:
+        print('  %-34s %8d  %-24s %s' % (name, size, module, area))
+
+
+def main():
+    ap = argparse.ArgumentParser(description='memory budget report of the TI linker output')
+    ap.add_argument('map', help='linker map file')
+    ap.add_argument('--xml', help='linkInfo XML (default: <map>_linkInfo.xml)')
+    ap.add_argument('--out', help='linker output with debug info (default: <map>.out)')
+    ap.add_argument('--budget', help='budget file (default: mapbudget.ini next to this tool)')
+    ap.add_argument('--top', type=int, default=20, help='no of symbols in the report')
+    args = ap.parse_args()
+
+    xml = args.xml
+    if xml is None:
+        guess = os.path.splitext(args.map)[0] + '_linkInfo.xml'
+        if os.path.exists(guess):
+            xml = guess
+    out = args.out
+    if out is None:
+        guess = os.path.splitext(args.map)[0] + '.out'
+        if os.path.exists(guess):
+            out = guess
+    budget = args.budget or os.path.join(os.path.dirname(os.path.abspath(__file__)), 'mapbudget.ini')
+
+    try:
+        img = read_xml(xml) if xml else read_map(args.map)
+        if not img.symbols or not img.areas:
+            # the xml may lack parts, complete them from the map
+            m = read_map(args.map)
+            img.symbols = img.symbols or m.symbols
+            img.areas = img.areas or m.areas
+    except (OSError, ET.ParseError) as e:
+        print('mapbudget: %s' % e, file=sys.stderr)
+        return 2
+    debug_sizes = {}
+    if out:
+        try:
+            debug_sizes = read_dwarf(out)
+        except (OSError, ValueError, KeyError, IndexError, struct.error) as e:
+            print('mapbudget: %s: no debug info used (%s)' % (out, e), file=sys.stderr)
+
+    usage = module_usage(img)
+    symbols = symbol_sizes(img, debug_sizes)
+    report(img, usage, symbols, args.top)
+
+    fails, notes = check_budget(budget, img, usage, symbols)
+    print()
+    for n in notes:
+        print('note: ' + n)
+    if fails:
+        for f in fails:
+            print('BUDGET FAILED: ' + f)
+        return 1
+    print('all budgets met (%s)' % budget)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
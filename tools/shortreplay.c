@@ -0,0 +1,253 @@
+//----------------------------------------------------------------
+//
+// OpenDCC
+//
+// This source file is subject of the GNU general public license 2,
+// that is available at the world-wide-web at
+// http://www.gnu.org/licenses/gpl.txt
+//
+//-----------------------------------------------------------------
+//
+// file:      shortreplay.c
+// history:   replay of main track shorts started
+//
+//-----------------------------------------------------------------
+//
+// purpose:   host tool for the TAPAS build
+// content:   runs the short handling of the main track (code/main_short.c,
+//            same source as in run_state) against fault windows of the
+//            short input and prints every change of track and state.
+//
+//            The dcc isr samples the input once per bit and cuts the
+//            track (main_trip_sample, MAIN_SHORT_TRIP); main_short_check
+//            runs every 1ms. A reported short switches the track off
+//            (RUN_SHORT) until the pc switches it on again, 50ms after
+//            the fault is gone.
+//
+// build:     gcc -Wall -Wno-unknown-pragmas -I code -o shortreplay
+//                tools/shortreplay.c code/main_short.c
+//
+// usage:     shortreplay [options]
+//              -t N   simulated time in ms                (default 500)
+//              -i N   short ignore time in ms             (default 8, CV34)
+//              -b N   bit time in us, 116..232            (default 116)
+//              -f FROM,UNTIL  fault window in ms          (up to 8 times)
+//              -p     polled, no cut by the isr           (MAIN_SHORT_TRIP 0)
+//              -q     summary only
+//
+//            Without -f: a blip of 0.5ms at 100.2ms (cut by the isr
+//            between two checks), a glitch of 3ms at 200ms (both within
+//            the ignore time) and a short of 100ms at 300ms.
+//            e.g. shortreplay -q -f 100,100.3 -f 150,170
+//
+//            Exit code 0: after every fault shorter than the ignore time
+//            the track is on again, every fault longer than ignore time
+//            and fast recovery is reported, the track is never off
+//            without a report; 1: a check failed, 2: bad usage.
+//
+//-----------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "main_short.h"
+
+#define MAX_FAULTS      8
+#define PC_ON_US        50000L          // pc switches on after a reported short
+#define RECOVER_US      ((3 * (4 + 1 + 2) + 4) * 1000L)    // fast recovery, poll steps included
+
+static const char *state_name[] = {"no short", "ignore", "recover off", "recover on", "short"};
+
+static long fault_from[MAX_FAULTS], fault_until[MAX_FAULTS];   // us
+static int faults;
+static long now_us;
+static int track, trip, quiet;
+static unsigned long trips;
+
+static int fault_at(long t)
+  {
+    int k;
+
+    for (k=0; k<faults; k++)
+      {
+        if ((t >= fault_from[k]) && (t < fault_until[k])) return(1);
+      }
+    return(0);
+  }
+
+static void show_track(int on)
+  {
+    if (on != track && !quiet) printf("%10.3f track %s\n", now_us / 1e3, on ? "on" : "off");
+    track = on;
+  }
+
+// hooks of main_short.c
+void main_hw_on(void)
+  {
+    show_track(1);
+  }
+
+void main_hw_off(void)
+  {
+    show_track(0);
+  }
+
+unsigned char main_hw_tripped(void)
+  {
+    if (trip)
+      {
+        trip = 0;
+        return(1);
+      }
+    return(0);
+  }
+
+unsigned char main_hw_fault(void)
+  {
+    return(fault_at(now_us));
+  }
+
+static void usage(void)
+  {
+    fprintf(stderr, "usage: shortreplay [-t ms] [-i ignore_ms] [-b bit_us] "
+                    "[-f from,until] [-p] [-q]\n");
+    exit(2);
+  }
+
+int main(int argc, char *argv[])
+  {
+    long total_ms = 500, bit_us = 116, end_us, next_bit, next_poll;
+    long stopped_at = 0, check_at[MAX_FAULTS];
+    int ignore_ms = 8, polled = 0, stopped = 0, failed = 0;
+    unsigned long reports = 0;
+    unsigned int report_of[MAX_FAULTS];
+    shortState_t last_state;
+    double from, until;
+    int i, k;
+
+    for (i=1; i<argc; i++)
+      {
+        if (!strcmp(argv[i], "-q")) quiet = 1;
+        else if (!strcmp(argv[i], "-p")) polled = 1;
+        else if (i+1 >= argc) usage();
+        else if (!strcmp(argv[i], "-t")) total_ms = atol(argv[++i]);
+        else if (!strcmp(argv[i], "-i")) ignore_ms = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-b")) bit_us = atol(argv[++i]);
+        else if (!strcmp(argv[i], "-f"))
+          {
+            if ((faults >= MAX_FAULTS) || (sscanf(argv[++i], "%lf,%lf", &from, &until) != 2)
+                || (until <= from) || (from < 0)) usage();
+            fault_from[faults] = (long)(from * 1000);
+            fault_until[faults] = (long)(until * 1000);
+            faults++;
+          }
+        else usage();
+      }
+    if ((total_ms < 1) || (ignore_ms < 0) || (ignore_ms > 255) || (bit_us < 116) || (bit_us > 232)) usage();
+    if (!faults)
+      {
+        fault_from[0] = 100200; fault_until[0] = 100700;
+        fault_from[1] = 200000; fault_until[1] = 203000;
+        fault_from[2] = 300000; fault_until[2] = 400000;
+        faults = 3;
+      }
+    for (k=0; k<faults; k++)
+      {
+        // a fault within the ignore time: track on again after the ignore time
+        check_at[k] = fault_from[k] + (ignore_ms + 2) * 1000L;
+        if (check_at[k] < fault_until[k] + 2000) check_at[k] = fault_until[k] + 2000;
+        report_of[k] = 0;
+      }
+
+    main_short_init(!polled);
+    main_short_time((unsigned char)ignore_ms);
+    track = 1;
+    trip = 0;
+    last_state = mainShortState;
+    end_us = total_ms * 1000;
+    next_bit = 0;
+    next_poll = 1000;
+    for (now_us=0; now_us<=end_us; now_us++)
+      {
+        if (now_us == next_bit)
+          {
+            // main_trip_sample in the dcc isr
+            if (!polled && track && fault_at(now_us))
+              {
+                show_track(0);
+                trip = 1;
+                trips++;
+              }
+            next_bit += bit_us;
+          }
+        if (now_us == next_poll)
+          {
+            next_poll += 1000;
+            if (stopped)
+              {
+                // RUN_SHORT: main_short_check is not called
+                if (!fault_at(now_us) && (now_us - stopped_at > PC_ON_US))
+                  {
+                    if (!quiet) printf("%10.3f pc: power on\n", now_us / 1e3);
+                    stopped = 0;
+                    show_track(1);
+                  }
+              }
+            else if (main_short_check((uint32_t)(now_us / 1000)))
+              {
+                if (!quiet) printf("%10.3f short reported\n", now_us / 1e3);
+                reports++;
+                for (k=0; k<faults; k++)
+                  {
+                    if ((now_us >= fault_from[k]) && (now_us <= fault_until[k] + 2000)) report_of[k]++;
+                  }
+                stopped = 1;
+                stopped_at = now_us;
+                show_track(0);
+              }
+            if (mainShortState != last_state && !quiet)
+              {
+                printf("%10.3f state %s\n", now_us / 1e3, state_name[mainShortState]);
+              }
+            last_state = mainShortState;
+          }
+        for (k=0; k<faults; k++)
+          {
+            if ((now_us != check_at[k]) || (fault_until[k] - fault_from[k] >= ignore_ms * 1000L)) continue;
+            if (!track && !stopped && !fault_at(now_us))
+              {
+                printf("fault %d (%.3f..%.3f): within the ignore time, track still off at %.3f\n",
+                       k, fault_from[k] / 1e3, fault_until[k] / 1e3, now_us / 1e3);
+                failed = 1;
+              }
+          }
+      }
+    now_us = end_us;
+
+    printf("%lu isr cuts, %lu shorts reported, track %s, state %s%s\n", trips, reports,
+           track ? "on" : "off", state_name[mainShortState], stopped ? " (RUN_SHORT)" : "");
+    for (k=0; k<faults; k++)
+      {
+        if (fault_until[k] > end_us) continue;
+        if ((fault_until[k] - fault_from[k] > ignore_ms * 1000L + RECOVER_US) && !report_of[k])
+          {
+            printf("fault %d (%.3f..%.3f): lasting short not reported\n",
+                   k, fault_from[k] / 1e3, fault_until[k] / 1e3);
+            failed = 1;
+          }
+        if ((fault_until[k] - fault_from[k] < ignore_ms * 1000L) && report_of[k])
+          {
+            printf("fault %d (%.3f..%.3f): reported, but within the ignore time\n",
+                   k, fault_from[k] / 1e3, fault_until[k] / 1e3);
+            failed = 1;
+          }
+      }
+    if (!track && !stopped && !fault_at(end_us))
+      {
+        printf("track off without a reported short\n");
+        failed = 1;
+      }
+    return(failed);
+  }